@@ -0,0 +1,383 @@
+/**
+ * Bilevel Codecs - server-side encoders for 1-bit device frames
+ *
+ * Each encoder takes a packed 1-bit frame (MSB first, 1 = white) and returns
+ * the compressed payload. The matching streaming decoders live in the
+ * firmware library lib/BilevelCodec under the same names; the device lists
+ * the ones it has in its capability descriptor ("codecs").
+ *
+ * Codecs work on byte-aligned rows, so frames whose width is not a multiple
+ * of 8 are repacked with padded rows first.
+ */
+
+// Must match LZ4_WINDOW_BYTES / HEATSHRINK_* in lib/BilevelCodec/src/BilevelCodec.h
+const LZ4_WINDOW_BYTES = 2048;
+const HEATSHRINK_WINDOW_BITS = 8;
+const HEATSHRINK_LOOKAHEAD_BITS = 4;
+
+/**
+ * MSB-first bit writer
+ */
+class BitWriter {
+  constructor() {
+    this.bytes = [];
+    this.acc = 0;
+    this.bits = 0;
+  }
+
+  write(value, count) {
+    for (let i = count - 1; i >= 0; i--) {
+      this.acc = (this.acc << 1) | ((value >> i) & 1);
+      if (++this.bits === 8) {
+        this.bytes.push(this.acc);
+        this.acc = 0;
+        this.bits = 0;
+      }
+    }
+  }
+
+  toBuffer() {
+    const out = this.bytes.slice();
+    if (this.bits > 0) out.push(this.acc << (8 - this.bits));
+    return Buffer.from(out);
+  }
+}
+
+/**
+ * Repack a continuous 1-bit bitmap into byte-aligned rows (padding is white)
+ */
+function toRowAligned(bitmap, width, height) {
+  if (width % 8 === 0) return bitmap;
+
+  const rowBytes = Math.ceil(width / 8);
+  const out = Buffer.alloc(rowBytes * height, 0xFF);
+  for (let y = 0; y < height; y++) {
+    for (let x = 0; x < width; x++) {
+      const i = y * width + x;
+      if (!((bitmap[i >> 3] >> (7 - (i & 7))) & 1)) {
+        out[y * rowBytes + (x >> 3)] &= ~(0x80 >> (x & 7));
+      }
+    }
+  }
+  return out;
+}
+
+// ==================== RLE (PackBits) ====================
+
+function encodeRle(data) {
+  const out = [];
+  let i = 0;
+
+  while (i < data.length) {
+    // Repeat run
+    let run = 1;
+    while (i + run < data.length && run < 128 && data[i + run] === data[i]) run++;
+
+    if (run >= 2) {
+      out.push(257 - run, data[i]);
+      i += run;
+      continue;
+    }
+
+    // Literal run: up to the next repeat of 2+ bytes
+    const start = i;
+    while (i < data.length && i - start < 128) {
+      if (i + 1 < data.length && data[i + 1] === data[i]) break;
+      i++;
+    }
+    if (i === start) i++;  // lone byte before a repeat at the end of a literal window
+    out.push(i - start - 1);
+    for (let j = start; j < i; j++) out.push(data[j]);
+  }
+
+  return Buffer.from(out);
+}
+
+// ==================== LZ4 (block format) ====================
+
+function lz4WriteLength(out, length) {
+  while (length >= 255) {
+    out.push(255);
+    length -= 255;
+  }
+  out.push(length);
+}
+
+function lz4Sequence(out, data, literalStart, literalEnd, offset, matchLength) {
+  const literals = literalEnd - literalStart;
+  const matchCode = matchLength - 4;
+  let token = (Math.min(literals, 15) << 4);
+  if (offset) token |= Math.min(matchCode, 15);
+  out.push(token);
+  if (literals >= 15) lz4WriteLength(out, literals - 15);
+  for (let i = literalStart; i < literalEnd; i++) out.push(data[i]);
+  if (!offset) return;
+  out.push(offset & 0xFF, offset >> 8);
+  if (matchCode >= 15) lz4WriteLength(out, matchCode - 15);
+}
+
+function encodeLz4(data, window = LZ4_WINDOW_BYTES) {
+  const MIN_MATCH = 4;
+  const LAST_LITERALS = 5;   // LZ4 block rules: last 5 bytes are literals,
+  const MF_LIMIT = 12;       // and the last match starts 12+ bytes before the end
+  const HASH_BITS = 12;
+  const table = new Int32Array(1 << HASH_BITS).fill(-1);
+  const out = [];
+
+  const hashAt = (i) => {
+    const v = (data[i] | (data[i + 1] << 8) | (data[i + 2] << 16) | (data[i + 3] << 24)) >>> 0;
+    return (Math.imul(v, 2654435761) >>> (32 - HASH_BITS));
+  };
+
+  let anchor = 0;
+  let i = 0;
+  const matchLimit = data.length - MF_LIMIT;
+
+  while (i < matchLimit) {
+    const h = hashAt(i);
+    const candidate = table[h];
+    table[h] = i;
+
+    if (candidate >= 0 && i - candidate <= window &&
+        data[candidate] === data[i] && data[candidate + 1] === data[i + 1] &&
+        data[candidate + 2] === data[i + 2] && data[candidate + 3] === data[i + 3]) {
+      let length = MIN_MATCH;
+      while (i + length < data.length - LAST_LITERALS && data[candidate + length] === data[i + length]) length++;
+
+      lz4Sequence(out, data, anchor, i, i - candidate, length);
+
+      // Index the positions inside the match for later sequences
+      for (let j = i + 1; j < i + length && j < matchLimit; j++) table[hashAt(j)] = j;
+      i += length;
+      anchor = i;
+    } else {
+      i++;
+    }
+  }
+
+  lz4Sequence(out, data, anchor, data.length, 0, 0);
+  return Buffer.from(out);
+}
+
+// ==================== heatshrink (LZSS) ====================
+
+function encodeHeatshrink(data, windowBits = HEATSHRINK_WINDOW_BITS, lookaheadBits = HEATSHRINK_LOOKAHEAD_BITS) {
+  const windowSize = 1 << windowBits;
+  const maxLength = 1 << lookaheadBits;
+  // A back-reference costs 1 + windowBits + lookaheadBits bits, a literal 9
+  const minLength = Math.floor((1 + windowBits + lookaheadBits) / 9) + 1;
+  const out = new BitWriter();
+
+  let i = 0;
+  while (i < data.length) {
+    let bestLength = 0;
+    let bestOffset = 0;
+
+    for (let offset = 1; offset <= windowSize && offset <= i; offset++) {
+      let length = 0;
+      while (length < maxLength && i + length < data.length && data[i + length - offset] === data[i + length]) length++;
+      if (length > bestLength) {
+        bestLength = length;
+        bestOffset = offset;
+        if (length === maxLength) break;
+      }
+    }
+
+    if (bestLength >= minLength) {
+      out.write(0, 1);
+      out.write(bestOffset - 1, windowBits);
+      out.write(bestLength - 1, lookaheadBits);
+      i += bestLength;
+    } else {
+      out.write(1, 1);
+      out.write(data[i], 8);
+      i++;
+    }
+  }
+
+  return out.toBuffer();
+}
+
+// ==================== CCITT G4 (T.6) ====================
+
+// Modified Huffman codes, run length -> [code, bit length]
+const WHITE_CODES = {
+  0: [0x35, 8], 1: [0x7, 6], 2: [0x7, 4], 3: [0x8, 4], 4: [0xB, 4], 5: [0xC, 4],
+  6: [0xE, 4], 7: [0xF, 4], 8: [0x13, 5], 9: [0x14, 5], 10: [0x7, 5], 11: [0x8, 5],
+  12: [0x8, 6], 13: [0x3, 6], 14: [0x34, 6], 15: [0x35, 6], 16: [0x2A, 6], 17: [0x2B, 6],
+  18: [0x27, 7], 19: [0xC, 7], 20: [0x8, 7], 21: [0x17, 7], 22: [0x3, 7], 23: [0x4, 7],
+  24: [0x28, 7], 25: [0x2B, 7], 26: [0x13, 7], 27: [0x24, 7], 28: [0x18, 7], 29: [0x2, 8],
+  30: [0x3, 8], 31: [0x1A, 8], 32: [0x1B, 8], 33: [0x12, 8], 34: [0x13, 8], 35: [0x14, 8],
+  36: [0x15, 8], 37: [0x16, 8], 38: [0x17, 8], 39: [0x28, 8], 40: [0x29, 8], 41: [0x2A, 8],
+  42: [0x2B, 8], 43: [0x2C, 8], 44: [0x2D, 8], 45: [0x4, 8], 46: [0x5, 8], 47: [0xA, 8],
+  48: [0xB, 8], 49: [0x52, 8], 50: [0x53, 8], 51: [0x54, 8], 52: [0x55, 8], 53: [0x24, 8],
+  54: [0x25, 8], 55: [0x58, 8], 56: [0x59, 8], 57: [0x5A, 8], 58: [0x5B, 8], 59: [0x4A, 8],
+  60: [0x4B, 8], 61: [0x32, 8], 62: [0x33, 8], 63: [0x34, 8], 64: [0x1B, 5], 128: [0x12, 5],
+  192: [0x17, 6], 256: [0x37, 7], 320: [0x36, 8], 384: [0x37, 8], 448: [0x64, 8], 512: [0x65, 8],
+  576: [0x68, 8], 640: [0x67, 8], 704: [0xCC, 9], 768: [0xCD, 9], 832: [0xD2, 9], 896: [0xD3, 9],
+  960: [0xD4, 9], 1024: [0xD5, 9], 1088: [0xD6, 9], 1152: [0xD7, 9], 1216: [0xD8, 9], 1280: [0xD9, 9],
+  1344: [0xDA, 9], 1408: [0xDB, 9], 1472: [0x98, 9], 1536: [0x99, 9], 1600: [0x9A, 9], 1664: [0x18, 6],
+  1728: [0x9B, 9], 1792: [0x8, 11], 1856: [0xC, 11], 1920: [0xD, 11], 1984: [0x12, 12], 2048: [0x13, 12],
+  2112: [0x14, 12], 2176: [0x15, 12], 2240: [0x16, 12], 2304: [0x17, 12], 2368: [0x1C, 12], 2432: [0x1D, 12],
+  2496: [0x1E, 12], 2560: [0x1F, 12],
+};
+const BLACK_CODES = {
+  0: [0x37, 10], 1: [0x2, 3], 2: [0x3, 2], 3: [0x2, 2], 4: [0x3, 3], 5: [0x3, 4],
+  6: [0x2, 4], 7: [0x3, 5], 8: [0x5, 6], 9: [0x4, 6], 10: [0x4, 7], 11: [0x5, 7],
+  12: [0x7, 7], 13: [0x4, 8], 14: [0x7, 8], 15: [0x18, 9], 16: [0x17, 10], 17: [0x18, 10],
+  18: [0x8, 10], 19: [0x67, 11], 20: [0x68, 11], 21: [0x6C, 11], 22: [0x37, 11], 23: [0x28, 11],
+  24: [0x17, 11], 25: [0x18, 11], 26: [0xCA, 12], 27: [0xCB, 12], 28: [0xCC, 12], 29: [0xCD, 12],
+  30: [0x68, 12], 31: [0x69, 12], 32: [0x6A, 12], 33: [0x6B, 12], 34: [0xD2, 12], 35: [0xD3, 12],
+  36: [0xD4, 12], 37: [0xD5, 12], 38: [0xD6, 12], 39: [0xD7, 12], 40: [0x6C, 12], 41: [0x6D, 12],
+  42: [0xDA, 12], 43: [0xDB, 12], 44: [0x54, 12], 45: [0x55, 12], 46: [0x56, 12], 47: [0x57, 12],
+  48: [0x64, 12], 49: [0x65, 12], 50: [0x52, 12], 51: [0x53, 12], 52: [0x24, 12], 53: [0x37, 12],
+  54: [0x38, 12], 55: [0x27, 12], 56: [0x28, 12], 57: [0x58, 12], 58: [0x59, 12], 59: [0x2B, 12],
+  60: [0x2C, 12], 61: [0x5A, 12], 62: [0x66, 12], 63: [0x67, 12], 64: [0xF, 10], 128: [0xC8, 12],
+  192: [0xC9, 12], 256: [0x5B, 12], 320: [0x33, 12], 384: [0x34, 12], 448: [0x35, 12], 512: [0x6C, 13],
+  576: [0x6D, 13], 640: [0x4A, 13], 704: [0x4B, 13], 768: [0x4C, 13], 832: [0x4D, 13], 896: [0x72, 13],
+  960: [0x73, 13], 1024: [0x74, 13], 1088: [0x75, 13], 1152: [0x76, 13], 1216: [0x77, 13], 1280: [0x52, 13],
+  1344: [0x53, 13], 1408: [0x54, 13], 1472: [0x55, 13], 1536: [0x5A, 13], 1600: [0x5B, 13], 1664: [0x64, 13],
+  1728: [0x65, 13], 1792: [0x8, 11], 1856: [0xC, 11], 1920: [0xD, 11], 1984: [0x12, 12], 2048: [0x13, 12],
+  2112: [0x14, 12], 2176: [0x15, 12], 2240: [0x16, 12], 2304: [0x17, 12], 2368: [0x1C, 12], 2432: [0x1D, 12],
+  2496: [0x1E, 12], 2560: [0x1F, 12],
+};
+
+// Changing elements of a row: positions where the colour differs from the
+// pixel to the left (an imaginary white pixel precedes the row)
+function rowChanges(data, rowStart, width) {
+  const changes = [];
+  let previous = 1;  // white
+  for (let x = 0; x < width; x++) {
+    const pixel = (data[rowStart + (x >> 3)] >> (7 - (x & 7))) & 1;
+    if (pixel !== previous) {
+      changes.push(x);
+      previous = pixel;
+    }
+  }
+  return changes;
+}
+
+function g4WriteRun(out, run, black) {
+  const codes = black ? BLACK_CODES : WHITE_CODES;
+  while (run >= 2560) {
+    out.write(codes[2560][0], codes[2560][1]);
+    run -= 2560;
+  }
+  if (run >= 64) {
+    const makeup = run - (run % 64);
+    out.write(codes[makeup][0], codes[makeup][1]);
+    run -= makeup;
+  }
+  out.write(codes[run][0], codes[run][1]);
+}
+
+const G4_VERTICAL = {
+  '-3': [0x02, 7], '-2': [0x02, 6], '-1': [0x02, 3],
+  '0': [0x01, 1],
+  '1': [0x03, 3], '2': [0x03, 6], '3': [0x03, 7]
+};
+
+function encodeG4(data, width, height) {
+  const rowBytes = Math.ceil(width / 8);
+  const out = new BitWriter();
+  let ref = [];
+
+  // Next change strictly right of position, or width
+  const nextChange = (changes, position) => {
+    for (let i = 0; i < changes.length; i++) {
+      if (changes[i] > position) return i;
+    }
+    return changes.length;
+  };
+  const at = (changes, i) => (i < changes.length ? changes[i] : width);
+
+  for (let y = 0; y < height; y++) {
+    const cur = rowChanges(data, y * rowBytes, width);
+    let a0 = -1;
+    let color = 0;  // 0 = white, 1 = black
+
+    while (a0 < width) {
+      const ia1 = nextChange(cur, a0);
+      const a1 = at(cur, ia1);
+      const a2 = at(cur, ia1 + 1);
+
+      // b1: first reference change right of a0 with the opposite colour
+      // (even entries change to black)
+      let ib1 = nextChange(ref, a0);
+      if ((ib1 & 1) !== color) ib1++;
+      const b1 = at(ref, ib1);
+      const b2 = at(ref, ib1 + 1);
+
+      if (b2 < a1) {
+        out.write(0x1, 4);  // pass
+        a0 = b2;
+      } else if (Math.abs(a1 - b1) <= 3) {
+        const [code, length] = G4_VERTICAL[String(a1 - b1)];
+        out.write(code, length);
+        a0 = a1;
+        color ^= 1;
+      } else {
+        out.write(0x1, 3);  // horizontal
+        g4WriteRun(out, a1 - Math.max(a0, 0), color);
+        g4WriteRun(out, a2 - a1, color ^ 1);
+        a0 = a2;
+      }
+    }
+
+    ref = cur;
+  }
+
+  // EOFB
+  out.write(0x001, 12);
+  out.write(0x001, 12);
+  return out.toBuffer();
+}
+
+// ==================== REGISTRY ====================
+
+const ENCODERS = {
+  rle: (data) => encodeRle(data),
+  g4: (data, width, height) => encodeG4(data, width, height),
+  lz4: (data) => encodeLz4(data),
+  heatshrink: (data) => encodeHeatshrink(data)
+};
+
+/**
+ * Encode a packed 1-bit frame with the named codec
+ */
+function encodeFrame(codec, bitmap, width, height) {
+  const encoder = ENCODERS[codec];
+  if (!encoder) throw new Error(`Unknown codec: ${codec}`);
+  return encoder(toRowAligned(bitmap, width, height), width, height);
+}
+
+/**
+ * Encode a frame with each of the given codecs and keep the smallest result.
+ * Returns { codec, data }, or null when no codec beats the raw frame (G4 in
+ * particular expands heavily dithered photos).
+ */
+function encodeBest(bitmap, width, height, codecNames) {
+  const aligned = toRowAligned(bitmap, width, height);
+  let best = null;
+
+  for (const codec of codecNames) {
+    if (!ENCODERS[codec]) continue;
+    const data = ENCODERS[codec](aligned, width, height);
+    if (data.length < aligned.length && (!best || data.length < best.data.length)) {
+      best = { codec, data };
+    }
+  }
+
+  return best;
+}
+
+module.exports = {
+  CODECS: Object.keys(ENCODERS),
+  encodeFrame,
+  encodeBest,
+  toRowAligned,
+  encodeRle,
+  encodeLz4,
+  encodeHeatshrink,
+  encodeG4
+};
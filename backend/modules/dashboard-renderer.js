@@ -510,82 +510,217 @@ class PixelBuffer {
   }
 }
 
-function createDashboard(data) {
+// ==================== LAYOUT TEMPLATE ====================
+// The dashboard is a fixed template: static base elements plus widgets
+// bound to data values. The server renders template + bindings into a
+// raster, and devices that cache the template (see /api/device/:id/layout)
+// render the same thing locally from the bindings alone, redrawing only
+// the widgets whose values changed.
+//
+// Glyphs and icons are column-major bitmaps, ceil(h/8) little-endian bytes
+// per column with the top row in bit 0 (the FONT_5X7 layout), as hex.
+
+const ROW_HEIGHT = 11;
+const EVENT_ROWS = 3;
+const TODO_ROWS = 4;
+const EVENTS_Y = 58;
+const TODOS_Y = EVENTS_Y + 16 + EVENT_ROWS * ROW_HEIGHT + 6;
+
+// Encode the black pixels of a PixelBuffer as a column-major glyph
+function bufferToGlyph(buf) {
+  const bytesPerColumn = Math.ceil(buf.height / 8);
+  const out = Buffer.alloc(buf.width * bytesPerColumn);
+  for (let x = 0; x < buf.width; x++) {
+    for (let y = 0; y < buf.height; y++) {
+      if (buf.getPixel(x, y) < 128) {
+        out[x * bytesPerColumn + (y >> 3)] |= 1 << (y & 7);
+      }
+    }
+  }
+  return out.toString('hex');
+}
+
+function buildFonts() {
+  const small = {};
+  for (const [char, columns] of Object.entries(FONT_5X7)) {
+    small[char] = Buffer.from(columns).toString('hex');
+  }
+
+  const digits = {};
+  for (const digit of Object.keys(LARGE_NUMS)) {
+    const buf = new PixelBuffer(10, 14);
+    buf.drawLargeNumber(0, 0, digit, true);
+    digits[digit] = bufferToGlyph(buf);
+  }
+
+  return {
+    s: { w: 5, h: 7, a: 6, g: small },
+    d: { w: 10, h: 14, a: 12, g: digits }
+  };
+}
+
+function buildIcons() {
+  const icons = {};
+  // The checkmark overhangs the 8px box on the right
+  for (const [name, checked] of [['box', false], ['check', true]]) {
+    const buf = new PixelBuffer(11, 8);
+    buf.drawCheckbox(0, 0, 8, checked);
+    icons[name] = { w: 11, h: 8, d: bufferToGlyph(buf) };
+  }
+  return icons;
+}
+
+const layoutCache = new Map();
+
+// Template for a language (static strings are part of the layout).
+// c = ink (1 = black), bg = widget background (1 = black), s = text scale.
+function dashboardLayout(lang = 'pl') {
+  const language = DAY_NAMES[lang] ? lang : 'en';
+  if (layoutCache.has(language)) return layoutCache.get(language);
+
+  const strings = UI_STRINGS[language];
+  const base = [
+    { t: 'fill', x: 0, y: 0, w: WIDTH, h: 52, c: 1 },
+    { t: 'text', x: 8, y: EVENTS_Y, f: 's', s: 1, c: 1, v: strings.events },
+    { t: 'fill', x: 8, y: EVENTS_Y + 10, w: 184, h: 1, c: 1 },
+    { t: 'text', x: 8, y: TODOS_Y, f: 's', s: 1, c: 1, v: strings.todos },
+    { t: 'fill', x: 8, y: TODOS_Y + 10, w: 184, h: 1, c: 1 },
+    { t: 'fill', x: 0, y: 197, w: WIDTH, h: 1, c: 1 },
+    { t: 'fill', x: 0, y: 199, w: WIDTH, h: 1, c: 1 }
+  ];
+
+  const header = { t: 'text', f: 's', s: 1, c: 0, bg: 1 };
+  const row = { t: 'text', f: 's', s: 1, c: 1, bg: 0 };
+  const widgets = [
+    { ...header, id: 'day', f: 'd', x: 8, y: 6, w: 24, h: 14 },
+    { ...header, id: 'dow', x: 36, y: 8, w: 24, h: 7 },
+    { ...header, id: 'mon', x: 36, y: 20, w: 24, h: 7 },
+    { ...header, id: 'year', x: 36, y: 32, w: 24, h: 7 },
+    { ...header, id: 'temp', s: 2, x: 130, y: 10, w: 68, h: 14 },
+    { ...header, id: 'wx', x: 130, y: 34, w: 68, h: 7 }
+  ];
+
+  for (let i = 0; i < EVENT_ROWS; i++) {
+    widgets.push({ ...row, id: `ev${i}`, x: 8, y: EVENTS_Y + 16 + i * ROW_HEIGHT, w: 184, h: 7 });
+  }
+  for (let i = 0; i < TODO_ROWS; i++) {
+    const y = TODOS_Y + 16 + i * ROW_HEIGHT;
+    widgets.push({ id: `tb${i}`, t: 'icon', x: 8, y: y - 1, w: 11, h: 8, c: 1, bg: 0 });
+    widgets.push({ ...row, id: `td${i}`, x: 20, y, w: 172, h: 7 });
+  }
+
+  const layout = { w: WIDTH, h: HEIGHT, fonts: buildFonts(), icons: buildIcons(), base, widgets };
+  layoutCache.set(language, layout);
+  return layout;
+}
+
+// Widget values for the dashboard data ('' leaves a widget blank)
+function dashboardBindings(data) {
   const { weather, events, todos, date, lang = 'pl' } = data;
   const now = date || new Date();
   const language = DAY_NAMES[lang] ? lang : 'en';
-
-  const buf = new PixelBuffer(WIDTH, HEIGHT);
   const strings = UI_STRINGS[language];
-  const dayNames = DAY_NAMES[language];
-  const monthNames = MONTH_NAMES[language];
-
-  // === HEADER (black background) ===
-  buf.fillRect(0, 0, WIDTH, 52, true);
-
-  // Date - large number
-  const day = now.getDate();
-  buf.drawLargeDate(8, 6, day, false); // white on black
-
-  // Day name and month
-  buf.drawText(36, 8, dayNames[now.getDay()], 1, false);
-  buf.drawText(36, 20, monthNames[now.getMonth()], 1, false);
-  buf.drawText(36, 32, now.getFullYear().toString(), 1, false);
-
-  // Weather (if available)
-  if (weather && weather.temp !== undefined) {
-    const tempStr = `${weather.temp}°C`;
-    buf.drawText(130, 10, tempStr, 2, false);
-    if (weather.main) {
-      const weatherText = weather.main.substring(0, 10).toUpperCase();
-      buf.drawText(130, 34, weatherText, 1, false);
+
+  const bindings = {
+    day: now.getDate().toString().padStart(2, '0'),
+    dow: DAY_NAMES[language][now.getDay()],
+    mon: MONTH_NAMES[language][now.getMonth()],
+    year: now.getFullYear().toString(),
+    temp: weather && weather.temp !== undefined ? `${weather.temp}°C` : '--°C',
+    wx: weather && weather.temp !== undefined && weather.main ? weather.main.substring(0, 10).toUpperCase() : ''
+  };
+
+  const shownEvents = (events || []).slice(0, EVENT_ROWS);
+  for (let i = 0; i < EVENT_ROWS; i++) {
+    const event = shownEvents[i];
+    if (event) {
+      bindings[`ev${i}`] = `${formatEventTime(event.start)} ${truncateText(event.summary || 'Event', 22)}`;
+    } else {
+      bindings[`ev${i}`] = (i === 0 && shownEvents.length === 0) ? strings.noEvents : '';
     }
-  } else {
-    buf.drawText(140, 20, '--°C', 2, false);
-  }
-
-  // === EVENTS SECTION ===
-  let yPos = 58;
-  buf.drawText(8, yPos, strings.events, 1, true);
-  buf.drawHLine(8, yPos + 10, 184, true);
-  yPos += 16;
-
-  if (events && events.length > 0) {
-    events.slice(0, 3).forEach(event => {
-      const time = formatEventTime(event.start);
-      const title = truncateText(event.summary || 'Event', 22);
-      buf.drawText(8, yPos, `${time} ${title}`, 1, true);
-      yPos += 11;
-    });
-  } else {
-    buf.drawText(8, yPos, strings.noEvents, 1, true);
-    yPos += 11;
-  }
-
-  // === TODOS SECTION ===
-  yPos += 6;
-  buf.drawText(8, yPos, strings.todos, 1, true);
-  buf.drawHLine(8, yPos + 10, 184, true);
-  yPos += 16;
-
-  if (todos && todos.length > 0) {
-    todos.slice(0, 4).forEach(todo => {
-      buf.drawCheckbox(8, yPos - 1, 8, todo.completed);
-      const text = truncateText(todo.text || '', 24);
-      buf.drawText(20, yPos, text, 1, true);
-      yPos += 11;
-    });
-  } else {
-    buf.drawText(8, yPos, strings.noTasks, 1, true);
-  }
-
-  // Footer line
-  buf.drawHLine(0, 197, 200, true);
-  buf.drawHLine(0, 199, 200, true);
+  }
+
+  const shownTodos = (todos || []).slice(0, TODO_ROWS);
+  for (let i = 0; i < TODO_ROWS; i++) {
+    const todo = shownTodos[i];
+    bindings[`tb${i}`] = todo ? (todo.completed ? 'check' : 'box') : '';
+    if (todo) {
+      bindings[`td${i}`] = truncateText(todo.text || '', 24);
+    } else {
+      bindings[`td${i}`] = (i === 0 && shownTodos.length === 0) ? strings.noTasks : '';
+    }
+  }
+
+  // The "no tasks" line starts at the checkbox column
+  if (shownTodos.length === 0) {
+    bindings.tb0 = '';
+  }
+
+  return bindings;
+}
+
+function drawGlyph(buf, hex, x, y, w, h, scale, black) {
+  const glyph = Buffer.from(hex, 'hex');
+  const bytesPerColumn = Math.ceil(h / 8);
+  for (let col = 0; col < w; col++) {
+    for (let row = 0; row < h; row++) {
+      if (!((glyph[col * bytesPerColumn + (row >> 3)] >> (row & 7)) & 1)) continue;
+      buf.fillRect(x + col * scale, y + row * scale, scale, scale, black);
+    }
+  }
+}
+
+// Draw text in a template font; unknown characters get an outline box
+function drawTemplateText(buf, font, x, y, text, scale, black) {
+  let curX = x;
+  for (const char of text) {
+    const glyph = font.g[char];
+    if (glyph) {
+      drawGlyph(buf, glyph, curX, y, font.w, font.h, scale, black);
+    } else if (char !== ' ') {
+      const bw = (font.w - 2) * scale;
+      const bh = (font.h - 2) * scale;
+      buf.drawHLine(curX, y, bw + 1, black);
+      buf.drawHLine(curX, y + bh, bw + 1, black);
+      buf.drawVLine(curX, y, bh + 1, black);
+      buf.drawVLine(curX + bw, y, bh + 1, black);
+    }
+    curX += font.a * scale;
+  }
+}
+
+function drawTemplateElement(buf, layout, element, value) {
+  const black = element.c === 1;
+  if (element.t === 'fill') {
+    buf.fillRect(element.x, element.y, element.w, element.h, black);
+  } else if (element.t === 'text') {
+    drawTemplateText(buf, layout.fonts[element.f], element.x, element.y, value, element.s || 1, black);
+  } else if (element.t === 'icon') {
+    const icon = layout.icons[value];
+    if (icon) drawGlyph(buf, icon.d, element.x, element.y, icon.w, icon.h, 1, black);
+  }
+}
+
+// Render a template with its bindings (the device does the same per widget)
+function renderTemplate(layout, bindings) {
+  const buf = new PixelBuffer(layout.w, layout.h);
+
+  for (const element of layout.base) {
+    drawTemplateElement(buf, layout, element, element.v);
+  }
+
+  for (const widget of layout.widgets) {
+    if (widget.bg) buf.fillRect(widget.x, widget.y, widget.w, widget.h, true);
+    drawTemplateElement(buf, layout, widget, bindings[widget.id] || '');
+  }
 
   return buf;
 }
 
+function createDashboard(data) {
+  return renderTemplate(dashboardLayout(data.lang), dashboardBindings(data));
+}
+
 function formatEventTime(dateString) {
   if (!dateString) return '    ';
   if (dateString.length === 10) return 'CALY'; // All day in Polish
@@ -647,6 +782,12 @@ module.exports = {
   renderDashboard,
   renderDashboardBitmap,
   renderPlaceholderDashboard,
+  dashboardLayout,
+  dashboardBindings,
+  renderTemplate,
+  formatEventTime,
+  truncateText,
+  UI_STRINGS,
   PixelBuffer,
   WIDTH,
   HEIGHT
@@ -0,0 +1,46 @@
+/**
+ * Device Alerts - short urgent messages shown in a banner on the device
+ *
+ * One alert per device, kept in memory only: alerts are minutes long by
+ * nature. An alert past its expiry is dropped the next time it is looked
+ * up, so a device polling after the TTL gets no banner.
+ */
+
+const crypto = require('crypto');
+
+const ALERT_MAX_TEXT = 64;             // bytes of UTF-8, the device's buffer
+const ALERT_DEFAULT_TTL_SECONDS = 15 * 60;
+const ALERT_MAX_TTL_SECONDS = 24 * 3600;
+
+const deviceAlerts = new Map(); // deviceId -> { id, text, expiresAt }
+
+// Queue an alert, replacing the device's current one
+function setAlert(deviceId, text, ttlSeconds, now = Date.now()) {
+  // Nonzero 32-bit id; the device shows each id once
+  const alert = { id: crypto.randomInt(1, 0x7fffffff), text, expiresAt: now + ttlSeconds * 1000 };
+  deviceAlerts.set(deviceId, alert);
+  return alert;
+}
+
+function clearAlert(deviceId) {
+  deviceAlerts.delete(deviceId);
+}
+
+// The device's alert, or null when there is none or it has expired
+function activeAlert(deviceId, now = Date.now()) {
+  const alert = deviceAlerts.get(deviceId);
+  if (alert && alert.expiresAt <= now) {
+    deviceAlerts.delete(deviceId);
+    return null;
+  }
+  return alert || null;
+}
+
+module.exports = {
+  ALERT_MAX_TEXT,
+  ALERT_DEFAULT_TTL_SECONDS,
+  ALERT_MAX_TTL_SECONDS,
+  setAlert,
+  clearAlert,
+  activeAlert
+};
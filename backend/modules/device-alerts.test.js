@@ -0,0 +1,29 @@
+const { setAlert, clearAlert, activeAlert } = require('./device-alerts');
+
+describe('device alerts', () => {
+  test('an alert is served until it expires', () => {
+    const alert = setAlert('dev-1', 'Doorbell', 60, 1000);
+    expect(activeAlert('dev-1', 1000)).toBe(alert);
+    expect(activeAlert('dev-1', 60999)).toBe(alert);
+  });
+
+  test('polling after expiresAt drops the alert', () => {
+    const alert = setAlert('dev-2', 'Doorbell', 60, 1000);
+    expect(() => activeAlert('dev-2', alert.expiresAt)).not.toThrow();
+    expect(activeAlert('dev-2', alert.expiresAt)).toBeNull();
+    // Gone from the store, not just hidden: a later poll sees nothing either
+    expect(activeAlert('dev-2', 0)).toBeNull();
+  });
+
+  test('a new alert replaces the old one and can be cleared', () => {
+    setAlert('dev-3', 'First', 60, 0);
+    const second = setAlert('dev-3', 'Second', 60, 0);
+    expect(activeAlert('dev-3', 0)).toBe(second);
+    clearAlert('dev-3');
+    expect(activeAlert('dev-3', 0)).toBeNull();
+  });
+
+  test('alert ids are nonzero', () => {
+    expect(setAlert('dev-4', 'Id', 1, 0).id).toBeGreaterThan(0);
+  });
+});
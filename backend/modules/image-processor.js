@@ -343,6 +343,66 @@ function applyDithering(pixels, width, height, algorithm) {
   }
 }
 
+/**
+ * Quantize to 4 gray levels (0, 85, 170, 255), diffusing the error with
+ * Floyd-Steinberg unless dithering is 'none'
+ */
+function quantizeGray4(pixels, width, height, algorithm = 'floydSteinberg') {
+  const output = new Uint8Array(pixels.length);
+  const errors = new Float32Array(pixels.length);
+  const diffuse = algorithm !== 'none';
+
+  for (let i = 0; i < pixels.length; i++) {
+    errors[i] = pixels[i];
+  }
+
+  for (let y = 0; y < height; y++) {
+    for (let x = 0; x < width; x++) {
+      const idx = y * width + x;
+      const oldPixel = errors[idx];
+      const level = Math.max(0, Math.min(3, Math.round(oldPixel / 85)));
+      const newPixel = level * 85;
+      output[idx] = newPixel;
+      if (!diffuse) continue;
+
+      const error = oldPixel - newPixel;
+      if (x + 1 < width) {
+        errors[idx + 1] += error * 7 / 16;
+      }
+      if (y + 1 < height) {
+        if (x > 0) {
+          errors[idx + width - 1] += error * 3 / 16;
+        }
+        errors[idx + width] += error * 5 / 16;
+        if (x + 1 < width) {
+          errors[idx + width + 1] += error * 1 / 16;
+        }
+      }
+    }
+  }
+
+  return output;
+}
+
+/**
+ * Pack 4-level pixels into a 2-bit-per-pixel frame: the MSB plane followed
+ * by the LSB plane, packed like one 1-bit image twice as tall (1 = white,
+ * so white is 11 and black 00). The MSB plane alone is a usable 1-bit frame.
+ */
+function packGrayPlanes(pixels, width, height) {
+  const count = width * height;
+  const frame = Buffer.alloc(Math.ceil((count * 2) / 8));
+
+  for (let i = 0; i < count; i++) {
+    const level = Math.max(0, Math.min(3, Math.round(pixels[i] / 85)));
+    if (level & 2) frame[i >> 3] |= (1 << (7 - (i & 7)));
+    const j = count + i;
+    if (level & 1) frame[j >> 3] |= (1 << (7 - (j & 7)));
+  }
+
+  return frame;
+}
+
 /**
  * Process image with all adjustments
  */
@@ -367,7 +427,8 @@ async function processImage(inputBuffer, options = {}) {
     fit = 'cover',         // cover, contain, fill
     textOverlay = '',      // text to add
     textPosition = 'bottom', // top, bottom, center
-    textSize = 'medium'    // small, medium, large
+    textSize = 'medium',   // small, medium, large
+    grayLevels = 2         // 2 = 1-bit frame, 4 = 2-bit gray planes
   } = options;
 
   try {
@@ -451,7 +512,9 @@ async function processImage(inputBuffer, options = {}) {
       .toBuffer({ resolveWithObject: true });
 
     // Apply dithering first (before text, so text stays crisp)
-    let processedPixels = applyDithering(data, info.width, info.height, dithering);
+    let processedPixels = grayLevels === 4
+      ? quantizeGray4(data, info.width, info.height, dithering)
+      : applyDithering(data, info.width, info.height, dithering);
 
     // Add text overlay if specified (after dithering so text is clean)
     if (textOverlay && textOverlay.trim()) {
@@ -470,15 +533,20 @@ async function processImage(inputBuffer, options = {}) {
       raw: { width: info.width, height: info.height, channels: 1 }
     }).png().toBuffer();
 
-    // Convert to 1-bit bitmap for E-ink
-    const bitmapSize = Math.ceil((info.width * info.height) / 8);
-    const bitmap = Buffer.alloc(bitmapSize);
+    // Convert to 1-bit bitmap (or 2-bit gray planes) for E-ink
+    let bitmap;
+    if (grayLevels === 4) {
+      bitmap = packGrayPlanes(processedPixels, info.width, info.height);
+    } else {
+      const bitmapSize = Math.ceil((info.width * info.height) / 8);
+      bitmap = Buffer.alloc(bitmapSize);
 
-    for (let i = 0; i < processedPixels.length; i++) {
-      const byteIndex = Math.floor(i / 8);
-      const bitIndex = 7 - (i % 8);
-      if (processedPixels[i] > 127) {
-        bitmap[byteIndex] |= (1 << bitIndex);
+      for (let i = 0; i < processedPixels.length; i++) {
+        const byteIndex = Math.floor(i / 8);
+        const bitIndex = 7 - (i % 8);
+        if (processedPixels[i] > 127) {
+          bitmap[byteIndex] |= (1 << bitIndex);
+        }
       }
     }
 
@@ -486,7 +554,8 @@ async function processImage(inputBuffer, options = {}) {
       png: pngBuffer,
       bitmap: bitmap,
       width: info.width,
-      height: info.height
+      height: info.height,
+      planes: grayLevels === 4 ? 2 : 1
     };
   } catch (error) {
     console.error('Image processing error:', error);
@@ -510,6 +579,51 @@ async function generateBitmap(inputBuffer, options = {}) {
   return result.bitmap;
 }
 
+/**
+ * Downsample a packed 1-bit bitmap (1 = white, MSB first) by an integer factor.
+ * Each output pixel is black when most of its block is black; ties use a
+ * checkerboard so mid-tones in dithered photos stay mid-tones.
+ */
+function downsampleBitmap(bitmap, width, height, factor = 2) {
+  const outWidth = Math.floor(width / factor);
+  const outHeight = Math.floor(height / factor);
+  const out = Buffer.alloc(Math.ceil((outWidth * outHeight) / 8));
+  const half = (factor * factor) / 2;
+
+  for (let oy = 0; oy < outHeight; oy++) {
+    for (let ox = 0; ox < outWidth; ox++) {
+      let black = 0;
+      for (let dy = 0; dy < factor; dy++) {
+        for (let dx = 0; dx < factor; dx++) {
+          const i = (oy * factor + dy) * width + (ox * factor + dx);
+          if (!((bitmap[i >> 3] >> (7 - (i & 7))) & 1)) black++;
+        }
+      }
+
+      const isBlack = black > half || (black === half && ((ox + oy) & 1) === 0);
+      if (!isBlack) {
+        const o = oy * outWidth + ox;
+        out[o >> 3] |= (1 << (7 - (o & 7)));
+      }
+    }
+  }
+
+  return { bitmap: out, width: outWidth, height: outHeight };
+}
+
+/**
+ * 32-bit FNV-1a hash of a frame, matching frameHash() in the firmware
+ * (0 is reserved for "no frame", so it maps to 1)
+ */
+function frameHash(buffer) {
+  let hash = 0x811c9dc5;
+  for (let i = 0; i < buffer.length; i++) {
+    hash ^= buffer[i];
+    hash = Math.imul(hash, 0x01000193) >>> 0;
+  }
+  return hash || 1;
+}
+
 /**
  * Get available dithering algorithms
  */
@@ -532,6 +646,10 @@ module.exports = {
   getDitheringAlgorithms,
   DITHERING_ALGORITHMS,
   applyDithering,
+  quantizeGray4,
+  packGrayPlanes,
+  downsampleBitmap,
+  frameHash,
   floydSteinbergDither,
   atkinsonDither
 };
@@ -0,0 +1,93 @@
+/**
+ * Overlay Renderer - Small badges (clock, weather) drawn over photos
+ *
+ * Devices keep the photo as a base layer and composite overlay layers on
+ * top, so an overlay change only transfers the overlay. Each layer is an
+ * ink bitmap plus a mask (1 = the layer covers the pixel), both packed
+ * 1-bit MSB first like frames (1 = white ink). x and w are multiples of 8
+ * so devices can composite whole bytes.
+ */
+
+const { PixelBuffer, WIDTH } = require('./dashboard-renderer');
+
+const OVERLAY_TYPES = ['clock', 'weather'];
+
+// Layer ids are stable per overlay type so devices can tell layers apart
+const LAYER_IDS = { clock: 1, weather: 2 };
+
+const BADGE_SCALE = 2;
+const BADGE_PADDING = 4;
+const BADGE_MARGIN = 8;
+
+// What each enabled overlay shows right now (the text is also what the
+// overlay resource version is computed from)
+function overlayBadges(overlays, { weather, date } = {}) {
+  const now = date || new Date();
+  const badges = [];
+
+  for (const type of overlays || []) {
+    if (type === 'clock') {
+      const hours = now.getHours().toString().padStart(2, '0');
+      const minutes = now.getMinutes().toString().padStart(2, '0');
+      badges.push({ type, text: `${hours}:${minutes}`, corner: 'right' });
+    } else if (type === 'weather') {
+      const text = weather && weather.temp !== undefined ? `${weather.temp}°C` : '--°C';
+      badges.push({ type, text, corner: 'left' });
+    }
+  }
+
+  return badges;
+}
+
+// Render one badge: white text on a black box with a one pixel white
+// outline, so it reads on both light and dark photos
+function renderBadge(badge) {
+  const textWidth = badge.text.length * 6 * BADGE_SCALE - BADGE_SCALE;
+  const w = Math.ceil((textWidth + 2 * BADGE_PADDING + 2) / 8) * 8;
+  const h = 7 * BADGE_SCALE + 2 * BADGE_PADDING + 2;
+  const x = badge.corner === 'right' ? Math.floor((WIDTH - BADGE_MARGIN - w) / 8) * 8 : BADGE_MARGIN;
+  const y = BADGE_MARGIN;
+
+  const buf = new PixelBuffer(w, h);
+  buf.fillRect(1, 1, w - 2, h - 2, true);
+  buf.drawText(Math.floor((w - textWidth) / 2), BADGE_PADDING + 1, badge.text, BADGE_SCALE, false);
+
+  return {
+    id: LAYER_IDS[badge.type],
+    x,
+    y,
+    w,
+    h,
+    ink: buf.toBitmap(),
+    mask: Buffer.alloc((w / 8) * h, 0xFF)
+  };
+}
+
+function renderOverlayLayers(badges) {
+  return badges.map(renderBadge);
+}
+
+// Wire format: "IFOL", version 1, layer count, then per layer
+// id (1), x, y, w, h (2 bytes each, big-endian), ink bytes, mask bytes
+function encodeOverlayLayers(layers) {
+  const parts = [Buffer.from([0x49, 0x46, 0x4F, 0x4C, 1, layers.length])];
+
+  for (const layer of layers) {
+    const header = Buffer.alloc(9);
+    header[0] = layer.id;
+    header.writeUInt16BE(layer.x, 1);
+    header.writeUInt16BE(layer.y, 3);
+    header.writeUInt16BE(layer.w, 5);
+    header.writeUInt16BE(layer.h, 7);
+    parts.push(header, layer.ink, layer.mask);
+  }
+
+  return Buffer.concat(parts);
+}
+
+module.exports = {
+  OVERLAY_TYPES,
+  overlayBadges,
+  renderOverlayLayers,
+  encodeOverlayLayers
+};
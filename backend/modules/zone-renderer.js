@@ -0,0 +1,125 @@
+/**
+ * Zone Renderer - Split-screen layouts
+ *
+ * A zone layout divides the panel into rectangles, each with its own
+ * content source, version and refresh policy. Devices cache every zone
+ * separately and refetch only the zones whose version changed, then
+ * partial-refresh just those rectangles (or do a full refresh for zones
+ * whose policy asks for it, e.g. photos, which ghost under partials).
+ *
+ * Zone x and w are multiples of 8 so zone rasters are whole bytes per row.
+ */
+
+const { PixelBuffer, UI_STRINGS, formatEventTime, truncateText } = require('./dashboard-renderer');
+
+const ZONE_SOURCES = ['photo', 'calendar', 'todos', 'weather'];
+const ZONE_POLICIES = ['partial', 'full'];
+const MAX_ZONES = 4;
+
+// Photos ghost badly under repeated partial refreshes
+const DEFAULT_POLICY = { photo: 'full' };
+
+// Check a zone layout against the panel size; returns the normalized
+// zones, or throws with a message for the API client
+function normalizeZones(zones, width, height) {
+  if (!Array.isArray(zones) || zones.length === 0 || zones.length > MAX_ZONES) {
+    throw new Error(`A zone layout needs 1 to ${MAX_ZONES} zones`);
+  }
+
+  const ids = new Set();
+  return zones.map(zone => {
+    const { id, source } = zone;
+    const [x, y, w, h] = ['x', 'y', 'w', 'h'].map(key => parseInt(zone[key]));
+    const policy = zone.policy || DEFAULT_POLICY[source] || 'partial';
+
+    if (typeof id !== 'string' || !/^[a-z0-9]{1,7}$/.test(id) || ids.has(id)) {
+      throw new Error('Zone ids must be unique, 1-7 lowercase letters or digits');
+    }
+    if (!ZONE_SOURCES.includes(source)) {
+      throw new Error(`Zone source must be one of: ${ZONE_SOURCES.join(', ')}`);
+    }
+    if (!ZONE_POLICIES.includes(policy)) {
+      throw new Error(`Zone policy must be one of: ${ZONE_POLICIES.join(', ')}`);
+    }
+    if (![x, y, w, h].every(Number.isInteger) || x % 8 || w % 8 || w <= 0 || h <= 0 ||
+        x < 0 || y < 0 || x + w > width || y + h > height) {
+      throw new Error(`Zone ${id} must fit the ${width}x${height} panel with x and w multiples of 8`);
+    }
+
+    ids.add(id);
+    return { id, source, x, y, w, h, policy };
+  });
+}
+
+// What a non-photo zone shows; its version is a hash of this
+function zoneInputs(zone, data) {
+  const { weather, events, todos, lang } = data;
+  switch (zone.source) {
+    case 'calendar':
+      return { lang, day: new Date().toDateString(), events: (events || []).map(e => [e.start, e.summary]) };
+    case 'todos':
+      return { lang, todos: (todos || []).map(t => [t.text, t.completed]) };
+    case 'weather':
+      return weather ? [weather.temp, weather.main] : null;
+    default:
+      return null;
+  }
+}
+
+// Rows of text that fit the zone, with a title bar
+function drawList(buf, title, rows, emptyText) {
+  const maxChars = Math.floor((buf.width - 8) / 6);
+  const maxRows = Math.max(0, Math.floor((buf.height - 16) / 11));
+
+  buf.drawText(4, 2, truncateText(title, maxChars), 1, true);
+  buf.drawHLine(4, 12, buf.width - 8, true);
+
+  if (rows.length === 0) {
+    buf.drawText(4, 16, truncateText(emptyText, maxChars), 1, true);
+    return;
+  }
+
+  rows.slice(0, maxRows).forEach((row, i) => {
+    const y = 16 + i * 11;
+    if (row.checkbox !== undefined) {
+      buf.drawCheckbox(4, y - 1, 8, row.checkbox);
+      buf.drawText(16, y, truncateText(row.text, maxChars - 2), 1, true);
+    } else {
+      buf.drawText(4, y, truncateText(row.text, maxChars), 1, true);
+    }
+  });
+}
+
+// Render a non-photo zone to a packed 1-bit raster of zone.w x zone.h
+function renderZone(zone, data) {
+  const strings = UI_STRINGS[data.lang] || UI_STRINGS.en;
+  const buf = new PixelBuffer(zone.w, zone.h);
+
+  if (zone.source === 'calendar') {
+    const rows = (data.events || []).map(event => ({
+      text: `${formatEventTime(event.start)} ${event.summary || 'Event'}`
+    }));
+    drawList(buf, strings.events, rows, strings.noEvents);
+  } else if (zone.source === 'todos') {
+    const rows = (data.todos || []).map(todo => ({ text: todo.text || '', checkbox: !!todo.completed }));
+    drawList(buf, strings.todos, rows, strings.noTasks);
+  } else if (zone.source === 'weather') {
+    const weather = data.weather;
+    const temp = weather && weather.temp !== undefined ? `${weather.temp}°C` : '--°C';
+    const scale = zone.h >= 40 && zone.w >= 80 ? 2 : 1;
+    buf.drawText(4, 4, temp, scale, true);
+    if (weather && weather.main) {
+      buf.drawText(4, 8 + 7 * scale, truncateText(weather.main.toUpperCase(), Math.floor((zone.w - 8) / 6)), 1, true);
+    }
+  }
+
+  return buf.toBitmap();
+}
+
+module.exports = {
+  ZONE_SOURCES,
+  ZONE_POLICIES,
+  normalizeZones,
+  zoneInputs,
+  renderZone
+};
@@ -0,0 +1,169 @@
+#!/usr/bin/env node
+/**
+ * Build the frame corpus for bench/codec_bench
+ *
+ * Writes packed 1-bit frames plus one encoded file per codec into the output
+ * directory (default bench/corpus), and an index.txt listing
+ * "<name> <width> <height>" per frame.
+ *
+ * Frames come from the same code that renders them for devices:
+ *   - dashboard-*: the dashboard renderer with a few representative data sets
+ *   - photo-*:     image files passed on the command line, through
+ *                  generateBitmap() with each dithering algorithm
+ *   - live-*:      frames captured from a running server's /bitmap endpoint
+ *                  (--capture <server> --device <id> [--photos <n>])
+ *   - tone-*:      synthetic gradients + noise through applyDithering(), so
+ *                  the corpus has photo-like content even without sample photos
+ *
+ * Usage: node scripts/build-codec-corpus.js [--out <dir>]
+ *          [--capture <server> --device <id> [--photos <n>]] [photo ...]
+ */
+
+const fs = require('fs');
+const path = require('path');
+const axios = require('axios');
+const dashboardRenderer = require('../modules/dashboard-renderer');
+const imageProcessor = require('../modules/image-processor');
+const codecs = require('../modules/bilevel-codecs');
+
+const DITHERS = ['floydSteinberg', 'atkinson', 'bayer'];
+
+const DASHBOARD_SAMPLES = {
+  empty: { weather: null, events: [], todos: [], lang: 'en' },
+  busy: {
+    weather: { temp: 18, main: 'Clouds' },
+    events: [
+      { start: '2026-03-02T09:00:00', summary: 'Standup' },
+      { start: '2026-03-02T12:30:00', summary: 'Lunch with the design team' },
+      { start: '2026-03-02', summary: 'Conference day' }
+    ],
+    todos: [
+      { text: 'Order replacement panel', completed: true },
+      { text: 'Review firmware PR', completed: false },
+      { text: 'Call the landlord', completed: false },
+      { text: 'Groceries', completed: true }
+    ],
+    lang: 'en'
+  },
+  polish: {
+    weather: { temp: -3, main: 'Snow' },
+    events: [{ start: '2026-01-15T18:00:00', summary: 'Kolacja' }],
+    todos: [{ text: 'Zakupy', completed: false }],
+    lang: 'pl'
+  }
+};
+
+function packPixels(pixels) {
+  const bitmap = Buffer.alloc(Math.ceil(pixels.length / 8));
+  for (let i = 0; i < pixels.length; i++) {
+    if (pixels[i] > 127) bitmap[i >> 3] |= (1 << (7 - (i & 7)));
+  }
+  return bitmap;
+}
+
+// Deterministic pseudo-random noise so the corpus is reproducible
+function noise(seed) {
+  let state = seed >>> 0;
+  return () => {
+    state = (Math.imul(state, 1664525) + 1013904223) >>> 0;
+    return state / 0x100000000;
+  };
+}
+
+function toneFrame(width, height, seed) {
+  const random = noise(seed);
+  const pixels = new Uint8Array(width * height);
+  for (let y = 0; y < height; y++) {
+    for (let x = 0; x < width; x++) {
+      // Diagonal gradient with a soft radial highlight, roughly a lit photo
+      const dx = x - width * 0.35;
+      const dy = y - height * 0.4;
+      const glow = Math.max(0, 1 - Math.sqrt(dx * dx + dy * dy) / (width * 0.6));
+      const value = 40 + 120 * ((x + y) / (width + height)) + 90 * glow + (random() - 0.5) * 30;
+      pixels[y * width + x] = Math.max(0, Math.min(255, Math.round(value)));
+    }
+  }
+  return pixels;
+}
+
+function writeFrame(outDir, index, name, bitmap, width, height) {
+  const raw = codecs.toRowAligned(bitmap, width, height);
+  fs.writeFileSync(path.join(outDir, `${name}.bin`), raw);
+  for (const codec of codecs.CODECS) {
+    fs.writeFileSync(path.join(outDir, `${name}.${codec}`), codecs.encodeFrame(codec, bitmap, width, height));
+  }
+  index.push(`${name} ${width} ${height}`);
+  console.log(`${name}: ${width}x${height}`);
+}
+
+// Fetch one raw frame from /bitmap, dropping the preview pass of progressive frames
+async function captureFrame(server, deviceId, mode, index) {
+  const response = await axios.get(`${server}/api/device/${deviceId}/bitmap`, {
+    params: { mode, index, codec: 'raw', progressive: 0 },
+    responseType: 'arraybuffer'
+  });
+  const width = parseInt(response.headers['x-image-width']) || 200;
+  const height = parseInt(response.headers['x-image-height']) || 200;
+  const body = Buffer.from(response.data);
+  const frameBytes = Math.ceil((width * height) / 8);
+  return { bitmap: body.subarray(body.length - frameBytes), width, height, total: parseInt(response.headers['x-image-total']) || 0 };
+}
+
+async function main() {
+  const args = process.argv.slice(2);
+  let outDir = path.join(__dirname, '..', '..', 'bench', 'corpus');
+  let server = null;
+  let deviceId = null;
+  let livePhotos = 8;
+  const photos = [];
+
+  for (let i = 0; i < args.length; i++) {
+    if (args[i] === '--out') outDir = args[++i];
+    else if (args[i] === '--capture') server = args[++i].replace(/\/$/, '');
+    else if (args[i] === '--device') deviceId = args[++i];
+    else if (args[i] === '--photos') livePhotos = parseInt(args[++i]);
+    else photos.push(args[i]);
+  }
+
+  fs.mkdirSync(outDir, { recursive: true });
+  const index = [];
+
+  for (const [name, data] of Object.entries(DASHBOARD_SAMPLES)) {
+    const bitmap = await dashboardRenderer.renderDashboardBitmap({ ...data, date: new Date('2026-03-02T08:00:00') });
+    writeFrame(outDir, index, `dashboard-${name}`, bitmap, dashboardRenderer.WIDTH, dashboardRenderer.HEIGHT);
+  }
+
+  for (const photo of photos) {
+    const input = fs.readFileSync(photo);
+    const base = path.basename(photo, path.extname(photo)).replace(/[^\w-]/g, '_');
+    for (const dithering of DITHERS) {
+      const bitmap = await imageProcessor.generateBitmap(input, { width: 200, height: 200, dithering });
+      writeFrame(outDir, index, `photo-${base}-${dithering}`, bitmap, 200, 200);
+    }
+  }
+
+  if (server && deviceId) {
+    const dashboard = await captureFrame(server, deviceId, 'dashboard', 0);
+    writeFrame(outDir, index, 'live-dashboard', dashboard.bitmap, dashboard.width, dashboard.height);
+
+    for (let i = 0; i < livePhotos; i++) {
+      const frame = await captureFrame(server, deviceId, 'photo', i);
+      writeFrame(outDir, index, `live-photo-${i}`, frame.bitmap, frame.width, frame.height);
+      if (i + 1 >= frame.total) break;
+    }
+  }
+
+  const tone = toneFrame(200, 200, 1);
+  for (const dithering of DITHERS) {
+    const pixels = imageProcessor.applyDithering(Uint8Array.from(tone), 200, 200, dithering);
+    writeFrame(outDir, index, `tone-${dithering}`, packPixels(pixels), 200, 200);
+  }
+
+  fs.writeFileSync(path.join(outDir, 'index.txt'), index.join('\n') + '\n');
+  console.log(`Wrote ${index.length} frames to ${outDir}`);
+}
+
+main().catch(error => {
+  console.error(error);
+  process.exit(1);
+});
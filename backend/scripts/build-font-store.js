@@ -0,0 +1,232 @@
+#!/usr/bin/env node
+/**
+ * Build a compressed font blob for the device's local screens
+ *
+ * Reads a BDF bitmap font, keeps a subset of Unicode (by default Latin-1
+ * and Latin Extended-A, which covers Polish, plus common punctuation),
+ * crops every glyph to its ink and writes the blob lib/FontStore reads:
+ * glyphs sorted by code point, in blocks of 32 compressed with whichever
+ * bilevel codec does best. The format is described in
+ * lib/FontStore/src/FontStore.h.
+ *
+ * Outline fonts can be rasterized to BDF first, e.g. with
+ *   otf2bdf -p 12 -r 72 FreeSansBold.ttf -o title.bdf
+ *
+ * The firmware looks for /fonts/title.ifnt and /fonts/text.ifnt in
+ * LittleFS; the default output is data/fonts/<name>.ifnt, which
+ * `pio run -t uploadfs` puts there. That build runs this script itself
+ * for fonts/title.bdf and fonts/text.bdf (see fonts/README.md).
+ *
+ * Usage: node scripts/build-font-store.js [--out <file>] [--ranges <list>]
+ *          [--text <file>] <font.bdf>
+ *   --ranges  hex code point ranges, e.g. 20-7E,A0-17F,20AC
+ *   --text    keep only the characters used in this UTF-8 file
+ */
+
+const fs = require('fs');
+const path = require('path');
+const codecs = require('../modules/bilevel-codecs');
+
+// Must match lib/FontStore/src/FontStore.h
+const FONT_STORE_VERSION = 1;
+const HEADER_BYTES = 16;
+const INDEX_BYTES = 10;
+const BLOCK_BYTES = 8;
+const BLOCK_GLYPHS = 32;
+const MAX_GLYPH_BYTES = 128;
+
+// Codec ids from lib/BilevelCodec (G4 is for frames, not byte streams)
+const CODEC_IDS = { rle: 1, lz4: 3, heatshrink: 4 };
+
+const DEFAULT_RANGES = '20-7E,A0-17F,2013-2014,2018-201E,2022,2026,20AC';
+
+function parseRanges(list) {
+  return list.split(',').map(range => {
+    const [from, to] = range.split('-').map(hex => parseInt(hex, 16));
+    return [from, to === undefined ? from : to];
+  });
+}
+
+/**
+ * Parse a BDF font into { ascent, descent, glyphs: Map<cp, glyph> }. Glyph
+ * rows are arrays of 0/1; yOffset is the top row relative to the baseline
+ * (negative above it), as the device draws them.
+ */
+function parseBdf(text) {
+  const font = { ascent: 0, descent: 0, glyphs: new Map() };
+  let glyph = null;
+  let bitmapRows = null;
+
+  for (const line of text.split(/\r?\n/)) {
+    const [keyword, ...fields] = line.trim().split(/\s+/);
+    const values = fields.map(Number);
+
+    if (bitmapRows) {
+      if (keyword === 'ENDCHAR') {
+        glyph.rows = bitmapRows.map(hex => {
+          const bits = parseInt(hex, 16).toString(2).padStart(hex.length * 4, '0');
+          return Array.from(bits.substring(0, glyph.width), Number);
+        });
+        if (glyph.cp >= 0) font.glyphs.set(glyph.cp, glyph);
+        glyph = null;
+        bitmapRows = null;
+      } else {
+        bitmapRows.push(keyword);
+      }
+      continue;
+    }
+
+    if (keyword === 'FONT_ASCENT') font.ascent = values[0];
+    else if (keyword === 'FONT_DESCENT') font.descent = values[0];
+    else if (keyword === 'STARTCHAR') glyph = { cp: -1, advance: 0, width: 0, height: 0, xOffset: 0, yOffset: 0 };
+    else if (glyph && keyword === 'ENCODING') glyph.cp = values[0];
+    else if (glyph && keyword === 'DWIDTH') glyph.advance = values[0];
+    else if (glyph && keyword === 'BBX') {
+      [glyph.width, glyph.height, glyph.xOffset] = values;
+      glyph.yOffset = -(values[3] + glyph.height);
+    } else if (glyph && keyword === 'BITMAP') bitmapRows = [];
+  }
+  return font;
+}
+
+// Trim blank rows and columns so only the ink is stored
+function cropGlyph(glyph) {
+  const rows = glyph.rows.slice(0, glyph.height);
+  const inked = rows.map(row => row.includes(1));
+  const top = inked.indexOf(true);
+  if (top < 0) return { ...glyph, width: 0, height: 0, xOffset: 0, yOffset: 0, rows: [] };
+
+  const bottom = inked.lastIndexOf(true);
+  let left = glyph.width;
+  let right = -1;
+  for (const row of rows) {
+    const first = row.indexOf(1);
+    if (first >= 0) {
+      left = Math.min(left, first);
+      right = Math.max(right, row.lastIndexOf(1));
+    }
+  }
+
+  return {
+    ...glyph,
+    width: right - left + 1,
+    height: bottom - top + 1,
+    xOffset: glyph.xOffset + left,
+    yOffset: glyph.yOffset + top,
+    rows: rows.slice(top, bottom + 1).map(row => row.slice(left, right + 1))
+  };
+}
+
+// Rows back to back, MSB first, 1 = ink
+function packGlyph(glyph) {
+  const bits = glyph.rows.flat();
+  const bytes = Buffer.alloc(Math.ceil(bits.length / 8));
+  bits.forEach((bit, i) => {
+    if (bit) bytes[i >> 3] |= 0x80 >> (i & 7);
+  });
+  return bytes;
+}
+
+function buildFontStore(font, keep) {
+  const glyphs = [...font.glyphs.values()]
+    .filter(glyph => keep(glyph.cp))
+    .sort((a, b) => a.cp - b.cp)
+    .map(cropGlyph);
+
+  const index = Buffer.alloc(glyphs.length * INDEX_BYTES);
+  const blockCount = Math.ceil(glyphs.length / BLOCK_GLYPHS);
+  const blockTable = Buffer.alloc(blockCount * BLOCK_BYTES);
+  const blocks = [];
+  const codecUse = {};
+  let rawBytes = 0;
+  let dataOffset = HEADER_BYTES + index.length + blockTable.length;
+
+  for (let b = 0; b < blockCount; b++) {
+    const parts = [];
+    let offset = 0;
+
+    glyphs.slice(b * BLOCK_GLYPHS, (b + 1) * BLOCK_GLYPHS).forEach((glyph, i) => {
+      const bitmap = packGlyph(glyph);
+      if (bitmap.length > MAX_GLYPH_BYTES || glyph.width > 255 || glyph.height > 255) {
+        throw new Error(`U+${glyph.cp.toString(16).toUpperCase()} is too large (${glyph.width}x${glyph.height})`);
+      }
+      if (glyph.xOffset < -128 || glyph.xOffset > 127 || glyph.yOffset < -128 || glyph.yOffset > 127 || glyph.advance > 255) {
+        throw new Error(`U+${glyph.cp.toString(16).toUpperCase()} has metrics out of range`);
+      }
+
+      const entry = (b * BLOCK_GLYPHS + i) * INDEX_BYTES;
+      index.writeUIntBE(glyph.cp, entry, 3);
+      index.writeUInt8(glyph.width, entry + 3);
+      index.writeUInt8(glyph.height, entry + 4);
+      index.writeInt8(glyph.xOffset, entry + 5);
+      index.writeInt8(glyph.yOffset, entry + 6);
+      index.writeUInt8(glyph.advance, entry + 7);
+      index.writeUInt16BE(offset, entry + 8);
+      parts.push(bitmap);
+      offset += bitmap.length;
+    });
+
+    // The block's bytes as a frame 8 pixels wide, one byte per row
+    const raw = Buffer.concat(parts);
+    const encoded = raw.length > 0 ? codecs.encodeBest(raw, 8, raw.length, Object.keys(CODEC_IDS)) : null;
+    const data = encoded ? encoded.data : raw;
+    const codec = encoded ? encoded.codec : 'stored';
+
+    blockTable.writeUInt32BE(dataOffset, b * BLOCK_BYTES);
+    blockTable.writeUInt16BE(raw.length, b * BLOCK_BYTES + 4);
+    blockTable.writeUInt8(encoded ? CODEC_IDS[codec] : 0, b * BLOCK_BYTES + 6);
+    blocks.push(data);
+    codecUse[codec] = (codecUse[codec] || 0) + 1;
+    rawBytes += raw.length;
+    dataOffset += data.length;
+  }
+
+  const header = Buffer.alloc(HEADER_BYTES);
+  header.write('IFNT', 0, 'ascii');
+  header.writeUInt8(FONT_STORE_VERSION, 4);
+  header.writeUInt8(font.ascent, 5);
+  header.writeUInt8(font.descent, 6);
+  header.writeUInt16BE(glyphs.length, 8);
+  header.writeUInt16BE(blockCount, 10);
+
+  return {
+    blob: Buffer.concat([header, index, blockTable, ...blocks]),
+    glyphCount: glyphs.length,
+    rawBytes,
+    codecUse
+  };
+}
+
+function main() {
+  const args = process.argv.slice(2);
+  let out = null;
+  let ranges = DEFAULT_RANGES;
+  let textFile = null;
+  let input = null;
+
+  for (let i = 0; i < args.length; i++) {
+    if (args[i] === '--out') out = args[++i];
+    else if (args[i] === '--ranges') ranges = args[++i];
+    else if (args[i] === '--text') textFile = args[++i];
+    else input = args[i];
+  }
+  if (!input) {
+    console.error('Usage: node scripts/build-font-store.js [--out <file>] [--ranges <list>] [--text <file>] <font.bdf>');
+    process.exit(1);
+  }
+
+  const font = parseBdf(fs.readFileSync(input, 'utf8'));
+  const inRanges = parseRanges(ranges);
+  const used = textFile ? new Set([...fs.readFileSync(textFile, 'utf8')].map(char => char.codePointAt(0))) : null;
+  const keep = cp => cp === 0x3F || (inRanges.some(([from, to]) => cp >= from && cp <= to) && (!used || used.has(cp)));
+
+  const result = buildFontStore(font, keep);
+  out = out || path.join(__dirname, '..', '..', 'data', 'fonts', `${path.basename(input, path.extname(input))}.ifnt`);
+  fs.mkdirSync(path.dirname(out), { recursive: true });
+  fs.writeFileSync(out, result.blob);
+
+  const blocks = Object.entries(result.codecUse).map(([codec, n]) => `${n} ${codec}`).join(', ');
+  console.log(`${out}: ${result.glyphCount} glyphs, ${result.rawBytes} bitmap bytes -> ${result.blob.length} byte blob (blocks: ${blocks})`);
+}
+
+main();
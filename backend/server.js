@@ -17,6 +17,7 @@ const axios = require('axios');
 const multer = require('multer');
 const sharp = require('sharp');
 const path = require('path');
+const crypto = require('crypto');
 const fs = require('fs').promises;
 const fsSync = require('fs');
 const db = require('./database');
@@ -24,7 +25,11 @@ const weatherModule = require('./modules/weather');
 const todoModule = require('./modules/todo');
 const calendarModule = require('./modules/calendar');
 const dashboardRenderer = require('./modules/dashboard-renderer');
+const overlayRenderer = require('./modules/overlay-renderer');
+const zoneRenderer = require('./modules/zone-renderer');
 const imageProcessor = require('./modules/image-processor');
+const bilevelCodecs = require('./modules/bilevel-codecs');
+const deviceAlerts = require('./modules/device-alerts');
 
 // ==================== CONFIGURATION ====================
 
@@ -44,6 +49,14 @@ const config = {
   uploadDir: UPLOAD_DIR,
   webDir: WEB_DIR,
   maxImageSize: parseInt(process.env.MAX_IMAGE_SIZE) || 5 * 1024 * 1024,
+  // Frame codecs the server may use, for devices that advertise them
+  frameCodecs: (process.env.FRAME_CODECS || bilevelCodecs.CODECS.join(',')).split(',').map(c => c.trim()).filter(Boolean),
+  // Firmware version devices should be running (feeds the 'f' resource version)
+  latestFirmware: process.env.LATEST_FIRMWARE_VERSION || null,
+  // CoAP gateway (bench/coap_standin) devices may poll through, as host:port,
+  // and the secret per-device DTLS pre-shared keys are derived from
+  coapEndpoint: process.env.COAP_ENDPOINT || null,
+  coapPskSecret: process.env.COAP_PSK_SECRET || null,
 };
 
 console.log('='.repeat(50));
@@ -216,7 +229,7 @@ app.get('/api/auth/me', authenticate, (req, res) => {
 
 app.post('/api/devices/register', async (req, res, next) => {
   try {
-    const { deviceId, displayType, firmwareVersion } = req.body;
+    const { deviceId, displayType, firmwareVersion, caps, capsHash } = req.body;
     if (!deviceId) {
       return res.status(400).json({ error: 'Device ID is required' });
     }
@@ -238,10 +251,26 @@ app.post('/api/devices/register', async (req, res, next) => {
       console.log(`New device registered: ${deviceId}`);
     }
 
+    // Capability descriptor: devices send the full descriptor only when it
+    // changed, otherwise just its hash. Ask again if we don't know that hash.
+    const deviceConfig = { ...(device.configJson || {}) };
+    deviceConfig.displayType = displayType || deviceConfig.displayType || '154_BW';
+    deviceConfig.firmwareVersion = firmwareVersion || deviceConfig.firmwareVersion;
+    if (caps && typeof caps === 'object') {
+      deviceConfig.caps = caps;
+      deviceConfig.capsHash = capsHash;
+      console.log(`Device ${deviceId} capabilities: ${JSON.stringify(caps)}`);
+    }
+    const needCaps = !caps && capsHash !== undefined && capsHash !== deviceConfig.capsHash;
+    await db.updateDevice(deviceId, { configJson: deviceConfig });
+
     const apiKey = jwt.sign({ deviceId }, config.jwtSecret);
+    const coap = coapCredentials({ id: deviceId, configJson: deviceConfig });
     res.status(201).json({
-      device: { id: deviceId, deviceId, displayType: displayType || '154_BW' },
-      apiKey
+      device: { id: deviceId, deviceId, displayType: deviceConfig.displayType },
+      apiKey,
+      needCaps,
+      ...(coap && { coap })
     });
   } catch (error) {
     next(error);
@@ -307,11 +336,15 @@ app.post('/api/devices/:deviceId/refresh', authenticate, async (req, res, next)
     const updates = {
       refreshVersion,
       lastRefreshRequest: now,
-      lastUserActivity: now // User is active when they trigger refresh
+      lastUserActivity: now, // User is active when they trigger refresh
+      configJson: {
+        ...device.configJson,
+        refreshRequests: appendChange(device.configJson?.refreshRequests, refreshVersion, Date.parse(now))
+      }
     };
 
     // Optionally set display mode
-    if (mode && ['dashboard', 'photo'].includes(mode)) {
+    if (mode && displayModes(device).includes(mode)) {
       updates.displayMode = mode;
     }
 
@@ -362,6 +395,24 @@ app.get('/api/debug/devices', async (req, res) => {
   });
 });
 
+// Debug endpoint - content freshness percentiles per device and per firmware
+app.get('/api/debug/freshness', async (req, res) => {
+  const deviceList = Object.values(await db.getDevices());
+  const byFirmware = {};
+  for (const d of deviceList) {
+    const firmware = d.configJson?.firmwareVersion || 'unknown';
+    byFirmware[firmware] = [...(byFirmware[firmware] || []), ...(d.configJson?.freshnessMs || [])];
+  }
+  res.json({
+    devices: deviceList
+      .filter(d => d.configJson?.freshnessMs?.length)
+      .map(d => ({ deviceId: d.id, firmware: d.configJson?.firmwareVersion || 'unknown', ...percentiles(d.configJson.freshnessMs) })),
+    firmware: Object.entries(byFirmware)
+      .filter(([, samples]) => samples.length)
+      .map(([firmware, samples]) => ({ firmware, ...percentiles(samples) }))
+  });
+});
+
 // ==================== IMAGE ROUTES ====================
 
 const DISPLAY_CONFIGS = {
@@ -374,6 +425,311 @@ const DISPLAY_CONFIGS = {
   'default': { width: 200, height: 200 }
 };
 
+// Panel geometry for a device: from its capability descriptor when it sent
+// one, otherwise from its display type
+function getDisplayConfig(device) {
+  const panel = device?.configJson?.caps?.panel;
+  if (panel && panel.w > 0 && panel.h > 0) {
+    return { width: panel.w, height: panel.h };
+  }
+  return DISPLAY_CONFIGS[device?.configJson?.displayType] || DISPLAY_CONFIGS['default'];
+}
+
+// Whether a device's firmware advertised a payload format (see buildCapabilities() in the firmware)
+function deviceSupports(device, format) {
+  const formats = device?.configJson?.caps?.formats;
+  return Array.isArray(formats) && formats.includes(format);
+}
+
+// Display modes a device can be put in ('zones' needs a zone layout)
+function displayModes(device) {
+  return device?.configJson?.zones?.length ? ['dashboard', 'photo', 'zones'] : ['dashboard', 'photo'];
+}
+
+// Whether a device in this mode shows photos (a zone layout may have a photo zone)
+function showsPhotos(device, mode) {
+  return mode === 'photo' ||
+    (mode === 'zones' && (device.configJson?.zones || []).some(zone => zone.source === 'photo'));
+}
+
+// ==================== RESOURCE VERSIONS ====================
+// The poll carries a version vector with one counter per resource, so a
+// device refetches only what changed. Counters live in device.configJson
+// and are bumped when the resource's fingerprint changes.
+//   d = dashboard data, p = photo list, s = device settings, f = firmware,
+//   o = photo overlays, z = zone layout (per-zone versions are in /zones)
+const RESOURCE_KEYS = ['d', 'p', 's', 'f', 'o', 'z'];
+
+// Dashboard inputs include calendar API calls, so their fingerprint is
+// cached per user; todo and settings edits drop the cache entry
+const DASHBOARD_FINGERPRINT_TTL_MS = 5 * 60 * 1000;
+const dashboardFingerprints = new Map();
+
+function fingerprint(value) {
+  return imageProcessor.frameHash(Buffer.from(JSON.stringify(value ?? null)));
+}
+
+async function dashboardFingerprint(userId, settings) {
+  const cached = dashboardFingerprints.get(userId);
+  if (cached && Date.now() - cached.at < DASHBOARD_FINGERPRINT_TTL_MS) {
+    return cached.hash;
+  }
+
+  const [weather, events, todos] = await Promise.all([
+    settings.city ? weatherModule.getWeatherByCity(settings.city) : null,
+    calendarModule.getUpcomingEvents(userId, 3),
+    todoModule.getActiveTodos(userId, 4)
+  ]);
+
+  const hash = fingerprint({
+    day: new Date().toDateString(),
+    lang: settings.lang,
+    weather: weather ? [weather.temp, weather.main] : null,
+    events: (events || []).map(e => [e.start, e.summary]),
+    todos: (todos || []).map(t => [t.text, t.completed])
+  });
+
+  dashboardFingerprints.set(userId, { hash, at: Date.now() });
+  return hash;
+}
+
+// What a device's photo overlays show right now (configJson.overlays)
+async function overlayBadges(device, settings) {
+  const overlays = device.configJson?.overlays || [];
+  const weather = overlays.includes('weather') && settings.city
+    ? await weatherModule.getWeatherByCity(settings.city)
+    : null;
+  return overlayRenderer.overlayBadges(overlays, { weather });
+}
+
+// When each user last edited content in the web app. A version bump picks
+// this up as its change time (see resourceVersions()), so freshness is
+// measured from the edit rather than from the poll that noticed it.
+const contentEdits = new Map();
+
+function noteContentEdit(userId) {
+  contentEdits.set(userId, Date.now());
+}
+
+// Change times kept per resource (and for refresh requests), so the poll
+// can name the oldest change a device that fell several versions behind
+// hasn't shown yet
+const CHANGE_HISTORY = 8;
+
+function appendChange(history, n, t) {
+  return [...(history || []), [n, t]].slice(-CHANGE_HISTORY);
+}
+
+// Current version vector [d, p, s, f, o, z] for a device, persisting any
+// bumps. Each version is stamped with its change time (t, epoch ms), and
+// the recent versions with theirs (c: [[n, t], ...]).
+async function resourceVersions(device, settings, userImages) {
+  const prints = {
+    d: await dashboardFingerprint(device.userId, settings),
+    p: fingerprint(userImages.map(image => image.id)),
+    s: fingerprint([settings.city, settings.lang, settings.rotationInterval, settings.autoImageMode,
+      device.configJson?.livingPhoto || false]),
+    f: fingerprint(config.latestFirmware),
+    o: fingerprint(await overlayBadges(device, settings))
+  };
+  // Zones show dashboard data and the current photo, so they change with those
+  prints.z = fingerprint([device.configJson?.zones || null, prints.d, prints.p, device.currentImageIndex || 0]);
+
+  const stored = device.configJson?.versions || {};
+  const versions = {};
+  let changed = false;
+  const now = Date.now();
+  const edited = contentEdits.get(device.userId) || 0;
+
+  for (const key of RESOURCE_KEYS) {
+    const entry = stored[key];
+    if (!entry) {
+      versions[key] = { n: 0, h: prints[key], t: now };
+      changed = true;
+    } else if (entry.h !== prints[key]) {
+      // Changes nobody made in the app (weather, the date) date from now
+      const t = edited > (entry.t || 0) ? edited : now;
+      versions[key] = { n: entry.n + 1, h: prints[key], t, c: appendChange(entry.c, entry.n + 1, t) };
+      changed = true;
+    } else {
+      versions[key] = entry;
+    }
+  }
+
+  if (changed) {
+    await db.updateDevice(device.id, { configJson: { ...device.configJson, versions } });
+  }
+
+  return {
+    vector: RESOURCE_KEYS.map(key => versions[key].n),
+    changedAt: RESOURCE_KEYS.map(key => versions[key].t || 0),
+    changes: RESOURCE_KEYS.map(key => versions[key].c || [])
+  };
+}
+
+// ==================== CONTENT FRESHNESS ====================
+// Time from a content change to the panel showing it: poll interval +
+// fetch + refresh. The poll stamps what the device is behind on with its
+// change time (ct); the device reports that stamp back with the time its
+// panel update finished on its SNTP clock (fc, fd). The last samples are
+// kept per device, and /api/debug/freshness summarizes them per device
+// and per firmware version.
+const FRESHNESS_SAMPLES = 50;
+const FRESHNESS_MAX_MS = 7 * 24 * 3600 * 1000;  // anything longer is a clock problem
+
+// Time of the first change after version seen, up to version current.
+// Older than the kept history, the latest change time stands in.
+function oldestChangeAfter(changes, seen, current, latest) {
+  const times = changes.filter(([n]) => n > seen && n <= current).map(([, t]) => t);
+  return times.length ? Math.min(...times) : latest;
+}
+
+// Change time of the oldest update the device hasn't shown yet, or null:
+// a device that missed several updates has been stale since the first
+function pendingChangeTime(device, espVersion, deviceVector, versions) {
+  const times = [];
+  const shownVersion = parseInt(espVersion) || 0;
+  const refreshVersion = device.refreshVersion || 0;
+  if (shownVersion < refreshVersion && device.lastRefreshRequest) {
+    times.push(oldestChangeAfter(device.configJson?.refreshRequests || [], shownVersion, refreshVersion,
+      Date.parse(device.lastRefreshRequest) || 0));
+  }
+  const seen = deviceVector !== undefined ? String(deviceVector).split(',').map(v => parseInt(v)) : [];
+  versions.vector.forEach((n, r) => {
+    if (seen[r] !== undefined && seen[r] >= 0 && seen[r] !== n) {
+      times.push(oldestChangeAfter(versions.changes[r], seen[r], n, versions.changedAt[r]));
+    }
+  });
+  const changed = times.filter(t => t > 0);
+  return changed.length ? Math.min(...changed) : null;
+}
+
+// Nearest-rank percentiles of a list of samples
+function percentiles(samples) {
+  if (!samples.length) return null;
+  const sorted = [...samples].sort((a, b) => a - b);
+  const rank = p => sorted[Math.min(sorted.length - 1, Math.ceil(p / 100 * sorted.length) - 1)];
+  return { count: sorted.length, p50: rank(50), p90: rank(90), p99: rank(99), max: sorted[sorted.length - 1] };
+}
+
+// ==================== PEER SHARING ====================
+// Devices in the same peer group share frames over their LAN: one elected
+// device downloads, the others take the frame from it (see
+// lib/PeerShare). The poll gives each member the group id and a content
+// key naming the exact frame it should show, so peers never swap frames
+// that merely look alike, and the group key that authenticates every
+// datagram, so nobody else on the LAN can push frames to the group.
+
+const PEER_GROUP_MAX_LENGTH = 32;
+
+function peerGroup(device) {
+  return deviceSupports(device, 'peer') ? device.configJson?.peerGroup || null : null;
+}
+
+// Group members rotate photos on a shared clock so they keep showing (and
+// sharing) the same photo. null when the device isn't in a group.
+function peerGroupImageIndex(device, rotationInterval, imageCount, nowMs) {
+  if (!peerGroup(device) || imageCount === 0) return null;
+  return Math.floor(nowMs / (rotationInterval * 60 * 1000)) % imageCount;
+}
+
+// Per-group datagram key (hex), derived so it never has to be stored
+function peerGroupKey(userId, group) {
+  return crypto.createHmac('sha256', config.jwtSecret).update(`peer:${userId}:${group}`).digest().subarray(0, 16).toString('hex');
+}
+
+// Poll fields for group members: pg = group id, pgk = group key, pk =
+// content key (absent for modes the device builds locally)
+async function peerPollFields(device, settings, userImages, mode, imageIndex) {
+  const group = peerGroup(device);
+  if (!group) return {};
+
+  const panel = [getDisplayConfig(device), device.configJson?.caps?.planes || 1];
+  let key = null;
+  if (mode === 'photo' && userImages.length > 0) {
+    key = fingerprint(['photo', userImages[imageIndex % userImages.length].id, ...panel]);
+  } else if (mode === 'dashboard') {
+    key = fingerprint(['dashboard', await dashboardFingerprint(device.userId, settings), ...panel]);
+  }
+
+  const fields = { pg: fingerprint([device.userId, group]), pgk: peerGroupKey(device.userId, group) };
+  if (key !== null) fields.pk = key;
+  return fields;
+}
+
+// ==================== COAP TRANSPORT ====================
+// Devices that advertise 'coap' poll through a CoAP/DTLS gateway when one
+// is configured: a few hundred bytes per poll instead of a TLS handshake
+// and HTTP headers. The gateway forwards to the device routes here, so
+// the poll logic is shared. Each device gets its own pre-shared key, an
+// HMAC of its id, which the gateway derives from the same secret.
+
+function coapPsk(deviceId) {
+  return crypto.createHmac('sha256', config.coapPskSecret).update(String(deviceId)).digest().subarray(0, 16);
+}
+
+// Gateway endpoint and key for the register reply, or null (the device
+// then stays on HTTPS and forgets any key it had)
+function coapCredentials(device) {
+  if (!config.coapEndpoint || !config.coapPskSecret || !deviceSupports(device, 'coap')) return null;
+  const [host, port] = config.coapEndpoint.split(':');
+  return { host, port: parseInt(port) || 5684, psk: coapPsk(device.id).toString('hex') };
+}
+
+// ==================== SYNCHRONIZED REFRESH ====================
+// A peer group is also a wall that should change at once. The first
+// member to see new content schedules it SYNC_LEAD_MS ahead; members
+// polling before then get the same "display at" time, prefetch, and start
+// their panel refresh at that moment on their SNTP clocks.
+
+const SYNC_LEAD_MS = 25000;
+const SYNC_POLL_SECONDS = 15;     // every member polls within the lead time
+const groupSchedules = new Map(); // `${userId}:${group}` -> { content, at }
+
+function syncGroup(device) {
+  return deviceSupports(device, 'sync') ? peerGroup(device) : null;
+}
+
+// Epoch ms the device should refresh at, or null to refresh right away
+function syncDisplayAt(device, mode, imageIndex, contentKey, now) {
+  const group = syncGroup(device);
+  if (!group) return null;
+
+  const id = `${device.userId}:${group}`;
+  const content = fingerprint([mode, contentKey ?? imageIndex]);
+  const schedule = groupSchedules.get(id);
+  if (!schedule) {
+    // Nothing to line up with yet (e.g. after a server restart)
+    groupSchedules.set(id, { content, at: 0 });
+    return null;
+  }
+  if (schedule.content !== content) {
+    schedule.content = content;
+    schedule.at = now + SYNC_LEAD_MS;
+    console.log(`[Sync] Group ${id}: new content, refresh at ${new Date(schedule.at).toISOString()}`);
+  }
+  return schedule.at > now ? schedule.at : null;
+}
+
+// Bump one resource for all of a user's devices, for changes the
+// fingerprints can't see (e.g. a photo re-processed in place)
+async function bumpResourceVersion(userId, key) {
+  const devices = await db.getDevicesByUserId(userId);
+  for (const device of devices) {
+    const versions = device.configJson?.versions;
+    if (!versions?.[key]) continue;
+    await db.updateDevice(device.id, {
+      configJson: {
+        ...device.configJson,
+        versions: {
+          ...versions,
+          [key]: { ...versions[key], n: versions[key].n + 1, c: appendChange(versions[key].c, versions[key].n + 1, Date.now()) }
+        }
+      }
+    });
+  }
+}
+
 app.post('/api/images/upload', authenticate, upload.single('image'), async (req, res, next) => {
   try {
     if (!req.file) {
@@ -408,6 +764,7 @@ app.post('/api/images/upload', authenticate, upload.single('image'), async (req,
       console.log('Filesystem write skipped (ephemeral):', fsErr.message);
     }
 
+    noteContentEdit(req.user.id);
     res.status(201).json({
       image: {
         id: image.id,
@@ -496,6 +853,7 @@ app.delete('/api/images/:id', authenticate, async (req, res, next) => {
     }
 
     await db.deleteImage(id);
+    noteContentEdit(req.user.id);
     res.json({ message: 'Image deleted' });
   } catch (error) {
     next(error);
@@ -621,6 +979,7 @@ app.post('/api/images/process', authenticate, async (req, res, next) => {
 
     // Save processed image to database
     await db.updateImageData(imageId, imageData?.imageData || imageBuffer, result.png);
+    await bumpResourceVersion(req.user.id, 'p');
 
     // Also update filesystem cache
     try {
@@ -635,6 +994,157 @@ app.post('/api/images/process', authenticate, async (req, res, next) => {
   }
 });
 
+// Render a carousel photo for a device as { bitmap, planes } (null if the
+// source is missing). With gray, photos without user edits come out as 2-bit
+// gray planes; edited photos keep their stored 1-bit dithering.
+// Returns the frame with its geometry, which is the panel's unless the
+// device scales frames itself (anySize): then a pre-processed rendition is
+// sent at the size it was made for, so one rendition serves every panel.
+async function renderPhotoBitmap(image, displayConfig, gray = false, dithering = 'floydSteinberg', anySize = false) {
+  // Try to get processed image from database first (has dithering applied)
+  const imageData = await db.getImageData(image.id);
+
+  // Pre-processed images are only usable at the size they were processed for
+  const processed = imageData && imageData.processedData
+    ? await sharp(imageData.processedData).grayscale().raw().toBuffer({ resolveWithObject: true })
+    : null;
+  const nativeSize = processed && processed.info.width === displayConfig.width && processed.info.height === displayConfig.height;
+
+  if (processed && (nativeSize || (anySize && !gray))) {
+    // Use pre-processed image with dithering from database. Frames the
+    // device scales use the codec row layout (rows padded to whole bytes).
+    const { data, info } = processed;
+    const rowBits = nativeSize ? info.width : Math.ceil(info.width / 8) * 8;
+    const bitmapSize = Math.ceil((rowBits * info.height) / 8);
+    const bitmap = Buffer.alloc(bitmapSize);
+
+    for (let i = 0; i < data.length; i++) {
+      const bit = Math.floor(i / info.width) * rowBits + (i % info.width);
+      if (data[i] > 127) bitmap[bit >> 3] |= (1 << (7 - (bit & 7)));
+    }
+    return { bitmap, planes: 1, width: info.width, height: info.height };
+  }
+
+  // Fallback: process image on the fly with dithering
+  let imageBuffer;
+
+  // Try database first
+  if (imageData && imageData.imageData) {
+    imageBuffer = imageData.imageData;
+  } else {
+    // Fallback to filesystem
+    const imagePath = path.join(UPLOAD_DIR, image.filename);
+    try {
+      imageBuffer = await fs.readFile(imagePath);
+    } catch {
+      return null;
+    }
+  }
+
+  // Process with dithering for better E-ink display
+  const result = await imageProcessor.processImage(imageBuffer, {
+    width: displayConfig.width,
+    height: displayConfig.height,
+    dithering,
+    grayLevels: gray ? 4 : 2
+  });
+
+  return { bitmap: result.bitmap, planes: result.planes, width: displayConfig.width, height: displayConfig.height };
+}
+
+// Photo quality tier the device asks for (?q=) from its link estimate:
+// full detail, 1-bit, or coarse 1-bit with ordered dithering, whose
+// regular pattern the frame codecs compress several times better than
+// error diffusion. Devices that don't send q get full detail.
+const QUALITY_COARSE = 0;
+const QUALITY_LITE = 1;
+const QUALITY_FULL = 2;
+
+function frameQuality(req) {
+  const q = parseInt(req.query.q);
+  return q >= QUALITY_COARSE && q <= QUALITY_FULL ? q : QUALITY_FULL;
+}
+
+function photoDithering(req) {
+  return frameQuality(req) === QUALITY_COARSE ? 'ordered' : 'floydSteinberg';
+}
+
+// 4-gray photos for devices that advertise the gray2 format (?gray=0 opts
+// out), at full quality only
+function wantsGray(req, device) {
+  return req.query.gray !== '0' && frameQuality(req) === QUALITY_FULL && deviceSupports(device, 'gray2');
+}
+
+// Living photo rendition (?w=&h=): devices that pan and zoom over a photo
+// on their own ask once for a copy a few times the panel size. 1-bit only,
+// rows a whole number of bytes. Null for a normal frame.
+const LIVING_PHOTO_MAX_SCALE = 4;
+
+function livingPhotoConfig(req, device, displayConfig) {
+  if (!deviceSupports(device, 'living') || !device.configJson?.livingPhoto) return null;
+  const width = parseInt(req.query.w);
+  const height = parseInt(req.query.h);
+  if (!(width > displayConfig.width && height > displayConfig.height)) return null;
+  if (width > displayConfig.width * LIVING_PHOTO_MAX_SCALE || height > displayConfig.height * LIVING_PHOTO_MAX_SCALE) return null;
+  if (width % 8 !== 0) return null;
+  return { width, height };
+}
+
+// Send a device frame. Progressive frames carry a quarter-resolution preview
+// pass ahead of the full frame so big panels can show something early. Used
+// when the device asks (?progressive=1) or advertises the format and the
+// frame is big enough for the preview to pay off. Gray frames (two planes)
+// are never progressive, and neither are frames the device has to scale.
+// The firmware offers the format only from the same frame size (its
+// PROGRESSIVE_MIN_FRAME_BYTES) and opts out with ?progressive=0 on a weak link.
+const PROGRESSIVE_MIN_FRAME_BYTES = 15000;
+
+function sendBitmap(req, res, bitmap, displayConfig, device, planes = 1) {
+  const panel = getDisplayConfig(device);
+  const native = displayConfig.width === panel.width && displayConfig.height === panel.height;
+  const progressive = planes === 1 && native && (req.query.progressive === '1' ||
+    (req.query.progressive !== '0' && deviceSupports(device, 'progressive') && bitmap.length >= PROGRESSIVE_MIN_FRAME_BYTES));
+
+  // Compress the full frame with the best codec both sides have; the
+  // preview pass stays raw. ?codec=raw forces an uncompressed frame.
+  // Gray planes are coded as one bilevel frame twice as tall.
+  const deviceCodecs = device?.configJson?.caps?.codecs;
+  const encoded = Array.isArray(deviceCodecs) && req.query.codec !== 'raw'
+    ? bilevelCodecs.encodeBest(bitmap, displayConfig.width, displayConfig.height * planes,
+        config.frameCodecs.filter(codec => deviceCodecs.includes(codec)))
+    : null;
+  const exposed = [];
+
+  if (planes === 2) {
+    res.set('X-Frame-Format', 'gray2');
+    exposed.push('X-Frame-Format');
+  }
+
+  if (encoded) {
+    res.set('X-Frame-Codec', encoded.codec);
+    exposed.push('X-Frame-Codec');
+  }
+
+  const frame = encoded ? encoded.data : bitmap;
+  if (!progressive) {
+    if (exposed.length) {
+      res.set('Access-Control-Expose-Headers', `${res.get('Access-Control-Expose-Headers')}, ${exposed.join(', ')}`);
+    }
+    return res.send(frame);
+  }
+
+  const preview = imageProcessor.downsampleBitmap(bitmap, displayConfig.width, displayConfig.height, 2);
+  exposed.push('X-Frame-Format', 'X-Preview-Width', 'X-Preview-Height');
+  res.set({
+    'X-Frame-Format': 'progressive',
+    'X-Preview-Width': preview.width,
+    'X-Preview-Height': preview.height,
+    'Access-Control-Expose-Headers': `${res.get('Access-Control-Expose-Headers')}, ${exposed.join(', ')}`
+  });
+
+  res.send(Buffer.concat([preview.bitmap, frame]));
+}
+
 // ESP32 bitmap endpoint - supports both photo carousel and dashboard mode
 // This endpoint is smart: it decides what to show based on settings and auto-switch logic
 app.get('/api/device/:deviceId/bitmap', optionalAuth, async (req, res, next) => {
@@ -673,32 +1183,23 @@ app.get('/api/device/:deviceId/bitmap', optionalAuth, async (req, res, next) =>
       effectiveMode = 'dashboard';
     }
 
-    const displayConfig = DISPLAY_CONFIGS['default'];
+    const displayConfig = getDisplayConfig(device);
 
     // Dashboard mode - render weather, calendar, todos
     if (effectiveMode === 'dashboard') {
-      const [weather, events, todos] = await Promise.all([
-        settings.city ? weatherModule.getWeatherByCity(settings.city) : null,
-        calendarModule.getUpcomingEvents(device.userId, 3),
-        todoModule.getActiveTodos(device.userId, 4)
-      ]);
-
-      const bitmap = await dashboardRenderer.renderDashboardBitmap({
-        weather,
-        events: events || [],
-        todos: todos || [],
-        date: new Date(),
-        lang: settings.lang || 'pl'
-      });
+      const bitmap = await dashboardRenderer.renderDashboardBitmap(await gatherDashboardData(device.userId, settings));
 
       if (!bitmap) {
         return res.status(500).json({ error: 'Failed to render dashboard' });
       }
 
+      // The dashboard renderer has a fixed layout size
+      const dashboardConfig = { width: dashboardRenderer.WIDTH, height: dashboardRenderer.HEIGHT };
+
       res.set({
         'Content-Type': 'application/octet-stream',
-        'X-Image-Width': displayConfig.width,
-        'X-Image-Height': displayConfig.height,
+        'X-Image-Width': dashboardConfig.width,
+        'X-Image-Height': dashboardConfig.height,
         'X-Image-Index': 0,
         'X-Image-Total': userImages.length,
         'X-Content-Type': 'dashboard',
@@ -706,7 +1207,7 @@ app.get('/api/device/:deviceId/bitmap', optionalAuth, async (req, res, next) =>
         'Access-Control-Expose-Headers': 'X-Image-Width, X-Image-Height, X-Image-Index, X-Image-Total, X-Content-Type, X-Display-Mode'
       });
 
-      return res.send(bitmap);
+      return sendBitmap(req, res, bitmap, dashboardConfig, device);
     }
 
     // Photo carousel mode
@@ -716,69 +1217,104 @@ app.get('/api/device/:deviceId/bitmap', optionalAuth, async (req, res, next) =>
     // Update device with current index
     await db.updateDevice(deviceId, { currentImageIndex: currentIndex });
 
-    // Try to get processed image from database first (has dithering applied)
-    let bitmap;
-    const imageData = await db.getImageData(image.id);
+    const living = livingPhotoConfig(req, device, displayConfig);
+    const frame = living
+      ? await renderPhotoBitmap(image, living, false, photoDithering(req))
+      : await renderPhotoBitmap(image, displayConfig, wantsGray(req, device), photoDithering(req),
+        deviceSupports(device, 'scaled'));
+    if (!frame) {
+      return res.status(404).json({ error: 'Image file not found. Please re-upload.' });
+    }
+    const frameConfig = { width: frame.width, height: frame.height };
 
-    if (imageData && imageData.processedData) {
-      // Use pre-processed image with dithering from database
-      const processedBuffer = imageData.processedData;
+    res.set({
+      'Content-Type': 'application/octet-stream',
+      'X-Image-Width': frameConfig.width,
+      'X-Image-Height': frameConfig.height,
+      'X-Image-Index': currentIndex,
+      'X-Image-Total': userImages.length,
+      'X-Content-Type': 'photo',
+      'X-Display-Mode': 'photo',
+      'X-Frame-Quality': frameQuality(req),
+      'Access-Control-Expose-Headers': 'X-Image-Width, X-Image-Height, X-Image-Index, X-Image-Total, X-Content-Type, X-Display-Mode, X-Frame-Quality'
+    });
 
-      // Convert PNG to 1-bit bitmap
-      const { data } = await sharp(processedBuffer)
-        .grayscale()
-        .raw()
-        .toBuffer({ resolveWithObject: true });
+    sendBitmap(req, res, frame.bitmap, frameConfig, device, frame.planes);
+  } catch (error) {
+    console.error('Bitmap endpoint error:', error);
+    next(error);
+  }
+});
 
-      const bitmapSize = Math.ceil((displayConfig.width * displayConfig.height) / 8);
-      bitmap = Buffer.alloc(bitmapSize);
+// Contact sheet: several carousel frames in one streamed response, so the device
+// can fill its photo cache in a single radio burst instead of one request per photo.
+// Layout (big-endian): "IFCS", u8 format version, u8 reserved, u16 frame count,
+// then per frame: u16 index, u32 FNV-1a hash, u32 length, frame bytes.
+// Gray frames are twice the 1-bit length (both planes).
+// A frame that fails to render is sent with length 0 and hash 0.
+const CONTACT_SHEET_MAX_FRAMES = 32;
 
-      for (let i = 0; i < data.length; i++) {
-        const byteIndex = Math.floor(i / 8);
-        const bitIndex = 7 - (i % 8);
-        if (data[i] > 127) bitmap[byteIndex] |= (1 << bitIndex);
-      }
-    } else {
-      // Fallback: process image on the fly with dithering
-      let imageBuffer;
-
-      // Try database first
-      if (imageData && imageData.imageData) {
-        imageBuffer = imageData.imageData;
-      } else {
-        // Fallback to filesystem
-        const imagePath = path.join(UPLOAD_DIR, image.filename);
-        try {
-          imageBuffer = await fs.readFile(imagePath);
-        } catch {
-          return res.status(404).json({ error: 'Image file not found. Please re-upload.' });
-        }
-      }
+app.get('/api/device/:deviceId/bitmaps', optionalAuth, async (req, res, next) => {
+  try {
+    const { deviceId } = req.params;
 
-      // Process with dithering for better E-ink display
-      const result = await imageProcessor.processImage(imageBuffer, {
-        width: displayConfig.width,
-        height: displayConfig.height,
-        dithering: 'floydSteinberg'
-      });
+    const device = await db.getDeviceById(deviceId);
+    if (!device) return res.status(404).json({ error: 'Device not found' });
+    if (!device.userId) return res.status(404).json({ error: 'Device not linked to account' });
+
+    await db.updateDevice(deviceId, { lastSeen: new Date().toISOString() });
+
+    const userImages = await db.getImagesByUserId(device.userId);
+    const from = Math.max(0, parseInt(req.query.from) || 0);
+    const requested = parseInt(req.query.count) || userImages.length;
+    const count = Math.max(0, Math.min(requested, CONTACT_SHEET_MAX_FRAMES, userImages.length - from));
 
-      bitmap = result.bitmap;
+    if (count === 0) {
+      return res.status(404).json({ error: 'No images in range' });
     }
 
+    const displayConfig = getDisplayConfig(device);
+    const gray = wantsGray(req, device);
+    const dithering = photoDithering(req);
+
     res.set({
       'Content-Type': 'application/octet-stream',
       'X-Image-Width': displayConfig.width,
       'X-Image-Height': displayConfig.height,
-      'X-Image-Index': currentIndex,
       'X-Image-Total': userImages.length,
-      'X-Content-Type': 'photo',
-      'X-Display-Mode': 'photo',
-      'Access-Control-Expose-Headers': 'X-Image-Width, X-Image-Height, X-Image-Index, X-Image-Total, X-Content-Type, X-Display-Mode'
+      'X-Content-Type': 'contact-sheet',
+      'X-Frame-Quality': frameQuality(req),
+      'Access-Control-Expose-Headers': 'X-Image-Width, X-Image-Height, X-Image-Total, X-Content-Type, X-Frame-Quality'
     });
 
-    res.send(bitmap);
+    const header = Buffer.alloc(8);
+    header.write('IFCS', 0, 'ascii');
+    header.writeUInt8(1, 4);
+    header.writeUInt16BE(count, 6);
+    res.write(header);
+
+    // Stream each frame as soon as it is rendered
+    for (let index = from; index < from + count; index++) {
+      let bitmap = null;
+      try {
+        const frame = await renderPhotoBitmap(userImages[index], displayConfig, gray, dithering);
+        bitmap = frame && frame.bitmap;
+      } catch (error) {
+        console.error(`Contact sheet: failed to render image ${index}:`, error.message);
+      }
+
+      const entry = Buffer.alloc(10);
+      entry.writeUInt16BE(index, 0);
+      entry.writeUInt32BE(bitmap ? imageProcessor.frameHash(bitmap) : 0, 2);
+      entry.writeUInt32BE(bitmap ? bitmap.length : 0, 6);
+      res.write(entry);
+      if (bitmap) res.write(bitmap);
+    }
+
+    res.end();
   } catch (error) {
-    console.error('Bitmap endpoint error:', error);
+    console.error('Contact sheet endpoint error:', error);
+    if (res.headersSent) return res.end();
     next(error);
   }
 });
@@ -831,6 +1367,8 @@ app.get('/api/device/:deviceId/image-info', optionalAuth, async (req, res, next)
       autoImageMode: autoImageMode,
       refreshVersion: device.refreshVersion || 0,
       displayMode: effectiveMode,
+      livingPhoto: deviceSupports(device, 'living') && !!device.configJson?.livingPhoto,
+      lang: settings?.lang || 'pl',
       lastUserActivity: device.lastUserActivity,
       serverTime: new Date().toISOString()
     });
@@ -873,9 +1411,9 @@ app.post('/api/device/:deviceId/set-mode', optionalAuth, async (req, res, next)
     const device = await db.getDeviceById(deviceId);
     if (!device) return res.status(404).json({ error: 'Device not found' });
 
-    const validModes = ['dashboard', 'photo'];
+    const validModes = displayModes(device);
     if (!validModes.includes(mode)) {
-      return res.status(400).json({ error: 'Invalid mode. Use "dashboard" or "photo"' });
+      return res.status(400).json({ error: `Invalid mode. Use one of: ${validModes.join(', ')}` });
     }
 
     await db.updateDevice(deviceId, {
@@ -889,6 +1427,42 @@ app.post('/api/device/:deviceId/set-mode', optionalAuth, async (req, res, next)
   }
 });
 
+// Reconcile what the device shows after local history navigation (sent from the device outbox)
+app.post('/api/device/:deviceId/set-index', optionalAuth, async (req, res, next) => {
+  try {
+    const { deviceId } = req.params;
+    const { mode, index } = req.body;
+
+    const device = await db.getDeviceById(deviceId);
+    if (!device) return res.status(404).json({ error: 'Device not found' });
+
+    const validModes = displayModes(device);
+    if (!validModes.includes(mode)) {
+      return res.status(400).json({ error: `Invalid mode. Use one of: ${validModes.join(', ')}` });
+    }
+
+    const now = new Date().toISOString();
+    const updates = { displayMode: mode, lastUserActivity: now };
+
+    if (mode === 'photo') {
+      const userImages = device.userId ? await db.getImagesByUserId(device.userId) : [];
+      const imageIndex = parseInt(index) || 0;
+      if (imageIndex < 0 || imageIndex >= userImages.length) {
+        return res.status(400).json({ error: 'Image index out of range' });
+      }
+      // Restart the rotation timer so the photo the user picked stays up
+      updates.currentImageIndex = imageIndex;
+      updates.lastImageChange = now;
+    }
+
+    await db.updateDevice(deviceId, updates);
+
+    res.json({ message: 'Index set', displayMode: mode, imageIndex: updates.currentImageIndex });
+  } catch (error) {
+    next(error);
+  }
+});
+
 // ==================== COMPREHENSIVE ESP32 STATUS ENDPOINT ====================
 // This is the main endpoint ESP32 should poll every 30-60 seconds
 // It handles: refresh detection, auto-switch, image rotation - all automatically
@@ -954,7 +1528,13 @@ app.get('/api/device/:deviceId/status', optionalAuth, async (req, res, next) =>
     }
 
     // 3. Image rotation logic: cycle through photos at configured interval
-    if (effectiveMode === 'photo' && userImages.length > 1) {
+    const groupIndex = peerGroupImageIndex(device, rotationInterval, userImages.length, nowMs);
+    if (groupIndex !== null && showsPhotos(device, effectiveMode) && groupIndex !== currentIndex) {
+      currentIndex = groupIndex;
+      await db.updateDevice(deviceId, { currentImageIndex: groupIndex, lastImageChange: nowISO });
+      shouldRefresh = true;
+      refreshReason = refreshReason || 'image_rotation';
+    } else if (groupIndex === null && showsPhotos(device, effectiveMode) && userImages.length > 1) {
       const lastImageChange = device.lastImageChange ? new Date(device.lastImageChange).getTime() : 0;
       const timeSinceLastChange = (nowMs - lastImageChange) / (1000 * 60); // in minutes
 
@@ -974,8 +1554,8 @@ app.get('/api/device/:deviceId/status', optionalAuth, async (req, res, next) =>
       }
     }
 
-    // 4. If no images available, force dashboard mode
-    if (userImages.length === 0) {
+    // 4. If no images available, force dashboard mode (zone layouts show a blank photo zone)
+    if (userImages.length === 0 && effectiveMode !== 'zones') {
       effectiveMode = 'dashboard';
     }
 
@@ -1008,15 +1588,38 @@ app.get('/api/device/:deviceId/status', optionalAuth, async (req, res, next) =>
 app.get('/api/device/:deviceId/poll', optionalAuth, async (req, res, next) => {
   try {
     const { deviceId } = req.params;
-    const { v: espVersion = 0, m: currentMode = 'dashboard', i: currentIndex = 0 } = req.query;
+    const { v: espVersion = 0, m: currentMode = 'dashboard', i: currentIndex = 0, fb: feedbackMs, rb: refreshBwMs, rg: refreshGrayMs, tc: panelTempC, vv: deviceVector, fc: freshChangedAt, fd: freshShownAt } = req.query;
 
     const device = await db.getDeviceById(deviceId);
     if (!device) {
       return res.status(404).json({ e: 'not_found' });
     }
 
-    // Update last seen
-    await db.updateDevice(deviceId, { lastSeen: new Date().toISOString() });
+    // Update last seen (and the latency / refresh times the device measured, if any)
+    const seenUpdates = { lastSeen: new Date().toISOString() };
+    if (feedbackMs !== undefined) {
+      seenUpdates.configJson = { ...device.configJson, lastFeedbackMs: parseInt(feedbackMs) };
+      console.log(`[Poll] Device ${deviceId}: time to first visible feedback ${feedbackMs} ms`);
+    }
+    if (refreshBwMs !== undefined || refreshGrayMs !== undefined || panelTempC !== undefined) {
+      const configJson = seenUpdates.configJson || device.configJson;
+      const refreshMs = { ...configJson?.refreshMs };
+      if (refreshBwMs !== undefined) refreshMs.bw = parseInt(refreshBwMs);
+      if (refreshGrayMs !== undefined) refreshMs.gray = parseInt(refreshGrayMs);
+      const temp = panelTempC !== undefined ? parseFloat(panelTempC) : configJson?.panelTempC;
+      seenUpdates.configJson = { ...configJson, refreshMs, panelTempC: temp };
+      console.log(`[Poll] Device ${deviceId}: full refresh 1-bit ${refreshMs.bw ?? '-'} ms, 4-gray ${refreshMs.gray ?? '-'} ms at ${temp ?? '?'} C`);
+    }
+    if (freshChangedAt !== undefined && freshShownAt !== undefined) {
+      const freshnessMs = Number(freshShownAt) - Number(freshChangedAt);
+      if (freshnessMs >= 0 && freshnessMs < FRESHNESS_MAX_MS) {
+        const configJson = seenUpdates.configJson || device.configJson;
+        const freshness = [...(configJson?.freshnessMs || []), freshnessMs].slice(-FRESHNESS_SAMPLES);
+        seenUpdates.configJson = { ...configJson, freshnessMs: freshness };
+        console.log(`[Poll] Device ${deviceId}: content shown ${freshnessMs} ms after the change`);
+      }
+    }
+    await db.updateDevice(deviceId, seenUpdates);
 
     if (!device.userId) {
       return res.json({
@@ -1035,6 +1638,14 @@ app.get('/api/device/:deviceId/poll', optionalAuth, async (req, res, next) => {
     ]);
 
     const serverVersion = device.refreshVersion || 0;
+    // configJson was just replaced above when the device reported measurements
+    const versions = await resourceVersions({ ...device, configJson: seenUpdates.configJson || device.configJson },
+      settings || {}, userImages);
+    const versionVector = versions.vector;
+    const changedAt = pendingChangeTime(device, espVersion, deviceVector, versions);
+    if (deviceVector !== undefined && deviceVector !== versionVector.join(',')) {
+      console.log(`[Poll] Device ${deviceId}: versions ${deviceVector} -> ${versionVector.join(',')}`);
+    }
     const autoImageMode = settings?.autoImageMode || 0;
     const rotationInterval = settings?.rotationInterval || 60;
     const now = Date.now();
@@ -1072,7 +1683,18 @@ app.get('/api/device/:deviceId/poll', optionalAuth, async (req, res, next) => {
     }
 
     // 3. Image rotation logic: cycle through photos at configured interval
-    if (effectiveMode === 'photo' && userImages.length > 1) {
+    // (peer group members follow the group's shared clock instead)
+    const groupIndex = peerGroupImageIndex(device, rotationInterval, userImages.length, now);
+    if (groupIndex !== null && showsPhotos(device, effectiveMode)) {
+      if (groupIndex !== imageIndex) {
+        await db.updateDevice(deviceId, { currentImageIndex: groupIndex, lastImageChange: nowISO });
+        console.log(`[Poll] Device ${deviceId}: group rotation ${imageIndex} -> ${groupIndex}`);
+        imageIndex = groupIndex;
+        shouldRefresh = true;
+      }
+      const periodMs = rotationInterval * 60 * 1000;
+      nextPollSeconds = Math.min(nextPollSeconds, Math.max(10, Math.ceil((periodMs - now % periodMs) / 1000)));
+    } else if (showsPhotos(device, effectiveMode) && userImages.length > 1) {
       const lastImageChange = device.lastImageChange ? new Date(device.lastImageChange).getTime() : 0;
       const timeSinceLastChange = (now - lastImageChange) / (1000 * 60); // in minutes
 
@@ -1098,11 +1720,23 @@ app.get('/api/device/:deviceId/poll', optionalAuth, async (req, res, next) => {
       }
     }
 
-    // 4. No images = force dashboard mode
-    if (userImages.length === 0) {
+    // 4. No images = force dashboard mode (zone layouts show a blank photo zone)
+    if (userImages.length === 0 && effectiveMode !== 'zones') {
       effectiveMode = 'dashboard';
     }
 
+    // 5. A clock overlay changes every minute: poll right after it does
+    if (effectiveMode === 'photo' && device.configJson?.overlays?.includes('clock')) {
+      nextPollSeconds = Math.min(nextPollSeconds, 61 - new Date(now).getSeconds());
+    }
+
+    // 6. Peer groups: frame sharing fields, and walls refresh together
+    const peerFields = await peerPollFields(device, settings || {}, userImages, effectiveMode, imageIndex);
+    const displayAt = syncDisplayAt(device, effectiveMode, imageIndex, peerFields.pk, now);
+    if (syncGroup(device)) {
+      nextPollSeconds = Math.min(nextPollSeconds, SYNC_POLL_SECONDS);
+    }
+
     // Compact response (short keys to save bandwidth for ESP32)
     res.json({
       r: shouldRefresh,           // refresh needed
@@ -1110,7 +1744,12 @@ app.get('/api/device/:deviceId/poll', optionalAuth, async (req, res, next) => {
       v: serverVersion,           // version number
       n: Math.min(300, Math.max(10, nextPollSeconds)), // next poll in seconds (10s - 5min)
       i: imageIndex,              // current image index
-      t: userImages.length        // total images
+      t: userImages.length,       // total images
+      vv: versionVector,          // resource versions [dashboard, photos, settings, firmware, overlays, zones]
+      ...(changedAt ? { ct: changedAt } : {}), // change time of what the device is behind on (epoch ms)
+      ...peerFields,              // peer group, content key
+      ...alertPollFields(device), // alert banner
+      ...(displayAt ? { at: displayAt, st: Date.now() } : {}) // refresh at (epoch ms), server time
     });
 
   } catch (error) {
@@ -1161,6 +1800,8 @@ app.post('/api/todos', authenticate, async (req, res, next) => {
       return res.status(400).json({ error: 'Todo text is required' });
     }
     const todo = await todoModule.addTodo(req.user.id, text.trim());
+    dashboardFingerprints.delete(req.user.id);
+    noteContentEdit(req.user.id);
     res.status(201).json({ todo });
   } catch (error) {
     next(error);
@@ -1172,6 +1813,8 @@ app.put('/api/todos/:id', authenticate, async (req, res, next) => {
     const { id } = req.params;
     const { text, completed } = req.body;
     await todoModule.updateTodo(req.user.id, id, { text, completed });
+    dashboardFingerprints.delete(req.user.id);
+    noteContentEdit(req.user.id);
     res.json({ message: 'Todo updated' });
   } catch (error) {
     next(error);
@@ -1182,6 +1825,8 @@ app.delete('/api/todos/:id', authenticate, async (req, res, next) => {
   try {
     const { id } = req.params;
     await todoModule.deleteTodo(req.user.id, id);
+    dashboardFingerprints.delete(req.user.id);
+    noteContentEdit(req.user.id);
     res.json({ message: 'Todo deleted' });
   } catch (error) {
     next(error);
@@ -1291,6 +1936,8 @@ app.put('/api/settings', authenticate, async (req, res, next) => {
   try {
     const { city, displayMode, lat, lon, rotationInterval, lang, autoImageMode } = req.body;
     await db.updateUserSettings(req.user.id, { city, displayMode, lat, lon, rotationInterval, lang, autoImageMode });
+    dashboardFingerprints.delete(req.user.id);
+    noteContentEdit(req.user.id);
     res.json({ message: 'Settings updated' });
   } catch (error) {
     next(error);
@@ -1299,6 +1946,23 @@ app.put('/api/settings', authenticate, async (req, res, next) => {
 
 // ==================== DASHBOARD BITMAP ====================
 
+// Inputs for the dashboard renderer and its template bindings
+async function gatherDashboardData(userId, settings) {
+  const [weather, events, todos] = await Promise.all([
+    settings.city ? weatherModule.getWeatherByCity(settings.city) : null,
+    calendarModule.getUpcomingEvents(userId, 3),
+    todoModule.getActiveTodos(userId, 4)
+  ]);
+
+  return {
+    weather,
+    events: events || [],
+    todos: todos || [],
+    date: new Date(),
+    lang: settings.lang || 'pl'
+  };
+}
+
 app.get('/api/device/:deviceId/dashboard', optionalAuth, async (req, res, next) => {
   try {
     const { deviceId } = req.params;
@@ -1309,21 +1973,8 @@ app.get('/api/device/:deviceId/dashboard', optionalAuth, async (req, res, next)
     // Get user settings
     const settings = await db.getUserSettings(device.userId) || { city: 'Warsaw' };
 
-    // Gather dashboard data
-    const [weather, events, todos] = await Promise.all([
-      settings.city ? weatherModule.getWeatherByCity(settings.city) : null,
-      calendarModule.getUpcomingEvents(device.userId, 3),
-      todoModule.getActiveTodos(device.userId, 4)
-    ]);
-
     // Render dashboard bitmap
-    const bitmap = await dashboardRenderer.renderDashboardBitmap({
-      weather,
-      events: events || [],
-      todos: todos || [],
-      date: new Date(),
-      lang: settings.lang || 'pl'
-    });
+    const bitmap = await dashboardRenderer.renderDashboardBitmap(await gatherDashboardData(device.userId, settings));
 
     if (!bitmap) {
       return res.status(500).json({ error: 'Failed to render dashboard' });
@@ -1343,6 +1994,316 @@ app.get('/api/device/:deviceId/dashboard', optionalAuth, async (req, res, next)
   }
 });
 
+// ==================== DASHBOARD TEMPLATE ====================
+// Devices that advertise the "template" format cache the dashboard layout
+// (with its fonts and icons) in flash and then fetch only the widget
+// bindings. The layout version 'l' is a hash of the template, so a device
+// refetches the layout only when it (or the language) actually changed.
+
+app.get('/api/device/:deviceId/layout', optionalAuth, async (req, res, next) => {
+  try {
+    const { deviceId } = req.params;
+    const device = await db.getDeviceById(deviceId);
+    if (!device) return res.status(404).json({ error: 'Device not found' });
+    if (!device.userId) return res.status(404).json({ error: 'Device not linked' });
+
+    const settings = await db.getUserSettings(device.userId) || {};
+    const layout = dashboardRenderer.dashboardLayout(settings.lang || 'pl');
+
+    res.json({ l: fingerprint(layout), ...layout });
+  } catch (error) {
+    next(error);
+  }
+});
+
+app.get('/api/device/:deviceId/dashboard-data', optionalAuth, async (req, res, next) => {
+  try {
+    const { deviceId } = req.params;
+    const device = await db.getDeviceById(deviceId);
+    if (!device) return res.status(404).json({ error: 'Device not found' });
+    if (!device.userId) return res.status(404).json({ error: 'Device not linked' });
+
+    await db.updateDevice(deviceId, { lastSeen: new Date().toISOString() });
+
+    const settings = await db.getUserSettings(device.userId) || { city: 'Warsaw' };
+    const data = await gatherDashboardData(device.userId, settings);
+
+    res.json({
+      l: fingerprint(dashboardRenderer.dashboardLayout(data.lang)),
+      b: dashboardRenderer.dashboardBindings(data)
+    });
+  } catch (error) {
+    next(error);
+  }
+});
+
+// ==================== PHOTO OVERLAYS ====================
+// Badges (clock, weather) composited by the device over the photo it
+// already has. Changes arrive as the 'o' resource version; the device then
+// downloads just the layers and partial-refreshes their rectangles.
+
+app.put('/api/devices/:deviceId/overlays', authenticate, async (req, res, next) => {
+  try {
+    const { deviceId } = req.params;
+    const { overlays } = req.body;
+
+    const device = await db.getDeviceById(deviceId);
+    if (!device) return res.status(404).json({ error: 'Device not found' });
+    if (device.userId !== req.user.id) return res.status(403).json({ error: 'Not authorized' });
+
+    if (!Array.isArray(overlays) || overlays.some(type => !overlayRenderer.OVERLAY_TYPES.includes(type))) {
+      return res.status(400).json({ error: `Overlays must be a list of: ${overlayRenderer.OVERLAY_TYPES.join(', ')}` });
+    }
+
+    await db.updateDevice(deviceId, { configJson: { ...device.configJson, overlays: [...new Set(overlays)] } });
+    noteContentEdit(req.user.id);
+    res.json({ message: 'Overlays updated', overlays });
+  } catch (error) {
+    next(error);
+  }
+});
+
+// Living photo: the device slowly zooms in and out of the photo on screen
+// (see livingPhotoConfig). Arrives with the 's' resource version.
+app.put('/api/devices/:deviceId/living-photo', authenticate, async (req, res, next) => {
+  try {
+    const { deviceId } = req.params;
+    const { enabled } = req.body;
+
+    const device = await db.getDeviceById(deviceId);
+    if (!device) return res.status(404).json({ error: 'Device not found' });
+    if (device.userId !== req.user.id) return res.status(403).json({ error: 'Not authorized' });
+
+    if (typeof enabled !== 'boolean') {
+      return res.status(400).json({ error: 'enabled must be true or false' });
+    }
+    if (enabled && !deviceSupports(device, 'living')) {
+      return res.status(400).json({ error: 'Device firmware does not support living photos' });
+    }
+
+    await db.updateDevice(deviceId, { configJson: { ...device.configJson, livingPhoto: enabled } });
+    res.json({ message: 'Living photo updated', enabled });
+  } catch (error) {
+    next(error);
+  }
+});
+
+app.get('/api/device/:deviceId/overlay', optionalAuth, async (req, res, next) => {
+  try {
+    const { deviceId } = req.params;
+    const device = await db.getDeviceById(deviceId);
+    if (!device) return res.status(404).json({ error: 'Device not found' });
+    if (!device.userId) return res.status(404).json({ error: 'Device not linked' });
+
+    const settings = await db.getUserSettings(device.userId) || {};
+    const layers = overlayRenderer.renderOverlayLayers(await overlayBadges(device, settings));
+
+    res.set({
+      'Content-Type': 'application/octet-stream',
+      'X-Overlay-Count': layers.length,
+      'Access-Control-Expose-Headers': 'X-Overlay-Count'
+    });
+    res.send(overlayRenderer.encodeOverlayLayers(layers));
+  } catch (error) {
+    next(error);
+  }
+});
+
+// Put a device in a peer group (null leaves it). Devices of the same
+// account in the same group share frames on their LAN.
+app.put('/api/devices/:deviceId/peer-group', authenticate, async (req, res, next) => {
+  try {
+    const { deviceId } = req.params;
+    const { group } = req.body;
+
+    const device = await db.getDeviceById(deviceId);
+    if (!device) return res.status(404).json({ error: 'Device not found' });
+    if (device.userId !== req.user.id) return res.status(403).json({ error: 'Not authorized' });
+
+    if (group !== null && (typeof group !== 'string' || !group.trim() || group.length > PEER_GROUP_MAX_LENGTH)) {
+      return res.status(400).json({ error: `Group must be a name of up to ${PEER_GROUP_MAX_LENGTH} characters, or null` });
+    }
+    if (group !== null && !deviceSupports(device, 'peer')) {
+      return res.status(400).json({ error: 'Device firmware does not support peer sharing' });
+    }
+
+    const peerGroupName = group === null ? null : group.trim();
+    await db.updateDevice(deviceId, { configJson: { ...device.configJson, peerGroup: peerGroupName } });
+    res.json({ message: 'Peer group updated', group: peerGroupName });
+  } catch (error) {
+    next(error);
+  }
+});
+
+// ==================== ALERT BANNER ====================
+// Short urgent messages (a calendar reminder, a doorbell) shown on top of
+// whatever the device displays. They ride on the poll as 'al'; devices
+// that advertise "alert" draw the text locally with the dashboard
+// template font into a banner strip and partial-refresh only that, so an
+// alert costs no frame render or download. The device drops the banner
+// after the TTL; deleting the alert takes it down at the next poll.
+// Alerts are kept in memory (see modules/device-alerts.js).
+const { ALERT_MAX_TEXT, ALERT_DEFAULT_TTL_SECONDS, ALERT_MAX_TTL_SECONDS } = deviceAlerts;
+const ALERT_FONT = 's';                // dashboard template font for the banner
+
+// Poll fields: al = { id, t: text, f: font, ttl: seconds left }
+function alertPollFields(device) {
+  const alert = deviceSupports(device, 'alert') ? deviceAlerts.activeAlert(device.id) : null;
+  if (!alert) return {};
+  return { al: { id: alert.id, t: alert.text, f: ALERT_FONT, ttl: Math.ceil((alert.expiresAt - Date.now()) / 1000) } };
+}
+
+app.post('/api/devices/:deviceId/alert', authenticate, async (req, res, next) => {
+  try {
+    const { deviceId } = req.params;
+    const { text, ttl = ALERT_DEFAULT_TTL_SECONDS } = req.body;
+
+    const device = await db.getDeviceById(deviceId);
+    if (!device) return res.status(404).json({ error: 'Device not found' });
+    if (device.userId !== req.user.id) return res.status(403).json({ error: 'Not authorized' });
+
+    if (typeof text !== 'string' || !text.trim() || Buffer.byteLength(text.trim()) > ALERT_MAX_TEXT) {
+      return res.status(400).json({ error: `Text must be up to ${ALERT_MAX_TEXT} bytes` });
+    }
+    if (!Number.isInteger(ttl) || ttl < 1 || ttl > ALERT_MAX_TTL_SECONDS) {
+      return res.status(400).json({ error: `ttl must be 1-${ALERT_MAX_TTL_SECONDS} seconds` });
+    }
+    if (!deviceSupports(device, 'alert')) {
+      return res.status(400).json({ error: 'Device firmware does not support alerts' });
+    }
+
+    const alert = deviceAlerts.setAlert(device.id, text.trim(), ttl);
+    res.json({ message: 'Alert queued', id: alert.id, expiresAt: new Date(alert.expiresAt).toISOString() });
+  } catch (error) {
+    next(error);
+  }
+});
+
+app.delete('/api/devices/:deviceId/alert', authenticate, async (req, res, next) => {
+  try {
+    const { deviceId } = req.params;
+
+    const device = await db.getDeviceById(deviceId);
+    if (!device) return res.status(404).json({ error: 'Device not found' });
+    if (device.userId !== req.user.id) return res.status(403).json({ error: 'Not authorized' });
+
+    deviceAlerts.clearAlert(device.id);
+    res.json({ message: 'Alert removed' });
+  } catch (error) {
+    next(error);
+  }
+});
+
+// ==================== ZONE LAYOUTS ====================
+// Split-screen layouts: each zone has its own source, version and refresh
+// policy. The device lists the zones (with their current versions), then
+// downloads and refreshes only the zones whose version changed.
+
+app.put('/api/devices/:deviceId/zones', authenticate, async (req, res, next) => {
+  try {
+    const { deviceId } = req.params;
+    const device = await db.getDeviceById(deviceId);
+    if (!device) return res.status(404).json({ error: 'Device not found' });
+    if (device.userId !== req.user.id) return res.status(403).json({ error: 'Not authorized' });
+
+    // An empty list removes the layout
+    const displayConfig = getDisplayConfig(device);
+    let zones = null;
+    try {
+      if (Array.isArray(req.body.zones) && req.body.zones.length > 0) {
+        zones = zoneRenderer.normalizeZones(req.body.zones, displayConfig.width, displayConfig.height);
+      }
+    } catch (error) {
+      return res.status(400).json({ error: error.message });
+    }
+
+    const updates = { configJson: { ...device.configJson, zones } };
+    if (!zones && device.displayMode === 'zones') updates.displayMode = 'dashboard';
+    await db.updateDevice(deviceId, updates);
+    noteContentEdit(req.user.id);
+
+    res.json({ message: 'Zones updated', zones });
+  } catch (error) {
+    next(error);
+  }
+});
+
+// Current photo for photo zones (null when there are no photos)
+async function zonePhoto(device) {
+  const userImages = await db.getImagesByUserId(device.userId);
+  if (userImages.length === 0) return null;
+  return userImages[(device.currentImageIndex || 0) % userImages.length];
+}
+
+async function zoneVersion(zone, device, data) {
+  if (zone.source === 'photo') {
+    const image = await zonePhoto(device);
+    return fingerprint([zone.w, zone.h, image ? image.id : null]);
+  }
+  return fingerprint([zone.w, zone.h, zoneRenderer.zoneInputs(zone, data)]);
+}
+
+app.get('/api/device/:deviceId/zones', optionalAuth, async (req, res, next) => {
+  try {
+    const { deviceId } = req.params;
+    const device = await db.getDeviceById(deviceId);
+    if (!device) return res.status(404).json({ error: 'Device not found' });
+    if (!device.userId || !device.configJson?.zones) return res.status(404).json({ error: 'No zone layout' });
+
+    const settings = await db.getUserSettings(device.userId) || {};
+    const data = await gatherDashboardData(device.userId, settings);
+
+    const zones = [];
+    for (const zone of device.configJson.zones) {
+      const { id, x, y, w, h, policy } = zone;
+      zones.push({ id, x, y, w, h, p: policy, v: await zoneVersion(zone, device, data) });
+    }
+
+    res.json({ zones });
+  } catch (error) {
+    next(error);
+  }
+});
+
+app.get('/api/device/:deviceId/zone/:zoneId', optionalAuth, async (req, res, next) => {
+  try {
+    const { deviceId, zoneId } = req.params;
+    const device = await db.getDeviceById(deviceId);
+    if (!device) return res.status(404).json({ error: 'Device not found' });
+    if (!device.userId) return res.status(404).json({ error: 'Device not linked' });
+
+    const zone = (device.configJson?.zones || []).find(z => z.id === zoneId);
+    if (!zone) return res.status(404).json({ error: 'Zone not found' });
+
+    const settings = await db.getUserSettings(device.userId) || {};
+    const data = await gatherDashboardData(device.userId, settings);
+    const zoneConfig = { width: zone.w, height: zone.h };
+
+    let bitmap = null;
+    if (zone.source === 'photo') {
+      const image = await zonePhoto(device);
+      const rendered = image ? await renderPhotoBitmap(image, zoneConfig, false) : null;
+      bitmap = rendered ? rendered.bitmap : null;
+    }
+    if (!bitmap) {
+      // Non-photo sources, or a photo zone without photos (blank zone)
+      bitmap = zoneRenderer.renderZone(zone, data);
+    }
+
+    res.set({
+      'Content-Type': 'application/octet-stream',
+      'X-Image-Width': zone.w,
+      'X-Image-Height': zone.h,
+      'X-Zone-Version': await zoneVersion(zone, device, data),
+      'Access-Control-Expose-Headers': 'X-Image-Width, X-Image-Height, X-Zone-Version'
+    });
+
+    return sendBitmap(req, res, bitmap, zoneConfig, device);
+  } catch (error) {
+    next(error);
+  }
+});
+
 // ==================== HEALTH CHECK ====================
 
 app.get('/api/health', (req, res) => {
@@ -0,0 +1,535 @@
+/**
+ * Stand-in CoAP/DTLS gateway for the firmware's CoAP transport
+ *
+ * serve: accepts DTLS-PSK associations from frames (identity = device id,
+ * key = HMAC-SHA256(COAP_PSK_SECRET, device id), the same derivation the
+ * server hands out at registration) and forwards their CoAP requests to
+ * the HTTP device routes, /api/device/<id>/<path>. Without a backend it
+ * answers polls itself, to measure the transport on its own. Sessions are
+ * cached for resumption.
+ *
+ * poll: plays a device. Full handshake, a few polls over the open
+ * association, then a resumed handshake, with time and DTLS bytes for
+ * each step.
+ *
+ * Usage: COAP_PSK_SECRET=... coap_standin serve [port] [backend-host:port]
+ *        COAP_PSK_SECRET=... coap_standin poll <host> <port> <device-id> [polls]
+ *
+ * IPv4 only; handshakes are handled one at a time.
+ */
+
+#include <CoapLite.h>
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#define CIPHERS "PSK-AES128-CCM8:PSK-AES128-GCM-SHA256"
+#define PSK_BYTES 16
+#define DATAGRAM_BYTES 1500
+#define IDLE_SECONDS 900            // associations unused this long are dropped
+#define BACKEND_TIMEOUT_SECONDS 10
+#define HANDSHAKE_TIMEOUT_MS 10000
+
+static const char* pskSecret = nullptr;
+static unsigned char cookieSecret[16];
+
+struct Route {
+  uint8_t method;
+  const char* path;
+};
+
+// What devices may reach through the gateway: the poll and notifications
+static const Route routes[] = {
+  { COAP_GET, "poll" },
+  { COAP_POST, "set-mode" },
+  { COAP_POST, "set-index" },
+  { COAP_POST, "next-image" },
+};
+
+static double nowMs() {
+  using namespace std::chrono;
+  return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count() / 1000.0;
+}
+
+static bool derivePsk(const char* identity, unsigned char* psk) {
+  unsigned char mac[EVP_MAX_MD_SIZE];
+  unsigned int macLen = 0;
+  if (!HMAC(EVP_sha256(), pskSecret, (int)strlen(pskSecret), (const unsigned char*)identity, strlen(identity), mac, &macLen)) {
+    return false;
+  }
+  memcpy(psk, mac, PSK_BYTES);
+  return true;
+}
+
+static void printErrors(const char* what) {
+  fprintf(stderr, "%s: ", what);
+  ERR_print_errors_fp(stderr);
+  fprintf(stderr, "\n");
+}
+
+// ============================================================
+// GATEWAY
+// ============================================================
+
+struct Client {
+  int fd;
+  SSL* ssl;
+  std::string identity;
+  std::string address;
+  time_t lastUsed;
+};
+
+struct Backend {
+  std::string host;
+  std::string port;
+};
+
+static unsigned int pskServer(SSL*, const char* identity, unsigned char* psk, unsigned int maxLen) {
+  if (!identity || maxLen < PSK_BYTES || !derivePsk(identity, psk)) return 0;
+  return PSK_BYTES;
+}
+
+// Stateless cookies: an HMAC of the peer address (DTLS denial-of-service
+// protection, RFC 6347 4.2.1)
+static bool peerCookie(SSL* ssl, unsigned char* cookie, unsigned int* len) {
+  BIO_ADDR* peer = BIO_ADDR_new();
+  if (!peer || BIO_dgram_get_peer(SSL_get_rbio(ssl), peer) <= 0) {
+    BIO_ADDR_free(peer);
+    return false;
+  }
+  unsigned char raw[32];
+  size_t rawLen = sizeof(raw) - 2;
+  BIO_ADDR_rawaddress(peer, raw, &rawLen);
+  unsigned short port = BIO_ADDR_rawport(peer);
+  memcpy(raw + rawLen, &port, 2);
+  BIO_ADDR_free(peer);
+  return HMAC(EVP_sha256(), cookieSecret, sizeof(cookieSecret), raw, rawLen + 2, cookie, len) != nullptr;
+}
+
+static int generateCookie(SSL* ssl, unsigned char* cookie, unsigned int* len) {
+  return peerCookie(ssl, cookie, len) ? 1 : 0;
+}
+
+static int verifyCookie(SSL* ssl, const unsigned char* cookie, unsigned int len) {
+  unsigned char expected[EVP_MAX_MD_SIZE];
+  unsigned int expectedLen = 0;
+  return peerCookie(ssl, expected, &expectedLen) && len == expectedLen && CRYPTO_memcmp(cookie, expected, len) == 0;
+}
+
+static int udpSocket(uint16_t port, bool nonBlocking) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) return -1;
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  if (nonBlocking) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+// Plain HTTP/1.0 to the backend; returns the status, or 502 if unreachable
+static int httpForward(const Backend& backend, const char* method, const std::string& target,
+                       const uint8_t* payload, size_t payloadLength, std::string& body) {
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* res = nullptr;
+  if (getaddrinfo(backend.host.c_str(), backend.port.c_str(), &hints, &res) != 0) return 502;
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  timeval timeout = { BACKEND_TIMEOUT_SECONDS, 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  bool connected = fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) == 0;
+  freeaddrinfo(res);
+  if (!connected) {
+    if (fd >= 0) close(fd);
+    return 502;
+  }
+
+  std::string request = std::string(method) + " " + target + " HTTP/1.0\r\n" +
+                        "Host: " + backend.host + "\r\n" +
+                        "Content-Type: application/json\r\n" +
+                        "Content-Length: " + std::to_string(payloadLength) + "\r\n\r\n";
+  request.append((const char*)payload, payloadLength);
+
+  std::string reply;
+  bool sent = send(fd, request.data(), request.size(), 0) == (ssize_t)request.size();
+  char buf[4096];
+  ssize_t n;
+  while (sent && (n = recv(fd, buf, sizeof(buf), 0)) > 0) reply.append(buf, n);
+  close(fd);
+
+  int status = 0;
+  size_t headerEnd = reply.find("\r\n\r\n");
+  if (headerEnd == std::string::npos || sscanf(reply.c_str(), "HTTP/%*s %d", &status) != 1) return 502;
+  body = reply.substr(headerEnd + 4);
+  return status;
+}
+
+// Answer one request: forwarded, or locally when there is no backend
+static uint8_t handleRequest(const Backend* backend, const std::string& identity, const CoapMessage& msg, std::string& body) {
+  const Route* route = nullptr;
+  for (const Route& r : routes) {
+    if (r.method == msg.code && strcmp(r.path, msg.path) == 0) route = &r;
+  }
+  if (!route) return COAP_NOT_FOUND;
+
+  if (!backend) {
+    if (msg.code == COAP_GET) {
+      body = "{\"r\":false,\"m\":\"dashboard\",\"v\":1,\"n\":30,\"i\":0,\"t\":0,\"vv\":[1,1,1,1,1,1]}";
+    }
+    return coapFromHttpStatus(200, msg.code);
+  }
+
+  std::string target = "/api/device/" + identity + "/" + msg.path;
+  if (msg.query[0]) target += std::string("?") + msg.query;
+  int status = httpForward(*backend, msg.code == COAP_GET ? "GET" : "POST", target, msg.payload, msg.payloadLength, body);
+  return coapFromHttpStatus(status, msg.code);
+}
+
+// Read and answer what arrived on an association; false when it's gone
+static bool serveClient(const Backend* backend, Client& client) {
+  uint8_t in[DATAGRAM_BYTES];
+  int n = SSL_read(client.ssl, in, sizeof(in));
+  if (n <= 0) {
+    int err = SSL_get_error(client.ssl, n);
+    return err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE;
+  }
+  client.lastUsed = time(nullptr);
+
+  CoapMessage msg;
+  if (!coapParse(in, n, msg) || msg.type == COAP_ACK || msg.type == COAP_RST) return true;
+
+  uint8_t out[DATAGRAM_BYTES];
+  CoapWriter writer(out, sizeof(out));
+
+  if (msg.code == COAP_EMPTY) {
+    // CoAP ping: answered with a reset
+    writer.header(COAP_RST, COAP_EMPTY, msg.messageId, nullptr, 0);
+  } else {
+    std::string body;
+    double start = nowMs();
+    uint8_t code = handleRequest(backend, client.identity, msg, body);
+    printf("%s %s %s%s%s -> %d.%02d (%zu bytes, %.1f ms)\n", client.identity.c_str(),
+           msg.code == COAP_GET ? "GET" : "POST", msg.path, msg.query[0] ? "?" : "", msg.query,
+           code >> 5, code & 31, body.size(), nowMs() - start);
+
+    // Piggybacked on the ACK for confirmable requests
+    bool confirmable = msg.type == COAP_CON;
+    writer.header(confirmable ? COAP_ACK : COAP_NON, code, confirmable ? msg.messageId : (uint16_t)rand(),
+                  msg.token, msg.tokenLength);
+    if (!body.empty()) writer.contentFormat(COAP_FORMAT_JSON);
+    writer.payload((const uint8_t*)body.data(), body.size());
+    if (writer.length() == 0) {
+      CoapWriter error(out, sizeof(out));
+      error.header(confirmable ? COAP_ACK : COAP_NON, COAP_INTERNAL_ERROR, msg.messageId, msg.token, msg.tokenLength);
+      writer = error;
+    }
+  }
+
+  return SSL_write(client.ssl, out, (int)writer.length()) > 0;
+}
+
+// One ClientHello on the listening socket. Once its cookie checks out the
+// peer gets its own connected socket on the same port and the handshake
+// runs there.
+static void acceptClient(SSL_CTX* ctx, int listenFd, uint16_t port, std::vector<Client>& clients) {
+  SSL* ssl = SSL_new(ctx);
+  BIO* bio = BIO_new_dgram(listenFd, BIO_NOCLOSE);
+  SSL_set_bio(ssl, bio, bio);
+  SSL_set_options(ssl, SSL_OP_COOKIE_EXCHANGE);
+
+  BIO_ADDR* peer = BIO_ADDR_new();
+  if (DTLSv1_listen(ssl, peer) <= 0) {
+    SSL_free(ssl);
+    BIO_ADDR_free(peer);
+    return;
+  }
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  size_t addrLen = sizeof(addr.sin_addr);
+  BIO_ADDR_rawaddress(peer, &addr.sin_addr, &addrLen);
+  addr.sin_port = BIO_ADDR_rawport(peer);
+
+  int fd = udpSocket(port, false);
+  if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    if (fd >= 0) close(fd);
+    SSL_free(ssl);
+    BIO_ADDR_free(peer);
+    return;
+  }
+  BIO_set_fd(SSL_get_rbio(ssl), fd, BIO_NOCLOSE);
+  BIO_ctrl(SSL_get_rbio(ssl), BIO_CTRL_DGRAM_SET_CONNECTED, 0, peer);
+  BIO_ADDR_free(peer);
+
+  timeval timeout = { 5, 0 };
+  BIO_ctrl(SSL_get_rbio(ssl), BIO_CTRL_DGRAM_SET_RECV_TIMEOUT, 0, &timeout);
+
+  char address[64];
+  snprintf(address, sizeof(address), "%s:%u", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+
+  double start = nowMs();
+  if (SSL_accept(ssl) <= 0) {
+    fprintf(stderr, "%s: handshake failed\n", address);
+    ERR_clear_error();
+    SSL_free(ssl);
+    close(fd);
+    return;
+  }
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  Client client = { fd, ssl, SSL_get_psk_identity(ssl) ? SSL_get_psk_identity(ssl) : "", address, time(nullptr) };
+  printf("%s: %s %s (%s, %.1f ms)\n", address, client.identity.c_str(),
+         SSL_session_reused(ssl) ? "resumed" : "connected", SSL_get_cipher_name(ssl), nowMs() - start);
+  clients.push_back(client);
+}
+
+static void dropClient(Client& client, const char* why) {
+  printf("%s: %s %s\n", client.address.c_str(), client.identity.c_str(), why);
+  SSL_shutdown(client.ssl);
+  SSL_free(client.ssl);
+  close(client.fd);
+}
+
+static int serve(uint16_t port, const Backend* backend) {
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  RAND_bytes(cookieSecret, sizeof(cookieSecret));
+
+  SSL_CTX* ctx = SSL_CTX_new(DTLS_server_method());
+  SSL_CTX_set_min_proto_version(ctx, DTLS1_2_VERSION);
+  if (!SSL_CTX_set_cipher_list(ctx, CIPHERS)) {
+    printErrors("cipher list");
+    return 1;
+  }
+  SSL_CTX_set_psk_server_callback(ctx, pskServer);
+  SSL_CTX_set_cookie_generate_cb(ctx, generateCookie);
+  SSL_CTX_set_cookie_verify_cb(ctx, verifyCookie);
+  // Session-id resumption from the server cache (the firmware keeps the
+  // session and offers its id); no tickets
+  SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+  SSL_CTX_set_session_id_context(ctx, (const unsigned char*)"inkframe", 8);
+  SSL_CTX_set_timeout(ctx, 24 * 3600);
+
+  int listenFd = udpSocket(port, true);
+  if (listenFd < 0) {
+    perror("bind");
+    return 1;
+  }
+  printf("CoAP gateway on udp/%u, %s\n", port,
+         backend ? ("forwarding to http://" + backend->host + ":" + backend->port).c_str() : "answering polls locally");
+
+  std::vector<Client> clients;
+  for (;;) {
+    std::vector<pollfd> fds(1 + clients.size());
+    fds[0] = { listenFd, POLLIN, 0 };
+    for (size_t i = 0; i < clients.size(); i++) fds[i + 1] = { clients[i].fd, POLLIN, 0 };
+    if (poll(fds.data(), fds.size(), 1000) < 0) continue;
+
+    time_t now = time(nullptr);
+    for (size_t i = clients.size(); i-- > 0;) {
+      bool alive = true;
+      if (fds[i + 1].revents & POLLIN) alive = serveClient(backend, clients[i]);
+      if (!alive || now - clients[i].lastUsed > IDLE_SECONDS) {
+        dropClient(clients[i], alive ? "idle" : "closed");
+        clients.erase(clients.begin() + i);
+      }
+    }
+    if (fds[0].revents & POLLIN) acceptClient(ctx, listenFd, port, clients);
+  }
+}
+
+// ============================================================
+// DEVICE
+// ============================================================
+
+static std::string deviceIdentity;
+
+static unsigned int pskClient(SSL*, const char*, char* identity, unsigned int maxIdentityLen,
+                              unsigned char* psk, unsigned int maxPskLen) {
+  if (deviceIdentity.size() + 1 > maxIdentityLen || maxPskLen < PSK_BYTES) return 0;
+  memcpy(identity, deviceIdentity.c_str(), deviceIdentity.size() + 1);
+  return derivePsk(identity, psk) ? PSK_BYTES : 0;
+}
+
+struct Association {
+  SSL* ssl = nullptr;
+  BIO* bio = nullptr;
+};
+
+static bool associate(SSL_CTX* ctx, const sockaddr_in& server, SSL_SESSION* session, Association& a, const char* label) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0 || connect(fd, (const sockaddr*)&server, sizeof(server)) < 0) return false;
+
+  a.ssl = SSL_new(ctx);
+  a.bio = BIO_new_dgram(fd, BIO_CLOSE);
+  BIO_ctrl(a.bio, BIO_CTRL_DGRAM_SET_CONNECTED, 0, (void*)&server);
+  SSL_set_bio(a.ssl, a.bio, a.bio);
+  if (session) SSL_set_session(a.ssl, session);
+
+  // Non-blocking, so a gateway that rejects the key can't keep us in
+  // DTLS retransmissions
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  double start = nowMs();
+  int ret;
+  while ((ret = SSL_connect(a.ssl)) <= 0) {
+    int err = SSL_get_error(a.ssl, ret);
+    if ((err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) || nowMs() - start > HANDSHAKE_TIMEOUT_MS) {
+      fprintf(stderr, "%s: failed (wrong key, or no gateway)\n", label);
+      ERR_print_errors_fp(stderr);
+      return false;
+    }
+    timeval wait = { 0, 50000 };
+    DTLSv1_get_timeout(a.ssl, &wait);
+    int waitMs = (int)(wait.tv_sec * 1000 + wait.tv_usec / 1000) + 1;
+    pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, waitMs < 500 ? waitMs : 500) == 0) DTLSv1_handle_timeout(a.ssl);
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+  printf("%-22s %7.1f ms  %5lu bytes out  %5lu bytes in  (%s%s)\n", label, nowMs() - start,
+         (unsigned long)BIO_number_written(a.bio), (unsigned long)BIO_number_read(a.bio),
+         SSL_get_cipher_name(a.ssl), SSL_session_reused(a.ssl) ? ", resumed" : "");
+  return true;
+}
+
+static bool request(Association& a, uint16_t messageId, const char* query, const char* label) {
+  uint8_t out[DATAGRAM_BYTES];
+  uint8_t token[4];
+  RAND_bytes(token, sizeof(token));
+  CoapWriter writer(out, sizeof(out));
+  writer.header(COAP_CON, COAP_GET, messageId, token, sizeof(token));
+  writer.uriPath("poll");
+  writer.uriQuery(query);
+
+  unsigned long writtenBefore = BIO_number_written(a.bio);
+  unsigned long readBefore = BIO_number_read(a.bio);
+  double start = nowMs();
+  timeval timeout = { COAP_ACK_TIMEOUT_MS / 1000, 0 };
+  BIO_ctrl(a.bio, BIO_CTRL_DGRAM_SET_RECV_TIMEOUT, 0, &timeout);
+
+  for (int attempt = 0; attempt <= COAP_MAX_RETRANSMIT; attempt++) {
+    if (SSL_write(a.ssl, out, (int)writer.length()) <= 0) return false;
+    uint8_t in[DATAGRAM_BYTES];
+    int n = SSL_read(a.ssl, in, sizeof(in));
+    if (n <= 0) continue;
+
+    CoapMessage msg;
+    if (!coapParse(in, n, msg) || msg.messageId != messageId || memcmp(msg.token, token, sizeof(token)) != 0) continue;
+    printf("%-22s %7.1f ms  %5lu bytes out  %5lu bytes in  (%d.%02d, %zu byte payload)\n", label, nowMs() - start,
+           BIO_number_written(a.bio) - writtenBefore, BIO_number_read(a.bio) - readBefore,
+           msg.code >> 5, msg.code & 31, msg.payloadLength);
+    return true;
+  }
+  fprintf(stderr, "%s: no response\n", label);
+  return false;
+}
+
+static int device(const char* host, const char* port, int polls) {
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo* res = nullptr;
+  if (getaddrinfo(host, port, &hints, &res) != 0) {
+    fprintf(stderr, "can't resolve %s\n", host);
+    return 1;
+  }
+  sockaddr_in server;
+  memcpy(&server, res->ai_addr, sizeof(server));
+  freeaddrinfo(res);
+
+  SSL_CTX* ctx = SSL_CTX_new(DTLS_client_method());
+  SSL_CTX_set_min_proto_version(ctx, DTLS1_2_VERSION);
+  SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+  if (!SSL_CTX_set_cipher_list(ctx, CIPHERS)) {
+    printErrors("cipher list");
+    return 1;
+  }
+  SSL_CTX_set_psk_client_callback(ctx, pskClient);
+
+  const char* query = "v=1&vv=1,1,1,1,1,1&m=dashboard&i=0";
+  uint16_t messageId = (uint16_t)rand();
+  char label[32];
+
+  Association first;
+  if (!associate(ctx, server, nullptr, first, "full handshake")) return 1;
+  for (int i = 0; i < polls; i++) {
+    snprintf(label, sizeof(label), "poll %d", i + 1);
+    if (!request(first, ++messageId, query, label)) return 1;
+  }
+  SSL_SESSION* session = SSL_get1_session(first.ssl);
+  SSL_shutdown(first.ssl);
+  SSL_free(first.ssl);
+
+  // As after a NAT rebinding or a reboot with the session kept
+  Association second;
+  if (!associate(ctx, server, session, second, "resumed handshake")) return 1;
+  bool resumed = SSL_session_reused(second.ssl);
+  if (!request(second, ++messageId, query, "poll after resume")) return 1;
+  SSL_shutdown(second.ssl);
+  SSL_free(second.ssl);
+  SSL_SESSION_free(session);
+  SSL_CTX_free(ctx);
+
+  if (!resumed) {
+    fprintf(stderr, "session was not resumed\n");
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  pskSecret = getenv("COAP_PSK_SECRET");
+  if (!pskSecret || !pskSecret[0] || argc < 2) {
+    fprintf(stderr, "usage: COAP_PSK_SECRET=... %s serve [port] [backend-host:port]\n"
+                    "       COAP_PSK_SECRET=... %s poll <host> <port> <device-id> [polls]\n", argv[0], argv[0]);
+    return 1;
+  }
+  srand((unsigned)time(nullptr));
+
+  if (strcmp(argv[1], "serve") == 0) {
+    uint16_t port = argc > 2 ? (uint16_t)atoi(argv[2]) : COAP_DEFAULT_PORT;
+    if (argc > 3) {
+      std::string target = argv[3];
+      size_t colon = target.rfind(':');
+      Backend backend = { target.substr(0, colon), colon == std::string::npos ? "80" : target.substr(colon + 1) };
+      return serve(port, &backend);
+    }
+    return serve(port, nullptr);
+  }
+
+  if (strcmp(argv[1], "poll") == 0 && argc >= 5) {
+    deviceIdentity = argv[4];
+    return device(argv[2], argv[3], argc > 5 ? atoi(argv[5]) : 3);
+  }
+
+  fprintf(stderr, "unknown command %s\n", argv[1]);
+  return 1;
+}
@@ -0,0 +1,130 @@
+/**
+ * Host benchmark for the BilevelCodec decoders
+ *
+ * Decodes every frame in the corpus (see backend/scripts/build-codec-corpus.js)
+ * with every codec, checks the result against the raw frame and reports
+ * compression ratio, decode throughput and decoder working memory.
+ *
+ * Usage: codec_bench [corpus-dir] [iterations]
+ */
+
+#include <BilevelCodec.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct CompareSink {
+  const std::vector<uint8_t>* expected;
+  size_t rowBytes;
+  bool match;
+};
+
+static bool compareRow(void* ctx, int y, const uint8_t* row, size_t rowBytes) {
+  CompareSink* sink = static_cast<CompareSink*>(ctx);
+  if (memcmp(sink->expected->data() + (size_t)y * rowBytes, row, rowBytes) != 0) sink->match = false;
+  return true;
+}
+
+static bool discardRow(void*, int, const uint8_t*, size_t) {
+  return true;
+}
+
+static bool readFile(const std::string& path, std::vector<uint8_t>& out) {
+  std::ifstream file(path.c_str(), std::ios::binary);
+  if (!file) return false;
+  out.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return true;
+}
+
+struct Totals {
+  size_t raw = 0;
+  size_t encoded = 0;
+  double seconds = 0;
+  size_t workBytes = 0;
+  int failures = 0;
+};
+
+int main(int argc, char** argv) {
+  std::string dir = argc > 1 ? argv[1] : "corpus";
+  int iterations = argc > 2 ? atoi(argv[2]) : 200;
+
+  std::ifstream index((dir + "/index.txt").c_str());
+  if (!index) {
+    fprintf(stderr, "No %s/index.txt - run backend/scripts/build-codec-corpus.js first\n", dir.c_str());
+    return 1;
+  }
+
+  std::vector<Totals> totals(codecCount());
+  std::string line;
+
+  printf("%-28s %-11s %8s %8s %7s %9s %7s\n", "frame", "codec", "raw", "encoded", "ratio", "MB/s", "work");
+
+  while (std::getline(index, line)) {
+    std::istringstream fields(line);
+    std::string name;
+    int width, height;
+    if (!(fields >> name >> width >> height)) continue;
+
+    std::vector<uint8_t> raw;
+    if (!readFile(dir + "/" + name + ".bin", raw)) {
+      fprintf(stderr, "%s: missing raw frame\n", name.c_str());
+      return 1;
+    }
+
+    for (size_t c = 0; c < codecCount(); c++) {
+      const BilevelCodec* codec = codecAt(c);
+      std::vector<uint8_t> encoded;
+      if (!readFile(dir + "/" + name + "." + codec->name, encoded)) continue;
+
+      size_t workBytes = codec->workBytes(width);
+      std::vector<uint8_t> work(workBytes);
+
+      // Correctness pass
+      CompareSink check = { &raw, bilevelRowBytes(width), true };
+      MemoryByteSource src(encoded.data(), encoded.size());
+      bool ok = codec->decode(src, width, height, work.data(), compareRow, &check) && check.match;
+
+      // Timing pass
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < iterations; i++) {
+        MemoryByteSource timed(encoded.data(), encoded.size());
+        codec->decode(timed, width, height, work.data(), discardRow, nullptr);
+      }
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      double mbps = (double)raw.size() * iterations / seconds / 1e6;
+      printf("%-28s %-11s %8zu %8zu %6.2fx %9.1f %7zu%s\n", name.c_str(), codec->name, raw.size(), encoded.size(),
+             (double)raw.size() / encoded.size(), mbps, workBytes, ok ? "" : "  MISMATCH");
+
+      Totals& t = totals[c];
+      t.raw += raw.size();
+      t.encoded += encoded.size();
+      t.seconds += seconds / iterations;
+      if (workBytes > t.workBytes) t.workBytes = workBytes;
+      if (!ok) t.failures++;
+    }
+  }
+
+  printf("\n%-11s %8s %8s %7s %9s %7s\n", "codec", "raw", "encoded", "ratio", "MB/s", "work");
+  int failures = 0;
+  for (size_t c = 0; c < codecCount(); c++) {
+    const Totals& t = totals[c];
+    if (t.raw == 0) continue;
+    printf("%-11s %8zu %8zu %6.2fx %9.1f %7zu\n", codecAt(c)->name, t.raw, t.encoded,
+           (double)t.raw / t.encoded, t.raw / t.seconds / 1e6, t.workBytes);
+    failures += t.failures;
+  }
+
+  if (failures) {
+    fprintf(stderr, "%d frame(s) failed to round-trip\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,90 @@
+/**
+ * Host check and benchmark for lib/FontStore
+ *
+ * Loads a font blob (see backend/scripts/build-font-store.js), renders a
+ * line of text to the terminal, then draws it the way the firmware's paged
+ * display does (the same text once per page) with several cache sizes and
+ * reports hit rate, block bytes decoded and time per page.
+ *
+ * Usage: font_bench <font.ifnt> [text] [pages]
+ */
+
+#include <FontStore.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+struct Canvas {
+  int width;
+  int height;
+  std::vector<char> pixels;
+};
+
+static void plot(void* ctx, int x, int y) {
+  Canvas* canvas = static_cast<Canvas*>(ctx);
+  if (x >= 0 && y >= 0 && x < canvas->width && y < canvas->height) canvas->pixels[y * canvas->width + x] = '#';
+}
+
+static void countPixel(void* ctx, int, int) {
+  (*static_cast<long*>(ctx))++;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: font_bench <font.ifnt> [text] [pages]\n");
+    return 1;
+  }
+  std::string text = argc > 2 ? argv[2] : "Zażółć gęślą jaźń - ŻÓŁW, 21°C";
+  int pages = argc > 3 ? atoi(argv[3]) : 10;
+
+  std::ifstream file(argv[1], std::ios::binary);
+  if (!file) {
+    fprintf(stderr, "Can't read %s\n", argv[1]);
+    return 1;
+  }
+  std::vector<uint8_t> blob((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  MemoryFontSource source(blob.data(), blob.size());
+
+  // What the text looks like
+  std::vector<uint8_t> work(FontStore::workBytes(16));
+  FontStore font;
+  if (!font.begin(source, work.data(), 16)) {
+    fprintf(stderr, "%s is not a font blob\n", argv[1]);
+    return 1;
+  }
+  printf("%s: %zu bytes, %d glyphs, ascent %d, descent %d\n\n", argv[1], blob.size(), font.glyphCount(),
+         font.ascent(), font.descent());
+
+  Canvas canvas;
+  canvas.width = font.textWidth(text.c_str()) + 2;
+  canvas.height = font.lineHeight() + 2;
+  canvas.pixels.assign(canvas.width * canvas.height, '.');
+  font.drawText(1, 1 + font.ascent(), text.c_str(), plot, &canvas);
+  for (int y = 0; y < canvas.height; y++) {
+    printf("%.*s\n", canvas.width, &canvas.pixels[y * canvas.width]);
+  }
+
+  printf("\n%-6s %8s %6s %6s %8s %12s %10s\n", "cache", "work", "hits", "misses", "hit %", "decoded B", "us/page");
+  for (int glyphs : {1, 4, 16, 48}) {
+    work.assign(FontStore::workBytes(glyphs), 0);
+    if (!font.begin(source, work.data(), glyphs)) return 1;
+
+    long inked = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int page = 0; page < pages; page++) {
+      font.drawText(0, font.ascent(), text.c_str(), countPixel, &inked);
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    const FontStats& stats = font.stats();
+    uint32_t lookups = stats.hits + stats.misses;
+    printf("%-6d %8zu %6u %6u %7.1f%% %12u %10.1f\n", glyphs, work.size(), stats.hits, stats.misses,
+           lookups ? 100.0 * stats.hits / lookups : 0.0, stats.decodedBytes, us / pages);
+  }
+  return 0;
+}
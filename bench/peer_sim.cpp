@@ -0,0 +1,313 @@
+/**
+ * Multi-instance simulation of lib/PeerShare
+ *
+ * Runs several frames on a simulated LAN (multicast bus with packet loss
+ * and latency) against a simulated cloud. Every round the content changes
+ * and each frame needs the new frame at a slightly different time, like
+ * devices polling on their own schedules. Peers ask the group first and
+ * fall back to the cloud when nobody answers. Halfway through, the leader
+ * drops off the network to exercise re-election. An intruder on the same
+ * LAN, without the group key, keeps claiming leadership and pushing its
+ * own frame for every key; no device may take it.
+ *
+ * Reports cloud downloads per round (the goal is one per site, not one per
+ * device), LAN datagrams, and checks that every device ends up with the
+ * exact frame for the round.
+ *
+ * Usage: peer_sim [devices] [rounds] [loss-percent] [frame-bytes]
+ */
+
+#include <PeerShare.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#define TICK_MS 10
+#define LATENCY_MS 2
+#define PEER_WAIT_MS 8000
+#define CLOUD_MS 1500        // poll + download time of a cloud fetch
+#define INTRUDER_MS 100      // how often the intruder sends
+#define INTRUDER_ID 0x1      // lower than any device, so it would lead
+
+static uint32_t rngState = 12345;
+
+static uint32_t rng() {
+  rngState = rngState * 1103515245UL + 12345UL;
+  return rngState >> 8;
+}
+
+static uint8_t contentByte(uint32_t key, size_t i) {
+  return (uint8_t)((key * 2654435761UL) >> ((i % 4) * 8)) ^ (uint8_t)(i * 31);
+}
+
+struct Datagram {
+  uint32_t deliverMs;
+  int from;
+  std::vector<uint8_t> data;
+};
+
+// Multicast bus: every datagram reaches every other online node, unless lost
+struct Bus {
+  std::deque<Datagram> queue;
+  int lossPercent;
+  uint32_t datagrams = 0;
+  uint32_t bytes = 0;
+};
+
+class SimStore : public PeerFrameStore {
+public:
+  explicit SimStore(size_t size) : frame(size, 0) {}
+  void read(size_t offset, uint8_t* dst, size_t len) override { memcpy(dst, frame.data() + offset, len); }
+  void write(size_t offset, const uint8_t* src, size_t len) override { memcpy(frame.data() + offset, src, len); }
+  std::vector<uint8_t> frame;
+};
+
+class SimTransport : public PeerTransport {
+public:
+  SimTransport(Bus& bus, int node, const uint32_t& now) : bus_(bus), node_(node), now_(now) {}
+  bool send(const uint8_t* data, size_t len) override {
+    Datagram d;
+    d.deliverMs = now_ + LATENCY_MS;
+    d.from = node_;
+    d.data.assign(data, data + len);
+    bus_.queue.push_back(d);
+    bus_.datagrams++;
+    bus_.bytes += len;
+    return true;
+  }
+
+private:
+  Bus& bus_;
+  int node_;
+  const uint32_t& now_;
+};
+
+static void put32(uint8_t* p, uint32_t v) {
+  p[0] = (uint8_t)(v >> 24);
+  p[1] = (uint8_t)(v >> 16);
+  p[2] = (uint8_t)(v >> 8);
+  p[3] = (uint8_t)v;
+}
+
+// A well-formed datagram from the intruder; it can't compute the tag, so
+// it sends random bytes in its place
+static std::vector<uint8_t> forged(uint8_t type, uint32_t group, const uint8_t* body, size_t len) {
+  std::vector<uint8_t> packet(PEER_HEADER_BYTES + len + PEER_TAG_BYTES);
+  memcpy(packet.data(), "IFP", 3);
+  packet[3] = PEER_VERSION;
+  packet[4] = type;
+  put32(&packet[5], group);
+  put32(&packet[9], INTRUDER_ID);
+  if (len) memcpy(&packet[PEER_HEADER_BYTES], body, len);
+  for (size_t i = PEER_HEADER_BYTES + len; i < packet.size(); i++) packet[i] = (uint8_t)rng();
+  return packet;
+}
+
+// HELLO, then every chunk of a junk frame for key, with a hash that
+// matches the junk
+static void intrude(Bus& bus, uint32_t group, uint32_t key, size_t frameBytes, uint32_t now) {
+  std::vector<uint8_t> junk(frameBytes);
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < frameBytes; i++) {
+    junk[i] = (uint8_t)~contentByte(key, i);
+    hash = (hash ^ junk[i]) * 16777619UL;
+  }
+  if (!hash) hash = 1;
+
+  std::vector<std::vector<uint8_t>> packets;
+  packets.push_back(forged(1, group, nullptr, 0));
+  for (size_t offset = 0, index = 0; offset < frameBytes; offset += PEER_CHUNK_BYTES, index++) {
+    size_t len = frameBytes - offset < PEER_CHUNK_BYTES ? frameBytes - offset : PEER_CHUNK_BYTES;
+    std::vector<uint8_t> body(13 + len);
+    put32(&body[0], key);
+    put32(&body[4], hash);
+    put32(&body[8], (uint32_t)frameBytes);
+    body[12] = (uint8_t)index;
+    memcpy(&body[13], &junk[offset], len);
+    packets.push_back(forged(3, group, body.data(), body.size()));
+  }
+
+  for (std::vector<uint8_t>& data : packets) {
+    Datagram d;
+    d.deliverMs = now + LATENCY_MS;
+    d.from = -1;
+    d.data.swap(data);
+    bus.queue.push_back(d);
+  }
+}
+
+struct Node {
+  Node(Bus& bus, int index, uint32_t id, size_t frameBytes, const uint32_t& now)
+      : store(frameBytes), transport(bus, index, now), peer(transport, store, id) {}
+
+  SimStore store;
+  SimTransport transport;
+  PeerShare peer;
+  bool online = true;
+
+  uint32_t shownKey = 0;
+  uint32_t needKey = 0;       // content the next poll will ask for
+  uint32_t needAtMs = 0;      // when this device polls
+  uint32_t cloudDoneMs = 0;   // cloud fetch in flight until then
+  uint32_t cloudKey = 0;
+  int cloudFetches = 0;
+  int peerFetches = 0;
+};
+
+int main(int argc, char** argv) {
+  int devices = argc > 1 ? atoi(argv[1]) : 6;
+  int rounds = argc > 2 ? atoi(argv[2]) : 20;
+  int loss = argc > 3 ? atoi(argv[3]) : 5;
+  size_t frameBytes = argc > 4 ? (size_t)atoi(argv[4]) : 5000;
+
+  if (devices < 1 || devices > PEER_MAX_PEERS + 1 || frameBytes == 0 || frameBytes > PEER_MAX_FRAME_BYTES) {
+    fprintf(stderr, "devices must be 1..%d and frame-bytes 1..%d\n", PEER_MAX_PEERS + 1, PEER_MAX_FRAME_BYTES);
+    return 1;
+  }
+
+  uint32_t now = 0;
+  Bus bus;
+  bus.lossPercent = loss;
+
+  const uint32_t group = 0xC0FFEE;
+  uint8_t groupKey[PEER_KEY_BYTES];
+  for (int i = 0; i < PEER_KEY_BYTES; i++) groupKey[i] = (uint8_t)rng();
+
+  std::vector<Node*> nodes;
+  for (int i = 0; i < devices; i++) {
+    nodes.push_back(new Node(bus, i, 0x1000 + rng() % 0xFFFF, frameBytes, now));
+    nodes[i]->peer.setGroup(group, groupKey, now);
+  }
+
+  // Let membership settle before the first round
+  uint32_t settleUntil = PEER_EXPIRE_MS;
+  int totalCloud = 0;
+  int failures = 0;
+
+  printf("%-6s %-10s %6s %6s %9s %10s\n", "round", "leader", "cloud", "peer", "datagrams", "verified");
+
+  for (int round = 0; round < rounds; round++) {
+    uint32_t key = 0xA000 + round;
+
+    // Halfway through, the leader disappears
+    if (round == rounds / 2 && devices > 1) {
+      for (Node* n : nodes) {
+        if (n->online && n->peer.isLeader(now)) {
+          n->online = false;
+          printf("-- leader %08x goes offline\n", (unsigned)n->peer.leader(now));
+          break;
+        }
+      }
+    }
+
+    uint32_t roundStart = now > settleUntil ? now : settleUntil;
+    for (Node* n : nodes) {
+      n->needKey = key;
+      n->needAtMs = roundStart + rng() % 3000;  // devices poll on their own schedules
+    }
+
+    uint32_t datagramsBefore = bus.datagrams;
+    int cloudBefore = 0, peerBefore = 0;
+    for (Node* n : nodes) {
+      cloudBefore += n->cloudFetches;
+      peerBefore += n->peerFetches;
+    }
+
+    uint32_t roundEnd = roundStart + 3000 + PEER_WAIT_MS + 2 * CLOUD_MS;
+    for (; now < roundEnd; now += TICK_MS) {
+      if (now % INTRUDER_MS == 0) intrude(bus, group, key, frameBytes, now);
+
+      // Deliver datagrams that are due
+      while (!bus.queue.empty() && bus.queue.front().deliverMs <= now) {
+        Datagram d = bus.queue.front();
+        bus.queue.pop_front();
+        if (d.from >= 0 && !nodes[d.from]->online) continue;
+        for (size_t i = 0; i < nodes.size(); i++) {
+          if ((int)i == d.from || !nodes[i]->online) continue;
+          if ((int)(rng() % 100) < bus.lossPercent) continue;
+          nodes[i]->peer.onPacket(d.data.data(), d.data.size(), now);
+        }
+      }
+
+      for (Node* n : nodes) {
+        if (!n->online) continue;
+        PeerShare& p = n->peer;
+
+        // A cloud download finished: show it and serve it if leading
+        if (n->cloudKey && now >= n->cloudDoneMs) {
+          for (size_t i = 0; i < frameBytes; i++) n->store.frame[i] = contentByte(n->cloudKey, i);
+          n->shownKey = n->cloudKey;
+          n->cloudKey = 0;
+          n->cloudFetches++;
+          if (p.isLeader(now)) p.publish(n->shownKey, frameBytes);
+        }
+
+        // The group delivered a verified frame
+        if (p.fetchState() == PEER_COMPLETE) {
+          n->shownKey = p.fetchKey();
+          n->peerFetches++;
+          p.resetFetch();
+        }
+
+        // A peer asked the leader for something it doesn't have: poll now
+        if (p.requestedKey() && !n->cloudKey) {
+          if (p.requestedKey() == n->needKey && n->shownKey != n->needKey) n->needAtMs = now;
+          p.clearRequest();
+        }
+
+        // This device's poll says it needs the new frame
+        if (n->shownKey != n->needKey && !n->cloudKey && p.fetchState() != PEER_RECEIVING && now >= n->needAtMs) {
+          if (p.isLeader(now) || p.fetchState() == PEER_FAILED) {
+            p.resetFetch();
+            n->cloudKey = n->needKey;
+            n->cloudDoneMs = now + CLOUD_MS;
+          } else {
+            p.request(n->needKey, now, PEER_WAIT_MS);
+          }
+        }
+
+        p.poll(now);
+      }
+    }
+
+    int cloud = -cloudBefore, peer = -peerBefore, verified = 0, online = 0;
+    uint32_t leader = 0;
+    for (Node* n : nodes) {
+      cloud += n->cloudFetches;
+      peer += n->peerFetches;
+      if (!n->online) continue;
+      online++;
+      if (!leader) leader = n->peer.leader(now);
+      bool ok = n->shownKey == key;
+      for (size_t i = 0; ok && i < frameBytes; i++) ok = n->store.frame[i] == contentByte(key, i);
+      if (ok) verified++;
+    }
+    if (verified != online) failures++;
+    totalCloud += cloud;
+
+    printf("%-6d %08x   %6d %6d %9u %7d/%d\n", round, (unsigned)leader, cloud, peer,
+           (unsigned)(bus.datagrams - datagramsBefore), verified, online);
+  }
+
+  uint32_t hashFailures = 0;
+  uint32_t authFailures = 0;
+  for (Node* n : nodes) {
+    hashFailures += n->peer.stats().hashFailures;
+    authFailures += n->peer.stats().authFailures;
+  }
+
+  printf("\n%d devices, %d rounds, %d%% loss: %d cloud downloads (%.2f per round), %u datagrams, %u KB on the LAN, %u hash failures, %u forged datagrams dropped\n",
+         devices, rounds, loss, totalCloud, (double)totalCloud / rounds, (unsigned)bus.datagrams,
+         (unsigned)(bus.bytes / 1024), (unsigned)hashFailures, (unsigned)authFailures);
+
+  for (Node* n : nodes) delete n;
+
+  if (failures) {
+    fprintf(stderr, "%d round(s) left a device without the right frame\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,31 @@
+# PlatformIO pre-action for the filesystem image (pio run -t buildfs /
+# uploadfs): rebuilds data/fonts/<name>.ifnt from fonts/<name>.bdf with
+# backend/scripts/build-font-store.js whenever the BDF source is newer.
+# A missing source is not an error: the device then draws its local
+# screens in English with the built-in font. See fonts/README.md.
+import os
+import subprocess
+
+Import("env")
+
+FONTS = ("title", "text")  # FONT_TITLE_PATH / FONT_TEXT_PATH in src/main.cpp
+
+
+def build_fonts(source, target, env):
+    project = env.subst("$PROJECT_DIR")
+    script = os.path.join(project, "backend", "scripts", "build-font-store.js")
+
+    for name in FONTS:
+        bdf = os.path.join(project, "fonts", name + ".bdf")
+        ifnt = os.path.join(project, "data", "fonts", name + ".ifnt")
+        if not os.path.exists(bdf):
+            print("Fonts: no %s, local screens fall back to English" % os.path.relpath(bdf, project))
+            continue
+        if os.path.exists(ifnt) and os.path.getmtime(ifnt) >= os.path.getmtime(bdf):
+            continue
+
+        if subprocess.call(["node", script, "--out", ifnt, bdf]) != 0:
+            env.Exit(1)
+
+
+env.AddPreAction("$BUILD_DIR/${ESP32_FS_IMAGE_NAME}.bin", build_fonts)
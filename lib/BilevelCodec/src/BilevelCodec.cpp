@@ -0,0 +1,38 @@
+/**
+ * Codec registry
+ */
+
+#include "BilevelCodec.h"
+
+#include <string.h>
+
+size_t MemoryByteSource::read(uint8_t* dst, size_t len) {
+  size_t n = len_ - pos_;
+  if (n > len) n = len;
+  memcpy(dst, data_ + pos_, n);
+  pos_ += n;
+  return n;
+}
+
+// Order here is the order advertised in the device capability descriptor
+static const BilevelCodec* const registry[] = {
+  &codecRle,
+  &codecG4,
+  &codecLz4,
+  &codecHeatshrink,
+};
+
+size_t codecCount() {
+  return sizeof(registry) / sizeof(registry[0]);
+}
+
+const BilevelCodec* codecAt(size_t index) {
+  return index < codecCount() ? registry[index] : nullptr;
+}
+
+const BilevelCodec* codecByName(const char* name) {
+  for (size_t i = 0; i < codecCount(); i++) {
+    if (strcmp(registry[i]->name, name) == 0) return registry[i];
+  }
+  return nullptr;
+}
@@ -0,0 +1,78 @@
+/**
+ * BilevelCodec - streaming decoders for 1-bit frames
+ *
+ * Frames are packed 1-bit rows, MSB first, 1 = white (the same layout the
+ * server sends on /bitmap). Every codec decodes from a ByteSource and hands
+ * out one finished row at a time through a RowSink, so callers can write
+ * straight into the frame buffer, a file or the panel without holding the
+ * compressed payload in RAM.
+ *
+ * No Arduino dependencies: the same sources build for the ESP32 firmware
+ * and for the native benchmark in bench/.
+ *
+ * Adding a codec: implement decode/workBytes in its own file, declare it
+ * below and list it in the registry in BilevelCodec.cpp. The server-side
+ * encoder lives in backend/modules/bilevel-codecs.js under the same name.
+ */
+
+#ifndef BILEVEL_CODEC_H
+#define BILEVEL_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compressed input. read() returns the number of bytes copied into dst,
+// 0 at end of input or on error.
+class ByteSource {
+public:
+  virtual ~ByteSource() {}
+  virtual size_t read(uint8_t* dst, size_t len) = 0;
+};
+
+// ByteSource over a buffer already in memory
+class MemoryByteSource : public ByteSource {
+public:
+  MemoryByteSource(const uint8_t* data, size_t len) : data_(data), len_(len), pos_(0) {}
+  size_t read(uint8_t* dst, size_t len) override;
+
+private:
+  const uint8_t* data_;
+  size_t len_;
+  size_t pos_;
+};
+
+// Receives decoded rows in order (y = 0..height-1). Return false to abort.
+typedef bool (*RowSink)(void* ctx, int y, const uint8_t* row, size_t rowBytes);
+
+struct BilevelCodec {
+  const char* name;   // wire name, matches X-Frame-Codec
+  uint8_t id;
+
+  // Scratch memory decode() needs for frames of this width
+  size_t (*workBytes)(int width);
+
+  // Decode one width x height frame. work must hold workBytes(width) bytes.
+  bool (*decode)(ByteSource& in, int width, int height, uint8_t* work, RowSink sink, void* ctx);
+};
+
+extern const BilevelCodec codecRle;
+extern const BilevelCodec codecG4;
+extern const BilevelCodec codecLz4;
+extern const BilevelCodec codecHeatshrink;
+
+// LZ4 frames are encoded with back-references limited to this window
+#define LZ4_WINDOW_BYTES 2048
+
+// heatshrink parameters (window 2^8 bytes, lookahead 2^4 bytes)
+#define HEATSHRINK_WINDOW_BITS 8
+#define HEATSHRINK_LOOKAHEAD_BITS 4
+
+size_t codecCount();
+const BilevelCodec* codecAt(size_t index);
+const BilevelCodec* codecByName(const char* name);
+
+inline size_t bilevelRowBytes(int width) {
+  return (size_t)(width + 7) / 8;
+}
+
+#endif
@@ -0,0 +1,237 @@
+/**
+ * CCITT Group 4 codec (ITU-T T.6)
+ *
+ * Two-dimensional coding against the previous row: each changing element
+ * is coded as pass, horizontal (two modified-Huffman run lengths) or
+ * vertical (offset -3..+3 from the reference line). The first row codes
+ * against an imaginary white line. 1 bits are white, as in our frames.
+ *
+ * The decoder keeps the changing elements of the reference and current
+ * rows, so memory is a few bytes per pixel column regardless of height.
+ */
+
+#include "CodecSupport.h"
+
+#include <string.h>
+
+struct G4Code {
+  uint16_t code;
+  uint8_t len;
+  uint16_t run;
+};
+
+// Modified Huffman run-length codes (T.4 tables 2/3 plus extended
+// make-up codes), sorted by length then code for the decoder's search.
+static const G4Code whiteCodes[] = {
+  {0x007,  4,    2}, {0x008,  4,    3}, {0x00B,  4,    4}, {0x00C,  4,    5},
+  {0x00E,  4,    6}, {0x00F,  4,    7}, {0x007,  5,   10}, {0x008,  5,   11},
+  {0x012,  5,  128}, {0x013,  5,    8}, {0x014,  5,    9}, {0x01B,  5,   64},
+  {0x003,  6,   13}, {0x007,  6,    1}, {0x008,  6,   12}, {0x017,  6,  192},
+  {0x018,  6, 1664}, {0x02A,  6,   16}, {0x02B,  6,   17}, {0x034,  6,   14},
+  {0x035,  6,   15}, {0x003,  7,   22}, {0x004,  7,   23}, {0x008,  7,   20},
+  {0x00C,  7,   19}, {0x013,  7,   26}, {0x017,  7,   21}, {0x018,  7,   28},
+  {0x024,  7,   27}, {0x027,  7,   18}, {0x028,  7,   24}, {0x02B,  7,   25},
+  {0x037,  7,  256}, {0x002,  8,   29}, {0x003,  8,   30}, {0x004,  8,   45},
+  {0x005,  8,   46}, {0x00A,  8,   47}, {0x00B,  8,   48}, {0x012,  8,   33},
+  {0x013,  8,   34}, {0x014,  8,   35}, {0x015,  8,   36}, {0x016,  8,   37},
+  {0x017,  8,   38}, {0x01A,  8,   31}, {0x01B,  8,   32}, {0x024,  8,   53},
+  {0x025,  8,   54}, {0x028,  8,   39}, {0x029,  8,   40}, {0x02A,  8,   41},
+  {0x02B,  8,   42}, {0x02C,  8,   43}, {0x02D,  8,   44}, {0x032,  8,   61},
+  {0x033,  8,   62}, {0x034,  8,   63}, {0x035,  8,    0}, {0x036,  8,  320},
+  {0x037,  8,  384}, {0x04A,  8,   59}, {0x04B,  8,   60}, {0x052,  8,   49},
+  {0x053,  8,   50}, {0x054,  8,   51}, {0x055,  8,   52}, {0x058,  8,   55},
+  {0x059,  8,   56}, {0x05A,  8,   57}, {0x05B,  8,   58}, {0x064,  8,  448},
+  {0x065,  8,  512}, {0x067,  8,  640}, {0x068,  8,  576}, {0x098,  9, 1472},
+  {0x099,  9, 1536}, {0x09A,  9, 1600}, {0x09B,  9, 1728}, {0x0CC,  9,  704},
+  {0x0CD,  9,  768}, {0x0D2,  9,  832}, {0x0D3,  9,  896}, {0x0D4,  9,  960},
+  {0x0D5,  9, 1024}, {0x0D6,  9, 1088}, {0x0D7,  9, 1152}, {0x0D8,  9, 1216},
+  {0x0D9,  9, 1280}, {0x0DA,  9, 1344}, {0x0DB,  9, 1408}, {0x008, 11, 1792},
+  {0x00C, 11, 1856}, {0x00D, 11, 1920}, {0x012, 12, 1984}, {0x013, 12, 2048},
+  {0x014, 12, 2112}, {0x015, 12, 2176}, {0x016, 12, 2240}, {0x017, 12, 2304},
+  {0x01C, 12, 2368}, {0x01D, 12, 2432}, {0x01E, 12, 2496}, {0x01F, 12, 2560},
+};
+// first entry of each code length (index = length), white
+static const uint8_t whiteByLength[15] = {0, 0, 0, 0, 0, 6, 12, 21, 33, 75, 91, 91, 94, 104, 104};
+
+static const G4Code blackCodes[] = {
+  {0x002,  2,    3}, {0x003,  2,    2}, {0x002,  3,    1}, {0x003,  3,    4},
+  {0x002,  4,    6}, {0x003,  4,    5}, {0x003,  5,    7}, {0x004,  6,    9},
+  {0x005,  6,    8}, {0x004,  7,   10}, {0x005,  7,   11}, {0x007,  7,   12},
+  {0x004,  8,   13}, {0x007,  8,   14}, {0x018,  9,   15}, {0x008, 10,   18},
+  {0x00F, 10,   64}, {0x017, 10,   16}, {0x018, 10,   17}, {0x037, 10,    0},
+  {0x008, 11, 1792}, {0x00C, 11, 1856}, {0x00D, 11, 1920}, {0x017, 11,   24},
+  {0x018, 11,   25}, {0x028, 11,   23}, {0x037, 11,   22}, {0x067, 11,   19},
+  {0x068, 11,   20}, {0x06C, 11,   21}, {0x012, 12, 1984}, {0x013, 12, 2048},
+  {0x014, 12, 2112}, {0x015, 12, 2176}, {0x016, 12, 2240}, {0x017, 12, 2304},
+  {0x01C, 12, 2368}, {0x01D, 12, 2432}, {0x01E, 12, 2496}, {0x01F, 12, 2560},
+  {0x024, 12,   52}, {0x027, 12,   55}, {0x028, 12,   56}, {0x02B, 12,   59},
+  {0x02C, 12,   60}, {0x033, 12,  320}, {0x034, 12,  384}, {0x035, 12,  448},
+  {0x037, 12,   53}, {0x038, 12,   54}, {0x052, 12,   50}, {0x053, 12,   51},
+  {0x054, 12,   44}, {0x055, 12,   45}, {0x056, 12,   46}, {0x057, 12,   47},
+  {0x058, 12,   57}, {0x059, 12,   58}, {0x05A, 12,   61}, {0x05B, 12,  256},
+  {0x064, 12,   48}, {0x065, 12,   49}, {0x066, 12,   62}, {0x067, 12,   63},
+  {0x068, 12,   30}, {0x069, 12,   31}, {0x06A, 12,   32}, {0x06B, 12,   33},
+  {0x06C, 12,   40}, {0x06D, 12,   41}, {0x0C8, 12,  128}, {0x0C9, 12,  192},
+  {0x0CA, 12,   26}, {0x0CB, 12,   27}, {0x0CC, 12,   28}, {0x0CD, 12,   29},
+  {0x0D2, 12,   34}, {0x0D3, 12,   35}, {0x0D4, 12,   36}, {0x0D5, 12,   37},
+  {0x0D6, 12,   38}, {0x0D7, 12,   39}, {0x0DA, 12,   42}, {0x0DB, 12,   43},
+  {0x04A, 13,  640}, {0x04B, 13,  704}, {0x04C, 13,  768}, {0x04D, 13,  832},
+  {0x052, 13, 1280}, {0x053, 13, 1344}, {0x054, 13, 1408}, {0x055, 13, 1472},
+  {0x05A, 13, 1536}, {0x05B, 13, 1600}, {0x064, 13, 1664}, {0x065, 13, 1728},
+  {0x06C, 13,  512}, {0x06D, 13,  576}, {0x072, 13,  896}, {0x073, 13,  960},
+  {0x074, 13, 1024}, {0x075, 13, 1088}, {0x076, 13, 1152}, {0x077, 13, 1216},
+};
+// first entry of each code length (index = length), black
+static const uint8_t blackByLength[15] = {0, 0, 0, 2, 4, 6, 7, 9, 12, 14, 15, 20, 30, 84, 104};
+
+enum G4Mode {
+  G4_PASS,
+  G4_HORIZONTAL,
+  G4_VERTICAL,
+  G4_INVALID
+};
+
+// Room for one change per column plus sentinels
+static size_t g4ChangesLen(int width) {
+  return (size_t)width + 6;
+}
+
+static size_t g4WorkBytes(int width) {
+  size_t rowBytes = (bilevelRowBytes(width) + 1) & ~(size_t)1;  // keep the change lists aligned
+  return rowBytes + 2 * g4ChangesLen(width) * sizeof(uint16_t);
+}
+
+// Read one run-length code word; returns its run, or -1 on bad input
+static int g4ReadCode(BitReader& bits, const G4Code* codes, const uint8_t* byLength) {
+  int code = 0;
+  for (int len = 1; len <= 13; len++) {
+    int b = bits.bit();
+    if (b < 0) return -1;
+    code = (code << 1) | b;
+
+    int lo = byLength[len];
+    int hi = byLength[len + 1] - 1;
+    while (lo <= hi) {
+      int mid = (lo + hi) / 2;
+      if (codes[mid].code == code) return codes[mid].run;
+      if (codes[mid].code < code) lo = mid + 1;
+      else hi = mid - 1;
+    }
+  }
+  return -1;
+}
+
+// Make-up codes followed by a terminating code (< 64)
+static int g4ReadRun(BitReader& bits, int black) {
+  int total = 0;
+  for (;;) {
+    int run = black ? g4ReadCode(bits, blackCodes, blackByLength)
+                    : g4ReadCode(bits, whiteCodes, whiteByLength);
+    if (run < 0) return -1;
+    total += run;
+    if (run < 64) return total;
+  }
+}
+
+// 1 = V0, 011/010 = VR1/VL1, 001 = H, 0001 = P,
+// 000011/000010 = VR2/VL2, 0000011/0000010 = VR3/VL3
+static G4Mode g4ReadMode(BitReader& bits, int* delta) {
+  for (int zeros = 0; zeros < 6; zeros++) {
+    int b = bits.bit();
+    if (b < 0) return G4_INVALID;
+    if (!b) continue;
+
+    if (zeros == 0) {
+      *delta = 0;
+      return G4_VERTICAL;
+    }
+    if (zeros == 2) return G4_HORIZONTAL;
+    if (zeros == 3) return G4_PASS;
+
+    int right = bits.bit();
+    if (right < 0) return G4_INVALID;
+    int distance = (zeros == 1) ? 1 : zeros - 2;  // 01x, 00001x, 000001x
+    *delta = right ? distance : -distance;
+    return G4_VERTICAL;
+  }
+  return G4_INVALID;  // EOL/EOFB or an extension we don't support
+}
+
+static bool g4Decode(ByteSource& src, int width, int height, uint8_t* work, RowSink sink, void* ctx) {
+  size_t rowBytes = bilevelRowBytes(width);
+  size_t changesLen = g4ChangesLen(width);
+  uint8_t* row = work;
+  uint16_t* ref = (uint16_t*)(work + ((rowBytes + 1) & ~(size_t)1));
+  uint16_t* cur = ref + changesLen;
+
+  InputBuffer in(src);
+  BitReader bits(in);
+  RowWriter out(row, width, height, sink, ctx);
+
+  // Imaginary white reference line above the first row
+  for (int i = 0; i < 4; i++) ref[i] = width;
+
+  for (int y = 0; y < height; y++) {
+    int a0 = -1;
+    int color = 0;  // 0 = white, 1 = black
+    size_t n = 0;
+    size_t k = 0;
+
+    while (a0 < width) {
+      // b1: first change on the reference line right of a0 with the
+      // opposite colour to a0 (even entries change to black)
+      while (k > 0 && ref[k - 1] > a0) k--;
+      while (ref[k] <= a0 && ref[k] < width) k++;
+      if ((int)(k & 1) != color) k++;
+      int b1 = ref[k];
+      int b2 = ref[k + 1];
+
+      int delta = 0;
+      G4Mode mode = g4ReadMode(bits, &delta);
+
+      if (mode == G4_PASS) {
+        a0 = b2;
+      } else if (mode == G4_HORIZONTAL) {
+        int run1 = g4ReadRun(bits, color);
+        int run2 = g4ReadRun(bits, !color);
+        if (run1 < 0 || run2 < 0) return false;
+
+        int a1 = (a0 < 0 ? 0 : a0) + run1;
+        int a2 = a1 + run2;
+        if (a2 > width || n + 2 >= changesLen - 4) return false;
+        cur[n++] = a1;
+        cur[n++] = a2;
+        a0 = a2;
+      } else if (mode == G4_VERTICAL) {
+        int a1 = b1 + delta;
+        if (a1 < 0 || a1 > width || a1 < a0 || n + 1 >= changesLen - 4) return false;
+        cur[n++] = a1;
+        a0 = a1;
+        color ^= 1;
+      } else {
+        return false;
+      }
+    }
+
+    for (int i = 0; i < 4; i++) cur[n + i] = width;
+
+    // Paint the row from its changing elements
+    memset(row, 0xFF, rowBytes);
+    for (size_t i = 0; i < n; i += 2) {
+      int end = (i + 1 < n) ? cur[i + 1] : width;
+      for (int x = cur[i]; x < end; x++) {
+        row[x >> 3] &= ~(0x80 >> (x & 7));
+      }
+    }
+
+    if (!out.emitRow()) return false;
+
+    uint16_t* swap = ref;
+    ref = cur;
+    cur = swap;
+  }
+
+  return out.done();
+}
+
+const BilevelCodec codecG4 = { "g4", 2, g4WorkBytes, g4Decode };
@@ -0,0 +1,59 @@
+/**
+ * heatshrink codec (LZSS bitstream, heatshrink-compatible)
+ *
+ * MSB-first bitstream of tagged items: 1 + 8-bit literal, or 0 +
+ * (window bits) offset-1 + (lookahead bits) length-1. The decoder only
+ * needs the 2^HEATSHRINK_WINDOW_BITS byte window, which makes it the
+ * smallest-footprint LZ codec in the registry.
+ */
+
+#include "CodecSupport.h"
+
+#include <string.h>
+
+#define HEATSHRINK_WINDOW_SIZE (1u << HEATSHRINK_WINDOW_BITS)
+
+static size_t heatshrinkWorkBytes(int width) {
+  return HEATSHRINK_WINDOW_SIZE + bilevelRowBytes(width);
+}
+
+static bool heatshrinkDecode(ByteSource& src, int width, int height, uint8_t* work, RowSink sink, void* ctx) {
+  const size_t mask = HEATSHRINK_WINDOW_SIZE - 1;
+  uint8_t* window = work;
+  InputBuffer in(src);
+  BitReader bits(in);
+  RowWriter out(work + HEATSHRINK_WINDOW_SIZE, width, height, sink, ctx);
+  size_t pos = 0;
+
+  // Like heatshrink, back-references before the start read zeros
+  memset(window, 0, HEATSHRINK_WINDOW_SIZE);
+
+  while (!out.done()) {
+    int tag = bits.bit();
+    if (tag < 0) return false;
+
+    if (tag) {
+      int b = bits.bits(8);
+      if (b < 0) return false;
+      window[pos++ & mask] = (uint8_t)b;
+      if (!out.put((uint8_t)b)) return out.done();
+      continue;
+    }
+
+    int index = bits.bits(HEATSHRINK_WINDOW_BITS);
+    int count = bits.bits(HEATSHRINK_LOOKAHEAD_BITS);
+    if (index < 0 || count < 0) return false;
+
+    size_t offset = (size_t)index + 1;
+
+    for (int i = 0; i <= count; i++) {
+      uint8_t b = window[(pos - offset) & mask];
+      window[pos++ & mask] = b;
+      if (!out.put(b)) return out.done();
+    }
+  }
+
+  return true;
+}
+
+const BilevelCodec codecHeatshrink = { "heatshrink", 4, heatshrinkWorkBytes, heatshrinkDecode };
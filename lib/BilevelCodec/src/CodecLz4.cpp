@@ -0,0 +1,75 @@
+/**
+ * LZ4 codec (LZ4 block format)
+ *
+ * Standard LZ4 sequences (token, literals, 16-bit little-endian offset,
+ * match length) over the whole frame. The server limits match offsets to
+ * LZ4_WINDOW_BYTES, so decoding only needs that much history instead of
+ * the whole frame.
+ */
+
+#include "CodecSupport.h"
+
+static_assert((LZ4_WINDOW_BYTES & (LZ4_WINDOW_BYTES - 1)) == 0, "LZ4 window must be a power of two");
+
+static size_t lz4WorkBytes(int width) {
+  return LZ4_WINDOW_BYTES + bilevelRowBytes(width);
+}
+
+// Read an extended length (255-continued), or -1 at end of input
+static long lz4Length(InputBuffer& in, long base) {
+  long length = base;
+  if (base == 15) {
+    int b;
+    do {
+      b = in.next();
+      if (b < 0) return -1;
+      length += b;
+    } while (b == 255);
+  }
+  return length;
+}
+
+static bool lz4Decode(ByteSource& src, int width, int height, uint8_t* work, RowSink sink, void* ctx) {
+  const size_t mask = LZ4_WINDOW_BYTES - 1;
+  uint8_t* window = work;
+  InputBuffer in(src);
+  RowWriter out(work + LZ4_WINDOW_BYTES, width, height, sink, ctx);
+  size_t pos = 0;
+
+  while (!out.done()) {
+    int token = in.next();
+    if (token < 0) return false;
+
+    long literals = lz4Length(in, token >> 4);
+    if (literals < 0) return false;
+    for (long i = 0; i < literals; i++) {
+      int b = in.next();
+      if (b < 0) return false;
+      window[pos++ & mask] = (uint8_t)b;
+      if (!out.put((uint8_t)b)) return out.done();
+    }
+
+    // The last sequence has literals only
+    if (out.done()) break;
+
+    int lo = in.next();
+    int hi = in.next();
+    if (lo < 0 || hi < 0) return false;
+    size_t offset = (size_t)lo | ((size_t)hi << 8);
+    if (offset == 0 || offset > LZ4_WINDOW_BYTES || offset > pos) return false;
+
+    long match = lz4Length(in, token & 15);
+    if (match < 0) return false;
+    match += 4;
+
+    for (long i = 0; i < match; i++) {
+      uint8_t b = window[(pos - offset) & mask];
+      window[pos++ & mask] = b;
+      if (!out.put(b)) return out.done();
+    }
+  }
+
+  return true;
+}
+
+const BilevelCodec codecLz4 = { "lz4", 3, lz4WorkBytes, lz4Decode };
@@ -0,0 +1,39 @@
+/**
+ * RLE codec (PackBits)
+ *
+ * Control byte n: 0..127 copies the next n+1 bytes literally, 129..255
+ * repeats the next byte 257-n times, 128 is a no-op. Runs may cross rows.
+ */
+
+#include "CodecSupport.h"
+
+static size_t rleWorkBytes(int width) {
+  return bilevelRowBytes(width);
+}
+
+static bool rleDecode(ByteSource& src, int width, int height, uint8_t* work, RowSink sink, void* ctx) {
+  InputBuffer in(src);
+  RowWriter out(work, width, height, sink, ctx);
+
+  while (!out.done()) {
+    int n = in.next();
+    if (n < 0) return false;
+
+    if (n < 128) {
+      for (int i = 0; i <= n; i++) {
+        int b = in.next();
+        if (b < 0 || !out.put((uint8_t)b)) return out.done();
+      }
+    } else if (n > 128) {
+      int b = in.next();
+      if (b < 0) return false;
+      for (int i = 0; i < 257 - n; i++) {
+        if (!out.put((uint8_t)b)) return out.done();
+      }
+    }
+  }
+
+  return true;
+}
+
+const BilevelCodec codecRle = { "rle", 1, rleWorkBytes, rleDecode };
@@ -0,0 +1,112 @@
+/**
+ * Helpers shared by the codec implementations (not part of the public API)
+ */
+
+#ifndef BILEVEL_CODEC_SUPPORT_H
+#define BILEVEL_CODEC_SUPPORT_H
+
+#include "BilevelCodec.h"
+
+// Small read-ahead buffer so decoders can pull single bytes cheaply
+class InputBuffer {
+public:
+  explicit InputBuffer(ByteSource& src) : src_(src), pos_(0), len_(0) {}
+
+  // Next byte, or -1 at end of input
+  inline int next() {
+    if (pos_ == len_) {
+      len_ = src_.read(buf_, sizeof(buf_));
+      pos_ = 0;
+      if (len_ == 0) return -1;
+    }
+    return buf_[pos_++];
+  }
+
+private:
+  ByteSource& src_;
+  uint8_t buf_[64];
+  size_t pos_;
+  size_t len_;
+};
+
+// MSB-first bit reader
+class BitReader {
+public:
+  explicit BitReader(InputBuffer& in) : in_(in), acc_(0), bits_(0), eof_(false) {}
+
+  // Next bit (0/1), or -1 at end of input
+  inline int bit() {
+    if (bits_ == 0) {
+      int b = in_.next();
+      if (b < 0) {
+        eof_ = true;
+        return -1;
+      }
+      acc_ = (uint8_t)b;
+      bits_ = 8;
+    }
+    bits_--;
+    return (acc_ >> bits_) & 1;
+  }
+
+  // Next n bits (n <= 16) as an unsigned value, or -1 at end of input
+  inline int bits(int n) {
+    int value = 0;
+    for (int i = 0; i < n; i++) {
+      int b = bit();
+      if (b < 0) return -1;
+      value = (value << 1) | b;
+    }
+    return value;
+  }
+
+  bool eof() const { return eof_; }
+
+private:
+  InputBuffer& in_;
+  uint8_t acc_;
+  int bits_;
+  bool eof_;
+};
+
+// Collects decoded bytes into rows and hands complete rows to the sink
+class RowWriter {
+public:
+  RowWriter(uint8_t* row, int width, int height, RowSink sink, void* ctx)
+    : row_(row), rowBytes_(bilevelRowBytes(width)), fill_(0), y_(0), height_(height),
+      sink_(sink), ctx_(ctx), ok_(true) {}
+
+  // Append one byte; false once the frame is complete or the sink aborted
+  inline bool put(uint8_t b) {
+    if (!ok_ || y_ >= height_) return false;
+    row_[fill_++] = b;
+    if (fill_ == rowBytes_) {
+      ok_ = sink_(ctx_, y_++, row_, rowBytes_);
+      fill_ = 0;
+    }
+    return ok_;
+  }
+
+  // Emit the row buffer as-is (for codecs that build rows in place)
+  inline bool emitRow() {
+    if (!ok_ || y_ >= height_) return false;
+    ok_ = sink_(ctx_, y_++, row_, rowBytes_);
+    return ok_;
+  }
+
+  bool done() const { return ok_ && y_ >= height_; }
+  bool ok() const { return ok_; }
+  size_t rowBytes() const { return rowBytes_; }
+
+private:
+  uint8_t* row_;
+  size_t rowBytes_;
+  size_t fill_;
+  int y_;
+  int height_;
+  RowSink sink_;
+  void* ctx_;
+  bool ok_;
+};
+
+#endif
@@ -0,0 +1,139 @@
+/**
+ * Area-filter frame scaling
+ *
+ * Positions are 16.16 fixed point in source pixels. A source row is first
+ * resampled horizontally into cover_ (the white fraction of each
+ * destination column, 0..255), then added to the destination row it
+ * overlaps, weighted by how much of its height falls inside it. A source
+ * row that straddles a boundary is split between the two rows; when
+ * enlarging, one source row feeds several.
+ */
+
+#include "FrameScaler.h"
+
+#include <string.h>
+
+static size_t align4(size_t n) {
+  return (n + 3) & ~(size_t)3;
+}
+
+size_t FrameScaler::workBytes(int dstWidth) {
+  return align4(sizeof(uint32_t) * dstWidth) +
+         align4(sizeof(int16_t) * 2 * (dstWidth + 2)) +
+         align4(dstWidth) +
+         bilevelRowBytes(dstWidth);
+}
+
+bool FrameScaler::begin(int srcWidth, int srcHeight, int dstWidth, int dstHeight, uint8_t* work, RowSink out, void* ctx) {
+  if (srcWidth <= 0 || srcHeight <= 0 || dstWidth <= 0 || dstHeight <= 0) return false;
+
+  // Crop to the destination aspect ratio (cover, centered)
+  int cropW = srcWidth;
+  int cropH = srcHeight;
+  if ((long)srcWidth * dstHeight > (long)srcHeight * dstWidth) {
+    cropW = (int)(((long)srcHeight * dstWidth + dstHeight / 2) / dstHeight);
+  } else {
+    cropH = (int)(((long)srcWidth * dstHeight + dstWidth / 2) / dstWidth);
+  }
+  return beginWindow(srcWidth, srcHeight, (srcWidth - cropW) / 2, (srcHeight - cropH) / 2, cropW, cropH,
+                     dstWidth, dstHeight, work, out, ctx);
+}
+
+bool FrameScaler::beginWindow(int srcWidth, int srcHeight, int x, int y, int w, int h,
+                              int dstWidth, int dstHeight, uint8_t* work, RowSink out, void* ctx) {
+  if (dstWidth <= 0 || dstHeight <= 0 || w < 1 || h < 1) return false;
+  if (x < 0 || y < 0 || x + w > srcWidth || y + h > srcHeight) return false;
+  if (w > dstWidth * FRAME_SCALER_MAX_RATIO || h > dstHeight * FRAME_SCALER_MAX_RATIO) return false;
+
+  srcHeight_ = srcHeight;
+  dstWidth_ = dstWidth;
+  dstHeight_ = dstHeight;
+  cropX_ = x;
+  cropY_ = y;
+  stepX_ = (uint32_t)(((uint64_t)w << 16) / dstWidth);
+  stepY_ = (uint32_t)(((uint64_t)h << 16) / dstHeight);
+  srcY_ = 0;
+  dstY_ = 0;
+
+  acc_ = (uint32_t*)work;
+  work += align4(sizeof(uint32_t) * dstWidth);
+  err_ = (int16_t*)work;
+  work += align4(sizeof(int16_t) * 2 * (dstWidth + 2));
+  cover_ = work;
+  work += align4(dstWidth);
+  out_ = work;
+  sink_ = out;
+  ctx_ = ctx;
+
+  memset(acc_, 0, sizeof(uint32_t) * dstWidth);
+  memset(err_, 0, sizeof(int16_t) * 2 * (dstWidth + 2));
+  return true;
+}
+
+bool FrameScaler::push(const uint8_t* row) {
+  int y = srcY_++;
+  if (y >= srcHeight_ || dstY_ == dstHeight_) return true;
+  if (y < cropY_) return true;
+
+  // Horizontal: white coverage of each destination column
+  uint32_t start = (uint32_t)cropX_ << 16;
+  for (int x = 0; x < dstWidth_; x++, start += stepX_) {
+    uint32_t end = start + stepX_;
+    uint32_t white = 0;
+    for (uint32_t p = start >> 16; (p << 16) < end; p++) {
+      if (!(row[p >> 3] & (0x80 >> (p & 7)))) continue;
+      uint32_t lo = (p << 16) > start ? (p << 16) : start;
+      uint32_t hi = ((p + 1) << 16) < end ? ((p + 1) << 16) : end;
+      white += hi - lo;
+    }
+    cover_[x] = (uint8_t)(white * 255 / stepX_);
+  }
+
+  // Vertical: add the row to every destination row it overlaps
+  uint32_t rowStart = (uint32_t)(y - cropY_) << 16;
+  uint32_t rowEnd = rowStart + 0x10000;
+  while (dstY_ < dstHeight_) {
+    uint32_t dstStart = (uint32_t)dstY_ * stepY_;
+    uint32_t dstEnd = dstStart + stepY_;
+    uint32_t lo = rowStart > dstStart ? rowStart : dstStart;
+    uint32_t hi = rowEnd < dstEnd ? rowEnd : dstEnd;
+    if (hi > lo) {
+      uint32_t weight = hi - lo;
+      for (int x = 0; x < dstWidth_; x++) acc_[x] += weight * cover_[x];
+    }
+    if (dstEnd > rowEnd) break;  // the destination row continues in the next source row
+    if (!emitRow()) return false;
+  }
+  return true;
+}
+
+// Dither the finished row to 1 bit, hand it out and start the next
+bool FrameScaler::emitRow() {
+  int16_t* cur = err_ + (dstY_ & 1) * (dstWidth_ + 2);
+  int16_t* next = err_ + ((dstY_ + 1) & 1) * (dstWidth_ + 2);
+  memset(next, 0, sizeof(int16_t) * (dstWidth_ + 2));
+  memset(out_, 0, bilevelRowBytes(dstWidth_));
+
+  for (int x = 0; x < dstWidth_; x++) {
+    int v = (int)(acc_[x] / stepY_) + cur[x + 1] / 16;
+    if (v < -128) v = -128;
+    if (v > 383) v = 383;
+    bool white = v >= 128;
+    if (white) out_[x >> 3] |= 0x80 >> (x & 7);
+
+    int e = v - (white ? 255 : 0);
+    cur[x + 2] += e * 7;
+    next[x] += e * 3;
+    next[x + 1] += e * 5;
+    next[x + 2] += e;
+    acc_[x] = 0;
+  }
+
+  return sink_(ctx_, dstY_++, out_, bilevelRowBytes(dstWidth_));
+}
+
+bool FrameScaler::rowSink(void* ctx, int y, const uint8_t* row, size_t rowBytes) {
+  (void)y;
+  (void)rowBytes;
+  return static_cast<FrameScaler*>(ctx)->push(row);
+}
@@ -0,0 +1,68 @@
+/**
+ * FrameScaler - streaming area-filter resampling of 1-bit frames
+ *
+ * Turns a frame of any geometry into the panel's, one row in and rows out
+ * as they complete. The source is cropped (centered) to the destination's
+ * aspect ratio, each destination pixel averages the source area it covers
+ * (fractional pixels at the edges count by their overlap), and the gray
+ * result is dithered back to 1 bit with Floyd-Steinberg error diffusion.
+ * Memory is a few destination-width rows, whatever the source size.
+ *
+ * Rows use the codec layout (MSB first, 1 = white), so FrameScaler::rowSink
+ * can be handed to a codec's decode() to scale while decompressing.
+ */
+
+#ifndef FRAME_SCALER_H
+#define FRAME_SCALER_H
+
+#include "BilevelCodec.h"
+
+// Largest reduction per axis (source pixels per destination pixel)
+#define FRAME_SCALER_MAX_RATIO 16
+
+class FrameScaler {
+public:
+  // Scratch memory begin() needs for this destination width
+  static size_t workBytes(int dstWidth);
+
+  // Set up for one frame. work must hold workBytes(dstWidth) bytes until
+  // the last row is out. False if the geometry can't be scaled.
+  bool begin(int srcWidth, int srcHeight, int dstWidth, int dstHeight, uint8_t* work, RowSink out, void* ctx);
+
+  // Same with an explicit source window (pan and zoom) instead of the
+  // centered crop. The window is stretched if its aspect ratio differs.
+  bool beginWindow(int srcWidth, int srcHeight, int x, int y, int w, int h,
+                   int dstWidth, int dstHeight, uint8_t* work, RowSink out, void* ctx);
+
+  // Next source row, in order. Rows past the source height (a gray
+  // frame's second plane) are ignored.
+  bool push(const uint8_t* row);
+
+  // Every destination row has been handed out
+  bool done() const { return dstY_ == dstHeight_; }
+
+  // RowSink adapter: ctx is the FrameScaler
+  static bool rowSink(void* ctx, int y, const uint8_t* row, size_t rowBytes);
+
+private:
+  bool emitRow();
+
+  int srcHeight_;
+  int dstWidth_;
+  int dstHeight_;
+  int cropX_;          // top-left of the source window
+  int cropY_;
+  uint32_t stepX_;     // source pixels per destination pixel, 16.16
+  uint32_t stepY_;
+  int srcY_;           // next source row
+  int dstY_;           // destination row being built
+
+  uint32_t* acc_;      // weighted sums of the row being built
+  int16_t* err_;       // diffused error x16: this row, next row (dstWidth + 2 each)
+  uint8_t* cover_;     // the current source row resampled to dstWidth (0..255)
+  uint8_t* out_;       // packed destination row
+  RowSink sink_;
+  void* ctx_;
+};
+
+#endif
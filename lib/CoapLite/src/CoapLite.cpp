@@ -0,0 +1,191 @@
+/**
+ * CoAP message encoding and parsing
+ */
+
+#include "CoapLite.h"
+
+#include <string.h>
+
+CoapWriter::CoapWriter(uint8_t* buf, size_t capacity)
+    : buf_(buf), capacity_(capacity), len_(0), lastOption_(0), ok_(true) {}
+
+bool CoapWriter::put(const uint8_t* data, size_t len) {
+  if (!ok_ || len_ + len > capacity_) {
+    ok_ = false;
+    return false;
+  }
+  if (len) memcpy(buf_ + len_, data, len);
+  len_ += len;
+  return true;
+}
+
+bool CoapWriter::header(uint8_t type, uint8_t code, uint16_t messageId, const uint8_t* token, uint8_t tokenLength) {
+  if (tokenLength > COAP_MAX_TOKEN) return ok_ = false;
+  uint8_t head[4] = {
+    (uint8_t)(0x40 | (type << 4) | tokenLength),  // version 1
+    code,
+    (uint8_t)(messageId >> 8),
+    (uint8_t)messageId
+  };
+  return put(head, sizeof(head)) && put(token, tokenLength);
+}
+
+// Option delta and length use 4-bit nibbles with 13 / 269 extensions
+static size_t nibble(uint32_t value, uint8_t& n, uint8_t* ext) {
+  if (value < 13) {
+    n = (uint8_t)value;
+    return 0;
+  }
+  if (value < 269) {
+    n = 13;
+    ext[0] = (uint8_t)(value - 13);
+    return 1;
+  }
+  n = 14;
+  ext[0] = (uint8_t)((value - 269) >> 8);
+  ext[1] = (uint8_t)(value - 269);
+  return 2;
+}
+
+bool CoapWriter::option(uint16_t number, const uint8_t* value, size_t len) {
+  if (number < lastOption_ || len > 0xFFFF) return ok_ = false;
+
+  uint8_t head[5];
+  uint8_t deltaNibble, lengthNibble;
+  size_t n = 1;
+  n += nibble(number - lastOption_, deltaNibble, head + n);
+  n += nibble((uint32_t)len, lengthNibble, head + n);
+  head[0] = (uint8_t)((deltaNibble << 4) | lengthNibble);
+  lastOption_ = number;
+
+  return put(head, n) && put(value, len);
+}
+
+bool CoapWriter::split(uint16_t number, const char* text, char separator) {
+  if (!text) return ok_;
+  while (*text) {
+    const char* end = strchr(text, separator);
+    size_t len = end ? (size_t)(end - text) : strlen(text);
+    if (len > 0 && !option(number, (const uint8_t*)text, len)) return false;
+    text += len;
+    if (*text) text++;
+  }
+  return ok_;
+}
+
+bool CoapWriter::uriPath(const char* path) {
+  return split(COAP_OPTION_URI_PATH, path, '/');
+}
+
+bool CoapWriter::contentFormat(uint16_t format) {
+  uint8_t value[2] = { (uint8_t)(format >> 8), (uint8_t)format };
+  // Minimal encoding: leading zero bytes are dropped
+  if (format == 0) return option(COAP_OPTION_CONTENT_FORMAT, value, 0);
+  if (format < 256) return option(COAP_OPTION_CONTENT_FORMAT, value + 1, 1);
+  return option(COAP_OPTION_CONTENT_FORMAT, value, 2);
+}
+
+bool CoapWriter::uriQuery(const char* query) {
+  return split(COAP_OPTION_URI_QUERY, query, '&');
+}
+
+bool CoapWriter::payload(const uint8_t* data, size_t len) {
+  if (len == 0) return ok_;
+  static const uint8_t marker = 0xFF;
+  return put(&marker, 1) && put(data, len);
+}
+
+// Append an option value to a joined string, or fail if it doesn't fit
+static bool join(char* dst, size_t capacity, char separator, const uint8_t* value, size_t len) {
+  size_t used = strlen(dst);
+  size_t need = used + (used ? 1 : 0) + len + 1;
+  if (need > capacity) return false;
+  if (used) dst[used++] = separator;
+  memcpy(dst + used, value, len);
+  dst[used + len] = '\0';
+  return true;
+}
+
+// Read an extended delta or length, or -1 on a malformed option
+static long extended(uint8_t n, const uint8_t*& p, const uint8_t* end) {
+  if (n < 13) return n;
+  if (n == 13) {
+    if (p >= end) return -1;
+    return 13 + *p++;
+  }
+  if (n == 14) {
+    if (end - p < 2) return -1;
+    long v = 269 + ((long)p[0] << 8) + p[1];
+    p += 2;
+    return v;
+  }
+  return -1;  // 15 is reserved for the payload marker
+}
+
+bool coapParse(const uint8_t* data, size_t len, CoapMessage& msg) {
+  memset(&msg, 0, sizeof(msg));
+  msg.contentFormat = -1;
+  if (len < 4 || (data[0] >> 6) != 1) return false;
+
+  msg.type = (data[0] >> 4) & 3;
+  msg.tokenLength = data[0] & 15;
+  msg.code = data[1];
+  msg.messageId = (uint16_t)((data[2] << 8) | data[3]);
+  if (msg.tokenLength > COAP_MAX_TOKEN || len < 4u + msg.tokenLength) return false;
+  memcpy(msg.token, data + 4, msg.tokenLength);
+
+  const uint8_t* p = data + 4 + msg.tokenLength;
+  const uint8_t* end = data + len;
+  long number = 0;
+
+  while (p < end) {
+    if (*p == 0xFF) {
+      p++;
+      if (p == end) return false;  // a marker must be followed by a payload
+      msg.payload = p;
+      msg.payloadLength = end - p;
+      return true;
+    }
+
+    uint8_t head = *p++;
+    long delta = extended(head >> 4, p, end);
+    long optLen = extended(head & 15, p, end);
+    if (delta < 0 || optLen < 0 || end - p < optLen) return false;
+    number += delta;
+
+    if (number == COAP_OPTION_URI_PATH) {
+      if (!join(msg.path, sizeof(msg.path), '/', p, optLen)) return false;
+    } else if (number == COAP_OPTION_URI_QUERY) {
+      if (!join(msg.query, sizeof(msg.query), '&', p, optLen)) return false;
+    } else if (number == COAP_OPTION_CONTENT_FORMAT) {
+      msg.contentFormat = 0;
+      for (long i = 0; i < optLen; i++) msg.contentFormat = (msg.contentFormat << 8) | p[i];
+    }
+    p += optLen;
+  }
+
+  return true;
+}
+
+int coapToHttpStatus(uint8_t code) {
+  int cls = code >> 5;
+  if (cls == 2) return 200;
+  return cls * 100 + (code & 31);
+}
+
+uint8_t coapFromHttpStatus(int status, uint8_t method) {
+  if (status >= 200 && status < 300) {
+    if (method == COAP_GET) return COAP_CONTENT;
+    return status == 201 ? COAP_CREATED : COAP_CHANGED;
+  }
+  switch (status) {
+    case 400: return COAP_BAD_REQUEST;
+    case 401: return COAP_UNAUTHORIZED;
+    case 403: return COAP_FORBIDDEN;
+    case 404: return COAP_NOT_FOUND;
+    case 405: return COAP_METHOD_NOT_ALLOWED;
+    case 502: return COAP_BAD_GATEWAY;
+    case 504: return COAP_GATEWAY_TIMEOUT;
+    default: return COAP_INTERNAL_ERROR;
+  }
+}
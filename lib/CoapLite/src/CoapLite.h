@@ -0,0 +1,106 @@
+/**
+ * CoapLite - minimal CoAP (RFC 7252) message encoding and parsing
+ *
+ * Just what the poll and the small notifications need: confirmable
+ * requests with Uri-Path, Uri-Query and Content-Format options, and
+ * piggybacked or separate responses with a payload. No block-wise
+ * transfer and no observe; frames keep using HTTPS.
+ *
+ * No Arduino dependencies: the firmware's DTLS transport and the native
+ * stand-in server in bench/ share it.
+ */
+
+#ifndef COAP_LITE_H
+#define COAP_LITE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define COAP_DEFAULT_PORT 5684        // coaps://
+#define COAP_MAX_TOKEN 8
+#define COAP_MAX_PATH 64
+#define COAP_MAX_QUERY 256
+
+enum CoapType {
+  COAP_CON = 0,
+  COAP_NON = 1,
+  COAP_ACK = 2,
+  COAP_RST = 3
+};
+
+// Codes are class << 5 | detail (2.05 = 0x45)
+#define COAP_CODE(cls, detail) (uint8_t)(((cls) << 5) | (detail))
+#define COAP_EMPTY 0x00
+#define COAP_GET COAP_CODE(0, 1)
+#define COAP_POST COAP_CODE(0, 2)
+#define COAP_CREATED COAP_CODE(2, 1)
+#define COAP_CHANGED COAP_CODE(2, 4)
+#define COAP_CONTENT COAP_CODE(2, 5)
+#define COAP_BAD_REQUEST COAP_CODE(4, 0)
+#define COAP_UNAUTHORIZED COAP_CODE(4, 1)
+#define COAP_FORBIDDEN COAP_CODE(4, 3)
+#define COAP_NOT_FOUND COAP_CODE(4, 4)
+#define COAP_METHOD_NOT_ALLOWED COAP_CODE(4, 5)
+#define COAP_INTERNAL_ERROR COAP_CODE(5, 0)
+#define COAP_BAD_GATEWAY COAP_CODE(5, 2)
+#define COAP_GATEWAY_TIMEOUT COAP_CODE(5, 4)
+
+#define COAP_OPTION_URI_PATH 11
+#define COAP_OPTION_CONTENT_FORMAT 12
+#define COAP_OPTION_URI_QUERY 15
+
+#define COAP_FORMAT_JSON 50
+
+// Retransmission (RFC 7252 section 4.8)
+#define COAP_ACK_TIMEOUT_MS 2000
+#define COAP_MAX_RETRANSMIT 4
+
+struct CoapMessage {
+  uint8_t type;
+  uint8_t code;
+  uint16_t messageId;
+  uint8_t token[COAP_MAX_TOKEN];
+  uint8_t tokenLength;
+  int contentFormat;              // -1 when absent
+  char path[COAP_MAX_PATH];       // Uri-Path segments joined with '/'
+  char query[COAP_MAX_QUERY];     // Uri-Query items joined with '&'
+  const uint8_t* payload;         // points into the parsed datagram
+  size_t payloadLength;
+};
+
+// Builds one message into a caller buffer. Options must be added in
+// increasing option number order (path, content format, query).
+// length() is 0 if anything didn't fit.
+class CoapWriter {
+public:
+  CoapWriter(uint8_t* buf, size_t capacity);
+
+  bool header(uint8_t type, uint8_t code, uint16_t messageId, const uint8_t* token, uint8_t tokenLength);
+  bool option(uint16_t number, const uint8_t* value, size_t len);
+  bool uriPath(const char* path);      // "a/b" -> two Uri-Path options
+  bool contentFormat(uint16_t format);
+  bool uriQuery(const char* query);    // "a=1&b=2" -> two Uri-Query options
+  bool payload(const uint8_t* data, size_t len);
+
+  size_t length() const { return ok_ ? len_ : 0; }
+
+private:
+  bool put(const uint8_t* data, size_t len);
+  bool split(uint16_t number, const char* text, char separator);
+
+  uint8_t* buf_;
+  size_t capacity_;
+  size_t len_;
+  uint16_t lastOption_;
+  bool ok_;
+};
+
+// Parse a datagram. Unknown options are skipped (critical ones included:
+// the peers only ever send the options above).
+bool coapParse(const uint8_t* data, size_t len, CoapMessage& msg);
+
+// HTTP status for a CoAP response code (2.05 -> 200, 4.04 -> 404), and back
+int coapToHttpStatus(uint8_t code);
+uint8_t coapFromHttpStatus(int status, uint8_t method);
+
+#endif
@@ -0,0 +1,230 @@
+/**
+ * FontStore glyph lookup, block decoding and LRU cache
+ */
+
+#include "FontStore.h"
+
+#include <string.h>
+
+static uint16_t get16(const uint8_t* p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get24(const uint8_t* p) {
+  return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+}
+
+static uint32_t get32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static size_t align4(size_t n) {
+  return (n + 3) & ~(size_t)3;
+}
+
+// Decode one UTF-8 code point and advance p
+static uint32_t utf8Next(const char*& p) {
+  uint8_t c = (uint8_t)*p++;
+  if (c < 0x80) return c;
+  int extra = (c >= 0xF0) ? 3 : (c >= 0xE0) ? 2 : 1;
+  uint32_t cp = c & (0x3F >> extra);
+  while (extra-- > 0 && ((uint8_t)*p & 0xC0) == 0x80) {
+    cp = (cp << 6) | ((uint8_t)*p++ & 0x3F);
+  }
+  return cp;
+}
+
+// Largest scratch any codec needs for the 8-pixel-wide block frames
+static size_t codecWorkBytes() {
+  size_t bytes = 0;
+  for (size_t i = 0; i < codecCount(); i++) {
+    size_t n = codecAt(i)->workBytes(8);
+    if (n > bytes) bytes = n;
+  }
+  return bytes;
+}
+
+static const BilevelCodec* codecById(uint8_t id) {
+  for (size_t i = 0; i < codecCount(); i++) {
+    if (codecAt(i)->id == id) return codecAt(i);
+  }
+  return nullptr;
+}
+
+size_t MemoryFontSource::read(uint32_t offset, uint8_t* dst, size_t len) {
+  if (offset >= len_) return 0;
+  size_t n = len_ - offset;
+  if (n > len) n = len;
+  memcpy(dst, data_ + offset, n);
+  return n;
+}
+
+// A block's compressed bytes as a codec input
+class BlockByteSource : public ByteSource {
+public:
+  BlockByteSource(FontSource& source, uint32_t offset) : source_(source), offset_(offset) {}
+
+  size_t read(uint8_t* dst, size_t len) override {
+    size_t n = source_.read(offset_, dst, len);
+    offset_ += n;
+    return n;
+  }
+
+private:
+  FontSource& source_;
+  uint32_t offset_;
+};
+
+// Keeps the glyph's bytes out of the decoded block and stops the codec
+// right after them
+struct GlyphSink {
+  uint8_t* dst;
+  int start;
+  int end;
+  int got;
+};
+
+static bool glyphRowSink(void* ctx, int y, const uint8_t* row, size_t rowBytes) {
+  (void)rowBytes;
+  GlyphSink* sink = (GlyphSink*)ctx;
+  if (y >= sink->start) sink->dst[sink->got++] = row[0];
+  return y + 1 < sink->end;
+}
+
+size_t FontStore::workBytes(int cacheGlyphs) {
+  return align4(sizeof(Slot) * cacheGlyphs) + codecWorkBytes();
+}
+
+bool FontStore::begin(FontSource& source, uint8_t* work, int cacheGlyphs) {
+  ready_ = false;
+  uint8_t header[FONT_STORE_HEADER_BYTES];
+  if (cacheGlyphs < 1 || source.read(0, header, sizeof(header)) != sizeof(header)) return false;
+  if (memcmp(header, "IFNT", 4) != 0 || header[4] != FONT_STORE_VERSION) return false;
+
+  source_ = &source;
+  ascent_ = header[5];
+  descent_ = header[6];
+  glyphCount_ = get16(header + 8);
+  blockCount_ = get16(header + 10);
+  if (blockCount_ != (glyphCount_ + FONT_STORE_BLOCK_GLYPHS - 1) / FONT_STORE_BLOCK_GLYPHS) return false;
+
+  slots_ = (Slot*)work;
+  slotCount_ = cacheGlyphs;
+  codecWork_ = work + align4(sizeof(Slot) * cacheGlyphs);
+  for (int i = 0; i < slotCount_; i++) slots_[i].lastUse = 0;
+  useClock_ = 0;
+  memset(&stats_, 0, sizeof(stats_));
+  ready_ = true;
+  return true;
+}
+
+// Binary search of the index (entries are read from the blob as needed)
+bool FontStore::find(uint32_t cp, int& index, uint8_t* entry) {
+  int lo = 0;
+  int hi = (int)glyphCount_ - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    uint32_t offset = FONT_STORE_HEADER_BYTES + (uint32_t)mid * FONT_STORE_INDEX_BYTES;
+    if (source_->read(offset, entry, FONT_STORE_INDEX_BYTES) != FONT_STORE_INDEX_BYTES) return false;
+    uint32_t at = get24(entry);
+    if (at == cp) {
+      index = mid;
+      return true;
+    }
+    if (at < cp) {
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return false;
+}
+
+bool FontStore::decode(int index, const uint8_t* entry, FontGlyph& out) {
+  out.cp = get24(entry);
+  out.width = entry[3];
+  out.height = entry[4];
+  out.xOffset = (int8_t)entry[5];
+  out.yOffset = (int8_t)entry[6];
+  out.advance = entry[7];
+  int offset = get16(entry + 8);
+  int bytes = (out.width * out.height + 7) / 8;
+  if (bytes > FONT_STORE_MAX_GLYPH_BYTES) return false;
+  if (bytes == 0) return true;  // a space
+
+  uint8_t block[FONT_STORE_BLOCK_BYTES];
+  uint32_t blockAt = FONT_STORE_HEADER_BYTES + (uint32_t)glyphCount_ * FONT_STORE_INDEX_BYTES +
+                     (uint32_t)(index / FONT_STORE_BLOCK_GLYPHS) * FONT_STORE_BLOCK_BYTES;
+  if (source_->read(blockAt, block, sizeof(block)) != sizeof(block)) return false;
+  uint32_t dataOffset = get32(block);
+  int blockBytes = get16(block + 4);
+  if (offset + bytes > blockBytes) return false;
+
+  if (block[6] == 0) {
+    stats_.decodedBytes += bytes;
+    return source_->read(dataOffset + offset, out.bitmap, bytes) == (size_t)bytes;
+  }
+
+  const BilevelCodec* codec = codecById(block[6]);
+  if (!codec) return false;
+  BlockByteSource in(*source_, dataOffset);
+  GlyphSink sink = { out.bitmap, offset, offset + bytes, 0 };
+  // The sink stops the codec after the glyph, which decode() reports as a
+  // failure unless the glyph ends the block; what counts is the bytes
+  codec->decode(in, 8, blockBytes, codecWork_, glyphRowSink, &sink);
+  stats_.decodedBytes += offset + sink.got;
+  return sink.got == bytes;
+}
+
+const FontGlyph* FontStore::glyph(uint32_t cp) {
+  if (!ready_) return nullptr;
+
+  Slot* victim = &slots_[0];
+  for (int i = 0; i < slotCount_; i++) {
+    Slot& slot = slots_[i];
+    if (slot.lastUse && slot.glyph.cp == cp) {
+      slot.lastUse = ++useClock_;
+      stats_.hits++;
+      return &slot.glyph;
+    }
+    if (slot.lastUse < victim->lastUse) victim = &slot;
+  }
+
+  int index;
+  uint8_t entry[FONT_STORE_INDEX_BYTES];
+  if (!find(cp, index, entry)) return nullptr;
+
+  victim->lastUse = 0;
+  if (!decode(index, entry, victim->glyph)) return nullptr;
+  victim->lastUse = ++useClock_;
+  stats_.misses++;
+  return &victim->glyph;
+}
+
+int FontStore::textWidth(const char* text) {
+  int width = 0;
+  const char* p = text;
+  while (*p) {
+    const FontGlyph* g = glyph(utf8Next(p));
+    if (!g) g = glyph('?');
+    if (g) width += g->advance;
+  }
+  return width;
+}
+
+int FontStore::drawText(int x, int y, const char* text, PixelSink sink, void* ctx) {
+  const char* p = text;
+  while (*p) {
+    const FontGlyph* g = glyph(utf8Next(p));
+    if (!g) g = glyph('?');
+    if (!g) continue;
+
+    int left = x + g->xOffset;
+    int top = y + g->yOffset;
+    for (int i = 0; i < g->width * g->height; i++) {
+      if (g->bitmap[i >> 3] & (0x80 >> (i & 7))) sink(ctx, left + i % g->width, top + i / g->width);
+    }
+    x += g->advance;
+  }
+  return x;
+}
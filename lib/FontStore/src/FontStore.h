@@ -0,0 +1,131 @@
+/**
+ * FontStore - compressed Unicode bitmap fonts, decoded glyph by glyph
+ *
+ * A font is one blob built by backend/scripts/build-font-store.js from a
+ * BDF font: the glyphs of a chosen Unicode subset, each cropped to its ink
+ * and packed row after row (MSB first, 1 = ink, no row padding), sorted by
+ * code point and grouped into blocks of FONT_STORE_BLOCK_GLYPHS that are
+ * compressed with one of the BilevelCodec codecs (the block's bytes coded
+ * as a frame 8 pixels wide). Looking a glyph up binary-searches the index
+ * in the blob and decodes its block only as far as the glyph. Decoded
+ * glyphs stay in a small LRU cache, so a screen decodes each character
+ * once even though paged drawing renders the text several times.
+ *
+ * Blob layout, big-endian:
+ *   header  "IFNT", version (1), ascent (1), descent (1), flags (1),
+ *           glyph count (2), block count (2), reserved (4)
+ *   index   per glyph: code point (3), width (1), height (1),
+ *           x offset (1, signed), y offset (1, signed, top of the bitmap
+ *           relative to the baseline), advance (1), offset in the
+ *           block's decoded bytes (2)
+ *   blocks  per block: data offset in the blob (4), decoded bytes (2),
+ *           codec id (1, 0 = stored), reserved (1)
+ *   data    the blocks
+ *
+ * No Arduino dependencies: the firmware reads blobs from LittleFS and
+ * bench/font_bench.cpp from files.
+ */
+
+#ifndef FONT_STORE_H
+#define FONT_STORE_H
+
+#include "BilevelCodec.h"
+
+#define FONT_STORE_VERSION 1
+#define FONT_STORE_HEADER_BYTES 16
+#define FONT_STORE_INDEX_BYTES 10
+#define FONT_STORE_BLOCK_BYTES 8
+#define FONT_STORE_BLOCK_GLYPHS 32
+#define FONT_STORE_MAX_GLYPH_BYTES 128   // e.g. 32x32; the build step rejects larger glyphs
+
+// Where the blob lives. read() returns the number of bytes copied into
+// dst, less than len only at the end of the blob (or on error).
+class FontSource {
+public:
+  virtual ~FontSource() {}
+  virtual size_t read(uint32_t offset, uint8_t* dst, size_t len) = 0;
+};
+
+// FontSource over a blob already in memory (or memory-mapped flash)
+class MemoryFontSource : public FontSource {
+public:
+  MemoryFontSource(const uint8_t* data, size_t len) : data_(data), len_(len) {}
+  size_t read(uint32_t offset, uint8_t* dst, size_t len) override;
+
+private:
+  const uint8_t* data_;
+  size_t len_;
+};
+
+struct FontGlyph {
+  uint32_t cp;            // Unicode code point
+  uint8_t width;
+  uint8_t height;
+  int8_t xOffset;         // from the pen position to the bitmap's left edge
+  int8_t yOffset;         // from the baseline to the bitmap's top row
+  uint8_t advance;
+  uint8_t bitmap[FONT_STORE_MAX_GLYPH_BYTES];
+};
+
+struct FontStats {
+  uint32_t hits;          // glyphs served from the cache
+  uint32_t misses;        // glyphs decoded
+  uint32_t decodedBytes;  // block bytes decoded for them
+};
+
+// Receives the ink pixels of drawn text
+typedef void (*PixelSink)(void* ctx, int x, int y);
+
+class FontStore {
+public:
+  FontStore() : source_(nullptr), ready_(false) {}
+
+  // Scratch memory begin() needs for a cache of this many glyphs
+  static size_t workBytes(int cacheGlyphs);
+
+  // Check the blob's header and set up the cache. work must hold
+  // workBytes(cacheGlyphs) bytes for as long as the store is used.
+  bool begin(FontSource& source, uint8_t* work, int cacheGlyphs);
+  bool ready() const { return ready_; }
+
+  int ascent() const { return ascent_; }
+  int descent() const { return descent_; }
+  int lineHeight() const { return ascent_ + descent_; }
+  int glyphCount() const { return glyphCount_; }
+
+  // The glyph for a code point, or nullptr if the font doesn't have it.
+  // Valid until the next lookup.
+  const FontGlyph* glyph(uint32_t cp);
+
+  // Width of UTF-8 text in pixels (sum of advances)
+  int textWidth(const char* text);
+
+  // Draw UTF-8 text with its baseline at y; returns the pen position
+  // after it. Characters the font lacks are drawn as '?'.
+  int drawText(int x, int y, const char* text, PixelSink sink, void* ctx);
+
+  const FontStats& stats() const { return stats_; }
+
+private:
+  struct Slot {
+    FontGlyph glyph;
+    uint32_t lastUse;     // 0 = empty
+  };
+
+  bool find(uint32_t cp, int& index, uint8_t* entry);
+  bool decode(int index, const uint8_t* entry, FontGlyph& out);
+
+  FontSource* source_;
+  bool ready_;
+  uint8_t ascent_;
+  uint8_t descent_;
+  uint16_t glyphCount_;
+  uint16_t blockCount_;
+  Slot* slots_;
+  int slotCount_;
+  uint8_t* codecWork_;
+  uint32_t useClock_;
+  FontStats stats_;
+};
+
+#endif
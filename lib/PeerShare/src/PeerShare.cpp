@@ -0,0 +1,352 @@
+/**
+ * PeerShare protocol engine
+ */
+
+#include "PeerShare.h"
+
+#include <string.h>
+
+static void put32(uint8_t* p, uint32_t v) {
+  p[0] = (uint8_t)(v >> 24);
+  p[1] = (uint8_t)(v >> 16);
+  p[2] = (uint8_t)(v >> 8);
+  p[3] = (uint8_t)v;
+}
+
+static uint32_t get32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t get64le(const uint8_t* p) {
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+  return v;
+}
+
+#define SIP_ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+#define SIP_ROUND()                                                     \
+  do {                                                                  \
+    v0 += v1; v1 = SIP_ROTL(v1, 13); v1 ^= v0; v0 = SIP_ROTL(v0, 32);   \
+    v2 += v3; v3 = SIP_ROTL(v3, 16); v3 ^= v2;                          \
+    v0 += v3; v3 = SIP_ROTL(v3, 21); v3 ^= v0;                          \
+    v2 += v1; v1 = SIP_ROTL(v1, 17); v1 ^= v2; v2 = SIP_ROTL(v2, 32);   \
+  } while (0)
+
+// SipHash-2-4: a keyed hash made for authenticating short messages
+static uint64_t sipHash(const uint8_t* key, const uint8_t* data, size_t len) {
+  uint64_t k0 = get64le(key);
+  uint64_t k1 = get64le(key + 8);
+  uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+  uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+  uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+  uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+
+  size_t whole = len & ~(size_t)7;
+  for (size_t i = 0; i < whole; i += 8) {
+    uint64_t m = get64le(data + i);
+    v3 ^= m;
+    SIP_ROUND();
+    SIP_ROUND();
+    v0 ^= m;
+  }
+
+  uint64_t last = (uint64_t)len << 56;
+  for (size_t i = whole; i < len; i++) last |= (uint64_t)data[i] << (8 * (i - whole));
+  v3 ^= last;
+  SIP_ROUND();
+  SIP_ROUND();
+  v0 ^= last;
+
+  v2 ^= 0xff;
+  SIP_ROUND();
+  SIP_ROUND();
+  SIP_ROUND();
+  SIP_ROUND();
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+// Millisecond timestamps wrap; compare by difference
+static bool olderThan(uint32_t nowMs, uint32_t thenMs, uint32_t ageMs) {
+  return (uint32_t)(nowMs - thenMs) >= ageMs;
+}
+
+PeerShare::PeerShare(PeerTransport& transport, PeerFrameStore& store, uint32_t selfId)
+    : transport_(transport), store_(store), selfId_(selfId), group_(0), lastHelloMs_(0), helloDue_(false),
+      publishedKey_(0), publishedHash_(0), publishedLength_(0), pendingChunks_(0), requestedKey_(0),
+      state_(PEER_IDLE), wantKey_(0), hash_(0), length_(0), received_(0), startMs_(0), timeoutMs_(0),
+      lastProgressMs_(0) {
+  memset(key_, 0, sizeof(key_));
+  memset(members_, 0, sizeof(members_));
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+void PeerShare::setGroup(uint32_t group, const uint8_t* key, uint32_t nowMs) {
+  uint8_t next[PEER_KEY_BYTES];
+  if (group && key) {
+    memcpy(next, key, sizeof(next));
+  } else {
+    memset(next, 0, sizeof(next));
+  }
+  if (group == group_ && memcmp(next, key_, sizeof(key_)) == 0) return;
+  group_ = group;
+  memcpy(key_, next, sizeof(key_));
+  memset(members_, 0, sizeof(members_));
+  withdraw();
+  requestedKey_ = 0;
+  state_ = PEER_IDLE;
+  helloDue_ = (group != 0);
+  lastHelloMs_ = nowMs;
+}
+
+uint32_t PeerShare::allChunks(size_t length) {
+  uint32_t n = chunkCount(length);
+  return n >= 32 ? 0xFFFFFFFFUL : ((1UL << n) - 1);
+}
+
+uint32_t PeerShare::leader(uint32_t nowMs) const {
+  uint32_t best = selfId_;
+  for (int i = 0; i < PEER_MAX_PEERS; i++) {
+    const Member& m = members_[i];
+    if (m.id && !olderThan(nowMs, m.lastSeen, PEER_EXPIRE_MS) && m.id < best) best = m.id;
+  }
+  return best;
+}
+
+int PeerShare::memberCount(uint32_t nowMs) const {
+  int count = 1;
+  for (int i = 0; i < PEER_MAX_PEERS; i++) {
+    if (members_[i].id && !olderThan(nowMs, members_[i].lastSeen, PEER_EXPIRE_MS)) count++;
+  }
+  return count;
+}
+
+// FNV-1a over the stored frame, 0 mapped to 1 like the firmware's frameHash()
+uint32_t PeerShare::frameHash(PeerFrameStore& store, size_t length) {
+  uint8_t buf[128];
+  uint32_t hash = 2166136261UL;
+  for (size_t offset = 0; offset < length; offset += sizeof(buf)) {
+    size_t n = length - offset < sizeof(buf) ? length - offset : sizeof(buf);
+    store.read(offset, buf, n);
+    for (size_t i = 0; i < n; i++) {
+      hash ^= buf[i];
+      hash *= 16777619UL;
+    }
+  }
+  return hash ? hash : 1;
+}
+
+void PeerShare::publish(uint32_t key, size_t length) {
+  if (key == 0 || length == 0 || length > PEER_MAX_FRAME_BYTES) {
+    withdraw();
+    return;
+  }
+  if (key != publishedKey_) pendingChunks_ = 0;
+  publishedKey_ = key;
+  publishedLength_ = length;
+  publishedHash_ = frameHash(store_, length);
+  if (requestedKey_ == key) {
+    // Peers are already waiting for it
+    pendingChunks_ = allChunks(length);
+    requestedKey_ = 0;
+  }
+}
+
+void PeerShare::withdraw() {
+  publishedKey_ = 0;
+  publishedHash_ = 0;
+  publishedLength_ = 0;
+  pendingChunks_ = 0;
+}
+
+void PeerShare::request(uint32_t key, uint32_t nowMs, uint32_t timeoutMs) {
+  state_ = PEER_RECEIVING;
+  wantKey_ = key;
+  hash_ = 0;
+  length_ = 0;
+  received_ = 0;
+  startMs_ = nowMs;
+  timeoutMs_ = timeoutMs;
+  sendWant(nowMs);
+}
+
+size_t PeerShare::header(uint8_t* out, Type type) const {
+  out[0] = 'I';
+  out[1] = 'F';
+  out[2] = 'P';
+  out[3] = PEER_VERSION;
+  out[4] = (uint8_t)type;
+  put32(out + 5, group_);
+  put32(out + 9, selfId_);
+  return PEER_HEADER_BYTES;
+}
+
+void PeerShare::tag(const uint8_t* data, size_t len, uint8_t* out) const {
+  uint64_t mac = sipHash(key_, data, len);
+  put32(out, (uint32_t)(mac >> 32));
+  put32(out + 4, (uint32_t)mac);
+}
+
+// Append the tag to the len bytes in packet (which has room for it) and send
+bool PeerShare::transmit(uint8_t* packet, size_t len) {
+  tag(packet, len, packet + len);
+  if (!transport_.send(packet, len + PEER_TAG_BYTES)) return false;
+  stats_.sent++;
+  return true;
+}
+
+void PeerShare::sendHello(uint32_t nowMs) {
+  uint8_t packet[PEER_HEADER_BYTES + PEER_TAG_BYTES];
+  size_t n = header(packet, HELLO);
+  transmit(packet, n);
+  lastHelloMs_ = nowMs;
+  helloDue_ = false;
+}
+
+void PeerShare::sendWant(uint32_t nowMs) {
+  uint8_t packet[PEER_HEADER_BYTES + 8 + PEER_TAG_BYTES];
+  size_t n = header(packet, WANT);
+  // Until the first chunk arrives we don't know the length: ask for all
+  uint32_t missing = length_ ? (allChunks(length_) & ~received_) : 0xFFFFFFFFUL;
+  put32(packet + n, wantKey_);
+  put32(packet + n + 4, missing);
+  transmit(packet, n + 8);
+  lastProgressMs_ = nowMs;
+}
+
+void PeerShare::sendChunk(int index) {
+  uint8_t packet[PEER_PACKET_BYTES];
+  size_t n = header(packet, CHUNK);
+  size_t offset = (size_t)index * PEER_CHUNK_BYTES;
+  size_t len = publishedLength_ - offset < PEER_CHUNK_BYTES ? publishedLength_ - offset : PEER_CHUNK_BYTES;
+
+  put32(packet + n, publishedKey_);
+  put32(packet + n + 4, publishedHash_);
+  put32(packet + n + 8, (uint32_t)publishedLength_);
+  packet[n + 12] = (uint8_t)index;
+  n += 13;
+  store_.read(offset, packet + n, len);
+
+  if (transmit(packet, n + len)) stats_.chunksSent++;
+}
+
+void PeerShare::poll(uint32_t nowMs) {
+  if (group_ == 0) return;
+
+  if (helloDue_ || olderThan(nowMs, lastHelloMs_, PEER_HELLO_MS)) sendHello(nowMs);
+
+  // Queued chunks go out a few at a time so the receive path keeps up
+  for (int sent = 0; pendingChunks_ && sent < PEER_BURST; sent++) {
+    int index = 0;
+    while (!(pendingChunks_ & (1UL << index))) index++;
+    pendingChunks_ &= ~(1UL << index);
+    if (publishedKey_) sendChunk(index);
+  }
+
+  if (state_ == PEER_RECEIVING) {
+    if (olderThan(nowMs, startMs_, timeoutMs_)) {
+      state_ = PEER_FAILED;
+    } else if (olderThan(nowMs, lastProgressMs_, PEER_RETRY_MS)) {
+      sendWant(nowMs);
+    }
+  }
+}
+
+void PeerShare::heard(uint32_t id, uint32_t nowMs) {
+  Member* slot = nullptr;
+  for (int i = 0; i < PEER_MAX_PEERS; i++) {
+    Member& m = members_[i];
+    if (m.id == id) {
+      slot = &m;
+      break;
+    }
+    // Reuse an empty or expired entry, or else the stalest one
+    if (!slot || !m.id || (slot->id && (int32_t)(m.lastSeen - slot->lastSeen) < 0)) slot = &m;
+  }
+  // A newcomer learns about us before our next beacon
+  if (slot->id != id) helloDue_ = true;
+  slot->id = id;
+  slot->lastSeen = nowMs;
+}
+
+void PeerShare::onWant(uint32_t key, uint32_t mask, uint32_t nowMs) {
+  if (!isLeader(nowMs)) return;
+  if (key == publishedKey_) {
+    pendingChunks_ |= mask & allChunks(publishedLength_);
+  } else {
+    requestedKey_ = key;
+  }
+}
+
+void PeerShare::onChunk(const uint8_t* body, size_t len, uint32_t nowMs) {
+  if (len < 13 || state_ != PEER_RECEIVING) return;
+
+  uint32_t key = get32(body);
+  uint32_t hash = get32(body + 4);
+  uint32_t length = get32(body + 8);
+  int index = body[12];
+  const uint8_t* data = body + 13;
+  len -= 13;
+
+  if (key != wantKey_ || length == 0 || length > PEER_MAX_FRAME_BYTES) return;
+  if (length_ == 0) {
+    hash_ = hash;
+    length_ = length;
+  } else if (hash != hash_ || length != length_) {
+    return;  // another version of the frame; stick with the first one seen
+  }
+
+  size_t offset = (size_t)index * PEER_CHUNK_BYTES;
+  size_t expected = length_ - offset < PEER_CHUNK_BYTES ? length_ - offset : PEER_CHUNK_BYTES;
+  if ((uint32_t)index >= chunkCount(length_) || len != expected) return;
+  if (received_ & (1UL << index)) return;
+
+  store_.write(offset, data, len);
+  received_ |= 1UL << index;
+  lastProgressMs_ = nowMs;
+  stats_.chunksReceived++;
+
+  if (received_ == allChunks(length_)) {
+    if (frameHash(store_, length_) == hash_) {
+      state_ = PEER_COMPLETE;
+    } else {
+      stats_.hashFailures++;
+      state_ = PEER_FAILED;
+    }
+  }
+}
+
+void PeerShare::onPacket(const uint8_t* data, size_t len, uint32_t nowMs) {
+  if (group_ == 0 || len < PEER_HEADER_BYTES + PEER_TAG_BYTES) return;
+  if (data[0] != 'I' || data[1] != 'F' || data[2] != 'P' || data[3] != PEER_VERSION) return;
+  if (get32(data + 5) != group_) return;
+
+  // Nothing is believed, not even the sender id, without the group key
+  len -= PEER_TAG_BYTES;
+  uint8_t expected[PEER_TAG_BYTES];
+  tag(data, len, expected);
+  uint8_t diff = 0;
+  for (int i = 0; i < PEER_TAG_BYTES; i++) diff |= expected[i] ^ data[len + i];
+  if (diff) {
+    stats_.authFailures++;
+    return;
+  }
+
+  uint32_t sender = get32(data + 9);
+  if (sender == selfId_ || sender == 0) return;  // our own multicast loops back
+  stats_.received++;
+  heard(sender, nowMs);
+
+  const uint8_t* body = data + PEER_HEADER_BYTES;
+  size_t bodyLen = len - PEER_HEADER_BYTES;
+
+  switch (data[4]) {
+    case WANT:
+      if (bodyLen >= 8) onWant(get32(body), get32(body + 4), nowMs);
+      break;
+    case CHUNK:
+      onChunk(body, bodyLen, nowMs);
+      break;
+    default:
+      break;
+  }
+}
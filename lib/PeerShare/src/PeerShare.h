@@ -0,0 +1,177 @@
+/**
+ * PeerShare - LAN frame sharing between InkFrames over UDP multicast
+ *
+ * Frames in the same peer group (assigned by the server) elect a leader:
+ * every member multicasts a HELLO now and then, and the member with the
+ * lowest id heard recently leads. Only the leader downloads from the
+ * cloud. A peer that needs a frame multicasts WANT with the server's
+ * content key and a mask of the chunks it is missing; the leader answers
+ * with CHUNK packets (multicast, so one answer serves every peer waiting
+ * for the same frame). Each chunk carries the frame's hash and length, and
+ * the receiver verifies the hash over the whole frame before using it.
+ *
+ * The hash only catches corruption: anyone on the LAN could send a frame
+ * with a matching one. Every datagram therefore ends in a SipHash-2-4 tag
+ * under the group key, which the server hands to members over HTTPS, and
+ * datagrams without a valid tag are dropped before they are parsed. A
+ * host without the key can neither serve frames nor claim leadership.
+ *
+ * Wire format, big-endian: "IFP", version 2, type, group (4), sender (4),
+ * then per type:
+ *   HELLO  -
+ *   WANT   key (4), missing chunk mask (4)
+ *   CHUNK  key (4), hash (4), length (4), index (1), up to PEER_CHUNK_BYTES
+ * and last the tag (8) over everything before it.
+ *
+ * No Arduino dependencies: the firmware supplies the multicast socket and
+ * frame storage, and bench/peer_sim.cpp runs several instances on a
+ * simulated lossy LAN.
+ */
+
+#ifndef PEER_SHARE_H
+#define PEER_SHARE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PEER_VERSION 2
+#define PEER_HEADER_BYTES 13
+#define PEER_KEY_BYTES 16
+#define PEER_TAG_BYTES 8
+#define PEER_CHUNK_BYTES 1024
+#define PEER_MAX_CHUNKS 32          // chunk masks are 32 bits
+#define PEER_MAX_FRAME_BYTES (PEER_CHUNK_BYTES * PEER_MAX_CHUNKS)
+#define PEER_PACKET_BYTES (PEER_HEADER_BYTES + 13 + PEER_CHUNK_BYTES + PEER_TAG_BYTES)
+#define PEER_MAX_PEERS 8
+
+#define PEER_HELLO_MS 5000          // membership beacon interval
+#define PEER_EXPIRE_MS 16000        // a member not heard from this long is gone
+#define PEER_RETRY_MS 600           // re-send WANT when no chunk arrived for this long
+#define PEER_BURST 4                // chunks sent per poll() call
+
+// Multicasts one datagram to the group. Returns false if it couldn't.
+class PeerTransport {
+public:
+  virtual ~PeerTransport() {}
+  virtual bool send(const uint8_t* data, size_t len) = 0;
+};
+
+// Where the frame lives: the leader serves from it, a receiver writes
+// chunks into it. Offsets run over all planes back to back.
+class PeerFrameStore {
+public:
+  virtual ~PeerFrameStore() {}
+  virtual void read(size_t offset, uint8_t* dst, size_t len) = 0;
+  virtual void write(size_t offset, const uint8_t* src, size_t len) = 0;
+};
+
+enum PeerFetchState {
+  PEER_IDLE,
+  PEER_RECEIVING,
+  PEER_COMPLETE,
+  PEER_FAILED
+};
+
+struct PeerStats {
+  uint32_t sent;        // datagrams
+  uint32_t received;
+  uint32_t chunksSent;
+  uint32_t chunksReceived;
+  uint32_t hashFailures;
+  uint32_t authFailures;  // datagrams dropped for a bad tag
+};
+
+class PeerShare {
+public:
+  PeerShare(PeerTransport& transport, PeerFrameStore& store, uint32_t selfId);
+
+  // Join a group with its key (PEER_KEY_BYTES; group 0 leaves and key
+  // may be nullptr). Joining clears membership and any fetch.
+  void setGroup(uint32_t group, const uint8_t* key, uint32_t nowMs);
+  uint32_t group() const { return group_; }
+
+  // Lowest member id heard within PEER_EXPIRE_MS, ourselves included
+  uint32_t leader(uint32_t nowMs) const;
+  bool isLeader(uint32_t nowMs) const { return group_ != 0 && leader(nowMs) == selfId_; }
+  int memberCount(uint32_t nowMs) const;
+
+  // Leader: the store now holds the frame for key (length bytes). The
+  // hash is computed from the store, so it matches what peers receive.
+  void publish(uint32_t key, size_t length);
+  void withdraw();
+  uint32_t publishedKey() const { return publishedKey_; }
+  uint32_t publishedHash() const { return publishedHash_; }
+  size_t publishedLength() const { return publishedLength_; }
+
+  // Leader: a peer asked for a key we don't hold yet (0 = none)
+  uint32_t requestedKey() const { return requestedKey_; }
+  void clearRequest() { requestedKey_ = 0; }
+
+  // Receiver: ask the group for key, giving up after timeoutMs
+  void request(uint32_t key, uint32_t nowMs, uint32_t timeoutMs);
+  PeerFetchState fetchState() const { return state_; }
+  uint32_t fetchKey() const { return wantKey_; }
+  size_t fetchedLength() const { return state_ == PEER_COMPLETE ? length_ : 0; }
+  void resetFetch() { state_ = PEER_IDLE; }
+
+  // Periodic work: HELLO beacons, WANT retries, queued chunk sends
+  void poll(uint32_t nowMs);
+
+  // Feed every datagram received on the group socket
+  void onPacket(const uint8_t* data, size_t len, uint32_t nowMs);
+
+  const PeerStats& stats() const { return stats_; }
+
+  static uint32_t frameHash(PeerFrameStore& store, size_t length);
+
+private:
+  enum Type { HELLO = 1, WANT = 2, CHUNK = 3 };
+
+  struct Member {
+    uint32_t id;
+    uint32_t lastSeen;
+  };
+
+  size_t header(uint8_t* out, Type type) const;
+  bool transmit(uint8_t* packet, size_t len);
+  void tag(const uint8_t* data, size_t len, uint8_t* out) const;
+  void sendHello(uint32_t nowMs);
+  void sendWant(uint32_t nowMs);
+  void sendChunk(int index);
+  void heard(uint32_t id, uint32_t nowMs);
+  void onWant(uint32_t key, uint32_t mask, uint32_t nowMs);
+  void onChunk(const uint8_t* body, size_t len, uint32_t nowMs);
+  static uint32_t chunkCount(size_t length) { return (uint32_t)((length + PEER_CHUNK_BYTES - 1) / PEER_CHUNK_BYTES); }
+  static uint32_t allChunks(size_t length);
+
+  PeerTransport& transport_;
+  PeerFrameStore& store_;
+  uint32_t selfId_;
+  uint32_t group_;
+  uint8_t key_[PEER_KEY_BYTES];
+
+  Member members_[PEER_MAX_PEERS];
+  uint32_t lastHelloMs_;
+  bool helloDue_;
+
+  // Serving
+  uint32_t publishedKey_;
+  uint32_t publishedHash_;
+  size_t publishedLength_;
+  uint32_t pendingChunks_;
+  uint32_t requestedKey_;
+
+  // Receiving
+  PeerFetchState state_;
+  uint32_t wantKey_;
+  uint32_t hash_;
+  size_t length_;
+  uint32_t received_;
+  uint32_t startMs_;
+  uint32_t timeoutMs_;
+  uint32_t lastProgressMs_;
+
+  PeerStats stats_;
+};
+
+#endif
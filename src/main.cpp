@@ -24,6 +24,21 @@
 #include <Preferences.h>
 #include <HTTPClient.h>
 #include <ArduinoJson.h>
+#include <LittleFS.h>
+#include <esp_partition.h>
+#include <BilevelCodec.h>
+#include <FrameScaler.h>
+#include <FontStore.h>
+#include <WiFiUdp.h>
+#include <PeerShare.h>
+#include <esp_sntp.h>
+#include <esp_timer.h>
+#include <sys/time.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/net_sockets.h>
+#include <CoapLite.h>
 
 // ============================================================
 // PIN DEFINITIONS FOR WAVESHARE ESP32 DRIVER BOARD
@@ -37,6 +52,10 @@
 
 #define BUTTON_PIN 0  // BOOT button for WiFi reset
 
+// Button gesture timing (ms)
+#define BUTTON_DOUBLE_PRESS_MS 400  // max gap between presses of a double press
+#define BUTTON_LONG_PRESS_MS   800  // hold time for a long press
+
 // ============================================================
 // DISPLAY DRIVER SELECTION
 // The Waveshare 1.54" display may use different controllers
@@ -54,8 +73,11 @@
 //);
 
 // OPTION 3: GxEPD2_154_GDEY0154D67 
-GxEPD2_BW<GxEPD2_154_GDEY0154D67, GxEPD2_154_GDEY0154D67::HEIGHT> display(
-GxEPD2_154_GDEY0154D67(EPD_CS, EPD_DC, EPD_RST, EPD_BUSY)
+// PanelDriver must name the active driver: the capability descriptor
+// reads its traits (partial update support, refresh times)
+typedef GxEPD2_154_GDEY0154D67 PanelDriver;
+GxEPD2_BW<PanelDriver, PanelDriver::HEIGHT> display(
+PanelDriver(EPD_CS, EPD_DC, EPD_RST, EPD_BUSY)
 );
 
 // ============================================================
@@ -65,8 +87,192 @@ GxEPD2_154_GDEY0154D67(EPD_CS, EPD_DC, EPD_RST, EPD_BUSY)
 // #define API_SERVER "http://192.168.1.100:3000"
 // For production, use your domain:
 #define API_SERVER "https://www.eink-luvia.com"
+#define FIRMWARE_VERSION "1.0.0"
 #define DISPLAY_WIDTH 200
 #define DISPLAY_HEIGHT 200
+#define FRAME_BYTES (DISPLAY_WIDTH * DISPLAY_HEIGHT / 8)
+
+// Number of recently displayed frames kept for local back/forward
+#define HISTORY_SIZE 8
+
+// Carousel photos cached in flash, filled by one contact-sheet download
+#define PHOTO_CACHE_SIZE 16
+
+// Raw frame store: a flash partition (see partitions.csv) mapped into the
+// address space, so cached frames are sent to the panel straight from flash.
+// Slots are erase-sector aligned and hold a small header plus up to two planes.
+#define FRAME_STORE_LABEL "frames"
+#define FRAME_STORE_SUBTYPE 0x40
+#define FRAME_SLOT_HEADER 16
+#define FRAME_SLOT_BYTES (((FRAME_SLOT_HEADER + 2 * FRAME_BYTES) + 4095) & ~4095)
+
+// Frames at another geometry (X-Image-Width/Height) are cropped and scaled
+// to the panel while they stream in (lib/BilevelCodec FrameScaler), so one
+// server rendition can serve several panel sizes. Gray frames at another
+// geometry are shown from their first plane.
+#define SCALE_ENABLED 1
+
+// Living photo: one rendition LIVING_SCALE times the panel size is kept at
+// the end of the frame store partition (or in PSRAM without one), and the
+// photo on screen slowly zooms in and out of it, one crop every
+// LIVING_STEP_MS, with no download per step
+#define LIVING_ENABLED 1
+#define LIVING_SCALE 3
+#define LIVING_WIDTH (LIVING_SCALE * DISPLAY_WIDTH)
+#define LIVING_HEIGHT (LIVING_SCALE * DISPLAY_HEIGHT)
+#define LIVING_BYTES ((LIVING_WIDTH + 7) / 8 * LIVING_HEIGHT)
+#define LIVING_REGION_BYTES (((FRAME_SLOT_HEADER + LIVING_BYTES) + 4095) & ~4095)
+#define LIVING_STEPS 30                    // one zoom in and back out
+#define LIVING_STEP_MS (2 * 60 * 1000UL)
+
+// Progressive preview: a quarter-resolution pass ahead of the full frame,
+// shown with the fast partial waveform while the rest downloads. Offered
+// in the capabilities only on big panels (same limit as the server's
+// PROGRESSIVE_MIN_FRAME_BYTES), and the server decides per frame; override
+// with -DPROGRESSIVE_MIN_FRAME_BYTES=0 to offer it anyway.
+#ifndef PROGRESSIVE_MIN_FRAME_BYTES
+#define PROGRESSIVE_MIN_FRAME_BYTES 15000
+#endif
+#define PROGRESSIVE_ENABLED (FRAME_BYTES >= PROGRESSIVE_MIN_FRAME_BYTES)
+
+// 4-gray photos: the server sends two bit-planes and drawImage() shows them
+// with a grayscale waveform written straight to the SSD1681. Set to 0 to
+// keep photos 1-bit dithered.
+#ifndef GRAY_ENABLED
+#define GRAY_ENABLED 1
+#endif
+
+// Ghosting accounting: 1-bit frames use partial refreshes of the changed
+// area, and partial updates are counted per tile. A worn tile is cleaned
+// (regionally, or with a full refresh for large areas) once the device has
+// been idle, or on the next update once it passes the hard limit.
+#ifndef GHOST_PARTIAL_ENABLED
+#define GHOST_PARTIAL_ENABLED 1
+#endif
+#define GHOST_TILE_W 40             // multiple of 8: partial windows are byte aligned
+#define GHOST_TILE_H 40
+#define GHOST_TILES_X ((DISPLAY_WIDTH + GHOST_TILE_W - 1) / GHOST_TILE_W)
+#define GHOST_TILES_Y ((DISPLAY_HEIGHT + GHOST_TILE_H - 1) / GHOST_TILE_H)
+#define GHOST_SOFT_LIMIT 6          // partials before a tile is cleaned when idle
+#define GHOST_HARD_LIMIT 15         // partials before a tile is cleaned regardless
+#define GHOST_IDLE_MS (10UL * 60UL * 1000UL)  // no button use for this long = nobody watching
+#define GHOST_REGION_MAX_TILES 6    // bigger worn areas get a full refresh instead
+
+// Temperature-compensated waveform selection (degrees C, read from the
+// SSD1681's sensor before each update). Below these limits the faster
+// waveforms are skipped in favour of the slow, robust full refresh.
+#define TEMP_FAST_FULL_MIN_C 10     // GxEPD2 fast full update
+#define TEMP_PARTIAL_MIN_C    5     // partial (fast) refresh
+#define TEMP_GRAY_MIN_C      15     // custom 4-gray LUT (not temperature compensated)
+#define TEMP_GRAY_MAX_C      35
+#define TEMP_DEFAULT_C       20     // assumed until the first good reading
+
+// Dashboard template: the layout (with fonts and icons) is cached in flash
+// and only widget bindings are downloaded; changed widgets are redrawn and
+// partial-refreshed on their own
+#define TEMPLATE_ENABLED 1
+#define TEMPLATE_MAX_FONTS 2
+#define TEMPLATE_MAX_GLYPHS 160
+#define TEMPLATE_MAX_ICONS 4
+#define TEMPLATE_MAX_BASE 12
+#define TEMPLATE_MAX_WIDGETS 24
+#define TEMPLATE_POOL_BYTES 2048    // glyph and icon bitmaps, base strings
+#define TEMPLATE_MAX_BITMAP_PX 32   // glyph and icon width / height
+
+// Locally redrawn rectangles (template widgets, overlays) are partial-
+// refreshed one by one; more than this many refresh as one window
+#define DIRTY_MAX_RECTS 4
+
+// Photo overlays: badge layers composited over the photo on the device
+#define OVERLAY_ENABLED 1
+#define OVERLAY_MAX_LAYERS 4
+#define OVERLAY_POOL_BYTES 2048     // ink + mask bitmaps of all layers
+
+// Alert banner: a short urgent message that comes with the poll, drawn on
+// the device with a cached template font into a strip at the bottom of
+// the panel and partial-refreshed; no frame is downloaded for it
+#define ALERT_ENABLED 1
+#define ALERT_BANNER_HEIGHT 24      // full-width strip, so rows stay byte aligned
+#define ALERT_MAX_TEXT 64           // bytes of UTF-8
+#define ALERT_MAX_TTL_S (24 * 3600)
+
+// Local screens (setup, WiFi failure, offline dashboard) draw their text
+// with compressed Unicode fonts from LittleFS (lib/FontStore, built by
+// backend/scripts/build-font-store.js), so they can be shown in the
+// owner's language. Without the font files they fall back to the
+// built-in GFX fonts, which are ASCII only, and to English.
+#define FONTS_ENABLED 1
+#define FONT_TITLE_PATH "/fonts/title.ifnt"
+#define FONT_TEXT_PATH "/fonts/text.ifnt"
+#define FONT_CACHE_GLYPHS 24        // decoded glyphs kept per font
+
+// Zone layouts: split screen, each zone cached and refreshed on its own
+#define ZONES_ENABLED 1
+#define ZONES_MAX 4
+
+// LAN peer sharing (lib/PeerShare): devices the server puts in the same
+// peer group get frames from the elected leader instead of the cloud.
+// A follower waits this long for the group before downloading itself.
+#define PEER_ENABLED 1
+#define PEER_MULTICAST_IP IPAddress(239, 255, 73, 70)
+#define PEER_UDP_PORT 4270
+#define PEER_WAIT_MS 8000
+#define PEER_POLL_MIN_MS 10000      // leader polls early at most this often
+
+// Synchronized refresh: a poll may say "display at T" (epoch ms). The frame
+// is prefetched and the panel refresh starts at T on the SNTP clock, with
+// the local oscillator's drift measured between syncs.
+#define SYNC_ENABLED 1
+#define SYNC_NTP_SERVER "pool.ntp.org"
+#define SYNC_NTP_INTERVAL_MS (15 * 60 * 1000UL)
+#define SYNC_MAX_WAIT_MS 120000      // schedules further out are drawn at once
+#define SYNC_PREPARE_MS 2000         // temperature read, compositing and RAM write start this early
+#define SYNC_MAX_DRIFT_PPM 200.0
+
+// CoAP transport (lib/CoapLite): the poll and small notifications go to
+// the CoAP gateway named at registration, over DTLS with a per-device
+// pre-shared key. Frames and anything that fails stay on HTTPS.
+#define COAP_ENABLED 1
+#define COAP_BUFFER_BYTES 1152       // a whole poll response fits one datagram
+#define COAP_HANDSHAKE_MAX_MS 2000   // DTLS retransmits after 1 s and 2 s, then gives up
+#define COAP_REQUEST_BUDGET_MS 4000  // whole exchange, handshake included; HTTPS allows 5-10 s
+#define COAP_BACKOFF_MIN_S 300       // after a failure CoAP rests this long, doubling per failure
+#define COAP_BACKOFF_MAX_S (6 * 3600)
+#define COAP_IDLE_MS (10 * 60 * 1000UL)  // NAT bindings may be gone after this: resume
+
+// Link quality tiers: smoothed download throughput, failure rate and RSSI
+// pick how much photo detail to ask for (full gray, 1-bit, or coarse
+// 1-bit that compresses far better). A photo shown below the full tier
+// is fetched again once the link allows.
+#define LINK_ENABLED 1
+#define LINK_EWMA_WEIGHT 0.3f
+#define LINK_MIN_SAMPLE_BYTES 1024   // smaller downloads say little about throughput
+#define LINK_FULL_MIN_KBPS 8.0f      // a 10 KB gray frame in about a second
+#define LINK_LITE_MIN_KBPS 3.0f
+#define LINK_LOSS_MAX 0.25f          // above this failure rate, one tier lower
+#define LINK_RSSI_WEAK_DBM -78
+#define LINK_RSSI_POOR_DBM -86
+#define LINK_UPGRADE_INTERVAL_MS (3 * 60 * 1000UL)
+#define LINK_DECAY_INTERVAL_MS (10 * 60 * 1000UL)  // without samples, halve the way to neutral
+#define LINK_NEUTRAL_KBPS 16.0f      // where an estimate without samples settles
+
+// Request scheduling: there is one radio and one TLS session, so requests
+// run one at a time and the question is which goes next. Button-driven
+// fetches always go first; background work (cache refills, quality
+// upgrades) stays off the air while the user is interacting, is cut short
+// by a button press, and has a byte budget per window.
+#define NET_QUIET_MS 15000               // no background traffic this long after a button press
+#define NET_BACKGROUND_BUDGET_BYTES (256 * 1024UL)
+#define NET_BUDGET_WINDOW_MS (60 * 60 * 1000UL)
+#define NET_RETRY_MS (10 * 60 * 1000UL)  // before a failed background job runs again
+
+// Connection prewarming: DNS, TCP and TLS (or the DTLS resumption) are
+// done shortly before a poll is due, so the poll goes out on a ready
+// session. The lead time follows the handshake times seen so far.
+#define PREWARM_ENABLED 1
+#define PREWARM_DEFAULT_LEAD_MS 1500   // until a handshake has been timed
+#define PREWARM_MIN_LEAD_MS 300
+#define PREWARM_MAX_LEAD_MS 8000       // servers drop sockets that sit idle too long
 
 // ============================================================
 // GLOBALS
@@ -81,7 +287,8 @@ bool wifiConnected = false;
 enum DisplayMode {
   MODE_DASHBOARD,
   MODE_IMAGE,
-  MODE_SETUP
+  MODE_SETUP,
+  MODE_ZONES      // split screen (see ZONE LAYOUTS)
 };
 
 DisplayMode currentMode = MODE_DASHBOARD;
@@ -95,10 +302,310 @@ int serverRefreshVersion = 0;
 int nextPollSeconds = 30;  // Default: poll every 30 seconds
 unsigned long lastPollTime = 0;
 
+// Per-resource versions from the poll ("vv"), so only what changed is
+// refetched. -1 = not known yet. Persisted so the photo cache survives
+// a reboot.
+enum Resource {
+  RES_DASHBOARD,  // dashboard data (weather, calendar, todos)
+  RES_PHOTOS,     // photo list and photo processing
+  RES_SETTINGS,   // device settings (/image-info)
+  RES_FIRMWARE,   // firmware release
+  RES_OVERLAY,    // photo overlays (clock, weather badges)
+  RES_ZONES,      // zone layout and zone contents
+  RES_COUNT
+};
+int32_t resourceVersion[RES_COUNT] = {-1, -1, -1, -1, -1, -1};
+
+// Photo quality tiers (?q=), see LINK QUALITY
+enum LinkTier {
+  TIER_COARSE,    // 1-bit, ordered dithering (compresses best)
+  TIER_LITE,      // 1-bit, error diffusion
+  TIER_FULL       // full detail (gray planes where supported)
+};
+
+// Link estimate from recent downloads, and the tier of the photo shown
+float linkKBps = -1;              // smoothed throughput, -1 = not measured yet
+float linkLoss = 0;               // smoothed failure rate, 0..1
+unsigned long linkSampleMs = 0;   // last download recorded (or last decay step)
+LinkTier frameTier = TIER_FULL;
+int frameUpgradeIndex = -1;       // photo shown below the full tier, -1 = none
+unsigned long linkUpgradeTryMs = 0;
+
+// Request scheduler (see NET SCHEDULER)
+enum NetPriority {
+  NET_FOREGROUND,   // the user is waiting: button handlers
+  NET_REFRESH,      // the poll and the refreshes it triggers
+  NET_BACKGROUND    // prefetch and upgrades nobody is waiting for
+};
+NetPriority netPriority = NET_REFRESH;  // class of the requests being made
+bool netPreempted = false;              // the background job was cut short
+unsigned long netBudgetStartMs = 0;
+size_t netBudgetUsed = 0;
+unsigned long photoRefillTryMs = 0;
+
+// Connection prewarming (see CONNECTION PREWARM)
+float prewarmHandshakeMs = -1;   // smoothed handshake time, -1 = none timed yet
+bool prewarmDone = false;        // the connection for the next poll is up
+
+// Button-to-pixel latency: set on a button gesture, cleared when the first
+// visible update lands. The last measurement is reported with the next poll.
+unsigned long interactionStartMs = 0;
+long lastFeedbackMs = -1;
+
 // Image buffer (200x200 / 8 = 5000 bytes)
-uint8_t imageBuffer[DISPLAY_WIDTH * DISPLAY_HEIGHT / 8];
+uint8_t imageBuffer[FRAME_BYTES];
 bool hasImage = false;
 
+// 4-gray frames: imageBuffer holds the MSB plane (a usable 1-bit frame on
+// its own, which is what history keeps) and grayPlane the LSB plane
+uint8_t grayPlane[FRAME_BYTES];
+bool imageGray = false;
+
+// Last full refresh time per rendering path, reported with the next poll
+long refreshMsBw = -1;
+long refreshMsGray = -1;
+
+// Content freshness: the server's change time for the update being
+// fetched (poll "ct"), and the last change shown with the SNTP time its
+// panel update finished. Reported with the next poll.
+uint64_t freshPendingAt = 0;
+uint64_t freshChangedAt = 0;   // 0 = nothing to report
+int64_t freshShownAt = 0;
+
+// Panel temperature and the waveforms it allows (see selectWaveform())
+float panelTempC = TEMP_DEFAULT_C;
+bool panelTempMeasured = false;
+bool panelHibernating = false;   // deep sleep after drawImageGray() until GxEPD2 wakes it
+bool waveformPartialOk = true;
+bool waveformGrayOk = true;
+
+// Ghosting accounting: partial updates per tile since it was last cleaned,
+// and a hash of what each tile shows (valid while ghostPanelKnown)
+uint8_t ghostCount[GHOST_TILES_Y][GHOST_TILES_X];
+uint32_t ghostTileHash[GHOST_TILES_Y][GHOST_TILES_X];
+bool ghostPanelKnown = false;
+unsigned long lastInteractionMs = 0;
+
+// Local screens (see DASHBOARD): which one is on the panel and a hash of
+// what each of its widgets shows
+enum LocalScreenId { SCREEN_NONE, SCREEN_DASHBOARD, SCREEN_SETUP, SCREEN_WIFI_FAILED };
+enum DashWidgetId { DASH_TITLE, DASH_DEVICE, DASH_NETWORK, DASH_IMAGES, DASH_UPTIME, DASH_WIDGETS };
+enum SetupWidgetId { SETUP_TITLE, SETUP_STEPS, SETUP_CONNECT, SETUP_FOLLOW, SETUP_WIDGETS };
+enum FailedWidgetId { FAILED_TITLE, FAILED_HINT, FAILED_WIDGETS };
+#define SCREEN_MAX_WIDGETS DASH_WIDGETS
+uint32_t screenShownHash[SCREEN_MAX_WIDGETS];
+LocalScreenId screenOnPanel = SCREEN_NONE;
+
+// What the frame in imageBuffer shows, set by fetchBitmap() and cache loads
+// frameFromServer is cleared once the frame has been recorded in history
+bool frameFromServer = false;
+DisplayMode frameMode = MODE_DASHBOARD;
+int frameImageIndex = 0;
+
+// Frame history ring (newest at historyHead, cursor counts back from it)
+struct FrameMeta {
+  uint32_t hash;        // FNV-1a of the frame, 0 = empty slot
+  uint8_t mode;         // DisplayMode the frame was shown in
+  int16_t imageIndex;   // carousel index (photo frames)
+  int32_t version;      // serverRefreshVersion when it was shown
+};
+
+FrameMeta historyMeta[HISTORY_SIZE];
+uint8_t historyHead = 0;
+uint8_t historyCount = 0;
+uint8_t historyCursor = 0;       // 0 = newest frame
+uint8_t* historyPsram = nullptr; // frame storage when PSRAM is available
+
+bool flashFsReady = false;       // LittleFS mounted
+
+// Photo cache: hash per carousel index (0 = not cached), valid while the
+// server's image count and photo list version match what it was filled with
+uint32_t photoCacheHash[PHOTO_CACHE_SIZE];
+int photoCacheTotal = -1;
+int photoCacheVersion = -1;
+LinkTier photoCacheTier = TIER_FULL;  // tier the contact sheet was fetched at
+
+// Mapped frame store (nullptr when the partition is missing). frameMapped
+// points into it while the frame being shown is read in place; imageBuffer
+// is stale then, see currentFrame() and frameMaterialize().
+const esp_partition_t* frameStorePart = nullptr;
+const uint8_t* frameStoreMap = nullptr;
+spi_flash_mmap_handle_t frameStoreHandle;
+int frameStoreSlots = 0;
+const uint8_t* frameMapped = nullptr;
+
+// Living photo (see LIVING PHOTO). livingData points at the rendition in
+// mapped flash or PSRAM while it is complete.
+bool livingEnabled = false;       // device setting from the server
+size_t livingOffset = 0;          // rendition region in the frame store partition
+uint8_t* livingPsram = nullptr;
+const uint8_t* livingData = nullptr;
+int livingIndex = -1;             // photo the rendition is of
+int livingVersion = -1;           // photo list version it was fetched at
+uint32_t livingHash = 0;          // picks the point the zoom heads for
+int livingShownIndex = -1;        // photo the steps are counted for
+int livingStep = 0;
+unsigned long livingStepMs = 0;
+unsigned long livingTryMs = 0;
+
+// Peer sharing: group and content key from the last poll (0 = none). The
+// key names the frame for (peerKeyMode, peerKeyIndex) on this kind of panel.
+uint32_t peerGroupId = 0;
+uint32_t peerKey = 0;
+DisplayMode peerKeyMode = MODE_DASHBOARD;
+int peerKeyIndex = 0;
+uint32_t peerFrameKey = 0;       // key of the frame just fetched, see peerPublishFrame()
+size_t peerFrameLength = 0;
+unsigned long peerEarlyPollMs = 0;
+
+// Wall clock model for synchronized refresh: epoch ms at a local timer
+// reading, advanced at the local rate corrected by the measured drift.
+// SNTP samples win; the server's time is only used until SNTP has synced.
+bool clockSynced = false;
+bool clockFromNtp = false;
+int64_t clockBaseEpochMs = 0;
+int64_t clockBaseUs = 0;
+double clockDriftPpm = 0;
+uint64_t syncDrawAt = 0;         // draw the prefetched frame at this epoch ms (0 = none)
+uint64_t panelRefreshAt = 0;     // hold the next refresh trigger until this epoch ms (0 = none)
+int64_t syncLateMs = 0;          // how far off the last held trigger went out
+
+// CoAP gateway and this device's DTLS pre-shared key, from registration
+char coapHost[64] = "";
+uint16_t coapPort = 0;
+uint8_t coapPsk[16];
+bool coapProvisioned = false;
+
+// CoAP breaker: consecutive failures and when CoAP may be tried again
+// (time(), which keeps running through deep sleep). In RTC memory so a
+// network that drops UDP isn't retried on every wake.
+RTC_DATA_ATTR uint8_t coapFailures = 0;
+RTC_DATA_ATTR time_t coapSuspendedUntil = 0;
+
+// Outbox: server notifications queued while offline or browsing history,
+// flushed before the next poll. One entry per endpoint, latest wins.
+#define OUTBOX_SIZE 4
+struct OutboxEntry {
+  char endpoint[16];
+  char payload[64];
+  bool used;
+};
+OutboxEntry outbox[OUTBOX_SIZE];
+
+// Dashboard template (see DASHBOARD TEMPLATE)
+enum TemplateType : uint8_t {
+  TEMPLATE_NONE,
+  TEMPLATE_FILL,
+  TEMPLATE_TEXT,
+  TEMPLATE_ICON
+};
+
+struct TemplateFont {
+  char name[4];
+  uint8_t w, h, advance;
+  uint16_t first, count;  // range in templateGlyphs
+};
+
+struct TemplateGlyph {
+  uint32_t cp;            // Unicode code point
+  uint16_t offset;        // bitmap in templatePool
+};
+
+struct TemplateIcon {
+  char name[8];
+  uint8_t w, h;
+  uint16_t offset;
+};
+
+struct TemplateElement {
+  char id[8];             // binding key (widgets only)
+  uint8_t type;
+  uint8_t font;
+  uint8_t scale;
+  bool ink;               // true = black
+  bool bg;                // widget background, true = black
+  int16_t x, y, w, h;
+  int16_t text;           // base text in templatePool, -1 = none
+  uint32_t valueHash;     // hash of the value drawn, 0 = not drawn yet
+};
+
+TemplateFont templateFonts[TEMPLATE_MAX_FONTS];
+TemplateGlyph templateGlyphs[TEMPLATE_MAX_GLYPHS];
+TemplateIcon templateIcons[TEMPLATE_MAX_ICONS];
+TemplateElement templateBase[TEMPLATE_MAX_BASE];
+TemplateElement templateWidgets[TEMPLATE_MAX_WIDGETS];
+uint8_t templatePool[TEMPLATE_POOL_BYTES];
+int templateFontCount = 0;
+int templateGlyphCount = 0;
+int templateIconCount = 0;
+int templateBaseCount = 0;
+int templateWidgetCount = 0;
+int templatePoolUsed = 0;
+bool templateReady = false;
+uint32_t templateVersion = 0;     // layout hash ('l') from the server
+uint32_t templateFrameHash = 0;   // imageBuffer hash after the last template render
+
+// Rectangles redrawn locally since the last refresh, consumed by drawImage()
+struct PanelRect {
+  int16_t x, y, w, h;
+  bool clean;             // flash it through its negative first, like a full refresh
+};
+PanelRect dirtyRects[DIRTY_MAX_RECTS];
+int dirtyRectCount = 0;
+
+// Photo overlays (see OVERLAY LAYERS). layerBase holds the photo without
+// overlays; imageBuffer holds the composite, whose hash is layerComposedHash.
+struct OverlayLayer {
+  uint8_t id;
+  int16_t x, y, w, h;     // x and w are multiples of 8
+  uint16_t offset;        // ink in overlayPool, mask right after it
+};
+OverlayLayer overlayLayers[OVERLAY_MAX_LAYERS];
+OverlayLayer overlayPrev[OVERLAY_MAX_LAYERS];  // geometry before the last fetch
+uint8_t overlayPool[OVERLAY_POOL_BYTES];
+int overlayCount = 0;
+int overlayPrevCount = 0;
+int32_t overlayVersion = -1;      // resourceVersion[RES_OVERLAY] the layers are from
+uint8_t layerBase[FRAME_BYTES];
+uint8_t layerBaseGray[GRAY_ENABLED ? FRAME_BYTES : 1];
+uint32_t layerComposedHash = 0;   // 0 = imageBuffer is not a composite
+
+// Alert banner (see ALERT BANNER). The banner is never drawn into
+// imageBuffer: drawImage() paints a copy of the frame with the strip
+// replaced (alertFrame), so dismissing it repaints the frame as it was.
+uint8_t alertFrame[ALERT_ENABLED ? FRAME_BYTES : 1];
+uint8_t alertStrip[ALERT_ENABLED ? ALERT_BANNER_HEIGHT * DISPLAY_WIDTH / 8 : 1];
+uint32_t alertId = 0;             // alert in alertStrip, 0 = none
+bool alertShown = false;          // alertId is up (not yet expired)
+unsigned long alertShownMs = 0;
+unsigned long alertTtlMs = 0;
+
+// Local screen fonts and language (see LOCAL FONTS)
+enum LocalFont { FONT_TITLE, FONT_TEXT, FONT_COUNT };
+FontStore localFonts[FONT_COUNT];
+char deviceLang[4] = "en";        // from image-info, kept in preferences
+
+// Zone layout (see ZONE LAYOUTS)
+struct Zone {
+  char id[8];
+  int16_t x, y, w, h;     // x and w are multiples of 8
+  uint32_t version;       // current version from /zones
+  uint32_t shown;         // version drawn into imageBuffer, 0 = none
+  bool fullRefresh;       // policy: clean refresh of the zone's window instead of a plain partial
+};
+Zone zones[ZONES_MAX];
+int zoneCount = 0;
+uint32_t zoneFrameHash = 0;       // imageBuffer hash after the last zone update
+
+bool forceFullRefresh = false;    // next drawImage() must not use a partial window
+
+enum ButtonGesture {
+  GESTURE_NONE,
+  GESTURE_SINGLE,
+  GESTURE_DOUBLE,
+  GESTURE_LONG
+};
+
 // Function declarations
 void initDisplay();
 void drawTestScreen();
@@ -106,17 +613,94 @@ void drawDashboard();
 bool fetchBitmap(int index, const char* mode);
 bool fetchDashboard();
 void drawSetupScreen();
+void drawWifiFailedScreen();
+void initLocalFonts();
+void saveDeviceLang(const char* lang);
 void setupWiFi();
 void resetWiFiSettings();
 bool fetchImage(int index);
 void drawImage();
 void registerDevice();
+void buildCapabilities(JsonDocument& caps);
 void fetchDeviceSettings();
+void drawPreview(int previewWidth, int previewHeight);
+void drawImageGray();
+void markVisibleFeedback();
+void markFreshness();
 void toggleMode();
 void advanceImage();
 void setupSecureClient();
 bool pollServerForInstructions();
 void notifyServerModeChange(const char* mode);
+ButtonGesture readButtonGesture();
+uint32_t fnv1a(uint32_t hash, const uint8_t* data, size_t len);
+uint32_t frameHash(const uint8_t* data, size_t len);
+int readStreamBytes(HTTPClient& http, uint8_t* dst, int len, unsigned long startTime, unsigned long timeoutMs);
+bool decodeFrameStream(HTTPClient& http, const BilevelCodec* codec, int planes, int remaining, unsigned long startTime, unsigned long timeoutMs);
+bool scaleFrameStream(HTTPClient& http, const BilevelCodec* codec, int width, int height, int planes, int remaining, unsigned long startTime, unsigned long timeoutMs);
+void loadResourceVersions();
+void initFrameStore();
+const uint8_t* currentFrame();
+void frameMaterialize();
+void initPhotoCache();
+bool photoCacheLoad(int index);
+bool fetchContactSheet();
+void initFrameHistory();
+void historyRecord();
+bool historyStep(int delta);
+void outboxPut(const char* endpoint, const String& payload);
+void outboxFlush();
+void loadLayoutTemplate();
+bool fetchLayoutTemplate();
+bool fetchDashboardData();
+void markDirtyRect(int x, int y, int w, int h, bool clean = false);
+bool fetchOverlays();
+void overlayPrepare();
+void overlayRedraw();
+bool alertUpdate(JsonObject alert);
+void alertRedraw();
+void alertLoop();
+const uint8_t* alertCompose(const uint8_t* frame);
+bool updateZones();
+void peerSetGroup(uint32_t group, const char* keyHex);
+bool peerFollowing();
+bool peerReceive(DisplayMode mode, int index);
+void peerFrameFetched(DisplayMode mode, int index, size_t length);
+void peerPublishFrame();
+void peerLoop();
+void initClockSync();
+void clockServerSample(uint64_t serverMs, int64_t sentUs, int64_t receivedUs);
+void drawFetched(uint64_t displayAt);
+void syncLoop();
+unsigned long prewarmLeadMs();
+void prewarmLoop(unsigned long dueInMs);
+bool netAdmit(size_t bytes);
+bool netPreempt();
+void netBackgroundLoop();
+bool photoRefillLoop();
+bool fetchLivingPhoto(int index);
+bool livingFetchLoop();
+void livingLoop();
+LinkTier linkTier();
+void linkRecord(bool ok, size_t bytes, unsigned long ms);
+unsigned long linkTimeoutMs(size_t bytes);
+void linkUpgradeLoop();
+void loadCoapConfig();
+void coapProvision(JsonObjectConst reply);
+void coapClose();
+bool coapSuspended();
+int coapRequest(uint8_t method, const char* path, const char* query, const String& payload, String& response);
+const char* modeName(DisplayMode mode);
+float readPanelTemperature();
+void selectWaveform();
+void panelRefreshGate();
+bool ghostChangedBounds(const uint8_t* frame, int& x, int& y, int& w, int& h);
+void ghostRecordPartial(const uint8_t* frame);
+void ghostRecordFull(const uint8_t* frame);
+void ghostRecordRect(int x, int y, int w, int h);
+void ghostRecordClean(const PanelRect& r);
+bool ghostCleaningDue(bool idle);
+void ghostMaintain();
 
 // ============================================================
 // SETUP
@@ -146,6 +730,21 @@ void setup() {
   
   // Initialize display
   initDisplay();
+
+  // Flash filesystem for frame history and the photo cache
+  flashFsReady = LittleFS.begin(true);
+  if (!flashFsReady) {
+    Serial.println("LittleFS mount failed, flash caches disabled");
+  }
+
+  // Restore frame history for local back/forward navigation
+  initFrameHistory();
+  initFrameStore();
+  loadResourceVersions();  // the photo cache is keyed on the photo list version
+  initPhotoCache();
+  loadLayoutTemplate();
+  loadCoapConfig();
+  initLocalFonts();
   
   // Draw test pattern
   Serial.println("\nDrawing test screen...");
@@ -166,35 +765,58 @@ void setup() {
 // The server tells us when to refresh, what mode to use, etc.
 // ============================================================
 void loop() {
-  static unsigned long lastButtonPress = 0;
-
-  // Check for button press (manual mode toggle)
-  static bool lastButtonState = HIGH;
-  bool currentButtonState = digitalRead(BUTTON_PIN);
+  // Button gestures: press = toggle mode, double press = previous frame,
+  // long press = next frame (history navigation is local, no download)
+  ButtonGesture gesture = readButtonGesture();
+  if (gesture != GESTURE_NONE) {
+    interactionStartMs = millis();
+    lastInteractionMs = interactionStartMs;
+    netPriority = NET_FOREGROUND;
+    freshPendingAt = 0;  // what gets drawn now is the user's choice, not the change
+  }
 
-  if (currentButtonState == LOW && lastButtonState == HIGH && millis() - lastButtonPress > 300) {
-    lastButtonPress = millis();
+  if (gesture == GESTURE_SINGLE) {
     Serial.println("Button pressed - toggling mode");
     toggleMode();
     // Reset poll timer to allow immediate server sync
     lastPollTime = 0;
+  } else if (gesture == GESTURE_DOUBLE) {
+    Serial.println("Double press - previous frame");
+    historyStep(1);
+  } else if (gesture == GESTURE_LONG) {
+    Serial.println("Long press - next frame");
+    historyStep(-1);
   }
-  lastButtonState = currentButtonState;
+  interactionStartMs = 0;  // handlers draw synchronously; nothing left to measure
+  netPriority = NET_REFRESH;
 
   if (!wifiConnected) {
     delay(50);
     return;
   }
 
+  // A scheduled refresh is due before anything else
+  syncLoop();
+
   // Server-driven polling
   // Poll interval is controlled by server (returned in 'n' field)
   unsigned long pollIntervalMs = (unsigned long)nextPollSeconds * 1000UL;
+  unsigned long sinceLastPoll = millis() - lastPollTime;
 
-  if (millis() - lastPollTime > pollIntervalMs) {
+  if (sinceLastPoll > pollIntervalMs) {
     pollServerForInstructions();
     lastPollTime = millis();
+    prewarmDone = false;
+  } else if (lastPollTime != 0) {
+    prewarmLoop(pollIntervalMs - sinceLastPoll);
   }
 
+  ghostMaintain();
+  peerLoop();
+  alertLoop();
+  livingLoop();
+  netBackgroundLoop();
+
   delay(50);
 }
 
@@ -245,25 +867,299 @@ void toggleMode() {
 // ============================================================
 // NOTIFY SERVER OF MODE CHANGE
 // ============================================================
+// Mode name in the server API
+const char* modeName(DisplayMode mode) {
+  if (mode == MODE_IMAGE) return "photo";
+  if (mode == MODE_ZONES) return "zones";
+  return "dashboard";
+}
+
 void notifyServerModeChange(const char* mode) {
-  HTTPClient http;
-  String deviceId = String((uint32_t)ESP.getEfuseMac(), HEX);
-  String url = String(API_SERVER) + "/api/device/" + deviceId + "/set-mode";
+  String payload = "{\"mode\":\"" + String(mode) + "\"}";
+  String response;
+  int httpCode = coapRequest(COAP_POST, "set-mode", nullptr, payload, response);
 
-  http.begin(secureClient, url);
-  http.addHeader("Content-Type", "application/json");
-  http.setTimeout(5000);
+  if (httpCode == 0) {
+    HTTPClient http;
+    String deviceId = String((uint32_t)ESP.getEfuseMac(), HEX);
+    String url = String(API_SERVER) + "/api/device/" + deviceId + "/set-mode";
 
-  String payload = "{\"mode\":\"" + String(mode) + "\"}";
-  int httpCode = http.POST(payload);
+    http.begin(secureClient, url);
+    http.addHeader("Content-Type", "application/json");
+    http.setTimeout(5000);
+    httpCode = http.POST(payload);
+    http.end();
+  }
 
   if (httpCode == 200) {
     Serial.printf("Server mode updated to: %s\n", mode);
   } else {
     Serial.printf("Failed to update server mode: %d\n", httpCode);
   }
+}
 
-  http.end();
+// ============================================================
+// BUTTON GESTURES
+// Sampled from loop() every ~50ms, which also debounces the button.
+// A single press is only reported once the double-press window closes.
+// ============================================================
+ButtonGesture readButtonGesture() {
+  static bool lastState = HIGH;
+  static bool held = false;
+  static bool longFired = false;
+  static uint8_t pressCount = 0;
+  static unsigned long pressedAt = 0;
+  static unsigned long releasedAt = 0;
+
+  bool state = digitalRead(BUTTON_PIN);
+  unsigned long now = millis();
+  ButtonGesture gesture = GESTURE_NONE;
+
+  if (state == LOW && lastState == HIGH) {
+    held = true;
+    longFired = false;
+    pressedAt = now;
+  } else if (state == HIGH && lastState == LOW && held) {
+    held = false;
+    releasedAt = now;
+    if (!longFired) pressCount++;
+  }
+  lastState = state;
+
+  // Long press fires while still held so feedback doesn't wait for release
+  if (held && !longFired && now - pressedAt >= BUTTON_LONG_PRESS_MS) {
+    longFired = true;
+    pressCount = 0;
+    return GESTURE_LONG;
+  }
+
+  if (!held && pressCount > 0 && now - releasedAt >= BUTTON_DOUBLE_PRESS_MS) {
+    gesture = (pressCount >= 2) ? GESTURE_DOUBLE : GESTURE_SINGLE;
+    pressCount = 0;
+  }
+
+  return gesture;
+}
+
+// ============================================================
+// FRAME HISTORY
+// Keeps the last HISTORY_SIZE displayed frames so the button can step
+// back and forward without a server round trip. Frames live in PSRAM
+// when the board has it, otherwise in LittleFS (metadata in Preferences
+// so the history survives a reboot).
+// ============================================================
+uint32_t fnv1a(uint32_t hash, const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    hash ^= data[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+// Same hash as frameHash() in the server's image-processor
+uint32_t frameHash(const uint8_t* data, size_t len) {
+  uint32_t hash = fnv1a(2166136261UL, data, len);
+  return hash ? hash : 1;  // 0 marks an empty slot
+}
+
+static String historyPath(uint8_t slot) {
+  return "/hist" + String(slot) + ".bin";
+}
+
+static uint8_t historySlot(uint8_t offset) {
+  return (historyHead + HISTORY_SIZE - offset) % HISTORY_SIZE;
+}
+
+static void historySaveMeta() {
+  if (historyPsram) return;  // PSRAM history doesn't survive reboot anyway
+
+  preferences.begin("inkframe", false);
+  preferences.putBytes("histMeta", historyMeta, sizeof(historyMeta));
+  preferences.putUChar("histHead", historyHead);
+  preferences.putUChar("histCount", historyCount);
+  preferences.end();
+}
+
+static bool historyWriteFrame(uint8_t slot, const uint8_t* frame) {
+  if (historyPsram) {
+    memcpy(historyPsram + (size_t)slot * FRAME_BYTES, frame, FRAME_BYTES);
+    return true;
+  }
+
+  File f = LittleFS.open(historyPath(slot), FILE_WRITE);
+  if (!f) return false;
+  size_t written = f.write(frame, FRAME_BYTES);
+  f.close();
+  return written == FRAME_BYTES;
+}
+
+static bool historyReadFrame(uint8_t slot, uint8_t* frame) {
+  if (historyPsram) {
+    memcpy(frame, historyPsram + (size_t)slot * FRAME_BYTES, FRAME_BYTES);
+    return true;
+  }
+
+  File f = LittleFS.open(historyPath(slot), FILE_READ);
+  if (!f) return false;
+  size_t got = f.read(frame, FRAME_BYTES);
+  f.close();
+  return got == FRAME_BYTES;
+}
+
+void initFrameHistory() {
+  memset(historyMeta, 0, sizeof(historyMeta));
+  historyHead = 0;
+  historyCount = 0;
+  historyCursor = 0;
+
+  if (psramFound()) {
+    historyPsram = (uint8_t*)ps_malloc((size_t)HISTORY_SIZE * FRAME_BYTES);
+  }
+  if (historyPsram) {
+    Serial.printf("Frame history: %d frames in PSRAM\n", HISTORY_SIZE);
+    return;
+  }
+
+  if (!flashFsReady) {
+    Serial.println("Frame history: no flash filesystem, history disabled");
+    return;
+  }
+
+  preferences.begin("inkframe", true);
+  if (preferences.getBytesLength("histMeta") == sizeof(historyMeta)) {
+    preferences.getBytes("histMeta", historyMeta, sizeof(historyMeta));
+    historyHead = preferences.getUChar("histHead", 0) % HISTORY_SIZE;
+    historyCount = min((int)preferences.getUChar("histCount", 0), HISTORY_SIZE);
+  }
+  preferences.end();
+
+  Serial.printf("Frame history: %d/%d frames in flash\n", historyCount, HISTORY_SIZE);
+}
+
+// Record the frame in imageBuffer as the newest history entry.
+// Called after a server frame has been drawn; local navigation doesn't record.
+// A photo is recorded without its overlays: drawImage() composites the
+// current ones over it again when it is shown, instead of stacking them.
+void historyRecord() {
+  const uint8_t* frame = (layerComposedHash != 0) ? layerBase : currentFrame();
+  uint32_t hash = frameHash(frame, FRAME_BYTES);
+
+  // Same frame as the newest entry (e.g. a refresh with unchanged content)
+  if (historyCount > 0 && historyMeta[historyHead].hash == hash) {
+    historyCursor = 0;
+    return;
+  }
+
+  uint8_t slot = (historyCount == 0) ? historyHead : (historyHead + 1) % HISTORY_SIZE;
+  if (!historyWriteFrame(slot, frame)) {
+    Serial.println("Frame history: write failed");
+    return;
+  }
+
+  historyMeta[slot].hash = hash;
+  historyMeta[slot].mode = (uint8_t)frameMode;
+  historyMeta[slot].imageIndex = frameImageIndex;
+  historyMeta[slot].version = serverRefreshVersion;
+  historyHead = slot;
+  if (historyCount < HISTORY_SIZE) historyCount++;
+  historyCursor = 0;
+
+  historySaveMeta();
+}
+
+// Step through history: delta > 0 goes back (older), delta < 0 forward.
+// Only the panel refresh is paid; the server learns about it via the outbox.
+bool historyStep(int delta) {
+  int target = (int)historyCursor + delta;
+  if (target < 0 || target >= historyCount) {
+    Serial.printf("History: no %s frame (%d/%d)\n",
+                  delta > 0 ? "older" : "newer", historyCursor + 1, historyCount);
+    return false;
+  }
+
+  uint8_t slot = historySlot(target);
+  if (!historyReadFrame(slot, imageBuffer)) {
+    Serial.println("History: read failed");
+    return false;
+  }
+
+  const FrameMeta& meta = historyMeta[slot];
+  historyCursor = target;
+  currentMode = (DisplayMode)meta.mode;
+  if (currentMode == MODE_IMAGE) currentImageIndex = meta.imageIndex;
+  hasImage = true;
+  imageGray = false;
+  frameMapped = nullptr;
+  frameFromServer = false;
+
+  Serial.printf("History: showing frame %d/%d (mode %d, index %d)\n",
+                historyCursor + 1, historyCount, meta.mode, meta.imageIndex);
+  drawImage();
+
+  // Reconcile the server so the next poll doesn't undo the navigation
+  String payload = "{\"mode\":\"" + String(modeName(currentMode)) +
+                   "\",\"index\":" + String(currentImageIndex) + "}";
+  outboxPut("set-index", payload);
+  return true;
+}
+
+// ============================================================
+// OUTBOX
+// ============================================================
+void outboxPut(const char* endpoint, const String& payload) {
+  OutboxEntry* entry = nullptr;
+
+  for (int i = 0; i < OUTBOX_SIZE && !entry; i++) {
+    if (outbox[i].used && strcmp(outbox[i].endpoint, endpoint) == 0) entry = &outbox[i];
+  }
+  for (int i = 0; i < OUTBOX_SIZE && !entry; i++) {
+    if (!outbox[i].used) entry = &outbox[i];
+  }
+  if (!entry) {
+    Serial.printf("Outbox full, dropping %s\n", endpoint);
+    return;
+  }
+
+  strlcpy(entry->endpoint, endpoint, sizeof(entry->endpoint));
+  strlcpy(entry->payload, payload.c_str(), sizeof(entry->payload));
+  entry->used = true;
+}
+
+void outboxFlush() {
+  String deviceId = String((uint32_t)ESP.getEfuseMac(), HEX);
+
+  for (int i = 0; i < OUTBOX_SIZE; i++) {
+    if (!outbox[i].used) continue;
+
+    String payload = String(outbox[i].payload);
+    String response;
+    int httpCode = coapRequest(COAP_POST, outbox[i].endpoint, nullptr, payload, response);
+
+    if (httpCode == 0) {
+      HTTPClient http;
+      String url = String(API_SERVER) + "/api/device/" + deviceId + "/" + outbox[i].endpoint;
+
+      http.begin(secureClient, url);
+      http.addHeader("Content-Type", "application/json");
+      http.setTimeout(5000);
+      httpCode = http.POST(payload);
+      http.end();
+    }
+
+    if (httpCode >= 200 && httpCode < 300) {
+      Serial.printf("Outbox: sent %s %s\n", outbox[i].endpoint, outbox[i].payload);
+      outbox[i].used = false;
+    } else if (httpCode >= 400 && httpCode < 500 && httpCode != 429) {
+      // Refused for good (e.g. an index the photos no longer have): sending
+      // it again can't help
+      Serial.printf("Outbox: %s rejected (%d), dropping %s\n", outbox[i].endpoint, httpCode, outbox[i].payload);
+      outbox[i].used = false;
+    } else {
+      // Transport error, server error or busy: keep the entry and retry on the next poll
+      Serial.printf("Outbox: %s failed: %d\n", outbox[i].endpoint, httpCode);
+      return;
+    }
+  }
 }
 
 // ============================================================
@@ -332,39 +1228,132 @@ void registerDevice() {
   }
   http.end();
 
+  // Capability descriptor: sent in full only when it differs from the one
+  // the server last acknowledged, otherwise just its hash. The server asks
+  // for the full descriptor (needCaps) if it doesn't know that hash.
+  JsonDocument caps;
+  buildCapabilities(caps);
+  String capsJson;
+  serializeJson(caps, capsJson);
+  uint32_t capsHash = frameHash((const uint8_t*)capsJson.c_str(), capsJson.length());
+
+  preferences.begin("inkframe", true);
+  uint32_t ackedCapsHash = preferences.getUInt("capsHash", 0);
+  preferences.end();
+
+  bool sendCaps = (capsHash != ackedCapsHash);
+
   // Now register
   Serial.println("\nSending registration...");
   String url = String(API_SERVER) + "/api/devices/register";
 
-  http.begin(secureClient, url);
-  http.addHeader("Content-Type", "application/json");
-  http.setTimeout(15000);
+  for (int attempt = 0; attempt < 2; attempt++) {
+    http.begin(secureClient, url);
+    http.addHeader("Content-Type", "application/json");
+    http.setTimeout(15000);
 
-  JsonDocument doc;
-  doc["deviceId"] = deviceId;
-  doc["displayType"] = "154_BW";
-  doc["firmwareVersion"] = "1.0.0";
+    JsonDocument doc;
+    doc["deviceId"] = deviceId;
+    doc["displayType"] = "154_BW";
+    doc["firmwareVersion"] = FIRMWARE_VERSION;
+    doc["capsHash"] = capsHash;
+    if (sendCaps) {
+      doc["caps"] = caps.as<JsonObjectConst>();
+    }
 
-  String payload;
-  serializeJson(doc, payload);
-  Serial.printf("Payload: %s\n", payload.c_str());
+    String payload;
+    serializeJson(doc, payload);
+    Serial.printf("Payload: %s\n", payload.c_str());
 
-  int httpCode = http.POST(payload);
+    int httpCode = http.POST(payload);
+    bool needCaps = false;
 
-  if (httpCode == 200 || httpCode == 201) {
-    Serial.println("SUCCESS! Device registered.");
-    Serial.println(http.getString());
-  } else if (httpCode < 0) {
-    Serial.printf("CONNECTION ERROR: %s\n", http.errorToString(httpCode).c_str());
-  } else {
-    Serial.printf("SERVER ERROR: HTTP %d\n", httpCode);
-    Serial.println(http.getString());
+    if (httpCode == 200 || httpCode == 201) {
+      Serial.println("SUCCESS! Device registered.");
+      String response = http.getString();
+      Serial.println(response);
+
+      JsonDocument reply;
+      if (!deserializeJson(reply, response)) {
+        needCaps = reply["needCaps"] | false;
+        coapProvision(reply["coap"].as<JsonObjectConst>());
+      }
+
+      if (sendCaps && !needCaps) {
+        preferences.begin("inkframe", false);
+        preferences.putUInt("capsHash", capsHash);
+        preferences.end();
+      }
+    } else if (httpCode < 0) {
+      Serial.printf("CONNECTION ERROR: %s\n", http.errorToString(httpCode).c_str());
+    } else {
+      Serial.printf("SERVER ERROR: HTTP %d\n", httpCode);
+      Serial.println(http.getString());
+    }
+
+    http.end();
+
+    if (!needCaps || sendCaps) break;
+    Serial.println("Server requested full capability descriptor");
+    sendCaps = true;
   }
 
-  http.end();
   Serial.println("--- REGISTRATION COMPLETE ---\n");
 }
 
+// ============================================================
+// CAPABILITY DESCRIPTOR
+// Describes what this build can decode and display. Panel traits come
+// from the GxEPD2 driver and the feature sections come from the compile
+// flags above, so the server can pick the cheapest payload per device and
+// only use features that a device's firmware actually has.
+// ============================================================
+void buildCapabilities(JsonDocument& caps) {
+  caps["v"] = 1;
+
+  JsonObject panel = caps["panel"].to<JsonObject>();
+  panel["w"] = DISPLAY_WIDTH;
+  panel["h"] = DISPLAY_HEIGHT;
+  panel["color"] = PanelDriver::hasColor;
+  panel["partial"] = PanelDriver::hasPartialUpdate;
+  panel["fastPartial"] = PanelDriver::hasFastPartialUpdate;
+  panel["fullMs"] = PanelDriver::full_refresh_time;
+  panel["partialMs"] = PanelDriver::partial_refresh_time;
+
+  // Frame payloads this firmware can decode
+  JsonArray formats = caps["formats"].to<JsonArray>();
+  formats.add("raw1");
+  if (PROGRESSIVE_ENABLED) formats.add("progressive");
+  if (PHOTO_CACHE_SIZE > 0) formats.add("contact-sheet");
+  if (GRAY_ENABLED) formats.add("gray2");
+  if (TEMPLATE_ENABLED) formats.add("template");
+  if (OVERLAY_ENABLED) formats.add("overlay");
+  if (ALERT_ENABLED && TEMPLATE_ENABLED) formats.add("alert");
+  if (ZONES_ENABLED) formats.add("zones");
+  if (PEER_ENABLED) formats.add("peer");
+  if (SYNC_ENABLED) formats.add("sync");
+  if (COAP_ENABLED) formats.add("coap");
+  if (SCALE_ENABLED) formats.add("scaled");
+  if (LIVING_ENABLED) formats.add("living");
+
+  // Compressed frame codecs (lib/BilevelCodec), in registry order
+  JsonArray codecs = caps["codecs"].to<JsonArray>();
+  for (size_t i = 0; i < codecCount(); i++) {
+    codecs.add(codecAt(i)->name);
+  }
+
+  caps["planes"] = GRAY_ENABLED ? 2 : 1;
+
+  JsonObject memory = caps["mem"].to<JsonObject>();
+  memory["ramKB"] = ESP.getHeapSize() / 1024;
+  memory["psramKB"] = ESP.getPsramSize() / 1024;
+
+  JsonObject cache = caps["cache"].to<JsonObject>();
+  cache["history"] = (historyPsram || flashFsReady) ? HISTORY_SIZE : 0;
+  cache["photos"] = (flashFsReady || frameStoreMap) ? PHOTO_CACHE_SIZE : 0;
+  cache["frameStore"] = frameStoreSlots;
+}
+
 // ============================================================
 // FETCH DEVICE SETTINGS
 // ============================================================
@@ -387,6 +1376,8 @@ void fetchDeviceSettings() {
       currentImageIndex = doc["currentIndex"] | 0;
       int rotateMinutes = doc["rotateMinutes"] | 60;
       imageRotateInterval = rotateMinutes * 60 * 1000UL;
+      livingEnabled = LIVING_ENABLED && (doc["livingPhoto"] | false);
+      saveDeviceLang(doc["lang"] | "en");
 
       Serial.printf("Settings: %d images, current: %d, rotate every %d min\n",
                     totalImages, currentImageIndex, rotateMinutes);
@@ -403,23 +1394,59 @@ void fetchDeviceSettings() {
 // This is the main polling function - server tells us what to do
 // ============================================================
 bool pollServerForInstructions() {
+  // Deliver queued notifications first so the poll sees our local state
+  outboxFlush();
+
   Serial.println("Polling server for instructions...");
 
   HTTPClient http;
   String deviceId = String((uint32_t)ESP.getEfuseMac(), HEX);
 
-  // Build URL with current state so server can compare
-  String url = String(API_SERVER) + "/api/device/" + deviceId + "/poll";
-  url += "?v=" + String(serverRefreshVersion);
-  url += "&m=" + String(currentMode == MODE_DASHBOARD ? "dashboard" : "photo");
-  url += "&i=" + String(currentImageIndex);
+  // Build query with current state so server can compare
+  String query = "v=" + String(serverRefreshVersion);
+  query += "&vv=";
+  for (int r = 0; r < RES_COUNT; r++) {
+    if (r) query += ",";
+    query += String(resourceVersion[r]);
+  }
+  query += "&m=" + String(modeName(currentMode));
+  query += "&i=" + String(currentImageIndex);
+  if (lastFeedbackMs >= 0) {
+    query += "&fb=" + String(lastFeedbackMs);
+  }
+  if (refreshMsBw >= 0) {
+    query += "&rb=" + String(refreshMsBw);
+  }
+  if (refreshMsGray >= 0) {
+    query += "&rg=" + String(refreshMsGray);
+  }
+  if (panelTempMeasured) {
+    query += "&tc=" + String(panelTempC, 1);
+  }
+  if (freshChangedAt) {
+    char fresh[48];
+    snprintf(fresh, sizeof(fresh), "&fc=%llu&fd=%lld", freshChangedAt, freshShownAt);
+    query += fresh;
+  }
 
-  http.begin(secureClient, url);
-  http.setTimeout(10000);
-  int httpCode = http.GET();
+  // CoAP when provisioned, HTTPS otherwise or when that fails
+  String response;
+  int64_t sentUs = esp_timer_get_time();
+  int httpCode = coapRequest(COAP_GET, "poll", query.c_str(), "", response);
+  if (httpCode == 0) {
+    http.begin(secureClient, String(API_SERVER) + "/api/device/" + deviceId + "/poll?" + query);
+    http.setTimeout(10000);
+    sentUs = esp_timer_get_time();
+    httpCode = http.GET();
+    if (httpCode == 200) response = http.getString();
+  }
+  int64_t receivedUs = esp_timer_get_time();
 
   if (httpCode == 200) {
-    String response = http.getString();
+    lastFeedbackMs = -1;  // delivered
+    refreshMsBw = -1;
+    refreshMsGray = -1;
+    freshChangedAt = 0;
     Serial.printf("Poll response: %s\n", response.c_str());
 
     JsonDocument doc;
@@ -432,6 +1459,9 @@ bool pollServerForInstructions() {
       int newPollSeconds = doc["n"] | 30;
       int newIndex = doc["i"] | 0;
       int newTotal = doc["t"] | 0;
+      uint64_t displayAt = doc["at"].as<uint64_t>();  // scheduled refresh (epoch ms), 0 = now
+      uint64_t changedAt = doc["ct"].as<uint64_t>();  // change time of what we're behind on, 0 = none
+      if (!doc["st"].isNull()) clockServerSample(doc["st"].as<uint64_t>(), sentUs, receivedUs);
 
       Serial.printf("Poll result: refresh=%d, mode=%s, ver=%d, next=%ds, idx=%d/%d\n",
                     shouldRefresh, mode, newVersion, newPollSeconds, newIndex, newTotal);
@@ -441,37 +1471,104 @@ bool pollServerForInstructions() {
       nextPollSeconds = newPollSeconds;
       totalImages = newTotal;
 
+      // Which resources changed since the last poll (unknown -> known is
+      // not a change: boot already fetched everything)
+      bool changed[RES_COUNT] = {false};
+      JsonArray vv = doc["vv"];
+      if (!vv.isNull() && vv.size() >= RES_COUNT) {
+        bool dirty = false;
+        for (int r = 0; r < RES_COUNT; r++) {
+          int32_t v = vv[r] | 0;
+          if (v == resourceVersion[r]) continue;
+          changed[r] = resourceVersion[r] >= 0;
+          resourceVersion[r] = v;
+          dirty = true;
+        }
+        if (dirty) {
+          preferences.begin("inkframe", false);
+          preferences.putBytes("resVer", resourceVersion, sizeof(resourceVersion));
+          preferences.end();
+          Serial.printf("Resource versions: dashboard=%d photos=%d settings=%d firmware=%d overlays=%d zones=%d\n",
+                        resourceVersion[RES_DASHBOARD], resourceVersion[RES_PHOTOS],
+                        resourceVersion[RES_SETTINGS], resourceVersion[RES_FIRMWARE],
+                        resourceVersion[RES_OVERLAY], resourceVersion[RES_ZONES]);
+        }
+      }
+
+      // Settings and firmware never need a frame refresh
+      if (changed[RES_SETTINGS]) {
+        fetchDeviceSettings();
+      }
+      if (changed[RES_FIRMWARE]) {
+        Serial.println("Firmware update available on the server");
+      }
+
+      // Overlays are fetched on their own (also the first time, so the
+      // layers exist before the first photo is composited)
+      bool overlaysChanged = false;
+      if (OVERLAY_ENABLED && resourceVersion[RES_OVERLAY] >= 0 && overlayVersion != resourceVersion[RES_OVERLAY]) {
+        overlaysChanged = fetchOverlays();
+      }
+
       // Determine if mode changed
-      DisplayMode newMode = (strcmp(mode, "photo") == 0) ? MODE_IMAGE : MODE_DASHBOARD;
+      DisplayMode newMode = (strcmp(mode, "photo") == 0) ? MODE_IMAGE :
+                            (strcmp(mode, "zones") == 0) ? MODE_ZONES : MODE_DASHBOARD;
       bool modeChanged = (newMode != currentMode);
 
       // Update image index if changed
       bool indexChanged = (newIndex != currentImageIndex);
       currentImageIndex = newIndex;
 
-      // Refresh display if server says so, or mode/index changed
-      if (shouldRefresh || modeChanged || indexChanged) {
+      // Peer group membership and the content key for this mode/index
+      peerSetGroup(doc["pg"].as<uint32_t>(), doc["pgk"] | "");
+      peerKey = doc["pk"].as<uint32_t>();
+      peerKeyMode = newMode;
+      peerKeyIndex = newIndex;
+
+      // An alert (or its removal) shows with whatever this poll draws
+      bool alertChanged = alertUpdate(doc["al"].as<JsonObject>());
+
+      // Only the content on screen matters: new photos don't redraw a
+      // dashboard, and new dashboard data doesn't redraw a photo
+      bool contentChanged = (newMode == MODE_DASHBOARD) ? changed[RES_DASHBOARD] :
+                            (newMode == MODE_ZONES) ? changed[RES_ZONES] : changed[RES_PHOTOS];
+
+      // Refresh display if server says so, or mode/index/content changed
+      if (shouldRefresh || modeChanged || indexChanged || contentChanged) {
         currentMode = newMode;
+        freshPendingAt = changedAt;
         http.end();
 
-        Serial.printf("Refreshing display (reason: refresh=%d, modeChange=%d, indexChange=%d)\n",
-                      shouldRefresh, modeChanged, indexChanged);
+        Serial.printf("Refreshing display (reason: refresh=%d, modeChange=%d, indexChange=%d, contentChange=%d)\n",
+                      shouldRefresh, modeChanged, indexChanged, contentChanged);
 
         // Fetch and display new content based on mode
-        if (currentMode == MODE_DASHBOARD) {
+        if (currentMode == MODE_ZONES) {
+          if (updateZones()) {
+            drawFetched(displayAt);
+          } else {
+            // No usable zone layout, fall back to dashboard
+            currentMode = MODE_DASHBOARD;
+            if (fetchDashboard()) {
+              drawFetched(displayAt);
+            } else {
+              drawDashboard();
+            }
+          }
+        } else if (currentMode == MODE_DASHBOARD) {
           if (fetchDashboard()) {
-            drawImage();
+            drawFetched(displayAt);
           } else {
             drawDashboard();  // Local fallback
           }
         } else {
           if (totalImages > 0 && fetchImage(currentImageIndex)) {
-            drawImage();
+            drawFetched(displayAt);
           } else {
             // No images, fall back to dashboard
             currentMode = MODE_DASHBOARD;
             if (fetchDashboard()) {
-              drawImage();
+              drawFetched(displayAt);
             } else {
               drawDashboard();
             }
@@ -479,6 +1576,21 @@ bool pollServerForInstructions() {
         }
         return true;
       }
+
+      // Only the overlays changed: recomposite over the photo on screen
+      if (overlaysChanged && currentMode == MODE_IMAGE) {
+        freshPendingAt = changedAt;
+        http.end();
+        overlayRedraw();
+        return true;
+      }
+
+      // Only the alert changed: drawImage() refreshes just the strip
+      if (alertChanged) {
+        http.end();
+        alertRedraw();
+        return true;
+      }
     } else {
       Serial.printf("JSON parse error: %s\n", error.c_str());
     }
@@ -496,111 +1608,3171 @@ bool pollServerForInstructions() {
 // FETCH IMAGE (supports both photo and dashboard mode)
 // ============================================================
 bool fetchImage(int index) {
+  if (photoCacheLoad(index)) {
+    peerFrameFetched(MODE_IMAGE, index, imageGray ? 2 * FRAME_BYTES : FRAME_BYTES);
+    return true;
+  }
+
+  // Cache is stale or never filled: refill the whole carousel in one burst
+  // (peer group followers get single frames from the leader instead). A
+  // button press only waits for its own frame; the refill runs later in
+  // the background.
+  bool stale = (photoCacheTotal != totalImages || photoCacheVersion != resourceVersion[RES_PHOTOS]);
+  if (stale && netPriority != NET_FOREGROUND && !peerFollowing() && fetchContactSheet() && photoCacheLoad(index)) {
+    peerFrameFetched(MODE_IMAGE, index, imageGray ? 2 * FRAME_BYTES : FRAME_BYTES);
+    return true;
+  }
+
   return fetchBitmap(index, "photo");
 }
 
 bool fetchDashboard() {
+  // Template devices fetch only the bindings; the raster is the fallback
+  if (fetchDashboardData()) return true;
   return fetchBitmap(0, "dashboard");
 }
 
 bool fetchBitmap(int index, const char* mode) {
+  DisplayMode fetchMode = (strcmp(mode, "photo") == 0) ? MODE_IMAGE : MODE_DASHBOARD;
+  if (peerReceive(fetchMode, index)) {
+    frameTier = TIER_FULL;  // whatever the leader got; not ours to upgrade
+    frameUpgradeIndex = -1;
+    return true;
+  }
+
   Serial.printf("Fetching %s (index %d)...\n", mode, index);
 
   HTTPClient http;
   String deviceId = String((uint32_t)ESP.getEfuseMac(), HEX);
   String url = String(API_SERVER) + "/api/device/" + deviceId + "/bitmap?index=" + String(index) + "&mode=" + String(mode);
+  LinkTier tier = linkTier();
+  if (LINK_ENABLED) {
+    url += "&q=" + String((int)tier);
+  }
+  // The preview pass costs extra bytes; not worth it on a weak link
+  if (PROGRESSIVE_ENABLED && tier != TIER_FULL) {
+    url += "&progressive=0";
+  }
+
+  http.begin(secureClient, url);
+  http.setTimeout(15000);  // 15 second timeout
+
+  // Collect headers including new X-Content-Type
+  const char* headerKeys[] = {"X-Image-Total", "X-Image-Index", "X-Image-Width", "X-Image-Height", "X-Content-Type",
+                              "X-Frame-Format", "X-Preview-Width", "X-Preview-Height", "X-Frame-Codec", "X-Frame-Quality"};
+  http.collectHeaders(headerKeys, 10);
+
+  int httpCode = http.GET();
+
+  if (httpCode == 200) {
+    int len = http.getSize();
+    int expectedSize = DISPLAY_WIDTH * DISPLAY_HEIGHT / 8;
+
+    // Get metadata from headers
+    if (http.hasHeader("X-Image-Total")) {
+      totalImages = http.header("X-Image-Total").toInt();
+      Serial.printf("Total images: %d\n", totalImages);
+    }
+
+    if (http.hasHeader("X-Content-Type")) {
+      String contentType = http.header("X-Content-Type");
+      Serial.printf("Content type: %s\n", contentType.c_str());
+    }
+
+    // Gray frames carry a second bit-plane after the first
+    int planes = 1;
+    if (http.header("X-Frame-Format") == "gray2") {
+      if (!GRAY_ENABLED) {
+        Serial.println("Gray frame received but GRAY_ENABLED is off");
+        http.end();
+        return false;
+      }
+      planes = 2;
+    }
+
+    // Progressive frames start with a low-resolution preview pass
+    int previewWidth = 0;
+    int previewHeight = 0;
+    int previewSize = 0;
+    if (http.header("X-Frame-Format") == "progressive") {
+      previewWidth = http.header("X-Preview-Width").toInt();
+      previewHeight = http.header("X-Preview-Height").toInt();
+      if (previewWidth > 0 && previewHeight > 0 &&
+          DISPLAY_WIDTH % previewWidth == 0 && DISPLAY_HEIGHT % previewHeight == 0) {
+        previewSize = (previewWidth * previewHeight + 7) / 8;  // the server pads the last byte
+      } else {
+        Serial.printf("Bad preview geometry %dx%d\n", previewWidth, previewHeight);
+        http.end();
+        return false;
+      }
+    }
+
+    // Frames at another geometry are scaled to the panel as they arrive
+    int frameWidth = http.hasHeader("X-Image-Width") ? http.header("X-Image-Width").toInt() : DISPLAY_WIDTH;
+    int frameHeight = http.hasHeader("X-Image-Height") ? http.header("X-Image-Height").toInt() : DISPLAY_HEIGHT;
+    bool scaled = (frameWidth != DISPLAY_WIDTH || frameHeight != DISPLAY_HEIGHT);
+    if (scaled && (!SCALE_ENABLED || previewSize > 0 || frameWidth <= 0 || frameHeight <= 0 ||
+                   frameWidth > DISPLAY_WIDTH * FRAME_SCALER_MAX_RATIO || frameHeight > DISPLAY_HEIGHT * FRAME_SCALER_MAX_RATIO)) {
+      Serial.printf("Can't show a %dx%d frame on this panel\n", frameWidth, frameHeight);
+      http.end();
+      return false;
+    }
+    int frameBytes = scaled ? bilevelRowBytes(frameWidth) * frameHeight : expectedSize;
+
+    // Compressed frames have no fixed size; the codec stops at the last row
+    const BilevelCodec* codec = nullptr;
+    if (http.hasHeader("X-Frame-Codec")) {
+      String codecName = http.header("X-Frame-Codec");
+      codec = codecByName(codecName.c_str());
+      if (!codec) {
+        Serial.printf("Unknown frame codec: %s\n", codecName.c_str());
+        http.end();
+        return false;
+      }
+    }
+
+    if (codec || len == frameBytes * planes + previewSize || len == -1) {  // -1 means chunked/unknown
+      int bytesRead = 0;
+      unsigned long startTime = millis();
+      size_t payloadBytes = len > 0 ? len : frameBytes * planes + previewSize;
+      unsigned long timeoutMs = linkTimeoutMs(payloadBytes);
+
+      if (previewSize > 0) {
+        // The preview fits in the front of imageBuffer; the full frame
+        // overwrites it once the preview is on the panel
+        bytesRead = readStreamBytes(http, imageBuffer, previewSize, startTime, timeoutMs);
+
+        if (bytesRead != previewSize) {
+          Serial.printf("Incomplete preview: got %d, expected %d\n", bytesRead, previewSize);
+          linkRecord(false, 0, 0);
+          http.end();
+          return false;
+        }
+
+        Serial.printf("Preview received after %lu ms\n", millis() - startTime);
+        drawPreview(previewWidth, previewHeight);
+      }
+
+      if (scaled) {
+        unsigned long scaleStart = millis();
+        if (!scaleFrameStream(http, codec, frameWidth, frameHeight, planes, len, startTime, timeoutMs)) {
+          Serial.printf("Failed to scale %dx%d frame\n", frameWidth, frameHeight);
+          linkRecord(false, 0, 0);
+          http.end();
+          return false;
+        }
+        Serial.printf("Scaled %dx%d frame to %dx%d in %lu ms\n", frameWidth, frameHeight,
+                      DISPLAY_WIDTH, DISPLAY_HEIGHT, millis() - scaleStart);
+        bytesRead = expectedSize;
+        planes = 1;  // only the first plane was used
+      } else if (codec) {
+        unsigned long decodeStart = millis();
+        if (!decodeFrameStream(http, codec, planes, len < 0 ? -1 : len - previewSize, startTime, timeoutMs)) {
+          Serial.printf("Failed to decode %s frame\n", codec->name);
+          linkRecord(false, 0, 0);
+          http.end();
+          return false;
+        }
+        Serial.printf("Decoded %s frame in %lu ms\n", codec->name, millis() - decodeStart);
+        bytesRead = expectedSize;
+      } else {
+        bytesRead = readStreamBytes(http, imageBuffer, expectedSize, startTime, timeoutMs);
+        if (bytesRead == expectedSize && planes == 2 &&
+            readStreamBytes(http, grayPlane, expectedSize, startTime, timeoutMs) != expectedSize) {
+          Serial.println("Incomplete gray plane");
+          bytesRead = 0;
+        }
+      }
+
+      if (bytesRead == expectedSize) {
+        Serial.printf("Bitmap received: %d bytes\n", bytesRead);
+        hasImage = true;
+        imageGray = (planes == 2);
+        frameMapped = nullptr;
+        frameFromServer = true;
+        frameMode = fetchMode;
+        frameImageIndex = index;
+        linkRecord(true, payloadBytes, millis() - startTime);
+
+        // Older servers don't say: they always send full detail
+        frameTier = http.hasHeader("X-Frame-Quality") ? (LinkTier)constrain(http.header("X-Frame-Quality").toInt(), TIER_COARSE, TIER_FULL) : TIER_FULL;
+        frameUpgradeIndex = (fetchMode == MODE_IMAGE && frameTier < TIER_FULL) ? index : -1;
+        if (frameUpgradeIndex >= 0) linkUpgradeTryMs = millis();
+
+        peerFrameFetched(fetchMode, index, expectedSize * planes);
+        http.end();
+        return true;
+      } else {
+        Serial.printf("Incomplete read: got %d, expected %d\n", bytesRead, expectedSize);
+        linkRecord(false, 0, 0);
+      }
+    } else {
+      Serial.printf("Wrong size: got %d, expected %d\n", len, frameBytes * planes + previewSize);
+    }
+  } else if (httpCode == 404) {
+    Serial.println("No content available on server");
+    totalImages = 0;
+  } else {
+    Serial.printf("HTTP error: %d\n", httpCode);
+    if (httpCode < 0) linkRecord(false, 0, 0);
+  }
+
+  http.end();
+  return false;
+}
+
+// Read exactly len bytes of an HTTP response body into dst.
+// Gives up timeoutMs after startTime; returns the number of bytes read.
+int readStreamBytes(HTTPClient& http, uint8_t* dst, int len, unsigned long startTime, unsigned long timeoutMs) {
+  WiFiClient* stream = http.getStreamPtr();
+  int bytesRead = 0;
+
+  while (bytesRead < len && (millis() - startTime < timeoutMs) && !netPreempt()) {
+    if (stream->available()) {
+      int toRead = min(stream->available(), len - bytesRead);
+      int c = stream->read(dst + bytesRead, toRead);
+      if (c > 0) bytesRead += c;
+    } else if (!http.connected()) {
+      break;
+    } else {
+      delay(1);
+    }
+  }
+
+  return bytesRead;
+}
+
+// Feeds a compressed frame body to a codec, a chunk at a time
+class HttpByteSource : public ByteSource {
+public:
+  HttpByteSource(HTTPClient& http, int remaining, unsigned long startTime, unsigned long timeoutMs)
+    : http_(http), remaining_(remaining), startTime_(startTime), timeoutMs_(timeoutMs) {}
+
+  size_t read(uint8_t* dst, size_t len) override {
+    WiFiClient* stream = http_.getStreamPtr();
+    if (remaining_ == 0) return 0;
+    if (remaining_ > 0 && (int)len > remaining_) len = remaining_;
+
+    while (!stream->available()) {
+      if (!http_.connected() || millis() - startTime_ >= timeoutMs_ || netPreempt()) return 0;
+      delay(1);
+    }
+
+    int c = stream->read(dst, min((size_t)stream->available(), len));
+    if (c <= 0) return 0;
+    if (remaining_ > 0) remaining_ -= c;
+    return c;
+  }
+
+private:
+  HTTPClient& http_;
+  int remaining_;  // -1 when the body length is unknown
+  unsigned long startTime_;
+  unsigned long timeoutMs_;
+};
+
+// Gray frames decode as one frame twice as tall: MSB plane rows, then LSB
+static bool frameRowSink(void* ctx, int y, const uint8_t* row, size_t rowBytes) {
+  uint8_t* plane = (y < DISPLAY_HEIGHT) ? imageBuffer : grayPlane;
+  memcpy(plane + (y % DISPLAY_HEIGHT) * rowBytes, row, rowBytes);
+  return true;
+}
+
+// Decode a compressed frame straight from the response into imageBuffer
+// (and grayPlane). The codec only needs its small working buffer, never
+// the whole payload.
+bool decodeFrameStream(HTTPClient& http, const BilevelCodec* codec, int planes, int remaining, unsigned long startTime, unsigned long timeoutMs) {
+  uint8_t* work = (uint8_t*)malloc(codec->workBytes(DISPLAY_WIDTH));
+  if (!work) {
+    Serial.println("No memory for frame decoder");
+    return false;
+  }
+
+  HttpByteSource src(http, remaining, startTime, timeoutMs);
+  bool ok = codec->decode(src, DISPLAY_WIDTH, DISPLAY_HEIGHT * planes, work, frameRowSink, nullptr);
+  free(work);
+  return ok;
+}
+
+// Scale a frame of another geometry into imageBuffer while it streams in,
+// raw or through its codec. Memory is the scaler's few rows plus either
+// the codec's working buffer or one source row.
+bool scaleFrameStream(HTTPClient& http, const BilevelCodec* codec, int width, int height, int planes, int remaining, unsigned long startTime, unsigned long timeoutMs) {
+  size_t scalerBytes = FrameScaler::workBytes(DISPLAY_WIDTH);
+  size_t sourceBytes = codec ? codec->workBytes(width) : bilevelRowBytes(width);
+  uint8_t* work = (uint8_t*)malloc(scalerBytes + sourceBytes);
+  if (!work) {
+    Serial.println("No memory for frame scaler");
+    return false;
+  }
+
+  FrameScaler scaler;
+  bool ok = scaler.begin(width, height, DISPLAY_WIDTH, DISPLAY_HEIGHT, work, frameRowSink, nullptr);
+  if (ok && codec) {
+    // Rows of a second plane go to the scaler too, which ignores them
+    HttpByteSource src(http, remaining, startTime, timeoutMs);
+    ok = codec->decode(src, width, height * planes, work + scalerBytes, FrameScaler::rowSink, &scaler);
+  } else if (ok) {
+    // The second plane of a raw gray frame is simply not read
+    uint8_t* row = work + scalerBytes;
+    for (int y = 0; y < height && ok; y++) {
+      ok = readStreamBytes(http, row, sourceBytes, startTime, timeoutMs) == (int)sourceBytes && scaler.push(row);
+    }
+  }
+  ok = ok && scaler.done();
+
+  free(work);
+  return ok;
+}
+
+// ============================================================
+// FRAME STORE
+// A raw "frames" data partition, memory-mapped once at boot. Slot n starts
+// with a header (frame length, little-endian) followed by the planes; the
+// header is programmed last, so a slot whose write was interrupted reads
+// as empty. A 1-bit frame in a slot is never copied into RAM: drawImage()
+// hands the mapped pointer to the panel driver, which streams it over SPI.
+// ============================================================
+void initFrameStore() {
+  frameStorePart = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                            (esp_partition_subtype_t)FRAME_STORE_SUBTYPE, FRAME_STORE_LABEL);
+  if (!frameStorePart) {
+    Serial.println("Frame store: no partition, photo cache uses LittleFS");
+    return;
+  }
+
+  const void* map = nullptr;
+  esp_err_t err = esp_partition_mmap(frameStorePart, 0, frameStorePart->size, SPI_FLASH_MMAP_DATA, &map, &frameStoreHandle);
+  if (err != ESP_OK) {
+    Serial.printf("Frame store: mmap failed (%d)\n", err);
+    frameStorePart = nullptr;
+    return;
+  }
+
+  frameStoreMap = (const uint8_t*)map;
+  size_t slotArea = frameStorePart->size;
+  if (LIVING_ENABLED && slotArea >= (size_t)LIVING_REGION_BYTES + PHOTO_CACHE_SIZE * FRAME_SLOT_BYTES) {
+    // The living photo rendition takes the end of the partition
+    slotArea -= LIVING_REGION_BYTES;
+    livingOffset = slotArea;
+  }
+  frameStoreSlots = slotArea / FRAME_SLOT_BYTES;
+  Serial.printf("Frame store: %d slots of %d bytes mapped at %p\n", frameStoreSlots, FRAME_SLOT_BYTES, map);
+}
+
+// Frame length stored in a slot, 0 when the slot is empty or erased
+static uint32_t frameSlotLength(int slot) {
+  if (!frameStoreMap || slot < 0 || slot >= frameStoreSlots) return 0;
+  uint32_t length;
+  memcpy(&length, frameStoreMap + slot * FRAME_SLOT_BYTES, sizeof(length));
+  return (length == 0xFFFFFFFFUL || length > 2 * FRAME_BYTES) ? 0 : length;
+}
+
+static const uint8_t* frameSlotData(int slot) {
+  return frameStoreMap + slot * FRAME_SLOT_BYTES + FRAME_SLOT_HEADER;
+}
+
+// Erase a slot before streaming a frame into it with frameSlotWrite()
+static bool frameSlotErase(int slot) {
+  if (!frameStoreMap || slot < 0 || slot >= frameStoreSlots) return false;
+  return esp_partition_erase_range(frameStorePart, slot * FRAME_SLOT_BYTES, FRAME_SLOT_BYTES) == ESP_OK;
+}
+
+static bool frameSlotWrite(int slot, size_t offset, const uint8_t* data, size_t len) {
+  return esp_partition_write(frameStorePart, slot * FRAME_SLOT_BYTES + FRAME_SLOT_HEADER + offset, data, len) == ESP_OK;
+}
+
+// Mark a fully written slot valid
+static bool frameSlotCommit(int slot, uint32_t length) {
+  uint8_t header[FRAME_SLOT_HEADER];
+  memset(header, 0xFF, sizeof(header));
+  memcpy(header, &length, sizeof(length));
+  return esp_partition_write(frameStorePart, slot * FRAME_SLOT_BYTES, header, sizeof(header)) == ESP_OK;
+}
+
+// The frame being shown: a mapped slot, or imageBuffer
+const uint8_t* currentFrame() {
+  return frameMapped ? frameMapped : imageBuffer;
+}
+
+// Copy a mapped frame into imageBuffer before something edits it in place
+void frameMaterialize() {
+  if (!frameMapped) return;
+  memcpy(imageBuffer, frameMapped, FRAME_BYTES);
+  frameMapped = nullptr;
+}
+
+// ============================================================
+// PHOTO CACHE + CONTACT SHEET
+// Carousel frames live in the frame store (slot = carousel index), or in
+// LittleFS as /photo<index>.bin when the partition is missing. A contact
+// sheet (/bitmaps) fills the whole cache in one streamed response, so
+// rotating through the carousel costs no further downloads until the
+// photo set changes on the server.
+// ============================================================
+static String photoCachePath(int index) {
+  return "/photo" + String(index) + ".bin";
+}
+
+static void photoCacheSaveMeta() {
+  preferences.begin("inkframe", false);
+  preferences.putBytes("photoHash", photoCacheHash, sizeof(photoCacheHash));
+  preferences.putInt("photoTotal", photoCacheTotal);
+  preferences.putInt("photoVer", photoCacheVersion);
+  preferences.putUChar("photoTier", (uint8_t)photoCacheTier);
+  preferences.end();
+}
+
+void initPhotoCache() {
+  memset(photoCacheHash, 0, sizeof(photoCacheHash));
+  if (!flashFsReady && !frameStoreMap) return;
+
+  preferences.begin("inkframe", true);
+  if (preferences.getBytesLength("photoHash") == sizeof(photoCacheHash)) {
+    preferences.getBytes("photoHash", photoCacheHash, sizeof(photoCacheHash));
+    photoCacheTotal = preferences.getInt("photoTotal", -1);
+    photoCacheVersion = preferences.getInt("photoVer", -1);
+    photoCacheTier = (LinkTier)preferences.getUChar("photoTier", TIER_FULL);
+  }
+  preferences.end();
+
+  int cached = 0;
+  for (int i = 0; i < PHOTO_CACHE_SIZE; i++) {
+    if (photoCacheHash[i]) cached++;
+  }
+  Serial.printf("Photo cache: %d/%d frames\n", cached, PHOTO_CACHE_SIZE);
+}
+
+void loadResourceVersions() {
+  preferences.begin("inkframe", true);
+  if (preferences.getBytesLength("resVer") == sizeof(resourceVersion)) {
+    preferences.getBytes("resVer", resourceVersion, sizeof(resourceVersion));
+  }
+  preferences.end();
+}
+
+// Point frameMapped at a cached frame in the frame store. Gray frames are
+// copied out, since the gray path loads both planes from RAM.
+static size_t photoCacheMap(int index, bool& gray, uint32_t& hash) {
+  size_t length = frameSlotLength(index);
+  const uint8_t* data = frameSlotData(index);
+  gray = GRAY_ENABLED && length == 2 * FRAME_BYTES;
+  if (length != FRAME_BYTES && !gray) return 0;
+
+  hash = fnv1a(2166136261UL, data, length);
+  if (gray) {
+    memcpy(imageBuffer, data, FRAME_BYTES);
+    memcpy(grayPlane, data + FRAME_BYTES, FRAME_BYTES);
+    frameMapped = nullptr;
+  } else {
+    frameMapped = data;
+  }
+  return length;
+}
+
+// Load a cached carousel frame if the cache is current: mapped in place
+// from the frame store, or read from LittleFS into imageBuffer
+bool photoCacheLoad(int index) {
+  if ((!flashFsReady && !frameStoreMap) || index < 0 || index >= PHOTO_CACHE_SIZE) return false;
+  if (photoCacheTotal != totalImages || photoCacheVersion != resourceVersion[RES_PHOTOS]) return false;
+  if (photoCacheHash[index] == 0) return false;
+
+  bool gray = false;
+  uint32_t hash = 0;
+  size_t got = 0;
+
+  if (frameStoreMap) {
+    got = photoCacheMap(index, gray, hash);
+  } else {
+    File f = LittleFS.open(photoCachePath(index), FILE_READ);
+    if (!f) return false;
+    gray = GRAY_ENABLED && f.size() == 2 * FRAME_BYTES;
+    got = f.read(imageBuffer, FRAME_BYTES);
+    hash = fnv1a(2166136261UL, imageBuffer, FRAME_BYTES);
+    if (gray) {
+      got += f.read(grayPlane, FRAME_BYTES);
+      hash = fnv1a(hash, grayPlane, FRAME_BYTES);
+    }
+    f.close();
+    frameMapped = nullptr;
+  }
+
+  if (got != (gray ? 2 : 1) * FRAME_BYTES || (hash ? hash : 1) != photoCacheHash[index]) {
+    frameMapped = nullptr;
+    Serial.printf("Photo cache: entry %d corrupt, dropping\n", index);
+    photoCacheHash[index] = 0;
+    photoCacheSaveMeta();
+    hasImage = false;
+    return false;
+  }
+
+  Serial.printf("Photo cache hit: image %d%s%s\n", index, gray ? " (gray)" : "", frameMapped ? " (mapped)" : "");
+  hasImage = true;
+  imageGray = gray;
+  frameFromServer = true;
+  frameMode = MODE_IMAGE;
+  frameImageIndex = index;
+  frameTier = photoCacheTier;
+  frameUpgradeIndex = (photoCacheTier < TIER_FULL) ? index : -1;
+  return true;
+}
+
+// Download up to PHOTO_CACHE_SIZE carousel frames in one response and
+// stream them straight into flash, verifying each frame's hash
+bool fetchContactSheet() {
+  int count = min(totalImages, PHOTO_CACHE_SIZE);
+  if ((!flashFsReady && !frameStoreMap) || count <= 0) return false;
+
+  Serial.printf("Fetching contact sheet (%d frames)...\n", count);
+
+  HTTPClient http;
+  String deviceId = String((uint32_t)ESP.getEfuseMac(), HEX);
+  String url = String(API_SERVER) + "/api/device/" + deviceId + "/bitmaps?from=0&count=" + String(count);
+  LinkTier tier = linkTier();
+  if (LINK_ENABLED) {
+    url += "&q=" + String((int)tier);
+  }
+
+  http.begin(secureClient, url);
+  http.setTimeout(15000);
+  int httpCode = http.GET();
+
+  if (httpCode != 200) {
+    Serial.printf("Contact sheet failed: %d\n", httpCode);
+    if (httpCode < 0) linkRecord(false, 0, 0);
+    http.end();
+    return false;
+  }
+
+  unsigned long startTime = millis();
+  unsigned long timeoutMs = 10000UL + 5000UL * count;
+  uint8_t header[10];
+
+  if (readStreamBytes(http, header, 8, startTime, timeoutMs) != 8 || memcmp(header, "IFCS", 4) != 0 || header[4] != 1) {
+    Serial.println("Contact sheet: bad header");
+    http.end();
+    return false;
+  }
+
+  int frames = (header[6] << 8) | header[7];
+  int stored = 0;
+  size_t received = 8;
+  bool ok = true;
+  bool writeFailed = false;
+
+  // Invalidate up front; entries become valid only once their hash checks out
+  memset(photoCacheHash, 0, sizeof(photoCacheHash));
+
+  for (int n = 0; n < frames && ok; n++) {
+    if (readStreamBytes(http, header, 10, startTime, timeoutMs) != 10) {
+      ok = false;
+      break;
+    }
+
+    int index = (header[0] << 8) | header[1];
+    uint32_t hash = ((uint32_t)header[2] << 24) | ((uint32_t)header[3] << 16) | ((uint32_t)header[4] << 8) | header[5];
+    uint32_t length = ((uint32_t)header[6] << 24) | ((uint32_t)header[7] << 16) | ((uint32_t)header[8] << 8) | header[9];
+    received += 10 + length;
+
+    bool keep = ((length == FRAME_BYTES || (GRAY_ENABLED && length == 2 * FRAME_BYTES)) &&
+                 index < PHOTO_CACHE_SIZE && hash != 0);
+    // Never rewrite the slot the panel is being fed from
+    bool mapped = (frameStoreMap != nullptr);
+    if (keep && mapped && frameMapped == frameSlotData(index)) frameMaterialize();
+    File f;
+    if (keep && mapped) {
+      keep = frameSlotErase(index);
+    } else if (keep) {
+      f = LittleFS.open(photoCachePath(index), FILE_WRITE);
+      keep = (bool)f;
+    }
+
+    // Stream the frame through a small buffer, hashing as we go
+    uint8_t chunk[512];
+    uint32_t running = 2166136261UL;
+    uint32_t remaining = length;
+    while (remaining > 0) {
+      int want = min((uint32_t)sizeof(chunk), remaining);
+      if (readStreamBytes(http, chunk, want, startTime, timeoutMs) != want) {
+        ok = false;
+        break;
+      }
+      if (keep) {
+        running = fnv1a(running, chunk, want);
+        if (mapped) {
+          keep = frameSlotWrite(index, length - remaining, chunk, want);
+        } else {
+          keep = f.write(chunk, want) == (size_t)want;  // short on a full filesystem
+        }
+        if (!keep) {
+          Serial.printf("Contact sheet: frame %d write failed\n", index);
+          writeFailed = true;
+        }
+      }
+      remaining -= want;
+    }
+    if (f) {
+      f.close();
+      if (!keep) LittleFS.remove(photoCachePath(index));
+    }
+
+    if (ok && keep && (running ? running : 1) == hash && (!mapped || frameSlotCommit(index, length))) {
+      photoCacheHash[index] = hash;
+      stored++;
+    } else if (keep) {
+      Serial.printf("Contact sheet: frame %d failed verification\n", index);
+    }
+  }
+
+  http.end();
+  linkRecord(ok, received, millis() - startTime);
+
+  // Current only once every byte arrived and was stored; cut short (by the
+  // scheduler or a failed read) or not written it stays stale so the refill
+  // runs again
+  bool complete = ok && !netPreempted && !writeFailed;
+  photoCacheTotal = complete ? totalImages : -1;
+  photoCacheVersion = resourceVersion[RES_PHOTOS];
+  photoCacheTier = tier;
+  photoCacheSaveMeta();
+
+  Serial.printf("Contact sheet: cached %d/%d frames in %lu ms%s\n", stored, frames, millis() - startTime,
+                complete ? "" : " (incomplete)");
+  return complete && stored > 0;
+}
+
+// ============================================================
+// DASHBOARD TEMPLATE
+// The dashboard layout (static base, widget rectangles, fonts and icons)
+// is downloaded once and kept in LittleFS as /layout.json. After that a
+// dashboard update is just the widget bindings (/dashboard-data): each
+// widget keeps a hash of its value, only widgets whose value changed are
+// redrawn into imageBuffer, and drawImage() partial-refreshes just their
+// rectangles. Text is UTF-8; glyphs and icons are column-major bitmaps
+// (ceil(h/8) bytes per column, top row in bit 0) as sent by the server.
+// ============================================================
+#define LAYOUT_PATH "/layout.json"
+
+static void frameSetPixel(int x, int y, bool black) {
+  if (x < 0 || y < 0 || x >= DISPLAY_WIDTH || y >= DISPLAY_HEIGHT) return;
+  int i = y * DISPLAY_WIDTH + x;
+  if (black) {
+    imageBuffer[i >> 3] &= ~(0x80 >> (i & 7));
+  } else {
+    imageBuffer[i >> 3] |= (0x80 >> (i & 7));
+  }
+}
+
+static void frameFillRect(int x, int y, int w, int h, bool black) {
+  for (int py = y; py < y + h; py++) {
+    for (int px = x; px < x + w; px++) {
+      frameSetPixel(px, py, black);
+    }
+  }
+}
+
+static void frameDrawGlyph(const uint8_t* glyph, int x, int y, int w, int h, int scale, bool black) {
+  int bytesPerColumn = (h + 7) / 8;
+  for (int col = 0; col < w; col++) {
+    for (int row = 0; row < h; row++) {
+      if ((glyph[col * bytesPerColumn + (row >> 3)] >> (row & 7)) & 1) {
+        frameFillRect(x + col * scale, y + row * scale, scale, scale, black);
+      }
+    }
+  }
+}
+
+// Decode one UTF-8 code point and advance p
+static uint32_t utf8Next(const char*& p) {
+  uint8_t c = (uint8_t)*p++;
+  if (c < 0x80) return c;
+  int extra = (c >= 0xF0) ? 3 : (c >= 0xE0) ? 2 : 1;
+  uint32_t cp = c & (0x3F >> extra);
+  while (extra-- > 0 && ((uint8_t)*p & 0xC0) == 0x80) {
+    cp = (cp << 6) | ((uint8_t)*p++ & 0x3F);
+  }
+  return cp;
+}
+
+// Bitmap bytes of a w x h glyph or icon (column-major, ceil(h/8) bytes per
+// column), or 0 when the size is not one the device draws
+static size_t templateBitmapBytes(int w, int h) {
+  if (w < 1 || h < 1 || w > TEMPLATE_MAX_BITMAP_PX || h > TEMPLATE_MAX_BITMAP_PX) return 0;
+  return w * ((h + 7) / 8);
+}
+
+// Append exactly len hex-encoded bytes to the pool; returns their offset,
+// or -1 when the string has another length or the pool is full
+static int templatePoolHex(const char* hex, size_t len) {
+  if (strlen(hex) != 2 * len) return -1;
+  if (templatePoolUsed + len > TEMPLATE_POOL_BYTES) return -1;
+  int offset = templatePoolUsed;
+  for (size_t i = 0; i < len; i++) {
+    char byteHex[3] = {hex[2 * i], hex[2 * i + 1], 0};
+    templatePool[templatePoolUsed++] = (uint8_t)strtoul(byteHex, nullptr, 16);
+  }
+  return offset;
+}
+
+static int templatePoolString(const char* text) {
+  size_t len = strlen(text) + 1;
+  if (templatePoolUsed + len > TEMPLATE_POOL_BYTES) return -1;
+  int offset = templatePoolUsed;
+  memcpy(templatePool + offset, text, len);
+  templatePoolUsed += len;
+  return offset;
+}
+
+static int templateFontIndex(const char* name) {
+  for (int i = 0; i < templateFontCount; i++) {
+    if (strcmp(templateFonts[i].name, name) == 0) return i;
+  }
+  return -1;
+}
+
+static const uint8_t* templateGlyph(const TemplateFont& font, uint32_t cp) {
+  for (int i = font.first; i < font.first + font.count; i++) {
+    if (templateGlyphs[i].cp == cp) return templatePool + templateGlyphs[i].offset;
+  }
+  return nullptr;
+}
+
+// Unknown characters get an outline box, like the server renderer
+static void templateDrawText(const TemplateFont& font, int x, int y, const char* text, int scale, bool black) {
+  const char* p = text;
+  while (*p) {
+    uint32_t cp = utf8Next(p);
+    const uint8_t* glyph = templateGlyph(font, cp);
+    if (glyph) {
+      frameDrawGlyph(glyph, x, y, font.w, font.h, scale, black);
+    } else if (cp != ' ') {
+      int bw = (font.w - 2) * scale;
+      int bh = (font.h - 2) * scale;
+      frameFillRect(x, y, bw + 1, 1, black);
+      frameFillRect(x, y + bh, bw + 1, 1, black);
+      frameFillRect(x, y, 1, bh + 1, black);
+      frameFillRect(x + bw, y, 1, bh + 1, black);
+    }
+    x += font.advance * scale;
+  }
+}
+
+static void templateDrawElement(const TemplateElement& e, const char* value) {
+  if (e.type == TEMPLATE_FILL) {
+    frameFillRect(e.x, e.y, e.w, e.h, e.ink);
+  } else if (e.type == TEMPLATE_TEXT) {
+    templateDrawText(templateFonts[e.font], e.x, e.y, value, e.scale, e.ink);
+  } else if (e.type == TEMPLATE_ICON) {
+    for (int i = 0; i < templateIconCount; i++) {
+      const TemplateIcon& icon = templateIcons[i];
+      if (strcmp(icon.name, value) == 0) {
+        frameDrawGlyph(templatePool + icon.offset, e.x, e.y, icon.w, icon.h, 1, e.ink);
+        break;
+      }
+    }
+  }
+}
+
+static bool templateParseElement(JsonObject obj, TemplateElement& e) {
+  const char* type = obj["t"] | "";
+  e.type = strcmp(type, "fill") == 0 ? TEMPLATE_FILL :
+           strcmp(type, "text") == 0 ? TEMPLATE_TEXT :
+           strcmp(type, "icon") == 0 ? TEMPLATE_ICON : TEMPLATE_NONE;
+  e.x = obj["x"] | 0;
+  e.y = obj["y"] | 0;
+  e.w = obj["w"] | 0;
+  e.h = obj["h"] | 0;
+  e.scale = max(1, (int)(obj["s"] | 1));
+  e.ink = (obj["c"] | 1) == 1;
+  e.bg = (obj["bg"] | 0) == 1;
+  e.valueHash = 0;
+  e.text = -1;
+
+  int font = templateFontIndex(obj["f"] | "");
+  if (e.type == TEMPLATE_TEXT && font < 0) return false;
+  e.font = max(font, 0);
+  strlcpy(e.id, obj["id"] | "", sizeof(e.id));
+  return e.type != TEMPLATE_NONE;
+}
+
+// Build the in-RAM template from a parsed layout document
+static bool templateParse(JsonDocument& doc) {
+  templateReady = false;
+  templatePoolUsed = 0;
+  templateFontCount = 0;
+  templateGlyphCount = 0;
+  templateIconCount = 0;
+  templateBaseCount = 0;
+  templateWidgetCount = 0;
+
+  if ((doc["w"] | 0) != DISPLAY_WIDTH || (doc["h"] | 0) != DISPLAY_HEIGHT) {
+    Serial.println("Layout: wrong panel size");
+    return false;
+  }
+
+  for (JsonPair fontPair : doc["fonts"].as<JsonObject>()) {
+    if (templateFontCount >= TEMPLATE_MAX_FONTS) break;
+    TemplateFont& font = templateFonts[templateFontCount++];
+    JsonObject f = fontPair.value().as<JsonObject>();
+    strlcpy(font.name, fontPair.key().c_str(), sizeof(font.name));
+    int w = f["w"] | 5;
+    int h = f["h"] | 7;
+    size_t glyphBytes = templateBitmapBytes(w, h);
+    if (glyphBytes == 0) {
+      Serial.printf("Layout: font %s has a bad size %dx%d\n", font.name, w, h);
+      return false;
+    }
+    // The advance divides the banner width when an alert wraps
+    int advance = f["a"] | (w + 1);
+    if (advance < 1 || advance > 255) {
+      Serial.printf("Layout: font %s has a bad advance %d\n", font.name, advance);
+      return false;
+    }
+    font.w = w;
+    font.h = h;
+    font.advance = advance;
+    font.first = templateGlyphCount;
+    font.count = 0;
+
+    for (JsonPair glyph : f["g"].as<JsonObject>()) {
+      if (templateGlyphCount >= TEMPLATE_MAX_GLYPHS) return false;
+      const char* key = glyph.key().c_str();
+      int offset = templatePoolHex(glyph.value() | "", glyphBytes);
+      if (offset < 0) {
+        Serial.printf("Layout: font %s glyph \"%s\" not %u bytes, or pool full\n", font.name, key, (unsigned)glyphBytes);
+        return false;
+      }
+      templateGlyphs[templateGlyphCount].cp = utf8Next(key);
+      templateGlyphs[templateGlyphCount].offset = offset;
+      templateGlyphCount++;
+      font.count++;
+    }
+  }
+
+  for (JsonPair iconPair : doc["icons"].as<JsonObject>()) {
+    if (templateIconCount >= TEMPLATE_MAX_ICONS) break;
+    TemplateIcon& icon = templateIcons[templateIconCount++];
+    JsonObject i = iconPair.value().as<JsonObject>();
+    strlcpy(icon.name, iconPair.key().c_str(), sizeof(icon.name));
+    int w = i["w"] | 0;
+    int h = i["h"] | 0;
+    size_t iconBytes = templateBitmapBytes(w, h);
+    int offset = iconBytes ? templatePoolHex(i["d"] | "", iconBytes) : -1;
+    if (offset < 0) {
+      Serial.printf("Layout: icon %s (%dx%d) doesn't match its bitmap, or pool full\n", icon.name, w, h);
+      return false;
+    }
+    icon.w = w;
+    icon.h = h;
+    icon.offset = offset;
+  }
+
+  for (JsonObject obj : doc["base"].as<JsonArray>()) {
+    if (templateBaseCount >= TEMPLATE_MAX_BASE) return false;
+    TemplateElement& e = templateBase[templateBaseCount];
+    if (!templateParseElement(obj, e)) continue;
+    if (e.type != TEMPLATE_FILL) {
+      e.text = templatePoolString(obj["v"] | "");
+      if (e.text < 0) return false;
+    }
+    templateBaseCount++;
+  }
+
+  for (JsonObject obj : doc["widgets"].as<JsonArray>()) {
+    if (templateWidgetCount >= TEMPLATE_MAX_WIDGETS) return false;
+    if (templateParseElement(obj, templateWidgets[templateWidgetCount])) templateWidgetCount++;
+  }
+
+  templateVersion = doc["l"].as<uint32_t>();
+  templateFrameHash = 0;  // nothing rendered with this template yet
+  templateReady = true;
+
+  Serial.printf("Layout %08lx: %d widgets, %d glyphs, %d icons, %d/%d pool bytes\n",
+                (unsigned long)templateVersion, templateWidgetCount, templateGlyphCount,
+                templateIconCount, templatePoolUsed, TEMPLATE_POOL_BYTES);
+  return true;
+}
+
+void loadLayoutTemplate() {
+  if (!TEMPLATE_ENABLED || !flashFsReady) return;
+
+  File f = LittleFS.open(LAYOUT_PATH, FILE_READ);
+  if (!f) return;
+
+  JsonDocument doc;
+  DeserializationError error = deserializeJson(doc, f);
+  f.close();
+
+  if (error || !templateParse(doc)) {
+    Serial.println("Layout: cached template unusable, dropping");
+    LittleFS.remove(LAYOUT_PATH);
+  }
+}
+
+// Download the layout template and keep it in flash for the next boot
+bool fetchLayoutTemplate() {
+  Serial.println("Fetching dashboard layout...");
+
+  HTTPClient http;
+  String deviceId = String((uint32_t)ESP.getEfuseMac(), HEX);
+  String url = String(API_SERVER) + "/api/device/" + deviceId + "/layout";
+
+  http.begin(secureClient, url);
+  http.setTimeout(10000);
+  int httpCode = http.GET();
+
+  if (httpCode != 200) {
+    Serial.printf("Layout fetch failed: %d\n", httpCode);
+    http.end();
+    return false;
+  }
+
+  String response = http.getString();
+  http.end();
+
+  JsonDocument doc;
+  DeserializationError error = deserializeJson(doc, response);
+  if (error || !templateParse(doc)) {
+    Serial.println("Layout: bad template");
+    return false;
+  }
+
+  if (flashFsReady) {
+    File f = LittleFS.open(LAYOUT_PATH, FILE_WRITE);
+    if (f) {
+      f.print(response);
+      f.close();
+    }
+  }
+  return true;
+}
+
+// Render the bindings into imageBuffer. Only widgets whose value changed
+// are redrawn, unless imageBuffer no longer holds the last template frame
+// (a photo or history frame replaced it), in which case everything is.
+// Returns the number of widgets redrawn.
+static int templateApply(JsonObject bindings) {
+  bool full = !hasImage || imageGray || frameMapped || templateFrameHash == 0 ||
+              frameHash(imageBuffer, FRAME_BYTES) != templateFrameHash;
+  dirtyRectCount = 0;
+
+  if (full) {
+    memset(imageBuffer, 0xFF, FRAME_BYTES);
+    for (int i = 0; i < templateBaseCount; i++) {
+      const TemplateElement& e = templateBase[i];
+      templateDrawElement(e, e.text >= 0 ? (const char*)templatePool + e.text : "");
+    }
+  }
+
+  int redrawn = 0;
+  for (int i = 0; i < templateWidgetCount; i++) {
+    TemplateElement& e = templateWidgets[i];
+    const char* value = bindings[e.id] | "";
+    uint32_t hash = frameHash((const uint8_t*)value, strlen(value));
+    if (!full && hash == e.valueHash) continue;
+
+    frameFillRect(e.x, e.y, e.w, e.h, e.bg);
+    templateDrawElement(e, value);
+    e.valueHash = hash;
+    if (!full) markDirtyRect(e.x, e.y, e.w, e.h);
+    redrawn++;
+  }
+
+  templateFrameHash = frameHash(imageBuffer, FRAME_BYTES);
+  return full ? -1 : redrawn;
+}
+
+// Dashboard from the cached template and fresh bindings; false when the
+// device has no usable template (the caller falls back to a raster)
+bool fetchDashboardData() {
+  if (!TEMPLATE_ENABLED) return false;
+
+  HTTPClient http;
+  String deviceId = String((uint32_t)ESP.getEfuseMac(), HEX);
+  String url = String(API_SERVER) + "/api/device/" + deviceId + "/dashboard-data";
+
+  http.begin(secureClient, url);
+  http.setTimeout(10000);
+  int httpCode = http.GET();
+
+  if (httpCode != 200) {
+    Serial.printf("Dashboard data failed: %d\n", httpCode);
+    http.end();
+    return false;
+  }
+
+  String response = http.getString();
+  http.end();
+
+  JsonDocument doc;
+  DeserializationError error = deserializeJson(doc, response);
+  if (error) {
+    Serial.printf("Dashboard data parse error: %s\n", error.c_str());
+    return false;
+  }
+
+  uint32_t version = doc["l"].as<uint32_t>();
+  if ((!templateReady || version != templateVersion) && !fetchLayoutTemplate()) {
+    return false;
+  }
+
+  int redrawn = templateApply(doc["b"].as<JsonObject>());
+  if (redrawn < 0) {
+    Serial.println("Dashboard: full template render");
+  } else {
+    Serial.printf("Dashboard: %d widget(s) changed\n", redrawn);
+  }
+
+  hasImage = true;
+  imageGray = false;
+  frameMapped = nullptr;
+  frameFromServer = (redrawn != 0);
+  frameMode = MODE_DASHBOARD;
+  frameImageIndex = 0;
+  return true;
+}
+
+// ============================================================
+// OVERLAY LAYERS
+// Badges (clock, weather) drawn over a photo. The photo stays in
+// layerBase and each overlay layer is an ink bitmap plus a mask, so the
+// composite is rebuilt locally with word-wise (base & ~mask) | (ink & mask)
+// and an overlay change downloads only the layers (/overlay) and
+// partial-refreshes only their rectangles. Layers are byte aligned.
+// ============================================================
+
+// Composite one layer into a plane (a frame or the gray LSB plane).
+// Gray pixels under the mask become the layer's black or white.
+static void overlayComposePlane(uint8_t* plane, const OverlayLayer& layer) {
+  const int rowBytes = DISPLAY_WIDTH / 8;
+  int bytes = layer.w / 8;
+  const uint8_t* ink = overlayPool + layer.offset;
+  const uint8_t* mask = ink + bytes * layer.h;
+
+  for (int row = 0; row < layer.h; row++) {
+    uint8_t* dst = plane + (layer.y + row) * rowBytes + layer.x / 8;
+    const uint8_t* in = ink + row * bytes;
+    const uint8_t* m = mask + row * bytes;
+
+    // Rows are not word aligned (25 bytes on this panel), so words go
+    // through memcpy, which compiles to plain loads on the ESP32
+    int i = 0;
+    for (; i + 4 <= bytes; i += 4) {
+      uint32_t d, s, k;
+      memcpy(&d, dst + i, 4);
+      memcpy(&s, in + i, 4);
+      memcpy(&k, m + i, 4);
+      d = (d & ~k) | (s & k);
+      memcpy(dst + i, &d, 4);
+    }
+    for (; i < bytes; i++) {
+      dst[i] = (dst[i] & ~m[i]) | (in[i] & m[i]);
+    }
+  }
+}
+
+// Rebuild imageBuffer (and grayPlane) from the base layer and the overlays
+static void overlayCompose() {
+  memcpy(imageBuffer, layerBase, FRAME_BYTES);
+  if (GRAY_ENABLED && imageGray) memcpy(grayPlane, layerBaseGray, FRAME_BYTES);
+
+  for (int i = 0; i < overlayCount; i++) {
+    overlayComposePlane(imageBuffer, overlayLayers[i]);
+    if (GRAY_ENABLED && imageGray) overlayComposePlane(grayPlane, overlayLayers[i]);
+  }
+  layerComposedHash = frameHash(imageBuffer, FRAME_BYTES);
+}
+
+// Called by drawImage(). A photo that just arrived in imageBuffer becomes
+// the base layer; the overlays are then composited over it.
+void overlayPrepare() {
+  if (!OVERLAY_ENABLED || currentMode != MODE_IMAGE) {
+    layerComposedHash = 0;
+    return;
+  }
+
+  // A photo read in place from the frame store is always a fresh photo
+  if (frameMapped) {
+    layerComposedHash = 0;
+    if (overlayCount == 0) return;
+    frameMaterialize();
+  }
+
+  bool fresh = (layerComposedHash == 0 || frameHash(imageBuffer, FRAME_BYTES) != layerComposedHash);
+  if (fresh) {
+    if (overlayCount == 0) return;
+    memcpy(layerBase, imageBuffer, FRAME_BYTES);
+    if (GRAY_ENABLED && imageGray) memcpy(layerBaseGray, grayPlane, FRAME_BYTES);
+  }
+
+  if (overlayCount == 0) {
+    // Overlays were switched off: show the bare photo again
+    memcpy(imageBuffer, layerBase, FRAME_BYTES);
+    if (GRAY_ENABLED && imageGray) memcpy(grayPlane, layerBaseGray, FRAME_BYTES);
+    layerComposedHash = 0;
+    return;
+  }
+
+  overlayCompose();
+}
+
+// Download the overlay layers. Returns true when they were replaced
+// (the old geometry is kept in overlayPrev for overlayRedraw()).
+bool fetchOverlays() {
+  HTTPClient http;
+  String deviceId = String((uint32_t)ESP.getEfuseMac(), HEX);
+  String url = String(API_SERVER) + "/api/device/" + deviceId + "/overlay";
+
+  http.begin(secureClient, url);
+  http.setTimeout(10000);
+  int httpCode = http.GET();
+
+  if (httpCode != 200) {
+    Serial.printf("Overlay fetch failed: %d\n", httpCode);
+    http.end();
+    return false;
+  }
+
+  unsigned long startTime = millis();
+  uint8_t header[9];
+  if (readStreamBytes(http, header, 6, startTime, 10000) != 6 || memcmp(header, "IFOL", 4) != 0 || header[4] != 1) {
+    Serial.println("Overlay: bad header");
+    http.end();
+    return false;
+  }
+
+  // Staged so a failed download keeps the current layers
+  OverlayLayer layers[OVERLAY_MAX_LAYERS];
+  static uint8_t pool[OVERLAY_POOL_BYTES];
+  int count = 0;
+  int used = 0;
+
+  for (int n = 0; n < header[5]; n++) {
+    uint8_t layerHeader[9];
+    if (readStreamBytes(http, layerHeader, 9, startTime, 10000) != 9) {
+      http.end();
+      return false;
+    }
+
+    OverlayLayer layer;
+    layer.id = layerHeader[0];
+    layer.x = (layerHeader[1] << 8) | layerHeader[2];
+    layer.y = (layerHeader[3] << 8) | layerHeader[4];
+    layer.w = (layerHeader[5] << 8) | layerHeader[6];
+    layer.h = (layerHeader[7] << 8) | layerHeader[8];
+    int bytes = layer.w / 8 * layer.h;
+
+    bool fits = (layer.x % 8 == 0 && layer.w % 8 == 0 && layer.w > 0 && layer.h > 0 &&
+                 layer.x + layer.w <= DISPLAY_WIDTH && layer.y + layer.h <= DISPLAY_HEIGHT &&
+                 count < OVERLAY_MAX_LAYERS && used + 2 * bytes <= OVERLAY_POOL_BYTES);
+    if (!fits) {
+      Serial.printf("Overlay: layer %d (%dx%d at %d,%d) doesn't fit\n", layer.id, layer.w, layer.h, layer.x, layer.y);
+      http.end();
+      return false;
+    }
+
+    if (readStreamBytes(http, pool + used, 2 * bytes, startTime, 10000) != 2 * bytes) {
+      http.end();
+      return false;
+    }
+    layer.offset = used;
+    used += 2 * bytes;
+    layers[count++] = layer;
+  }
+  http.end();
+
+  memcpy(overlayPrev, overlayLayers, sizeof(OverlayLayer) * overlayCount);
+  overlayPrevCount = overlayCount;
+  memcpy(overlayLayers, layers, sizeof(OverlayLayer) * count);
+  memcpy(overlayPool, pool, used);
+  overlayCount = count;
+  overlayVersion = resourceVersion[RES_OVERLAY];
+
+  Serial.printf("Overlay: %d layer(s), %d bytes\n", count, used);
+  return true;
+}
+
+// Show new overlays over the photo on screen: recomposite locally and
+// refresh only the old and new layer rectangles
+void overlayRedraw() {
+  if (!hasImage) return;
+
+  // Only a composite (or bare photo) we made ourselves has a usable base
+  bool onScreen = (layerComposedHash != 0 && frameHash(imageBuffer, FRAME_BYTES) == layerComposedHash);
+  if (onScreen) {
+    dirtyRectCount = 0;
+    for (int i = 0; i < overlayPrevCount; i++) {
+      const OverlayLayer& l = overlayPrev[i];
+      markDirtyRect(l.x, l.y, l.w, l.h);
+    }
+    for (int i = 0; i < overlayCount; i++) {
+      const OverlayLayer& l = overlayLayers[i];
+      markDirtyRect(l.x, l.y, l.w, l.h);
+    }
+  }
+
+  frameFromServer = false;  // overlay ticks don't go into history
+  drawImage();
+}
+
+// ============================================================
+// ALERT BANNER
+// Urgent text (a calendar reminder, a doorbell) arrives in the poll as
+// "al": {id, t, f, ttl}. It is set once into alertStrip with the template
+// font f, white on black, at scale 2 when it fits on one line and as two
+// lines at scale 1 otherwise. drawImage() paints the frame with the strip
+// swapped in, and the panel's partial refresh finds that only the strip
+// changed. When the TTL runs out (or the server drops the alert) the
+// unchanged frame is painted again, which restores what was under it.
+// ============================================================
+#define ALERT_STRIP_Y (DISPLAY_HEIGHT - ALERT_BANNER_HEIGHT)
+#define ALERT_STRIP_OFFSET (ALERT_STRIP_Y * DISPLAY_WIDTH / 8)
+
+// Code points in text
+static int utf8Length(const char* text) {
+  int n = 0;
+  for (const char* p = text; *p; n++) utf8Next(p);
+  return n;
+}
+
+// Byte offset where a line of at most maxChars code points should end:
+// the last space that fits, or a hard cut when there is none
+static int alertLineBreak(const char* text, int maxChars) {
+  const char* p = text;
+  const char* lastSpace = nullptr;
+  for (int n = 0; *p && n < maxChars; n++) {
+    if (*p == ' ') lastSpace = p;
+    utf8Next(p);
+  }
+  if (!*p) return p - text;
+  return lastSpace ? lastSpace - text : p - text;
+}
+
+// Render the banner for text into alertStrip. The template helpers draw
+// into imageBuffer, so the strip is borrowed from it and put back.
+static bool alertRender(const char* text, const char* fontName) {
+  int font = templateFontIndex(fontName);
+  if (font < 0) return false;
+  const TemplateFont& f = templateFonts[font];
+
+  uint8_t saved[sizeof(alertStrip)];
+  memcpy(saved, imageBuffer + ALERT_STRIP_OFFSET, sizeof(saved));
+  frameFillRect(0, ALERT_STRIP_Y, DISPLAY_WIDTH, ALERT_BANNER_HEIGHT, true);
+  frameFillRect(0, ALERT_STRIP_Y + 1, DISPLAY_WIDTH, 1, false);  // rule between frame and banner
+
+  int usable = DISPLAY_WIDTH - 8;
+  if (utf8Length(text) * f.advance * 2 <= usable && f.h * 2 + 4 <= ALERT_BANNER_HEIGHT) {
+    templateDrawText(f, 4, ALERT_STRIP_Y + (ALERT_BANNER_HEIGHT - f.h * 2) / 2 + 1, text, 2, false);
+  } else {
+    int perLine = usable / f.advance;
+    int lineGap = (ALERT_BANNER_HEIGHT - 2 * f.h) / 3;
+    char line[ALERT_MAX_TEXT + 1];
+    const char* p = text;
+    for (int i = 0; i < 2 && *p; i++) {
+      int len = alertLineBreak(p, perLine);
+      memcpy(line, p, len);
+      line[len] = 0;
+      templateDrawText(f, 4, ALERT_STRIP_Y + 1 + lineGap + i * (f.h + lineGap), line, 1, false);
+      p += len;
+      while (*p == ' ') p++;
+    }
+  }
+
+  memcpy(alertStrip, imageBuffer + ALERT_STRIP_OFFSET, sizeof(alertStrip));
+  memcpy(imageBuffer + ALERT_STRIP_OFFSET, saved, sizeof(saved));
+  return true;
+}
+
+// Take the poll's alert field. Returns true when the banner on screen
+// has to change (a new alert, or the current one was withdrawn).
+bool alertUpdate(JsonObject alert) {
+  if (!ALERT_ENABLED) return false;
+
+  if (alert.isNull()) {
+    if (!alertShown) return false;
+    Serial.printf("Alert %08x withdrawn\n", alertId);
+    alertShown = false;
+    return true;
+  }
+
+  uint32_t id = alert["id"].as<uint32_t>();
+  if (!id || id == alertId) return false;  // an expired alert stays down
+
+  char text[ALERT_MAX_TEXT + 1];
+  strlcpy(text, alert["t"] | "", sizeof(text));
+  if (!templateReady && !fetchLayoutTemplate()) return false;
+  if (!alertRender(text, alert["f"] | "s")) {
+    Serial.println("Alert: font not in the layout template");
+    return false;
+  }
+
+  alertId = id;
+  alertShown = true;
+  alertShownMs = millis();
+  alertTtlMs = constrain((long)(alert["ttl"] | 0), 1L, (long)ALERT_MAX_TTL_S) * 1000UL;
+  Serial.printf("Alert %08x for %lu s: %s\n", id, alertTtlMs / 1000, text);
+  return true;
+}
+
+// Show the banner as it now is; a scheduled refresh will show it anyway
+void alertRedraw() {
+  if (!hasImage || syncDrawAt) return;
+  frameFromServer = false;  // banner changes don't go into history
+  drawImage();
+}
+
+// Called from loop(): take the banner down when its time is up
+void alertLoop() {
+  if (!alertShown || millis() - alertShownMs < alertTtlMs) return;
+  Serial.printf("Alert %08x expired\n", alertId);
+  alertShown = false;
+  alertRedraw();
+}
+
+// Called by drawImage(): the frame to paint, with the banner if one is up.
+// A local redraw only refreshes its own rectangles, so the strip joins
+// them whenever the banner differs from what the panel shows.
+const uint8_t* alertCompose(const uint8_t* frame) {
+  static uint32_t onPanel = 0;  // alert the panel shows, 0 = none
+  uint32_t wanted = (ALERT_ENABLED && alertShown) ? alertId : 0;
+
+  if (dirtyRectCount > 0 && wanted != onPanel) markDirtyRect(0, ALERT_STRIP_Y, DISPLAY_WIDTH, ALERT_BANNER_HEIGHT);
+  onPanel = wanted;
+  if (!wanted) return frame;
+
+  memcpy(alertFrame, frame, ALERT_STRIP_OFFSET);
+  memcpy(alertFrame + ALERT_STRIP_OFFSET, alertStrip, sizeof(alertStrip));
+  return alertFrame;
+}
+
+// ============================================================
+// ZONE LAYOUTS
+// Split screen: each zone (e.g. a photo and a calendar) has its own
+// content source, version and refresh policy on the server. /zones lists
+// the current versions; only zones whose version changed are loaded, from
+// their flash cache entry (/zone<slot>.bin: id, version, rows) or the
+// server, and refreshed on their own window (a plain partial, or a clean
+// one through the negative for zones whose policy asks for a full
+// waveform, e.g. photos).
+// ============================================================
+#define ZONE_CACHE_HEADER 12        // id (8) + version (4)
+
+static String zoneCachePath(int slot) {
+  return "/zone" + String(slot) + ".bin";
+}
+
+struct ZoneSink {
+  const Zone* zone;
+  File* file;
+};
+
+// Decoded zone rows go into the zone's rectangle of imageBuffer (and the cache)
+static bool zoneRowSink(void* ctx, int y, const uint8_t* row, size_t rowBytes) {
+  ZoneSink* sink = (ZoneSink*)ctx;
+  const Zone& z = *sink->zone;
+  memcpy(imageBuffer + (z.y + y) * (DISPLAY_WIDTH / 8) + z.x / 8, row, rowBytes);
+  if (sink->file) sink->file->write(row, rowBytes);
+  return true;
+}
+
+static bool zoneCacheLoad(const Zone& z, int slot) {
+  if (!flashFsReady) return false;
+
+  File f = LittleFS.open(zoneCachePath(slot), FILE_READ);
+  if (!f) return false;
+
+  int rowBytes = z.w / 8;
+  uint8_t header[ZONE_CACHE_HEADER];
+  bool ok = (f.size() == ZONE_CACHE_HEADER + (size_t)rowBytes * z.h &&
+             f.read(header, ZONE_CACHE_HEADER) == ZONE_CACHE_HEADER &&
+             strncmp((const char*)header, z.id, 8) == 0 &&
+             memcmp(header + 8, &z.version, 4) == 0);
+
+  uint8_t row[DISPLAY_WIDTH / 8];
+  ZoneSink sink = {&z, nullptr};
+  for (int y = 0; ok && y < z.h; y++) {
+    ok = f.read(row, rowBytes) == (size_t)rowBytes && zoneRowSink(&sink, y, row, rowBytes);
+  }
+  f.close();
+
+  if (ok) Serial.printf("Zone %s: cache hit\n", z.id);
+  return ok;
+}
+
+// A load or download that failed may have stopped partway through the
+// zone. Put back what the panel shows: the cache entry of the shown
+// version, or else a blank zone that the next pass fetches again.
+static void zoneRestore(Zone& z, int slot) {
+  Zone shown = z;
+  shown.version = z.shown;
+  if (z.shown && zoneCacheLoad(shown, slot)) return;
+
+  for (int y = 0; y < z.h; y++) {
+    memset(imageBuffer + (z.y + y) * (DISPLAY_WIDTH / 8) + z.x / 8, 0xFF, z.w / 8);
+  }
+  if (z.shown) markDirtyRect(z.x, z.y, z.w, z.h);
+  z.shown = 0;
+}
+
+// Download one zone into imageBuffer, streaming it into a new cache entry
+// that replaces the old one only once it is complete
+static bool fetchZone(Zone& z, int slot) {
+  Serial.printf("Fetching zone %s (%dx%d at %d,%d)...\n", z.id, z.w, z.h, z.x, z.y);
+
+  HTTPClient http;
+  String deviceId = String((uint32_t)ESP.getEfuseMac(), HEX);
+  String url = String(API_SERVER) + "/api/device/" + deviceId + "/zone/" + String(z.id) + "?progressive=0";
+
+  http.begin(secureClient, url);
+  http.setTimeout(15000);
+  const char* headerKeys[] = {"X-Image-Width", "X-Image-Height", "X-Frame-Codec", "X-Zone-Version"};
+  http.collectHeaders(headerKeys, 4);
+  int httpCode = http.GET();
+
+  if (httpCode != 200 || http.header("X-Image-Width").toInt() != z.w || http.header("X-Image-Height").toInt() != z.h) {
+    Serial.printf("Zone %s fetch failed: %d\n", z.id, httpCode);
+    http.end();
+    return false;
+  }
+
+  const BilevelCodec* codec = nullptr;
+  if (http.hasHeader("X-Frame-Codec")) {
+    codec = codecByName(http.header("X-Frame-Codec").c_str());
+    if (!codec) {
+      Serial.printf("Zone %s: unknown codec\n", z.id);
+      http.end();
+      return false;
+    }
+  }
+  if (http.hasHeader("X-Zone-Version")) {
+    z.version = strtoul(http.header("X-Zone-Version").c_str(), nullptr, 10);
+  }
+
+  File f;
+  String partPath = zoneCachePath(slot) + ".part";
+  if (flashFsReady) {
+    f = LittleFS.open(partPath, FILE_WRITE);
+    if (f) {
+      char id[8] = {0};
+      strncpy(id, z.id, sizeof(id));
+      f.write((const uint8_t*)id, 8);
+      f.write((const uint8_t*)&z.version, 4);
+    }
+  }
+
+  ZoneSink sink = {&z, f ? &f : nullptr};
+  int rowBytes = z.w / 8;
+  int len = http.getSize();
+  unsigned long startTime = millis();
+  bool ok;
+
+  if (codec) {
+    uint8_t* work = (uint8_t*)malloc(codec->workBytes(z.w));
+    HttpByteSource src(http, len, startTime, 10000);
+    ok = work && codec->decode(src, z.w, z.h, work, zoneRowSink, &sink);
+    free(work);
+  } else {
+    uint8_t row[DISPLAY_WIDTH / 8];
+    ok = (len == -1 || len == rowBytes * z.h);
+    for (int y = 0; ok && y < z.h; y++) {
+      ok = readStreamBytes(http, row, rowBytes, startTime, 10000) == rowBytes && zoneRowSink(&sink, y, row, rowBytes);
+    }
+  }
+  http.end();
+
+  if (f) {
+    f.close();
+    if (ok) {
+      LittleFS.remove(zoneCachePath(slot));
+      LittleFS.rename(partPath, zoneCachePath(slot));
+    } else {
+      LittleFS.remove(partPath);
+    }
+  }
+  Serial.printf("Zone %s: %s in %lu ms\n", z.id, ok ? "received" : "incomplete", millis() - startTime);
+  return ok;
+}
+
+// Bring imageBuffer up to date with the zone layout. Returns false when
+// there is no layout or nothing could be drawn (the caller falls back).
+bool updateZones() {
+  if (!ZONES_ENABLED) return false;
+
+  HTTPClient http;
+  String deviceId = String((uint32_t)ESP.getEfuseMac(), HEX);
+  String url = String(API_SERVER) + "/api/device/" + deviceId + "/zones";
+
+  http.begin(secureClient, url);
+  http.setTimeout(10000);
+  int httpCode = http.GET();
+
+  if (httpCode != 200) {
+    Serial.printf("Zone list failed: %d\n", httpCode);
+    http.end();
+    return false;
+  }
+
+  String response = http.getString();
+  http.end();
+
+  JsonDocument doc;
+  if (deserializeJson(doc, response)) {
+    Serial.println("Zone list: bad JSON");
+    return false;
+  }
+
+  Zone listed[ZONES_MAX];
+  int count = 0;
+  for (JsonObject obj : doc["zones"].as<JsonArray>()) {
+    if (count >= ZONES_MAX) break;
+    Zone& z = listed[count];
+    strlcpy(z.id, obj["id"] | "", sizeof(z.id));
+    z.x = obj["x"] | 0;
+    z.y = obj["y"] | 0;
+    z.w = obj["w"] | 0;
+    z.h = obj["h"] | 0;
+    z.version = obj["v"].as<uint32_t>();
+    z.shown = 0;
+    z.fullRefresh = strcmp(obj["p"] | "partial", "full") == 0;
+    if (z.x % 8 || z.w % 8 || z.w <= 0 || z.h <= 0 || z.x + z.w > DISPLAY_WIDTH || z.y + z.h > DISPLAY_HEIGHT) {
+      Serial.printf("Zone %s doesn't fit the panel, skipped\n", z.id);
+      continue;
+    }
+    count++;
+  }
+  if (count == 0) return false;
+
+  // A different layout starts over; otherwise keep what each zone shows
+  bool layoutChanged = (count != zoneCount);
+  for (int i = 0; i < count && !layoutChanged; i++) {
+    const Zone& a = listed[i];
+    const Zone& b = zones[i];
+    layoutChanged = strcmp(a.id, b.id) != 0 || a.x != b.x || a.y != b.y || a.w != b.w || a.h != b.h;
+  }
+  for (int i = 0; i < count; i++) {
+    if (!layoutChanged) listed[i].shown = zones[i].shown;
+    zones[i] = listed[i];
+  }
+  zoneCount = count;
+
+  // imageBuffer no longer holds our zones (a photo, dashboard or history
+  // frame replaced it): rebuild every zone, mostly from the flash cache
+  bool rebuild = layoutChanged || !hasImage || imageGray || frameMapped || zoneFrameHash == 0 ||
+                 frameHash(imageBuffer, FRAME_BYTES) != zoneFrameHash;
+  if (rebuild) {
+    memset(imageBuffer, 0xFF, FRAME_BYTES);
+    for (int i = 0; i < zoneCount; i++) zones[i].shown = 0;
+  }
+
+  dirtyRectCount = 0;
+  int updated = 0;
+
+  for (int i = 0; i < zoneCount; i++) {
+    Zone& z = zones[i];
+    if (z.shown == z.version) continue;
+    if (!zoneCacheLoad(z, i) && !fetchZone(z, i)) {
+      zoneRestore(z, i);  // keeps showing the old content
+      continue;
+    }
+
+    z.shown = z.version;
+    updated++;
+    markDirtyRect(z.x, z.y, z.w, z.h, z.fullRefresh);
+  }
+
+  if (rebuild && updated == 0) return false;
+
+  Serial.printf("Zones: %d/%d updated%s\n", updated, zoneCount, rebuild ? " (full refresh)" : "");
+  zoneFrameHash = frameHash(imageBuffer, FRAME_BYTES);
+  // A rebuilt screen replaces whatever the panel showed
+  if (rebuild) forceFullRefresh = true;
+  hasImage = true;
+  imageGray = false;
+  frameMapped = nullptr;
+  frameFromServer = (updated > 0);
+  frameMode = MODE_ZONES;
+  frameImageIndex = currentImageIndex;
+  return true;
+}
+
+// ============================================================
+// PEER SHARING
+// Frames in one peer group (set on the server) share downloads over UDP
+// multicast on the LAN, see lib/PeerShare. The elected leader fetches
+// from the cloud and serves what it shows; the others ask the group first
+// and verify the frame's hash before drawing it. Datagrams are tagged with
+// the group key from the poll, so only group members can serve frames.
+// The server's content key says which frame a poll wants, so peers only
+// take exactly that frame.
+// ============================================================
+class UdpPeerTransport : public PeerTransport {
+public:
+  bool send(const uint8_t* data, size_t len) override {
+    if (!peerUdp.beginMulticastPacket()) return false;
+    peerUdp.write(data, len);
+    return peerUdp.endPacket() == 1;
+  }
+
+  WiFiUDP peerUdp;
+};
+
+// Served frames are the bare photo (overlays are per device); received
+// frames go into imageBuffer and grayPlane
+class FramePeerStore : public PeerFrameStore {
+public:
+  void read(size_t offset, uint8_t* dst, size_t len) override {
+    const uint8_t* msb = layerComposedHash ? layerBase : currentFrame();
+    const uint8_t* lsb = layerComposedHash ? layerBaseGray : grayPlane;
+    while (len > 0 && offset < 2 * FRAME_BYTES) {
+      size_t n = span(offset, len);
+      memcpy(dst, (offset < FRAME_BYTES ? msb : lsb) + offset % FRAME_BYTES, n);
+      dst += n;
+      offset += n;
+      len -= n;
+    }
+  }
+
+  void write(size_t offset, const uint8_t* src, size_t len) override {
+    while (len > 0 && offset < 2 * FRAME_BYTES) {
+      size_t n = span(offset, len);
+      memcpy((offset < FRAME_BYTES ? imageBuffer : grayPlane) + offset % FRAME_BYTES, src, n);
+      src += n;
+      offset += n;
+      len -= n;
+    }
+  }
+
+private:
+  // Bytes from offset to the end of its plane, at most len
+  static size_t span(size_t offset, size_t len) {
+    return min(len, (size_t)FRAME_BYTES - offset % FRAME_BYTES);
+  }
+};
+
+UdpPeerTransport peerTransport;
+FramePeerStore peerStore;
+PeerShare peer(peerTransport, peerStore, (uint32_t)ESP.getEfuseMac());
+
+// Join or leave the group the server assigned (0 = not sharing). The
+// group key authenticates every datagram; without one we don't share.
+void peerSetGroup(uint32_t group, const char* keyHex) {
+  if (!PEER_ENABLED) return;
+
+  uint8_t key[PEER_KEY_BYTES];
+  bool keyed = strlen(keyHex) == 2 * sizeof(key);
+  for (size_t i = 0; keyed && i < sizeof(key); i++) {
+    char byteHex[3] = { keyHex[2 * i], keyHex[2 * i + 1], '\0' };
+    char* end;
+    key[i] = (uint8_t)strtoul(byteHex, &end, 16);
+    keyed = (*end == '\0');
+  }
+  if (group && !keyed) {
+    Serial.println("Peer: no group key, not sharing");
+    group = 0;
+  }
+
+  if (group == peerGroupId) {
+    if (group) peer.setGroup(group, key, millis());  // the key may have been rotated
+    return;
+  }
+
+  if (peerGroupId) peerTransport.peerUdp.stop();
+  if (group && !peerTransport.peerUdp.beginMulticast(PEER_MULTICAST_IP, PEER_UDP_PORT)) {
+    Serial.println("Peer: multicast join failed");
+    group = 0;
+  }
+
+  peerGroupId = group;
+  peer.setGroup(group, group ? key : nullptr, millis());
+  Serial.printf("Peer: %s group %08x\n", group ? "joined" : "left", group);
+}
+
+// In a group and not the one that downloads
+bool peerFollowing() {
+  return PEER_ENABLED && peerGroupId && !peer.isLeader(millis());
+}
+
+static void peerPump() {
+  uint8_t packet[PEER_PACKET_BYTES];
+  int size;
+  while ((size = peerTransport.peerUdp.parsePacket()) > 0) {
+    int len = peerTransport.peerUdp.read(packet, sizeof(packet));
+    if (len > 0) peer.onPacket(packet, len, millis());
+  }
+  peer.poll(millis());
+}
+
+// Ask the group for the frame the last poll asked for. Falls through to
+// the cloud on the leader, for other frames, and when nobody answers.
+bool peerReceive(DisplayMode mode, int index) {
+  peerFrameKey = 0;
+  if (!peerFollowing() || !peerKey || mode != peerKeyMode || index != peerKeyIndex) return false;
+
+  unsigned long start = millis();
+  Serial.printf("Peer: asking group for %08x (leader %08x, %d members)\n",
+                peerKey, peer.leader(start), peer.memberCount(start));
+
+  peer.request(peerKey, start, PEER_WAIT_MS);
+  while (peer.fetchState() == PEER_RECEIVING) {
+    peerPump();
+    delay(5);
+  }
+
+  size_t length = peer.fetchedLength();
+  bool gray = GRAY_ENABLED && length == 2 * FRAME_BYTES;
+  bool ok = (peer.fetchState() == PEER_COMPLETE && (length == FRAME_BYTES || gray));
+  peer.resetFetch();
+
+  if (!ok) {
+    Serial.printf("Peer: no frame from the group after %lu ms, using the cloud\n", millis() - start);
+    return false;
+  }
+
+  Serial.printf("Peer: frame %08x from the group in %lu ms\n", peerKey, millis() - start);
+  hasImage = true;
+  imageGray = gray;
+  frameMapped = nullptr;
+  frameFromServer = true;
+  frameMode = mode;
+  frameImageIndex = index;
+  return true;
+}
+
+// A fetch put the frame for mode/index on screen; drawImage() serves it
+void peerFrameFetched(DisplayMode mode, int index, size_t length) {
+  peerFrameKey = (peerKey && mode == peerKeyMode && index == peerKeyIndex) ? peerKey : 0;
+  peerFrameLength = length;
+}
+
+// Called at the end of drawImage(): the leader serves the frame it just
+// fetched, and stops serving once the screen shows something else
+void peerPublishFrame() {
+  if (!PEER_ENABLED || !peerGroupId) return;
+
+  if (peerFrameKey && peer.isLeader(millis())) {
+    peer.publish(peerFrameKey, peerFrameLength);
+  } else if (peer.publishedKey() &&
+             PeerShare::frameHash(peerStore, peer.publishedLength()) != peer.publishedHash()) {
+    peer.withdraw();
+  }
+  peerFrameKey = 0;
+}
+
+// Called from loop(): answer peers, and poll early when a peer wants a
+// frame we don't have yet so the group doesn't wait for our schedule
+void peerLoop() {
+  if (!PEER_ENABLED || !peerGroupId) return;
+  peerPump();
+
+  if (peer.requestedKey()) {
+    if (millis() - peerEarlyPollMs > PEER_POLL_MIN_MS) {
+      Serial.printf("Peer: group wants %08x, polling now\n", peer.requestedKey());
+      peerEarlyPollMs = millis();
+      lastPollTime = 0;
+    }
+    peer.clearRequest();
+  }
+}
+
+// ============================================================
+// SYNCHRONIZED REFRESH
+// Frames in a wall get "display at T" with a poll. They fetch right away,
+// keep the frame in imageBuffer, and start the panel refresh at T, so the
+// wall changes at once instead of rippling with each frame's poll. All
+// the slow work (temperature read, compositing, the RAM write) is done
+// SYNC_PREPARE_MS ahead; only the refresh trigger waits for T. T is
+// read off a local clock model: SNTP sets it, and consecutive syncs
+// measure the oscillator's drift, which corrects the time in between.
+// ============================================================
+static int64_t clockAt(int64_t us) {
+  double elapsedMs = (us - clockBaseUs) / 1000.0;
+  return clockBaseEpochMs + (int64_t)(elapsedMs * (1.0 + clockDriftPpm * 1e-6));
+}
+
+int64_t clockNowMs() {
+  return clockAt(esp_timer_get_time());
+}
+
+// Re-anchor the clock on a time sample, learning the drift from how far
+// off the model had wandered since the previous sample of the same kind
+static void clockCorrect(int64_t epochMs, int64_t us, bool ntp) {
+  if (clockFromNtp && !ntp) return;
+
+  if (clockSynced && clockFromNtp == ntp && us - clockBaseUs > 60 * 1000000LL) {
+    double errorMs = (double)(epochMs - clockAt(us));
+    double ppm = clockDriftPpm + 0.5 * errorMs * 1000.0 / (us - clockBaseUs) * 1e6;
+    clockDriftPpm = constrain(ppm, -SYNC_MAX_DRIFT_PPM, SYNC_MAX_DRIFT_PPM);
+    Serial.printf("Clock: %+.0f ms off after %lld s, drift %.1f ppm\n",
+                  errorMs, (us - clockBaseUs) / 1000000LL, clockDriftPpm);
+  }
+
+  clockBaseEpochMs = epochMs;
+  clockBaseUs = us;
+  clockSynced = true;
+  clockFromNtp = clockFromNtp || ntp;
+}
+
+static void onNtpSync(struct timeval* tv) {
+  clockCorrect((int64_t)tv->tv_sec * 1000 + tv->tv_usec / 1000, esp_timer_get_time(), true);
+}
+
+void initClockSync() {
+  if (!SYNC_ENABLED) return;
+  sntp_set_time_sync_notification_cb(onNtpSync);
+  sntp_set_sync_interval(SYNC_NTP_INTERVAL_MS);
+  configTime(0, 0, SYNC_NTP_SERVER);
+}
+
+// The poll's server time, stamped when the response was built: assume it
+// is halfway through the round trip
+void clockServerSample(uint64_t serverMs, int64_t sentUs, int64_t receivedUs) {
+  if (!SYNC_ENABLED || serverMs == 0) return;
+  clockCorrect((int64_t)serverMs + (receivedUs - sentUs) / 2000, receivedUs, false);
+}
+
+// Show what the poll just fetched: now, or at the scheduled time
+void drawFetched(uint64_t displayAt) {
+  if (SYNC_ENABLED && displayAt && clockSynced) {
+    int64_t wait = (int64_t)displayAt - clockNowMs();
+    if (wait > 0 && wait < SYNC_MAX_WAIT_MS) {
+      syncDrawAt = displayAt;
+      layerComposedHash = 0;  // imageBuffer holds the new bare frame now
+      peerPublishFrame();     // the rest of the wall prefetches from us
+      Serial.printf("Sync: frame ready, refresh scheduled in %lld ms\n", wait);
+      return;
+    }
+  }
+  drawImage();
+}
+
+// Hold a refresh trigger until panelRefreshAt. Called with the panel RAM
+// already written, so the wait is the last thing before the refresh.
+void panelRefreshGate() {
+  if (!panelRefreshAt) return;
+  int64_t wait = (int64_t)panelRefreshAt - clockNowMs();
+  if (wait > 0 && wait < SYNC_MAX_WAIT_MS) delay(wait);
+  syncLateMs = clockNowMs() - (int64_t)panelRefreshAt;
+  panelRefreshAt = 0;
+}
+
+// Called from loop(): ready the panel shortly before T; drawImage() then
+// holds only the refresh itself for T (panelRefreshGate())
+void syncLoop() {
+  if (!syncDrawAt) return;
+
+  int64_t wait = (int64_t)syncDrawAt - clockNowMs();
+  if (wait > SYNC_PREPARE_MS) return;
+
+  uint64_t at = syncDrawAt;
+  panelRefreshAt = at;
+  syncLateMs = 0;
+  drawImage();
+  panelRefreshAt = 0;
+  Serial.printf("Sync: refresh for %llu went out %+lld ms off (%s clock), prepared from %lld ms before\n",
+                at, syncLateMs, clockFromNtp ? "SNTP" : "server", wait);
+}
+
+// ============================================================
+// LIVING PHOTO
+// While a photo stays on screen, a rendition LIVING_SCALE times the panel
+// size is downloaded once (a background job) and the photo zooms in
+// towards a point and back out over LIVING_STEPS steps. Each step crops
+// a window straight out of the rendition in mapped flash or PSRAM and
+// area-scales it into imageBuffer (FrameScaler), then drawImage() refreshes
+// what changed. The rendition region has the same header as a frame slot.
+// ============================================================
+static bool livingStorage() {
+  if (livingOffset) return true;
+  if (!psramFound()) return false;
+  if (!livingPsram) livingPsram = (uint8_t*)ps_malloc(LIVING_BYTES);
+  return livingPsram != nullptr;
+}
+
+struct LivingSink {
+  size_t rowBytes;
+  uint32_t hash;
+  bool ok;
+};
+
+// Decoded rows go straight to their place in flash or PSRAM
+static bool livingRowSink(void* ctx, int y, const uint8_t* row, size_t rowBytes) {
+  LivingSink* sink = (LivingSink*)ctx;
+  if (y >= LIVING_HEIGHT) return true;  // a second plane is not used
+  size_t offset = (size_t)y * sink->rowBytes;
+  if (livingOffset) {
+    sink->ok = sink->ok && esp_partition_write(frameStorePart, livingOffset + FRAME_SLOT_HEADER + offset, row, rowBytes) == ESP_OK;
+  } else {
+    memcpy(livingPsram + offset, row, rowBytes);
+  }
+  sink->hash = fnv1a(sink->hash, row, rowBytes);
+  return sink->ok;
+}
+
+bool fetchLivingPhoto(int index) {
+  if (!livingStorage()) return false;
+
+  Serial.printf("Living photo: fetching image %d at %dx%d...\n", index, LIVING_WIDTH, LIVING_HEIGHT);
+  livingData = nullptr;
+  livingIndex = -1;
+
+  HTTPClient http;
+  String deviceId = String((uint32_t)ESP.getEfuseMac(), HEX);
+  String url = String(API_SERVER) + "/api/device/" + deviceId + "/bitmap?index=" + String(index) +
+               "&mode=photo&w=" + String(LIVING_WIDTH) + "&h=" + String(LIVING_HEIGHT);
+
+  http.begin(secureClient, url);
+  http.setTimeout(15000);
+  const char* headerKeys[] = {"X-Image-Width", "X-Image-Height", "X-Frame-Codec"};
+  http.collectHeaders(headerKeys, 3);
+  int httpCode = http.GET();
+
+  if (httpCode != 200) {
+    Serial.printf("Living photo: HTTP %d\n", httpCode);
+    http.end();
+    return false;
+  }
+  // Servers that don't know the option send the panel-sized frame
+  if (http.header("X-Image-Width").toInt() != LIVING_WIDTH || http.header("X-Image-Height").toInt() != LIVING_HEIGHT) {
+    Serial.println("Living photo: server sent another size");
+    http.end();
+    return false;
+  }
+
+  const BilevelCodec* codec = http.hasHeader("X-Frame-Codec") ? codecByName(http.header("X-Frame-Codec").c_str()) : nullptr;
+  if (http.hasHeader("X-Frame-Codec") && !codec) {
+    http.end();
+    return false;
+  }
+
+  if (livingOffset && esp_partition_erase_range(frameStorePart, livingOffset, LIVING_REGION_BYTES) != ESP_OK) {
+    http.end();
+    return false;
+  }
+
+  int len = http.getSize();
+  unsigned long startTime = millis();
+  unsigned long timeoutMs = linkTimeoutMs(len > 0 ? len : LIVING_BYTES);
+  LivingSink sink = { bilevelRowBytes(LIVING_WIDTH), 2166136261UL, true };
+  bool ok;
+
+  if (codec) {
+    uint8_t* work = (uint8_t*)malloc(codec->workBytes(LIVING_WIDTH));
+    HttpByteSource src(http, len, startTime, timeoutMs);
+    ok = work && codec->decode(src, LIVING_WIDTH, LIVING_HEIGHT, work, livingRowSink, &sink) && sink.ok;
+    free(work);
+  } else {
+    uint8_t* row = (uint8_t*)malloc(sink.rowBytes);
+    ok = row != nullptr;
+    for (int y = 0; y < LIVING_HEIGHT && ok; y++) {
+      ok = readStreamBytes(http, row, sink.rowBytes, startTime, timeoutMs) == (int)sink.rowBytes &&
+           livingRowSink(&sink, y, row, sink.rowBytes);
+    }
+    free(row);
+  }
+  http.end();
+  linkRecord(ok, len > 0 ? len : LIVING_BYTES, millis() - startTime);
+
+  if (ok && livingOffset) {
+    uint8_t header[FRAME_SLOT_HEADER];
+    uint32_t length = LIVING_BYTES;
+    memset(header, 0xFF, sizeof(header));
+    memcpy(header, &length, sizeof(length));
+    ok = esp_partition_write(frameStorePart, livingOffset, header, sizeof(header)) == ESP_OK;
+  }
+  if (!ok) {
+    Serial.println("Living photo: download failed");
+    return false;
+  }
+
+  livingData = livingOffset ? frameStoreMap + livingOffset + FRAME_SLOT_HEADER : livingPsram;
+  livingIndex = index;
+  livingVersion = resourceVersion[RES_PHOTOS];
+  livingHash = sink.hash;
+  Serial.printf("Living photo: %d bytes stored in %lu ms\n", LIVING_BYTES, millis() - startTime);
+  return true;
+}
+
+// Background job: fetch the rendition for a photo that has stayed on
+// screen for a step (photos that are skipped past never cost a download)
+bool livingFetchLoop() {
+  if (!livingEnabled || currentMode != MODE_IMAGE || frameMode != MODE_IMAGE) return false;
+  if (frameUpgradeIndex >= 0) return false;  // the tier upgrade goes first
+  if (livingIndex == frameImageIndex && livingVersion == resourceVersion[RES_PHOTOS]) return false;
+  if (livingShownIndex != frameImageIndex || millis() - livingStepMs < LIVING_STEP_MS) return false;
+  if (livingTryMs && millis() - livingTryMs < NET_RETRY_MS) return false;
+  if (!netAdmit(LIVING_BYTES)) return false;
+
+  livingTryMs = millis();
+  bool ok = fetchLivingPhoto(frameImageIndex);
+  if (ok || netPreempted) livingTryMs = 0;
+  return true;
+}
+
+// Crop window for a step: from the whole photo (step 0) towards a 1:1
+// window around the focus point and back, eased at both ends
+static void livingWindow(int step, int& x, int& y, int& w, int& h) {
+  int half = LIVING_STEPS / 2;
+  float t = (float)(step <= half ? step : LIVING_STEPS - step) / half;
+  t = t * t * (3 - 2 * t);
+
+  w = LIVING_WIDTH - (int)(t * (LIVING_WIDTH - DISPLAY_WIDTH));
+  h = LIVING_HEIGHT - (int)(t * (LIVING_HEIGHT - DISPLAY_HEIGHT));
+
+  // Focus somewhere in the middle half of the photo, fixed per photo
+  int focusX = LIVING_WIDTH / 4 + (int)(livingHash % (LIVING_WIDTH / 2));
+  int focusY = LIVING_HEIGHT / 4 + (int)((livingHash >> 16) % (LIVING_HEIGHT / 2));
+  int centerX = LIVING_WIDTH / 2 + (int)(t * (focusX - LIVING_WIDTH / 2));
+  int centerY = LIVING_HEIGHT / 2 + (int)(t * (focusY - LIVING_HEIGHT / 2));
+  x = constrain(centerX - w / 2, 0, LIVING_WIDTH - w);
+  y = constrain(centerY - h / 2, 0, LIVING_HEIGHT - h);
+}
+
+void livingLoop() {
+  if (!livingEnabled || currentMode != MODE_IMAGE || !hasImage || frameMode != MODE_IMAGE) return;
+  if (historyCursor != 0 || syncDrawAt || peerFollowing()) return;
+
+  // A new photo on screen starts counting from step 0
+  if (livingShownIndex != frameImageIndex) {
+    livingShownIndex = frameImageIndex;
+    livingStep = 0;
+    livingStepMs = millis();
+    return;
+  }
+  if (!livingData || livingIndex != frameImageIndex || livingVersion != resourceVersion[RES_PHOTOS]) return;
+  if (millis() - livingStepMs < LIVING_STEP_MS) return;
+  livingStepMs = millis();
+  livingStep = (livingStep + 1) % LIVING_STEPS;
+
+  int x, y, w, h;
+  livingWindow(livingStep, x, y, w, h);
+
+  uint8_t* work = (uint8_t*)malloc(FrameScaler::workBytes(DISPLAY_WIDTH));
+  if (!work) return;
+  FrameScaler scaler;
+  bool ok = scaler.beginWindow(LIVING_WIDTH, LIVING_HEIGHT, x, y, w, h, DISPLAY_WIDTH, DISPLAY_HEIGHT, work, frameRowSink, nullptr);
+  size_t rowBytes = bilevelRowBytes(LIVING_WIDTH);
+  for (int row = 0; ok && row < y + h; row++) {
+    ok = scaler.push(livingData + row * rowBytes);
+  }
+  free(work);
+  if (!ok || !scaler.done()) return;
+
+  Serial.printf("Living photo: step %d/%d, window %dx%d at %d,%d\n", livingStep, LIVING_STEPS, w, h, x, y);
+  frameMapped = nullptr;
+  frameFromServer = false;  // steps don't go into history
+  imageGray = false;
+  drawImage();
+}
+
+// ============================================================
+// NET SCHEDULER
+// Requests are synchronous, so a request never waits behind another one
+// that is in flight; it waits behind whatever loop() chose to run first.
+// Button handlers run first and make foreground requests (a photo fetch
+// then skips the bulk cache refill). The poll and the refreshes it
+// triggers come next. Background jobs run last, one per loop pass, and
+// only when admitted: not while the user is interacting or a synchronized
+// refresh is pending, and within a byte budget. A button press cuts a
+// background download short so the gesture is handled right away.
+// ============================================================
+bool netAdmit(size_t bytes) {
+  if (netPriority != NET_BACKGROUND) return true;
+
+  if (lastInteractionMs && millis() - lastInteractionMs < NET_QUIET_MS) return false;
+  if (syncDrawAt) return false;
+  if (prewarmDone) return false;  // would take down the session the poll is about to use
+
+  if (millis() - netBudgetStartMs >= NET_BUDGET_WINDOW_MS) {
+    netBudgetStartMs = millis();
+    netBudgetUsed = 0;
+  }
+  if (netBudgetUsed + bytes > NET_BACKGROUND_BUDGET_BYTES) {
+    Serial.printf("Scheduler: background budget spent (%u/%lu bytes)\n", (unsigned)netBudgetUsed, NET_BACKGROUND_BUDGET_BYTES);
+    return false;
+  }
+  netBudgetUsed += bytes;
+  return true;
+}
+
+// Polled by the response read loops: true once a background request
+// should give way to the button
+bool netPreempt() {
+  if (netPriority != NET_BACKGROUND) return false;
+  if (!netPreempted && digitalRead(BUTTON_PIN) == LOW) {
+    Serial.println("Scheduler: button pressed, cutting background download short");
+    netPreempted = true;
+  }
+  return netPreempted;
+}
+
+void netBackgroundLoop() {
+  netPriority = NET_BACKGROUND;
+  netPreempted = false;
+
+  // Most useful first: a full photo cache makes later button presses free
+  if (!photoRefillLoop() && !livingFetchLoop()) linkUpgradeLoop();
+
+  netPriority = NET_REFRESH;
+  netPreempted = false;
+}
+
+// Refill a stale photo cache while showing photos (a foreground fetch
+// left it for later)
+bool photoRefillLoop() {
+  if (currentMode != MODE_IMAGE || totalImages <= 0 || peerFollowing()) return false;
+  if ((!flashFsReady && !frameStoreMap) || PHOTO_CACHE_SIZE <= 0) return false;
+  if (photoCacheTotal == totalImages && photoCacheVersion == resourceVersion[RES_PHOTOS]) return false;
+  if (photoRefillTryMs && millis() - photoRefillTryMs < NET_RETRY_MS) return false;
+
+  int count = min(totalImages, PHOTO_CACHE_SIZE);
+  if (!netAdmit(count * FRAME_BYTES)) return false;
+
+  photoRefillTryMs = millis();
+  Serial.println("Scheduler: refilling photo cache in the background");
+  bool ok = fetchContactSheet();
+  if (ok || netPreempted) photoRefillTryMs = 0;  // cut short is not a failure: retry once it's quiet
+  return true;
+}
+
+// ============================================================
+// LINK QUALITY
+// Every frame download updates a smoothed throughput and failure rate.
+// With RSSI they pick the photo tier to ask for, so a frame at the edge
+// of coverage gets a payload it can finish instead of timing out on a
+// full one. A photo shown below the full tier is fetched again after a
+// while if the link has recovered; that fetch succeeding also marks the
+// photo cache for a refill at the better tier. Photos served from the
+// cache measure nothing, so an estimate without fresh samples decays
+// toward neutral; the tier then rises and the upgrade fetch probes the
+// link again, a failure there bringing the estimate back down.
+// ============================================================
+static void linkDecay() {
+  if (linkKBps < 0 && linkLoss == 0) return;
+  while (millis() - linkSampleMs >= LINK_DECAY_INTERVAL_MS) {
+    if (linkKBps >= 0) linkKBps += (LINK_NEUTRAL_KBPS - linkKBps) / 2;
+    linkLoss /= 2;
+    linkSampleMs += LINK_DECAY_INTERVAL_MS;
+  }
+}
+
+void linkRecord(bool ok, size_t bytes, unsigned long ms) {
+  // A download the scheduler cut short says nothing about the link
+  if (!LINK_ENABLED || netPreempted) return;
+
+  linkDecay();
+  linkSampleMs = millis();
+  linkLoss += LINK_EWMA_WEIGHT * ((ok ? 0.0f : 1.0f) - linkLoss);
+  if (ok && bytes >= LINK_MIN_SAMPLE_BYTES) {
+    float kbps = (float)bytes / (float)max(ms, 1UL);  // bytes per ms = KB/s
+    linkKBps = (linkKBps < 0) ? kbps : linkKBps + LINK_EWMA_WEIGHT * (kbps - linkKBps);
+  }
+
+  Serial.printf("Link: %.1f KB/s, %.0f%% failures, RSSI %d dBm -> tier %d\n",
+                linkKBps, linkLoss * 100, WiFi.RSSI(), (int)linkTier());
+}
+
+LinkTier linkTier() {
+  if (!LINK_ENABLED) return TIER_FULL;
+  linkDecay();
+
+  int tier = TIER_FULL;
+  if (linkKBps >= 0 && linkKBps < LINK_FULL_MIN_KBPS) tier = TIER_LITE;
+  if (linkKBps >= 0 && linkKBps < LINK_LITE_MIN_KBPS) tier = TIER_COARSE;
+
+  int rssi = WiFi.RSSI();  // 0 when not connected
+  if (rssi != 0 && rssi < LINK_RSSI_WEAK_DBM) tier = min(tier, (int)TIER_LITE);
+  if (rssi != 0 && rssi < LINK_RSSI_POOR_DBM) tier = TIER_COARSE;
+
+  if (linkLoss > LINK_LOSS_MAX && tier > TIER_COARSE) tier--;
+  return (LinkTier)tier;
+}
+
+// Read timeout for a download of this size: a slow link gets the time it
+// needs rather than failing the same download over and over
+unsigned long linkTimeoutMs(size_t bytes) {
+  if (!LINK_ENABLED || linkKBps <= 0) return 10000;
+  unsigned long expectedMs = (unsigned long)(bytes / linkKBps);
+  return constrain(3 * expectedMs, 10000UL, 30000UL);
+}
+
+void linkUpgradeLoop() {
+  if (!LINK_ENABLED || frameUpgradeIndex < 0) return;
+  if (currentMode != MODE_IMAGE || currentImageIndex != frameUpgradeIndex) return;
+  if (historyCursor != 0 || syncDrawAt || peerFollowing()) return;
+  if (millis() - linkUpgradeTryMs < LINK_UPGRADE_INTERVAL_MS) return;
+
+  linkUpgradeTryMs = millis();
+  LinkTier tier = linkTier();
+  if (tier <= frameTier) return;
+  if (!netAdmit(tier == TIER_FULL && GRAY_ENABLED ? 2 * FRAME_BYTES : FRAME_BYTES)) return;
+
+  Serial.printf("Link recovered: fetching image %d again at tier %d (was %d)\n", frameUpgradeIndex, (int)tier, (int)frameTier);
+  if (!fetchBitmap(frameUpgradeIndex, "photo")) {
+    // A failed read may have left imageBuffer half overwritten; the photo
+    // on screen is the newest history frame (below full tier it is 1-bit)
+    if (historyCount > 0 && historyReadFrame(historySlot(0), imageBuffer)) {
+      imageGray = false;
+      frameMapped = nullptr;
+    }
+    return;
+  }
+  drawImage();
+
+  if (photoCacheTier < frameTier && photoCacheTotal >= 0) {
+    photoCacheTotal = -1;  // refilled on the next photo that isn't this one
+    photoCacheSaveMeta();
+  }
+}
+
+// ============================================================
+// COAP TRANSPORT
+// The poll and the small notifications go to a CoAP gateway over DTLS
+// with a per-device pre-shared key (no certificates, no HTTP headers).
+// The association stays up between polls, so a poll is one datagram each
+// way. When it has to be re-established, the saved session is resumed:
+// an abbreviated handshake without the key exchange. Any failure returns
+// 0 and the caller uses HTTPS, which also stays the path for frames.
+// ============================================================
+struct CoapLink {
+  WiFiUDP udp;
+  IPAddress ip;
+  mbedtls_ssl_context ssl;
+  mbedtls_ssl_config conf;
+  mbedtls_entropy_context entropy;
+  mbedtls_ctr_drbg_context drbg;
+  mbedtls_ssl_session session;
+  bool ready;            // conf, entropy and drbg set up for the current key
+  bool open;             // association established
+  bool haveSession;      // a session to resume
+  unsigned long lastUsedMs;
+  unsigned long timerStartMs;
+  uint32_t timerIntMs;
+  uint32_t timerFinMs;
+  uint16_t messageId;
+};
+CoapLink coap;
+
+static const int coapCiphersuites[] = {
+  MBEDTLS_TLS_PSK_WITH_AES_128_CCM_8,       // mandatory for CoAP (RFC 7252 9.1.3.1)
+  MBEDTLS_TLS_PSK_WITH_AES_128_GCM_SHA256,
+  0
+};
+
+static int coapBioSend(void* ctx, const unsigned char* buf, size_t len) {
+  CoapLink* link = (CoapLink*)ctx;
+  if (!link->udp.beginPacket(link->ip, coapPort)) return MBEDTLS_ERR_NET_SEND_FAILED;
+  link->udp.write(buf, len);
+  return link->udp.endPacket() ? (int)len : MBEDTLS_ERR_NET_SEND_FAILED;
+}
+
+static int coapBioRecv(void* ctx, unsigned char* buf, size_t len, uint32_t timeoutMs) {
+  CoapLink* link = (CoapLink*)ctx;
+  if (timeoutMs == 0) timeoutMs = COAP_ACK_TIMEOUT_MS;
+  unsigned long start = millis();
+  while (millis() - start < timeoutMs) {
+    if (link->udp.parsePacket() > 0) {
+      if (link->udp.remoteIP() == link->ip && link->udp.remotePort() == coapPort) {
+        return link->udp.read(buf, len);
+      }
+      link->udp.flush();  // not from the gateway
+    }
+    delay(1);
+  }
+  return MBEDTLS_ERR_SSL_TIMEOUT;
+}
+
+// DTLS retransmission timers on millis()
+static void coapTimerSet(void* ctx, uint32_t intMs, uint32_t finMs) {
+  CoapLink* link = (CoapLink*)ctx;
+  link->timerStartMs = millis();
+  link->timerIntMs = intMs;
+  link->timerFinMs = finMs;
+}
+
+static int coapTimerGet(void* ctx) {
+  CoapLink* link = (CoapLink*)ctx;
+  if (link->timerFinMs == 0) return -1;
+  unsigned long elapsed = millis() - link->timerStartMs;
+  if (elapsed >= link->timerFinMs) return 2;
+  if (elapsed >= link->timerIntMs) return 1;
+  return 0;
+}
+
+void loadCoapConfig() {
+  preferences.begin("inkframe", true);
+  String host = preferences.getString("coapHost", "");
+  coapPort = preferences.getUShort("coapPort", 0);
+  size_t pskLen = preferences.getBytes("coapPsk", coapPsk, sizeof(coapPsk));
+  preferences.end();
+
+  strlcpy(coapHost, host.c_str(), sizeof(coapHost));
+  coapProvisioned = COAP_ENABLED && coapHost[0] && coapPort && pskLen == sizeof(coapPsk);
+  if (coapProvisioned) {
+    Serial.printf("CoAP gateway: %s:%u\n", coapHost, coapPort);
+  }
+}
+
+// Drop the association, the saved session and the DTLS config (it holds
+// the key)
+static void coapReset() {
+  coapClose();
+  if (!coap.ready) return;
+  mbedtls_ssl_session_free(&coap.session);
+  mbedtls_ssl_config_free(&coap.conf);
+  mbedtls_ctr_drbg_free(&coap.drbg);
+  mbedtls_entropy_free(&coap.entropy);
+  coap.haveSession = false;
+  coap.ready = false;
+}
+
+// Gateway and key from the register reply. A reply without them means
+// the server has no gateway for us (anymore): back to HTTPS only.
+void coapProvision(JsonObjectConst reply) {
+  const char* host = reply["host"] | "";
+  const char* pskHex = reply["psk"] | "";
+  uint16_t port = reply["port"] | COAP_DEFAULT_PORT;
+
+  uint8_t psk[sizeof(coapPsk)];
+  bool valid = COAP_ENABLED && host[0] && strlen(host) < sizeof(coapHost) && strlen(pskHex) == 2 * sizeof(psk);
+  for (size_t i = 0; valid && i < sizeof(psk); i++) {
+    char byteHex[3] = { pskHex[2 * i], pskHex[2 * i + 1], '\0' };
+    char* end;
+    psk[i] = (uint8_t)strtoul(byteHex, &end, 16);
+    valid = (*end == '\0');
+  }
+
+  bool same = valid ? (coapProvisioned && strcmp(host, coapHost) == 0 && port == coapPort &&
+                       memcmp(psk, coapPsk, sizeof(psk)) == 0)
+                    : !coapProvisioned;
+  if (same) return;
+
+  coapReset();
+  preferences.begin("inkframe", false);
+  if (valid) {
+    strlcpy(coapHost, host, sizeof(coapHost));
+    coapPort = port;
+    memcpy(coapPsk, psk, sizeof(coapPsk));
+    preferences.putString("coapHost", coapHost);
+    preferences.putUShort("coapPort", coapPort);
+    preferences.putBytes("coapPsk", coapPsk, sizeof(coapPsk));
+    Serial.printf("CoAP gateway provisioned: %s:%u\n", coapHost, coapPort);
+  } else {
+    coapHost[0] = '\0';
+    preferences.remove("coapHost");
+    preferences.remove("coapPort");
+    preferences.remove("coapPsk");
+    Serial.println("CoAP gateway withdrawn, using HTTPS");
+  }
+  preferences.end();
+  coapProvisioned = valid;
+}
+
+static bool coapSetup() {
+  if (coap.ready) return true;
+
+  mbedtls_ssl_config_init(&coap.conf);
+  mbedtls_entropy_init(&coap.entropy);
+  mbedtls_ctr_drbg_init(&coap.drbg);
+  mbedtls_ssl_session_init(&coap.session);
+  coap.ready = true;  // from here on coapReset() frees what was set up
+
+  // The PSK identity is the device id, which the gateway derives the key from
+  String deviceId = String((uint32_t)ESP.getEfuseMac(), HEX);
+  const char* pers = "inkframe-coap";
+  if (mbedtls_ctr_drbg_seed(&coap.drbg, mbedtls_entropy_func, &coap.entropy, (const unsigned char*)pers, strlen(pers)) != 0 ||
+      mbedtls_ssl_config_defaults(&coap.conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_DATAGRAM, MBEDTLS_SSL_PRESET_DEFAULT) != 0 ||
+      mbedtls_ssl_conf_psk(&coap.conf, coapPsk, sizeof(coapPsk), (const unsigned char*)deviceId.c_str(), deviceId.length()) != 0) {
+    Serial.println("CoAP: DTLS setup failed");
+    coapReset();
+    return false;
+  }
+  mbedtls_ssl_conf_rng(&coap.conf, mbedtls_ctr_drbg_random, &coap.drbg);
+  mbedtls_ssl_conf_ciphersuites(&coap.conf, coapCiphersuites);
+  mbedtls_ssl_conf_handshake_timeout(&coap.conf, COAP_ACK_TIMEOUT_MS / 2, COAP_HANDSHAKE_MAX_MS);
+  return true;
+}
+
+// After a failure the gateway is left alone, longer each time it fails
+// again in a row, so a blocked path costs one timeout per backoff period
+// instead of one per poll
+bool coapSuspended() {
+  return coapFailures && time(nullptr) < coapSuspendedUntil;
+}
+
+static void coapFailed(const char* what) {
+  if (coapFailures < 16) coapFailures++;
+  uint32_t backoffS = min((uint32_t)COAP_BACKOFF_MAX_S, (uint32_t)COAP_BACKOFF_MIN_S << (coapFailures - 1));
+  coapSuspendedUntil = time(nullptr) + backoffS;
+  Serial.printf("CoAP: %s, using HTTPS for the next %lu s\n", what, (unsigned long)backoffS);
+}
+
+static bool coapOpen() {
+  if (coap.open && millis() - coap.lastUsedMs < COAP_IDLE_MS) return true;
+  coapClose();
+  if (!coapSetup()) return false;
+
+  if (!WiFi.hostByName(coapHost, coap.ip)) {
+    Serial.printf("CoAP: can't resolve %s\n", coapHost);
+    coapFailed("gateway unresolved");
+    return false;
+  }
+  // A fresh source port per association: the gateway never mistakes us
+  // for the association it may still hold for the old one
+  coap.udp.begin(49152 + esp_random() % 16384);
+
+  mbedtls_ssl_init(&coap.ssl);
+  if (mbedtls_ssl_setup(&coap.ssl, &coap.conf) != 0) {
+    mbedtls_ssl_free(&coap.ssl);
+    coap.udp.stop();
+    return false;
+  }
+  mbedtls_ssl_set_bio(&coap.ssl, &coap, coapBioSend, nullptr, coapBioRecv);
+  mbedtls_ssl_set_timer_cb(&coap.ssl, &coap, coapTimerSet, coapTimerGet);
+  if (coap.haveSession) mbedtls_ssl_set_session(&coap.ssl, &coap.session);
+
+  unsigned long start = millis();
+  int ret;
+  do {
+    ret = mbedtls_ssl_handshake(&coap.ssl);
+  } while (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE);
+
+  if (ret != 0) {
+    Serial.printf("CoAP: DTLS handshake with %s:%u failed: -0x%04x\n", coapHost, coapPort, -ret);
+    mbedtls_ssl_free(&coap.ssl);
+    coap.udp.stop();
+    coapFailed("handshake failed");
+    return false;
+  }
+
+  // Keep the session for the next association; same id = it was resumed
+  bool resumed = false;
+  mbedtls_ssl_session fresh;
+  mbedtls_ssl_session_init(&fresh);
+  if (mbedtls_ssl_get_session(&coap.ssl, &fresh) == 0) {
+    resumed = coap.haveSession && fresh.id_len > 0 && fresh.id_len == coap.session.id_len &&
+              memcmp(fresh.id, coap.session.id, fresh.id_len) == 0;
+    mbedtls_ssl_session_free(&coap.session);
+    coap.session = fresh;
+    coap.haveSession = true;
+  } else {
+    mbedtls_ssl_session_free(&fresh);
+  }
+
+  Serial.printf("CoAP: DTLS %s with %s:%u in %lums (%s)\n", resumed ? "resumed" : "established",
+                coapHost, coapPort, millis() - start, mbedtls_ssl_get_ciphersuite(&coap.ssl));
+  coap.open = true;
+  coap.lastUsedMs = millis();
+  return true;
+}
+
+void coapClose() {
+  if (!coap.open) return;
+  mbedtls_ssl_close_notify(&coap.ssl);
+  mbedtls_ssl_free(&coap.ssl);
+  coap.udp.stop();
+  coap.open = false;
+}
+
+// One confirmable request to /<path>?<query> on the gateway. Returns the
+// HTTP status equivalent of the response code, or 0 if CoAP isn't
+// provisioned, is resting after a failure, or the exchange failed within
+// COAP_REQUEST_BUDGET_MS.
+int coapRequest(uint8_t method, const char* path, const char* query, const String& payload, String& response) {
+  if (!COAP_ENABLED || !coapProvisioned || !wifiConnected || coapSuspended()) return 0;
+  unsigned long start = millis();
+  if (!coapOpen()) return 0;
+
+  static uint8_t txBuf[COAP_BUFFER_BYTES];
+  static uint8_t rxBuf[COAP_BUFFER_BYTES];
+
+  uint32_t tokenValue = esp_random();
+  uint8_t token[4];
+  memcpy(token, &tokenValue, sizeof(token));
+  uint16_t messageId = ++coap.messageId;
+
+  CoapWriter writer(txBuf, sizeof(txBuf));
+  writer.header(COAP_CON, method, messageId, token, sizeof(token));
+  writer.uriPath(path);
+  if (payload.length()) writer.contentFormat(COAP_FORMAT_JSON);
+  writer.uriQuery(query);
+  writer.payload((const uint8_t*)payload.c_str(), payload.length());
+  size_t length = writer.length();
+  if (length == 0) {
+    Serial.printf("CoAP: %s request too large\n", path);
+    return 0;
+  }
+
+  uint32_t timeoutMs = COAP_ACK_TIMEOUT_MS;
+  bool acked = false;     // empty ACK: the response follows separately
+  bool broken = false;
+
+  for (int attempt = 0; attempt <= COAP_MAX_RETRANSMIT && !broken; attempt++, timeoutMs *= 2) {
+    unsigned long spent = millis() - start;
+    if (spent >= COAP_REQUEST_BUDGET_MS) break;
+    uint32_t waitMs = min(timeoutMs, (uint32_t)(COAP_REQUEST_BUDGET_MS - spent));
+
+    if (!acked && mbedtls_ssl_write(&coap.ssl, txBuf, length) < 0) {
+      broken = true;
+      break;
+    }
+
+    mbedtls_ssl_conf_read_timeout(&coap.conf, waitMs);
+    unsigned long waitStart = millis();
+    while (millis() - waitStart < waitMs) {
+      int n = mbedtls_ssl_read(&coap.ssl, rxBuf, sizeof(rxBuf));
+      if (n == MBEDTLS_ERR_SSL_TIMEOUT) break;
+      if (n == MBEDTLS_ERR_SSL_WANT_READ) continue;
+      if (n <= 0) {
+        broken = true;  // closed by the gateway, or a fatal alert
+        break;
+      }
+
+      CoapMessage msg;
+      if (!coapParse(rxBuf, n, msg)) continue;
+      if (msg.messageId == messageId && msg.type == COAP_RST) {
+        broken = true;
+        break;
+      }
+      if (msg.messageId == messageId && msg.type == COAP_ACK && msg.code == COAP_EMPTY) {
+        acked = true;
+        continue;
+      }
+      // Late responses to earlier (retransmitted) requests carry other tokens
+      if (msg.tokenLength != sizeof(token) || memcmp(msg.token, token, sizeof(token)) != 0) continue;
+
+      if (msg.type == COAP_CON) {
+        uint8_t ack[4];
+        CoapWriter ackWriter(ack, sizeof(ack));
+        ackWriter.header(COAP_ACK, COAP_EMPTY, msg.messageId, nullptr, 0);
+        mbedtls_ssl_write(&coap.ssl, ack, ackWriter.length());
+      }
+      coap.lastUsedMs = millis();
+      coapFailures = 0;  // the path works
+
+      int status = coapToHttpStatus(msg.code);
+      if (status >= 500) {
+        // The gateway couldn't reach the server; HTTPS may still get through
+        Serial.printf("CoAP: %s: gateway error %d\n", path, status);
+        return 0;
+      }
+      response = "";
+      response.concat((const char*)msg.payload, msg.payloadLength);
+      return status;
+    }
+  }
+
+  Serial.printf("CoAP: %s %s after %lu ms, falling back to HTTPS\n", path, broken ? "failed" : "timed out",
+                millis() - start);
+  coapClose();
+  coapFailed(broken ? "exchange failed" : "no response");
+  return 0;
+}
+
+// ============================================================
+// CONNECTION PREWARM
+// A poll from cold pays for DNS, TCP and a TLS handshake (or a DTLS
+// resumption) before its request goes out. Shortly before the poll is
+// due, the connection it will use is opened: the DTLS association when
+// CoAP is provisioned, otherwise secureClient, which HTTPClient reuses
+// when it is already connected. The lead is twice the smoothed handshake
+// time, so slow networks start earlier.
+// ============================================================
+unsigned long prewarmLeadMs() {
+  if (prewarmHandshakeMs < 0) return PREWARM_DEFAULT_LEAD_MS;
+  return constrain((unsigned long)(2 * prewarmHandshakeMs) + 200UL, (unsigned long)PREWARM_MIN_LEAD_MS, (unsigned long)PREWARM_MAX_LEAD_MS);
+}
+
+// Connect secureClient to the API host
+static bool prewarmHttps() {
+  String host = String(API_SERVER);
+  if (!host.startsWith("https://")) return false;
+  host = host.substring(8);
+  int slash = host.indexOf('/');
+  if (slash >= 0) host = host.substring(0, slash);
+  uint16_t port = 443;
+  int colon = host.indexOf(':');
+  if (colon >= 0) {
+    port = host.substring(colon + 1).toInt();
+    host = host.substring(0, colon);
+  }
+  return secureClient.connect(host.c_str(), port);
+}
+
+void prewarmLoop(unsigned long dueInMs) {
+  if (!PREWARM_ENABLED || prewarmDone || dueInMs > prewarmLeadMs()) return;
+  prewarmDone = true;
+
+  bool useCoap = COAP_ENABLED && coapProvisioned && !coapSuspended();
+  if (useCoap ? (coap.open && millis() - coap.lastUsedMs < COAP_IDLE_MS) : secureClient.connected()) {
+    return;  // still up from the last request
+  }
+
+  unsigned long start = millis();
+  bool ok = useCoap ? coapOpen() : prewarmHttps();
+  unsigned long handshakeMs = millis() - start;
+  if (!ok) {
+    Serial.printf("Prewarm: %s connect failed after %lu ms\n", useCoap ? "CoAP" : "HTTPS", handshakeMs);
+    return;
+  }
+
+  prewarmHandshakeMs = (prewarmHandshakeMs < 0) ? handshakeMs : prewarmHandshakeMs + 0.3f * (handshakeMs - prewarmHandshakeMs);
+  Serial.printf("Prewarm: %s ready in %lu ms, %lu ms before the poll (next lead %lu ms)\n",
+                useCoap ? "CoAP" : "HTTPS", handshakeMs, dueInMs > handshakeMs ? dueInMs - handshakeMs : 0, prewarmLeadMs());
+}
+
+// ============================================================
+// DRAW IMAGE
+// ============================================================
+
+// Send a window of a packed frame (imageBuffer or a mapped frame store
+// slot) straight to the controller and refresh it: a partial refresh of
+// the window, or a full refresh. The frame is read in place, never copied
+// into the GxEPD2 page buffer. invert paints the negative, which regional
+// ghost cleaning flashes first.
+static void paintFrame(const uint8_t* frame, int x, int y, int w, int h, bool partial, bool invert) {
+  // The controller addresses whole bytes horizontally
+  int x0 = x & ~7;
+  w = ((x + w + 7) & ~7) - x0;
+  x = x0;
+
+  display.epd2.writeImagePart(frame, x, y, DISPLAY_WIDTH, DISPLAY_HEIGHT, x, y, w, h, invert, false, false);
+  panelRefreshGate();
+  if (partial) {
+    display.epd2.refresh(x, y, w, h);
+  } else {
+    display.epd2.refresh(false);
+  }
+  // Differential waveforms compare against the previous image RAM
+  display.epd2.writeImagePartAgain(frame, x, y, DISPLAY_WIDTH, DISPLAY_HEIGHT, x, y, w, h, invert, false, false);
+}
+
+// Queue a locally redrawn rectangle for the next drawImage(). A clean
+// rectangle gets the full-refresh treatment (negative, then the content)
+// in its own window, leaving the rest of the panel alone.
+void markDirtyRect(int x, int y, int w, int h, bool clean) {
+  if (dirtyRectCount < DIRTY_MAX_RECTS) {
+    PanelRect& r = dirtyRects[dirtyRectCount];
+    r.x = x;
+    r.y = y;
+    r.w = w;
+    r.h = h;
+    r.clean = clean;
+  } else if (clean) {
+    forceFullRefresh = true;  // the one-window fallback can't clean just this
+  }
+  dirtyRectCount++;  // past the limit drawImage() falls back to one window
+}
+
+void drawImage() {
+  if (!hasImage) return;
+  syncDrawAt = 0;  // whatever was scheduled is superseded
+  overlayPrepare();
+  const uint8_t* frame = alertCompose(currentFrame());
+
+  // The banner is 1-bit: a gray photo shows its black/white plane under it
+  selectWaveform();
+  bool gray = imageGray && waveformGrayOk && !alertShown;
+
+  Serial.printf("Drawing %s image...\n", gray ? "4-gray" : "1-bit");
+  unsigned long refreshStart = millis();
+
+  int x, y, w, h;
+
+  if (gray) {
+    drawImageGray();
+    refreshMsGray = millis() - refreshStart;
+    ghostRecordFull(nullptr);  // the panel shows gray levels, not imageBuffer
+  } else if (GHOST_PARTIAL_ENABLED && PanelDriver::hasFastPartialUpdate && waveformPartialOk &&
+             ghostPanelKnown && !ghostCleaningDue(false) && !forceFullRefresh) {
+    if (dirtyRectCount > 0 && dirtyRectCount <= DIRTY_MAX_RECTS) {
+      // Local redraw (template widgets, overlays): refresh just those rectangles
+      for (int i = 0; i < dirtyRectCount; i++) {
+        const PanelRect& r = dirtyRects[i];
+        if (r.clean) paintFrame(frame, r.x, r.y, r.w, r.h, true, true);
+        paintFrame(frame, r.x, r.y, r.w, r.h, true, false);
+        Serial.printf("Partial refresh %dx%d at %d,%d (local%s)\n", r.w, r.h, r.x, r.y, r.clean ? ", clean" : "");
+      }
+      ghostRecordPartial(frame);
+      for (int i = 0; i < dirtyRectCount; i++) {
+        if (dirtyRects[i].clean) ghostRecordClean(dirtyRects[i]);
+      }
+    } else if (!ghostChangedBounds(frame, x, y, w, h)) {
+      Serial.println("Frame unchanged, no refresh needed");
+    } else {
+      paintFrame(frame, x, y, w, h, true, false);
+      ghostRecordPartial(frame);
+      Serial.printf("Partial refresh %dx%d at %d,%d\n", w, h, x, y);
+    }
+  } else {
+    paintFrame(frame, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, false, false);
+    refreshMsBw = millis() - refreshStart;
+    ghostRecordFull(frame);
+  }
+  if (!gray) panelHibernating = false;  // GxEPD2 woke the controller to paint
+  dirtyRectCount = 0;
+  forceFullRefresh = false;
+  panelRefreshAt = 0;  // nothing to refresh after all
+  peerPublishFrame();
+
+  Serial.printf("Image displayed in %lu ms at %.1f C%s (last 1-bit: %ld ms, last 4-gray: %ld ms)\n",
+                millis() - refreshStart, panelTempC, panelTempMeasured ? "" : " (assumed)",
+                refreshMsBw, refreshMsGray);
+  markVisibleFeedback();
+  markFreshness();
+
+  if (frameFromServer) {
+    historyRecord();
+    frameFromServer = false;
+  }
+}
+
+// ============================================================
+// GHOSTING ACCOUNTING
+// Partial updates leave ghosting roughly in proportion to how often an
+// area changed since its last full refresh. Changes are counted on a
+// coarse tile grid (a tile counts when its content hash changes), and
+// cleaning happens only where and when it is needed.
+// ============================================================
+static uint32_t ghostHashTile(const uint8_t* frame, int tx, int ty) {
+  int rowBytes = DISPLAY_WIDTH / 8;
+  int x0 = tx * GHOST_TILE_W / 8;
+  int bytes = min(GHOST_TILE_W, DISPLAY_WIDTH - tx * GHOST_TILE_W) / 8;
+  int y1 = min((ty + 1) * GHOST_TILE_H, DISPLAY_HEIGHT);
+
+  uint32_t hash = 2166136261UL;
+  for (int y = ty * GHOST_TILE_H; y < y1; y++) {
+    hash = fnv1a(hash, frame + y * rowBytes + x0, bytes);
+  }
+  return hash ? hash : 1;
+}
 
-  http.begin(secureClient, url);
-  http.setTimeout(15000);  // 15 second timeout
+// Pixel rectangle covering tiles [tx0..tx1] x [ty0..ty1], clipped to the panel
+static void ghostTileRect(int tx0, int ty0, int tx1, int ty1, int& x, int& y, int& w, int& h) {
+  x = tx0 * GHOST_TILE_W;
+  y = ty0 * GHOST_TILE_H;
+  w = min((tx1 + 1) * GHOST_TILE_W, DISPLAY_WIDTH) - x;
+  h = min((ty1 + 1) * GHOST_TILE_H, DISPLAY_HEIGHT) - y;
+}
 
-  // Collect headers including new X-Content-Type
-  const char* headerKeys[] = {"X-Image-Total", "X-Image-Index", "X-Image-Width", "X-Image-Height", "X-Content-Type"};
-  http.collectHeaders(headerKeys, 5);
+// Bounding box of the tiles where frame differs from what the panel shows.
+// False when nothing changed.
+bool ghostChangedBounds(const uint8_t* frame, int& x, int& y, int& w, int& h) {
+  int tx0 = GHOST_TILES_X, ty0 = GHOST_TILES_Y, tx1 = -1, ty1 = -1;
 
-  int httpCode = http.GET();
+  for (int ty = 0; ty < GHOST_TILES_Y; ty++) {
+    for (int tx = 0; tx < GHOST_TILES_X; tx++) {
+      if (ghostHashTile(frame, tx, ty) == ghostTileHash[ty][tx]) continue;
+      tx0 = min(tx0, tx);
+      ty0 = min(ty0, ty);
+      tx1 = max(tx1, tx);
+      ty1 = max(ty1, ty);
+    }
+  }
 
-  if (httpCode == 200) {
-    int len = http.getSize();
-    int expectedSize = DISPLAY_WIDTH * DISPLAY_HEIGHT / 8;
+  if (tx1 < 0) return false;
+  ghostTileRect(tx0, ty0, tx1, ty1, x, y, w, h);
+  return true;
+}
 
-    // Get metadata from headers
-    if (http.hasHeader("X-Image-Total")) {
-      totalImages = http.header("X-Image-Total").toInt();
-      Serial.printf("Total images: %d\n", totalImages);
+// After a partial update showing frame: count the tiles that changed.
+// nullptr means the content is not a known frame (e.g. a preview), so
+// every tile counts and the next update has to be a full refresh.
+void ghostRecordPartial(const uint8_t* frame) {
+  for (int ty = 0; ty < GHOST_TILES_Y; ty++) {
+    for (int tx = 0; tx < GHOST_TILES_X; tx++) {
+      uint32_t hash = frame ? ghostHashTile(frame, tx, ty) : 0;
+      if (frame && hash == ghostTileHash[ty][tx]) continue;
+      if (ghostCount[ty][tx] < 255) ghostCount[ty][tx]++;
+      ghostTileHash[ty][tx] = hash;
     }
+  }
+  ghostPanelKnown = (frame != nullptr);
+  screenOnPanel = SCREEN_NONE;
+}
 
-    if (http.hasHeader("X-Content-Type")) {
-      String contentType = http.header("X-Content-Type");
-      Serial.printf("Content type: %s\n", contentType.c_str());
+// After a partial update of a screen that is not imageBuffer (the local
+// screens): count the tiles the window covered
+void ghostRecordRect(int x, int y, int w, int h) {
+  for (int ty = y / GHOST_TILE_H; ty <= (y + h - 1) / GHOST_TILE_H && ty < GHOST_TILES_Y; ty++) {
+    for (int tx = x / GHOST_TILE_W; tx <= (x + w - 1) / GHOST_TILE_W && tx < GHOST_TILES_X; tx++) {
+      if (ghostCount[ty][tx] < 255) ghostCount[ty][tx]++;
+      ghostTileHash[ty][tx] = 0;
     }
+  }
+  ghostPanelKnown = false;
+}
 
-    if (len == expectedSize || len == -1) {  // -1 means chunked/unknown
-      WiFiClient* stream = http.getStreamPtr();
-      int bytesRead = 0;
-      unsigned long startTime = millis();
+// After a clean (negative, then content) refresh of r: the tiles it
+// covers completely start over
+void ghostRecordClean(const PanelRect& r) {
+  for (int ty = (r.y + GHOST_TILE_H - 1) / GHOST_TILE_H; (ty + 1) * GHOST_TILE_H <= r.y + r.h; ty++) {
+    for (int tx = (r.x + GHOST_TILE_W - 1) / GHOST_TILE_W; (tx + 1) * GHOST_TILE_W <= r.x + r.w; tx++) {
+      ghostCount[ty][tx] = 0;
+    }
+  }
+}
 
-      while (http.connected() && bytesRead < expectedSize && (millis() - startTime < 10000)) {
-        if (stream->available()) {
-          int toRead = min(stream->available(), expectedSize - bytesRead);
-          int c = stream->read(imageBuffer + bytesRead, toRead);
-          if (c > 0) bytesRead += c;
-        }
-        delay(1);
-      }
+// After a full refresh: every tile is clean. nullptr for screens that are
+// not imageBuffer (local screens, gray frames).
+void ghostRecordFull(const uint8_t* frame) {
+  memset(ghostCount, 0, sizeof(ghostCount));
+  for (int ty = 0; ty < GHOST_TILES_Y; ty++) {
+    for (int tx = 0; tx < GHOST_TILES_X; tx++) {
+      ghostTileHash[ty][tx] = frame ? ghostHashTile(frame, tx, ty) : 0;
+    }
+  }
+  ghostPanelKnown = (frame != nullptr);
+  screenOnPanel = SCREEN_NONE;
+}
 
-      if (bytesRead == expectedSize) {
-        Serial.printf("Bitmap received: %d bytes\n", bytesRead);
-        hasImage = true;
-        http.end();
-        return true;
-      } else {
-        Serial.printf("Incomplete read: got %d, expected %d\n", bytesRead, expectedSize);
+// Bounding box of tiles at or above limit; returns the number of tiles it spans
+static int ghostWornBounds(uint8_t limit, int& tx0, int& ty0, int& tx1, int& ty1) {
+  tx0 = GHOST_TILES_X;
+  ty0 = GHOST_TILES_Y;
+  tx1 = -1;
+  ty1 = -1;
+
+  for (int ty = 0; ty < GHOST_TILES_Y; ty++) {
+    for (int tx = 0; tx < GHOST_TILES_X; tx++) {
+      if (ghostCount[ty][tx] < limit) continue;
+      tx0 = min(tx0, tx);
+      ty0 = min(ty0, ty);
+      tx1 = max(tx1, tx);
+      ty1 = max(ty1, ty);
+    }
+  }
+
+  return tx1 < 0 ? 0 : (tx1 - tx0 + 1) * (ty1 - ty0 + 1);
+}
+
+bool ghostCleaningDue(bool idle) {
+  int tx0, ty0, tx1, ty1;
+  return ghostWornBounds(idle ? GHOST_SOFT_LIMIT : GHOST_HARD_LIMIT, tx0, ty0, tx1, ty1) > 0;
+}
+
+// Called from loop(): clean worn tiles once nobody has touched the device
+// for a while. A small worn area is flashed to its negative and back with
+// partial updates; anything bigger gets one full refresh.
+void ghostMaintain() {
+  if (!ghostPanelKnown || !hasImage || imageGray) return;
+  if (millis() - lastInteractionMs < GHOST_IDLE_MS) return;
+
+  int tx0, ty0, tx1, ty1;
+  int tiles = ghostWornBounds(GHOST_SOFT_LIMIT, tx0, ty0, tx1, ty1);
+  if (tiles == 0) return;
+
+  // Only clean what the panel is known to show
+  const uint8_t* frame = currentFrame();
+  int x, y, w, h;
+  if (ghostChangedBounds(frame, x, y, w, h)) return;
+
+  selectWaveform();
+  unsigned long start = millis();
+
+  if (tiles <= GHOST_REGION_MAX_TILES && waveformPartialOk) {
+    ghostTileRect(tx0, ty0, tx1, ty1, x, y, w, h);
+    paintFrame(frame, x, y, w, h, true, true);
+    paintFrame(frame, x, y, w, h, true, false);
+    for (int ty = ty0; ty <= ty1; ty++) {
+      for (int tx = tx0; tx <= tx1; tx++) {
+        ghostCount[ty][tx] = 0;
       }
-    } else {
-      Serial.printf("Wrong size: got %d, expected %d\n", len, expectedSize);
     }
-  } else if (httpCode == 404) {
-    Serial.println("No content available on server");
-    totalImages = 0;
+    Serial.printf("Ghosting: cleaned %d tile(s) at %d,%d %dx%d in %lu ms\n", tiles, x, y, w, h, millis() - start);
   } else {
-    Serial.printf("HTTP error: %d\n", httpCode);
+    paintFrame(frame, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, false, false);
+    ghostRecordFull(frame);
+    Serial.printf("Ghosting: full refresh for %d worn tiles in %lu ms\n", tiles, millis() - start);
   }
+}
 
-  http.end();
-  return false;
+// ============================================================
+// 4-GRAY RENDERING (SSD1681)
+// GxEPD2 only drives 1-bit waveforms, so gray frames talk to the
+// controller directly over the display's SPI bus. Each pixel's BW RAM bit
+// (MSB plane) and RED RAM bit (LSB plane) select one of four LUT groups,
+// and the waveform below drives each group to a different gray level.
+// ============================================================
+
+// Grayscale waveform for SSD1680/SSD1681 panels: 5 x 12 VS bytes, 12 x 7
+// phase timing bytes, 9 frame rate / gate bytes, then EOPT, VGH, VSH1,
+// VSH2, VSL and VCOM. If the two middle grays come out swapped on a
+// particular panel, swap the VS L1 and L2 rows.
+static const uint8_t grayWaveform[159] = {
+  0x00, 0x60, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // VS L0 (00 black)
+  0x20, 0x60, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // VS L1 (01 dark gray)
+  0x28, 0x60, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // VS L2 (10 light gray)
+  0x2A, 0x60, 0x15, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // VS L3 (11 white)
+  0x00, 0x90, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // VS L4 (VCOM)
+  0x00, 0x02, 0x00, 0x05, 0x14, 0x00, 0x00,  // group 0
+  0x1E, 0x1E, 0x00, 0x00, 0x00, 0x00, 0x01,  // group 1
+  0x00, 0x02, 0x00, 0x05, 0x14, 0x00, 0x00,  // group 2
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x24, 0x22, 0x22, 0x22, 0x23, 0x32, 0x00, 0x00, 0x00,  // frame rate, XON
+  0x22, 0x17, 0x41, 0xAE, 0x32, 0x28                     // EOPT, VGH, VSH1, VSH2, VSL, VCOM
+};
+
+static void epdCommand(uint8_t command) {
+  hspi.beginTransaction(SPISettings(4000000, MSBFIRST, SPI_MODE0));
+  digitalWrite(EPD_DC, LOW);
+  digitalWrite(EPD_CS, LOW);
+  hspi.transfer(command);
+  digitalWrite(EPD_CS, HIGH);
+  digitalWrite(EPD_DC, HIGH);
+  hspi.endTransaction();
+}
+
+static void epdData(const uint8_t* data, size_t len) {
+  hspi.beginTransaction(SPISettings(4000000, MSBFIRST, SPI_MODE0));
+  digitalWrite(EPD_CS, LOW);
+  for (size_t i = 0; i < len; i++) {
+    hspi.transfer(data[i]);
+  }
+  digitalWrite(EPD_CS, HIGH);
+  hspi.endTransaction();
+}
+
+static void epdData(uint8_t b) {
+  epdData(&b, 1);
+}
+
+// BUSY is high while the controller works
+static bool epdWaitBusy(unsigned long timeoutMs) {
+  unsigned long start = millis();
+  while (digitalRead(EPD_BUSY) == HIGH) {
+    if (millis() - start > timeoutMs) {
+      Serial.println("EPD busy timeout");
+      return false;
+    }
+    delay(1);
+  }
+  return true;
+}
+
+static void epdWritePlane(uint8_t ramCommand, const uint8_t* plane) {
+  epdCommand(0x4E);  // RAM X counter
+  epdData(0x00);
+  epdCommand(0x4F);  // RAM Y counter
+  epdData(0x00);
+  epdData(0x00);
+  epdCommand(ramCommand);
+  epdData(plane, FRAME_BYTES);
+}
+
+void drawImageGray() {
+  // Hardware + software reset: GxEPD2 may have put the panel to sleep
+  digitalWrite(EPD_RST, LOW);
+  delay(10);
+  digitalWrite(EPD_RST, HIGH);
+  delay(10);
+  epdWaitBusy(1000);
+  epdCommand(0x12);
+  epdWaitBusy(1000);
+
+  epdCommand(0x01);  // driver output control: gate lines
+  epdData((DISPLAY_HEIGHT - 1) & 0xFF);
+  epdData((DISPLAY_HEIGHT - 1) >> 8);
+  epdData(0x00);
+  epdCommand(0x11);  // data entry: x then y increment, same as GxEPD2
+  epdData(0x03);
+  epdCommand(0x44);  // RAM X window (bytes)
+  epdData(0x00);
+  epdData(DISPLAY_WIDTH / 8 - 1);
+  epdCommand(0x45);  // RAM Y window
+  epdData(0x00);
+  epdData(0x00);
+  epdData((DISPLAY_HEIGHT - 1) & 0xFF);
+  epdData((DISPLAY_HEIGHT - 1) >> 8);
+  epdCommand(0x3C);  // border waveform
+  epdData(0x04);
+  epdCommand(0x18);  // internal temperature sensor
+  epdData(0x80);
+
+  epdWritePlane(0x24, imageBuffer);  // BW RAM: MSB plane
+  epdWritePlane(0x26, grayPlane);    // RED RAM: LSB plane
+
+  epdCommand(0x32);
+  epdData(grayWaveform, 153);
+  epdCommand(0x3F);
+  epdData(grayWaveform[153]);
+  epdCommand(0x03);
+  epdData(grayWaveform[154]);
+  epdCommand(0x04);
+  epdData(&grayWaveform[155], 3);
+  epdCommand(0x2C);
+  epdData(grayWaveform[158]);
+
+  panelRefreshGate();
+  epdCommand(0x22);  // display update with the LUT loaded above
+  epdData(0xC7);
+  epdCommand(0x20);
+  epdWaitBusy(5000);
+
+  // Leave the MSB plane as the "previous" image for GxEPD2's next partial
+  // update, then let GxEPD2 re-initialise the controller on its next use
+  epdWritePlane(0x26, imageBuffer);
+  display.hibernate();
+  panelHibernating = true;
 }
 
 // ============================================================
-// DRAW IMAGE
+// PANEL TEMPERATURE + WAVEFORM SELECTION
+// The SSD1681 measures temperature with its built-in sensor when asked
+// to load it. Reading the result back needs the data line turned around,
+// so the HSPI pins are released and the read is bit-banged.
 // ============================================================
-void drawImage() {
-  if (!hasImage) return;
 
-  Serial.println("Drawing image...");
+// SFINAE: only drivers with a fast full update mode (GDEY0154D67 and
+// similar in current GxEPD2) have useFastFullUpdate
+template <typename Driver>
+static auto setFastFullUpdate(Driver& epd, bool enable, int) -> decltype(epd.useFastFullUpdate = enable, void()) {
+  epd.useFastFullUpdate = enable;
+}
+
+template <typename Driver>
+static void setFastFullUpdate(Driver&, bool, long) {}
+
+static void epdBitBangWrite(uint8_t b) {
+  for (int i = 7; i >= 0; i--) {
+    digitalWrite(EPD_MOSI, (b >> i) & 1);
+    digitalWrite(EPD_SCK, HIGH);
+    digitalWrite(EPD_SCK, LOW);
+  }
+}
+
+static uint8_t epdBitBangRead() {
+  uint8_t b = 0;
+  for (int i = 0; i < 8; i++) {
+    digitalWrite(EPD_SCK, HIGH);
+    b = (b << 1) | digitalRead(EPD_MOSI);
+    digitalWrite(EPD_SCK, LOW);
+  }
+  return b;
+}
+
+// Panel temperature in degrees C, or NAN if the controller can't answer:
+// in deep sleep it ignores commands (and waking it here would reset the
+// state GxEPD2 keeps), and some boards lack the data line for reads
+float readPanelTemperature() {
+  if (panelHibernating) return NAN;
+
+  // Measure: internal sensor, then "load temperature" update sequence
+  epdCommand(0x18);
+  epdData(0x80);
+  epdCommand(0x22);
+  epdData(0xB1);
+  epdCommand(0x20);
+  if (!epdWaitBusy(500)) return NAN;
+
+  // 0x1B returns the 12-bit two's complement reading, 1/16 C per step
+  hspi.end();
+  pinMode(EPD_SCK, OUTPUT);
+  pinMode(EPD_MOSI, OUTPUT);
+  digitalWrite(EPD_SCK, LOW);
+
+  digitalWrite(EPD_CS, LOW);
+  digitalWrite(EPD_DC, LOW);
+  epdBitBangWrite(0x1B);
+  digitalWrite(EPD_DC, HIGH);
+  pinMode(EPD_MOSI, INPUT);
+  uint8_t hi = epdBitBangRead();
+  uint8_t lo = epdBitBangRead();
+  digitalWrite(EPD_CS, HIGH);
+
+  hspi.begin(EPD_SCK, -1, EPD_MOSI, EPD_CS);
+
+  int16_t raw = (int16_t)(((uint16_t)hi << 8) | lo) >> 4;
+  float celsius = raw / 16.0f;
+
+  // All ones / all zeros means nobody drove the line
+  if ((hi == 0xFF && lo == 0xFF) || (hi == 0 && lo == 0) || celsius < -40 || celsius > 85) {
+    return NAN;
+  }
+  return celsius;
+}
+
+// Read the temperature before an update and pick the fastest waveforms that
+// are safe at it. Falls back to the last good reading (or TEMP_DEFAULT_C),
+// which is what a hibernated controller gets.
+void selectWaveform() {
+  float t = readPanelTemperature();
+  if (!isnan(t)) {
+    panelTempC = t;
+    panelTempMeasured = true;
+  }
+
+  bool fastFull = panelTempC >= TEMP_FAST_FULL_MIN_C;
+  waveformPartialOk = panelTempC >= TEMP_PARTIAL_MIN_C;
+  waveformGrayOk = GRAY_ENABLED && panelTempC >= TEMP_GRAY_MIN_C && panelTempC <= TEMP_GRAY_MAX_C;
+  setFastFullUpdate(display.epd2, fastFull, 0);
+
+  Serial.printf("Panel %.1f C%s: fast full %s, partial %s, gray %s\n", panelTempC,
+                panelTempMeasured ? "" : " (assumed)", fastFull ? "on" : "off",
+                waveformPartialOk ? "on" : "off", waveformGrayOk ? "on" : "off");
+}
+
+// ============================================================
+// DRAW PREVIEW (progressive frames)
+// Upscales the low-resolution pass in imageBuffer and shows it with a
+// partial-window (fast) refresh; drawImage() follows with a full refresh,
+// since the panel no longer matches a known frame.
+// ============================================================
+void drawPreview(int previewWidth, int previewHeight) {
+  int scaleX = DISPLAY_WIDTH / previewWidth;
+  int scaleY = DISPLAY_HEIGHT / previewHeight;
 
   display.setRotation(0);
-  display.setFullWindow();
+  display.setPartialWindow(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT);
 
   display.firstPage();
   do {
     display.fillScreen(GxEPD_WHITE);
 
-    // Draw the bitmap from buffer
-    // The buffer is packed 1-bit (8 pixels per byte, MSB first)
-    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
-      for (int x = 0; x < DISPLAY_WIDTH; x++) {
-        int byteIndex = (y * DISPLAY_WIDTH + x) / 8;
-        int bitIndex = 7 - ((y * DISPLAY_WIDTH + x) % 8);
-        bool isWhite = (imageBuffer[byteIndex] >> bitIndex) & 1;
+    for (int y = 0; y < previewHeight; y++) {
+      for (int x = 0; x < previewWidth; x++) {
+        int bit = y * previewWidth + x;
+        bool isWhite = (imageBuffer[bit / 8] >> (7 - (bit % 8))) & 1;
 
         if (!isWhite) {
-          display.drawPixel(x, y, GxEPD_BLACK);
+          display.fillRect(x * scaleX, y * scaleY, scaleX, scaleY, GxEPD_BLACK);
         }
       }
     }
   } while (display.nextPage());
 
-  Serial.println("Image displayed!");
+  Serial.println("Preview displayed!");
+  ghostRecordPartial(nullptr);
+  markVisibleFeedback();
+}
+
+// Record time from the last button gesture to the first visible update
+void markVisibleFeedback() {
+  if (interactionStartMs == 0) return;
+
+  lastFeedbackMs = millis() - interactionStartMs;
+  interactionStartMs = 0;
+  Serial.printf("Time to first visible feedback: %ld ms\n", lastFeedbackMs);
+}
+
+// Record when the content change being drawn reached the panel. Only on
+// the SNTP clock: the server's own time would hide its share of the delay.
+void markFreshness() {
+  if (freshPendingAt == 0) return;
+
+  if (clockFromNtp) {
+    freshChangedAt = freshPendingAt;
+    freshShownAt = clockNowMs();
+    Serial.printf("Freshness: shown %lld ms after the change\n", freshShownAt - (int64_t)freshChangedAt);
+  }
+  freshPendingAt = 0;
 }
 
 // ============================================================
@@ -642,6 +4814,123 @@ void initDisplay() {
   Serial.printf("  BUSY pin: %s\n", digitalRead(EPD_BUSY) ? "HIGH" : "LOW");
 }
 
+// ============================================================
+// LOCAL FONTS
+// Text on the screens the device draws itself comes from two font
+// blobs in LittleFS (title and body). A FontStore reads a blob through
+// an open file and decodes only the glyphs a screen uses, so a font can
+// cover Latin-1, Polish and the other Latin Extended-A letters without
+// the flash cost of the GFX fonts compiled into the firmware. The
+// strings follow the language the server reports for the device.
+// ============================================================
+class FileFontSource : public FontSource {
+public:
+  bool open(const char* path) {
+    file = LittleFS.open(path, FILE_READ);
+    return (bool)file;
+  }
+
+  size_t read(uint32_t offset, uint8_t* dst, size_t len) override {
+    if (file.position() != offset && !file.seek(offset)) return 0;
+    return file.read(dst, len);
+  }
+
+  File file;
+};
+
+static FileFontSource localFontFiles[FONT_COUNT];
+static const char* const localFontPaths[FONT_COUNT] = { FONT_TITLE_PATH, FONT_TEXT_PATH };
+static const GFXfont* const localGfxFonts[FONT_COUNT] = { &FreeSansBold12pt7b, &FreeSans9pt7b };
+
+struct LocalStrings {
+  const char* deviceId;
+  const char* signal;       // printf, dBm
+  const char* offline;
+  const char* images;       // printf, count
+  const char* showArt;
+  const char* noImages;
+  const char* linkDevice;
+  const char* uptime;       // printf, hours and minutes
+  const char* wifiFailed;
+  const char* holdReset;
+  const char* toResetWifi;
+  const char* wifiSetup;
+  const char* onPhone;
+  const char* openWifi;
+  const char* connectTo;
+  const char* followPrompts;
+};
+
+static const LocalStrings stringsEn = {
+  "Device ID:", "Signal: %d dBm", "WiFi: Offline", "Images: %d", "BTN = show art",
+  "No images yet", "Link device in app", "Up: %02d:%02d",
+  "WiFi Failed", "Hold BOOT + RST", "to reset WiFi",
+  "WiFi Setup", "On your phone:", "1. Open WiFi", "2. Connect to:", "3. Follow prompts"
+};
+
+static const LocalStrings stringsPl = {
+  "ID urządzenia:", "Sygnał: %d dBm", "WiFi: brak sieci", "Zdjęcia: %d", "Przycisk = obraz",
+  "Brak zdjęć", "Połącz w aplikacji", "Działa: %02d:%02d",
+  "Błąd WiFi", "Trzymaj BOOT + RST", "by zresetować WiFi",
+  "Ustaw WiFi", "Na telefonie:", "1. Otwórz WiFi", "2. Połącz z:", "3. Wykonaj kroki"
+};
+
+// Open the font blobs that are present and restore the language
+void initLocalFonts() {
+  preferences.begin("inkframe", true);
+  String lang = preferences.getString("lang", "en");
+  preferences.end();
+  strlcpy(deviceLang, lang.c_str(), sizeof(deviceLang));
+
+  if (!FONTS_ENABLED || !flashFsReady) return;
+  for (int i = 0; i < FONT_COUNT; i++) {
+    if (!localFontFiles[i].open(localFontPaths[i])) continue;
+    uint8_t* work = (uint8_t*)malloc(FontStore::workBytes(FONT_CACHE_GLYPHS));
+    if (work && localFonts[i].begin(localFontFiles[i], work, FONT_CACHE_GLYPHS)) {
+      Serial.printf("Font %s: %d glyphs\n", localFontPaths[i], localFonts[i].glyphCount());
+    } else {
+      Serial.printf("Font %s unusable, using built-in font\n", localFontPaths[i]);
+      free(work);
+      localFontFiles[i].file.close();
+    }
+  }
+}
+
+void saveDeviceLang(const char* lang) {
+  char next[sizeof(deviceLang)];
+  strlcpy(next, lang, sizeof(next));
+  if (strcmp(next, deviceLang) == 0) return;
+
+  strlcpy(deviceLang, next, sizeof(deviceLang));
+  preferences.begin("inkframe", false);
+  preferences.putString("lang", deviceLang);
+  preferences.end();
+  Serial.printf("Language: %s\n", deviceLang);
+}
+
+// Translations need the font store: the GFX fallback has no diacritics
+static const LocalStrings& localStrings() {
+  bool unicode = localFonts[FONT_TITLE].ready() && localFonts[FONT_TEXT].ready();
+  if (unicode && strcmp(deviceLang, "pl") == 0) return stringsPl;
+  return stringsEn;
+}
+
+static void displayInkSink(void* ctx, int x, int y) {
+  (void)ctx;
+  display.drawPixel(x, y, GxEPD_BLACK);
+}
+
+// Draw UTF-8 text with its baseline at y
+static void localText(LocalFont font, int x, int y, const char* text) {
+  if (localFonts[font].ready()) {
+    localFonts[font].drawText(x, y, text, displayInkSink, nullptr);
+    return;
+  }
+  display.setFont(localGfxFonts[font]);
+  display.setCursor(x, y);
+  display.print(text);
+}
+
 // ============================================================
 // TEST SCREEN
 // ============================================================
@@ -690,6 +4979,7 @@ void drawTestScreen() {
     display.drawTriangle(165, 185, 175, 165, 185, 185, GxEPD_BLACK);
     
   } while (display.nextPage());
+  ghostRecordFull(nullptr);
   
   Serial.println("  Test screen complete!");
 }
@@ -724,6 +5014,9 @@ void setupWiFi() {
     // Setup secure client for HTTPS
     setupSecureClient();
 
+    // Wall clock for scheduled refreshes
+    initClockSync();
+
     // Register device with server
     registerDevice();
 
@@ -747,147 +5040,287 @@ void setupWiFi() {
     wifiConnected = false;
     
     // Show error on display
-    display.setFullWindow();
-    display.firstPage();
-    do {
-      display.fillScreen(GxEPD_WHITE);
-      display.setFont(&FreeSansBold12pt7b);
-      display.setCursor(20, 80);
-      display.print("WiFi Failed");
-      display.setFont(&FreeSans9pt7b);
-      display.setCursor(20, 120);
-      display.print("Hold BOOT + RST");
-      display.setCursor(20, 145);
-      display.print("to reset WiFi");
-    } while (display.nextPage());
+    drawWifiFailedScreen();
   }
 }
 
 // ============================================================
-// SETUP SCREEN
+// DASHBOARD
+// The local screens (dashboard, WiFi setup, WiFi failed) are sets of
+// widgets, each with a fixed rectangle and the text bound to it. A redraw
+// binds the current values and, while the same screen is still on the
+// panel, repaints only the widgets whose text changed: one partial window
+// around them, in which the screen's chrome and every widget the window
+// crosses are drawn again. Anything else shown on the panel, or tiles
+// worn past the ghosting limit, make the next redraw a full refresh.
 // ============================================================
-void drawSetupScreen() {
-  Serial.println("  Drawing setup screen...");
-  
+struct DashWidget {
+  char text[2][40];    // bound values, "" = line unused
+};
+
+struct DashScreen {
+  LocalScreenId id;
+  const char* name;
+  const PanelRect* rects;
+  int count;
+  void (*drawChrome)();
+  void (*drawWidget)(int id, const DashWidget& widget);
+};
+
+// Copy a bound value, "" for none
+static void dashSet(DashWidget& widget, int line, const char* text) {
+  strlcpy(widget.text[line], text, sizeof(widget.text[line]));
+}
+
+// Show a screen with these bound values, refreshing as little of the
+// panel as it can
+static void dashShow(const DashScreen& screen, const DashWidget* widgets) {
+  // Window around the widgets whose values changed, byte aligned as the
+  // panel's partial window is
+  uint32_t hashes[SCREEN_MAX_WIDGETS];
+  int x0 = DISPLAY_WIDTH, y0 = DISPLAY_HEIGHT, x1 = 0, y1 = 0;
+  int changed = 0;
+  for (int i = 0; i < screen.count; i++) {
+    hashes[i] = fnv1a(2166136261UL, (const uint8_t*)widgets[i].text, sizeof(widgets[i].text));
+    if (hashes[i] == screenShownHash[i]) continue;
+    const PanelRect& r = screen.rects[i];
+    x0 = min(x0, (int)r.x);
+    y0 = min(y0, (int)r.y);
+    x1 = max(x1, r.x + r.w);
+    y1 = max(y1, r.y + r.h);
+    changed++;
+  }
+  x0 &= ~7;
+  x1 = min((x1 + 7) & ~7, DISPLAY_WIDTH);
+
+  selectWaveform();
+  bool partial = screenOnPanel == screen.id && GHOST_PARTIAL_ENABLED && PanelDriver::hasFastPartialUpdate &&
+                 waveformPartialOk && !ghostCleaningDue(false) && !forceFullRefresh;
+  if (partial && changed == 0) {
+    Serial.printf("%s unchanged, no refresh needed\n", screen.name);
+    markVisibleFeedback();
+    return;
+  }
+
   display.setRotation(0);
   display.setTextColor(GxEPD_BLACK);
-  display.setFullWindow();
-  
+  if (partial) {
+    display.setPartialWindow(x0, y0, x1 - x0, y1 - y0);
+  } else {
+    display.setFullWindow();
+    x0 = 0;
+    y0 = 0;
+    x1 = DISPLAY_WIDTH;
+    y1 = DISPLAY_HEIGHT;
+  }
+
+  int drawn = 0;
   display.firstPage();
   do {
     display.fillScreen(GxEPD_WHITE);
-    
-    // Border
-    display.drawRect(5, 5, 190, 190, GxEPD_BLACK);
-    
-    // Title
-    display.setFont(&FreeSansBold12pt7b);
-    display.setCursor(25, 40);
-    display.print("WiFi Setup");
-    
-    display.fillRect(20, 50, 160, 2, GxEPD_BLACK);
-    
-    // Instructions
-    display.setFont(&FreeSans9pt7b);
-    display.setCursor(15, 80);
-    display.print("On your phone:");
-    
-    display.setCursor(15, 105);
-    display.print("1. Open WiFi");
-    
-    display.setCursor(15, 125);
-    display.print("2. Connect to:");
-    
-    display.setFont(&FreeMonoBold9pt7b);
-    display.setCursor(15, 148);
-    display.print("InkFrame-xxx");
-    
-    display.setFont(&FreeSans9pt7b);
-    display.setCursor(15, 175);
-    display.print("3. Follow prompts");
-    
+    if (screen.drawChrome) screen.drawChrome();
+    drawn = 0;
+    for (int i = 0; i < screen.count; i++) {
+      const PanelRect& r = screen.rects[i];
+      if (r.x >= x1 || r.x + r.w <= x0 || r.y >= y1 || r.y + r.h <= y0) continue;
+      screen.drawWidget(i, widgets[i]);
+      drawn++;
+    }
   } while (display.nextPage());
+
+  if (partial) {
+    ghostRecordRect(x0, y0, x1 - x0, y1 - y0);
+    Serial.printf("%s partial refresh %dx%d at %d,%d (%d changed, %d drawn)\n",
+                  screen.name, x1 - x0, y1 - y0, x0, y0, changed, drawn);
+  } else {
+    ghostRecordFull(nullptr);
+    forceFullRefresh = false;
+  }
+  memcpy(screenShownHash, hashes, sizeof(uint32_t) * screen.count);
+  screenOnPanel = screen.id;
+
+  Serial.printf("%s complete!\n", screen.name);
+  markVisibleFeedback();
 }
 
-// ============================================================
-// DASHBOARD
-// ============================================================
+static const PanelRect dashRects[DASH_WIDGETS] = {
+  { 4, 4, 192, 34 },    // title, above the first separator
+  { 4, 40, 192, 46 },   // device ID
+  { 4, 88, 192, 46 },   // WiFi
+  { 4, 136, 192, 46 },  // images
+  { 4, 184, 192, 16 },  // uptime, down to the panel edge
+};
+
+static void dashBind(DashWidget* widgets, const char* deviceId) {
+  const LocalStrings& str = localStrings();
+  memset(widgets, 0, sizeof(DashWidget) * DASH_WIDGETS);
+
+  dashSet(widgets[DASH_TITLE], 0, "INKFRAME");
+  dashSet(widgets[DASH_DEVICE], 0, str.deviceId);
+  dashSet(widgets[DASH_DEVICE], 1, deviceId);
+
+  DashWidget& network = widgets[DASH_NETWORK];
+  if (wifiConnected) {
+    dashSet(network, 0, WiFi.localIP().toString().c_str());
+    snprintf(network.text[1], sizeof(network.text[1]), str.signal, WiFi.RSSI());
+  } else {
+    dashSet(network, 0, str.offline);
+  }
+
+  DashWidget& images = widgets[DASH_IMAGES];
+  if (totalImages > 0) {
+    snprintf(images.text[0], sizeof(images.text[0]), str.images, totalImages);
+    dashSet(images, 1, str.showArt);
+  } else {
+    dashSet(images, 0, str.noImages);
+    dashSet(images, 1, str.linkDevice);
+  }
+
+  unsigned long secs = millis() / 1000;
+  snprintf(widgets[DASH_UPTIME].text[0], sizeof(widgets[DASH_UPTIME].text[0]), str.uptime,
+           (int)(secs / 3600), (int)((secs % 3600) / 60));
+}
+
+// Border and separators; every window crosses the border
+static void dashDrawChrome() {
+  display.drawRect(2, 2, 196, 196, GxEPD_BLACK);
+  display.fillRect(20, 38, 160, 2, GxEPD_BLACK);
+  display.fillRect(20, 86, 160, 2, GxEPD_BLACK);
+  display.fillRect(20, 134, 160, 2, GxEPD_BLACK);
+  display.fillRect(20, 182, 160, 2, GxEPD_BLACK);
+}
+
+static void dashDrawWidget(int id, const DashWidget& widget) {
+  switch (id) {
+    case DASH_TITLE:
+      localText(FONT_TITLE, 35, 28, widget.text[0]);
+      break;
+    case DASH_DEVICE:
+      // Device ID - IMPORTANT for linking
+      localText(FONT_TEXT, 15, 58, widget.text[0]);
+      display.setFont(&FreeMonoBold9pt7b);
+      display.setCursor(15, 76);
+      display.print(widget.text[1]);
+      break;
+    case DASH_NETWORK:
+      if (widget.text[1][0]) {
+        localText(FONT_TEXT, 15, 106, widget.text[0]);
+        localText(FONT_TEXT, 15, 124, widget.text[1]);
+      } else {
+        localText(FONT_TEXT, 15, 115, widget.text[0]);
+      }
+      break;
+    case DASH_IMAGES:
+      localText(FONT_TEXT, 15, 154, widget.text[0]);
+      localText(FONT_TEXT, 15, 172, widget.text[1]);
+      break;
+    case DASH_UPTIME:
+      localText(FONT_TEXT, 15, 198, widget.text[0]);
+      break;
+  }
+}
+
+static const DashScreen dashScreen = {
+  SCREEN_DASHBOARD, "Dashboard", dashRects, DASH_WIDGETS, dashDrawChrome, dashDrawWidget
+};
+
 void drawDashboard() {
   Serial.println("Drawing dashboard...");
 
   String deviceId = String((uint32_t)ESP.getEfuseMac(), HEX);
   Serial.printf("Device ID: %s\n", deviceId.c_str());
 
-  display.setRotation(0);
-  display.setTextColor(GxEPD_BLACK);
-  display.setFullWindow();
-
-  // Calculate uptime
-  unsigned long secs = millis() / 1000;
-  int hrs = secs / 3600;
-  int mins = (secs % 3600) / 60;
+  DashWidget widgets[DASH_WIDGETS];
+  dashBind(widgets, deviceId.c_str());
+  dashShow(dashScreen, widgets);
+}
 
-  display.firstPage();
-  do {
-    display.fillScreen(GxEPD_WHITE);
+// ============================================================
+// SETUP SCREENS
+// WiFi setup and WiFi failed, shown while the device has no network:
+// local screens like the dashboard, so showing one again (or in another
+// language) refreshes only what differs.
+// ============================================================
+static const PanelRect setupRects[SETUP_WIDGETS] = {
+  { 8, 8, 184, 40 },     // title, above the separator
+  { 8, 54, 184, 56 },    // first instructions
+  { 8, 110, 184, 44 },   // access point to connect to
+  { 8, 154, 184, 36 },   // last instruction, inside the border
+};
 
-    // Border
-    display.drawRect(2, 2, 196, 196, GxEPD_BLACK);
+static void setupDrawChrome() {
+  display.drawRect(5, 5, 190, 190, GxEPD_BLACK);
+  display.fillRect(20, 50, 160, 2, GxEPD_BLACK);
+}
 
-    // Title
-    display.setFont(&FreeSansBold12pt7b);
-    display.setCursor(35, 28);
-    display.print("INKFRAME");
+static void setupDrawWidget(int id, const DashWidget& widget) {
+  switch (id) {
+    case SETUP_TITLE:
+      localText(FONT_TITLE, 25, 40, widget.text[0]);
+      break;
+    case SETUP_STEPS:
+      localText(FONT_TEXT, 15, 80, widget.text[0]);
+      localText(FONT_TEXT, 15, 105, widget.text[1]);
+      break;
+    case SETUP_CONNECT:
+      localText(FONT_TEXT, 15, 125, widget.text[0]);
+      display.setFont(&FreeMonoBold9pt7b);
+      display.setCursor(15, 148);
+      display.print(widget.text[1]);
+      break;
+    case SETUP_FOLLOW:
+      localText(FONT_TEXT, 15, 175, widget.text[0]);
+      break;
+  }
+}
 
-    // Separator
-    display.fillRect(20, 38, 160, 2, GxEPD_BLACK);
+static const DashScreen setupScreen = {
+  SCREEN_SETUP, "Setup screen", setupRects, SETUP_WIDGETS, setupDrawChrome, setupDrawWidget
+};
 
-    // Device ID - IMPORTANT for linking
-    display.setFont(&FreeSans9pt7b);
-    display.setCursor(15, 58);
-    display.print("Device ID:");
-    display.setFont(&FreeMonoBold9pt7b);
-    display.setCursor(15, 76);
-    display.print(deviceId);
+void drawSetupScreen() {
+  Serial.println("  Drawing setup screen...");
+  const LocalStrings& str = localStrings();
 
-    // Separator
-    display.fillRect(20, 86, 160, 2, GxEPD_BLACK);
+  DashWidget widgets[SETUP_WIDGETS];
+  memset(widgets, 0, sizeof(widgets));
+  dashSet(widgets[SETUP_TITLE], 0, str.wifiSetup);
+  dashSet(widgets[SETUP_STEPS], 0, str.onPhone);
+  dashSet(widgets[SETUP_STEPS], 1, str.openWifi);
+  dashSet(widgets[SETUP_CONNECT], 0, str.connectTo);
+  dashSet(widgets[SETUP_CONNECT], 1, "InkFrame-xxx");
+  dashSet(widgets[SETUP_FOLLOW], 0, str.followPrompts);
+  dashShow(setupScreen, widgets);
+}
 
-    // WiFi info
-    display.setFont(&FreeSans9pt7b);
-    if (wifiConnected) {
-      display.setCursor(15, 106);
-      display.print(WiFi.localIP().toString());
-      display.setCursor(15, 124);
-      display.printf("Signal: %d dBm", WiFi.RSSI());
-    } else {
-      display.setCursor(15, 115);
-      display.print("WiFi: Offline");
-    }
+static const PanelRect failedRects[FAILED_WIDGETS] = {
+  { 0, 56, 200, 40 },    // title
+  { 0, 100, 200, 56 },   // how to reset
+};
 
-    // Separator
-    display.fillRect(20, 134, 160, 2, GxEPD_BLACK);
-
-    // Images info
-    display.setCursor(15, 154);
-    if (totalImages > 0) {
-      display.printf("Images: %d", totalImages);
-      display.setCursor(15, 172);
-      display.print("BTN = show art");
-    } else {
-      display.print("No images yet");
-      display.setCursor(15, 172);
-      display.print("Link device in app");
-    }
+static void failedDrawWidget(int id, const DashWidget& widget) {
+  switch (id) {
+    case FAILED_TITLE:
+      localText(FONT_TITLE, 20, 80, widget.text[0]);
+      break;
+    case FAILED_HINT:
+      localText(FONT_TEXT, 20, 120, widget.text[0]);
+      localText(FONT_TEXT, 20, 145, widget.text[1]);
+      break;
+  }
+}
 
-    // Footer
-    display.fillRect(20, 182, 160, 2, GxEPD_BLACK);
-    display.setCursor(15, 198);
-    char uptimeStr[20];
-    sprintf(uptimeStr, "Up: %02d:%02d", hrs, mins);
-    display.print(uptimeStr);
+static const DashScreen failedScreen = {
+  SCREEN_WIFI_FAILED, "WiFi failed screen", failedRects, FAILED_WIDGETS, nullptr, failedDrawWidget
+};
 
-  } while (display.nextPage());
+void drawWifiFailedScreen() {
+  const LocalStrings& str = localStrings();
 
-  Serial.println("Dashboard complete!");
+  DashWidget widgets[FAILED_WIDGETS];
+  memset(widgets, 0, sizeof(widgets));
+  dashSet(widgets[FAILED_TITLE], 0, str.wifiFailed);
+  dashSet(widgets[FAILED_HINT], 0, str.holdReset);
+  dashSet(widgets[FAILED_HINT], 1, str.toResetWifi);
+  dashShow(failedScreen, widgets);
 }